@@ -0,0 +1,474 @@
+#ifndef CS207_ADJACENCY_HPP
+#define CS207_ADJACENCY_HPP
+
+/** @file Adjacency.hpp
+ * @brief Adjacency storage policies for Graph: tree map, sorted small vector, flat hash and lazy CSR
+ */
+
+#include "Hash.hpp"
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cassert>
+using namespace std;
+
+/** Every policy stores, for each node uid a, the (neighbor uid, edge uid) pairs of its
+ * edges. Graph inserts and erases both directions of an undirected edge. A policy provides
+ *
+ *   typedef ... const_iterator;		// it->first is the neighbor, it->second the edge
+ *   void add_node();			// appends an empty list for the next uid
+ *   unsigned find(a, b) const;		// edge uid of (a, b), or npos
+ *   void insert(a, b, e);		// @pre find(a, b) == npos
+ *   void erase(a, b);			// @pre find(a, b) != npos
+ *   unsigned degree(a) const;
+ *   const_iterator begin(a) const, end(a) const;
+ *   void clear(a);			// empties a's list, without touching the neighbors' lists
+ *   void clear();			// removes every node
+ *
+ * Incident iterators are invalidated by any insert() or erase().
+ */
+namespace adjacency{
+	typedef unsigned size_type;
+	typedef pair<size_type,size_type> entry_type;	//(neighbor uid, edge uid)
+	static const size_type npos = numeric_limits<size_type>::max();
+
+	/** Orders entries by neighbor uid */
+	inline bool entry_less(const entry_type& e, size_type b){
+		return e.first < b;
+	}
+}
+
+/** @class 	Map_adjacency
+ * @brief 	One red-black tree per node: O(log D) lookups with a heap node per entry
+ *
+ * The original Graph layout, kept for graphs with hub nodes of very high degree
+ * that are edited constantly.
+ */
+class Map_adjacency{
+	public:
+		typedef adjacency::size_type size_type;
+		typedef map<size_type,size_type>::const_iterator const_iterator;
+
+		void add_node(){
+			adj_.push_back(map<size_type,size_type>());
+		}
+
+		size_type find(size_type a, size_type b) const{
+			const_iterator it = adj_[a].find(b);
+			return it == adj_[a].end() ? adjacency::npos : it->second;
+		}
+
+		void insert(size_type a, size_type b, size_type e){
+			adj_[a][b] = e;
+		}
+
+		void erase(size_type a, size_type b){
+			adj_[a].erase(b);
+		}
+
+		size_type degree(size_type a) const{
+			return adj_[a].size();
+		}
+
+		const_iterator begin(size_type a) const{
+			return adj_[a].begin();
+		}
+
+		const_iterator end(size_type a) const{
+			return adj_[a].end();
+		}
+
+		void clear(size_type a){
+			adj_[a].clear();
+		}
+
+		void clear(){
+			adj_.clear();
+		}
+
+	private:
+		vector< map<size_type,size_type> > adj_;
+};
+
+/** @class 	Sorted_adjacency
+ * @brief 	One sorted array per node, the first @a K entries stored inline
+ *
+ * Lookups are a binary search and traversal is a scan of contiguous memory; a node of
+ * degree at most K (most nodes of a join graph or a dependency tree) needs no heap
+ * block at all. Insert and erase move the entries after the position, O(D).
+ */
+template <unsigned K = 4>
+class Sorted_adjacency{
+	public:
+		typedef adjacency::size_type size_type;
+		typedef adjacency::entry_type entry_type;
+		typedef const entry_type* const_iterator;
+
+		void add_node(){
+			adj_.push_back(small_list());
+		}
+
+		size_type find(size_type a, size_type b) const{
+			const small_list& l = adj_[a];
+			const entry_type* p = lower_bound(l.begin(),l.end(),b,adjacency::entry_less);
+			return (p != l.end() && p->first == b) ? p->second : adjacency::npos;
+		}
+
+		void insert(size_type a, size_type b, size_type e){
+			small_list& l = adj_[a];
+			size_type p = lower_bound(l.begin(),l.end(),b,adjacency::entry_less) - l.begin();
+			l.insert(p,entry_type(b,e));
+		}
+
+		void erase(size_type a, size_type b){
+			small_list& l = adj_[a];
+			const entry_type* p = lower_bound(l.begin(),l.end(),b,adjacency::entry_less);
+			assert(p != l.end() && p->first == b);
+			l.erase(p - l.begin());
+		}
+
+		size_type degree(size_type a) const{
+			return adj_[a].size_;
+		}
+
+		const_iterator begin(size_type a) const{
+			return adj_[a].begin();
+		}
+
+		const_iterator end(size_type a) const{
+			return adj_[a].end();
+		}
+
+		void clear(size_type a){
+			adj_[a] = small_list();
+		}
+
+		void clear(){
+			adj_.clear();
+		}
+
+	private:
+		/** Entries inline while size_ <= K, else all of them in heap_ */
+		struct small_list{
+			size_type size_;
+			entry_type inline_[K];
+			vector<entry_type> heap_;
+
+			small_list():size_(0),heap_(){
+			}
+
+			entry_type* begin(){
+				return size_ <= K ? inline_ : &heap_[0];
+			}
+
+			const entry_type* begin() const{
+				return size_ <= K ? inline_ : &heap_[0];
+			}
+
+			entry_type* end(){
+				return begin() + size_;
+			}
+
+			const entry_type* end() const{
+				return begin() + size_;
+			}
+
+			void insert(size_type p, const entry_type& x){
+				if (size_ < K){
+					for (size_type k = size_; k > p; --k)
+						inline_[k] = inline_[k-1];
+					inline_[p] = x;
+				}else{
+					if (size_ == K)
+						heap_.assign(inline_,inline_+K);
+					heap_.insert(heap_.begin()+p,x);
+				}
+				++size_;
+			}
+
+			void erase(size_type p){
+				entry_type* e = begin();
+				for (size_type k = p; k+1 < size_; ++k)
+					e[k] = e[k+1];
+				--size_;
+				if (size_ == K){
+					copy(heap_.begin(),heap_.begin()+K,inline_);
+					vector<entry_type>().swap(heap_);
+				}else if (size_ > K){
+					heap_.pop_back();
+				}
+			}
+		};
+
+		vector<small_list> adj_;
+};
+
+/** @class 	Hash_adjacency
+ * @brief 	One open-addressing table of all (a, b) pairs, plus an unordered array per node
+ *
+ * find() is a linear probe in a flat table keyed by the packed pair, so an edge test
+ * costs one hash and usually one cache line whatever the degrees. Each slot also holds
+ * the entry's position in a's array, so erase() is O(1): the last entry of the array
+ * moves into the hole and its slot is updated. Incident edges come in no particular order.
+ */
+class Hash_adjacency{
+	public:
+		typedef adjacency::size_type size_type;
+		typedef adjacency::entry_type entry_type;
+		typedef vector<entry_type>::const_iterator const_iterator;
+
+		Hash_adjacency():adj_(),slots_(16),mask_(15),used_(0){
+		}
+
+		void add_node(){
+			adj_.push_back(vector<entry_type>());
+		}
+
+		size_type find(size_type a, size_type b) const{
+			const slot* s = lookup(key(a,b));
+			return s ? adj_[a][s->pos_].second : adjacency::npos;
+		}
+
+		void insert(size_type a, size_type b, size_type e){
+			if (2*(used_+1) > slots_.size())
+				rehash(2*slots_.size());
+			uint64_t k = key(a,b);
+			size_t i = hash_mix(k) & mask_;
+			while (slots_[i].key_ != empty_key)
+				i = (i+1) & mask_;
+			slots_[i].key_ = k;
+			slots_[i].pos_ = adj_[a].size();
+			adj_[a].push_back(entry_type(b,e));
+			++used_;
+		}
+
+		void erase(size_type a, size_type b){
+			slot* s = const_cast<slot*>(lookup(key(a,b)));
+			assert(s);
+			vector<entry_type>& l = adj_[a];
+			size_type p = s->pos_;
+			if (p+1 != l.size()){
+				l[p] = l.back();
+				const_cast<slot*>(lookup(key(a,l[p].first)))->pos_ = p;
+			}
+			l.pop_back();
+			remove(s - &slots_[0]);
+		}
+
+		size_type degree(size_type a) const{
+			return adj_[a].size();
+		}
+
+		const_iterator begin(size_type a) const{
+			return adj_[a].begin();
+		}
+
+		const_iterator end(size_type a) const{
+			return adj_[a].end();
+		}
+
+		void clear(size_type a){
+			for (size_type k = 0; k < adj_[a].size(); ++k)
+				remove(const_cast<slot*>(lookup(key(a,adj_[a][k].first))) - &slots_[0]);
+			vector<entry_type>().swap(adj_[a]);
+		}
+
+		void clear(){
+			adj_.clear();
+			slots_.assign(16,slot());
+			mask_ = 15;
+			used_ = 0;
+		}
+
+	private:
+		static const uint64_t empty_key = ~(uint64_t) 0;
+
+		struct slot{
+			uint64_t key_;
+			size_type pos_;		//position of the entry in adj_[a]
+			slot():key_(empty_key),pos_(0){
+			}
+		};
+
+		static uint64_t key(size_type a, size_type b){
+			return ((uint64_t) a << 32) | b;
+		}
+
+		const slot* lookup(uint64_t k) const{
+			size_t i = hash_mix(k) & mask_;
+			while (slots_[i].key_ != empty_key){
+				if (slots_[i].key_ == k)
+					return &slots_[i];
+				i = (i+1) & mask_;
+			}
+			return 0;
+		}
+
+		/** Empties slot @a i by backward-shift deletion, so no tombstones build up */
+		void remove(size_t i){
+			size_t j = i;
+			for (;;){
+				j = (j+1) & mask_;
+				if (slots_[j].key_ == empty_key)
+					break;
+				size_t h = hash_mix(slots_[j].key_) & mask_;
+				// slot j may fill the hole at i only if its home h is not in (i, j]
+				if (((j-h) & mask_) >= ((j-i) & mask_)){
+					slots_[i] = slots_[j];
+					i = j;
+				}
+			}
+			slots_[i] = slot();
+			--used_;
+		}
+
+		void rehash(size_t n){
+			vector<slot> old(n);
+			old.swap(slots_);
+			mask_ = n-1;
+			for (size_t k = 0; k < old.size(); ++k){
+				if (old[k].key_ == empty_key)
+					continue;
+				size_t i = hash_mix(old[k].key_) & mask_;
+				while (slots_[i].key_ != empty_key)
+					i = (i+1) & mask_;
+				slots_[i] = old[k];
+			}
+		}
+
+		vector< vector<entry_type> > adj_;
+		vector<slot> slots_;
+		size_t mask_;
+		size_t used_;
+};
+
+/** @class 	Csr_adjacency
+ * @brief 	Compressed sparse rows for graphs that are built once and then traversed
+ *
+ * Insertions go to a Sorted_adjacency. The first begin() or end() after one packs
+ * every list into one offsets array and one entries array and frees the per-node
+ * lists; the next insertion unpacks them again. Both directions are O(N + E), so
+ * a graph that is built, then only searched, pays for one pack, and every traversal
+ * after it reads a single contiguous array. Erasure never changes the state: a packed
+ * row shrinks in place in O(D) and keeps its slack until the next pack, so removing
+ * nodes and edges of a packed graph costs what it does with Sorted_adjacency.
+ * find() and degree() work in either state.
+ */
+class Csr_adjacency{
+	public:
+		typedef adjacency::size_type size_type;
+		typedef adjacency::entry_type entry_type;
+		typedef const entry_type* const_iterator;
+
+		Csr_adjacency():lists_(),nodes_(0),packed_(false),ptr_(1,0),end_(),entries_(){
+		}
+
+		void add_node(){
+			unpack();
+			lists_.add_node();
+			++nodes_;
+		}
+
+		size_type find(size_type a, size_type b) const{
+			if (!packed_)
+				return lists_.find(a,b);
+			const entry_type* e = end(a);
+			const entry_type* p = lower_bound(begin(a),e,b,adjacency::entry_less);
+			return (p != e && p->first == b) ? p->second : adjacency::npos;
+		}
+
+		void insert(size_type a, size_type b, size_type e){
+			unpack();
+			lists_.insert(a,b,e);
+		}
+
+		void erase(size_type a, size_type b){
+			if (!packed_){
+				lists_.erase(a,b);
+				return;
+			}
+			entry_type* e = &entries_[0] + end_[a];
+			entry_type* p = lower_bound(&entries_[0] + ptr_[a],e,b,adjacency::entry_less);
+			assert(p != e && p->first == b);
+			copy(p+1,e,p);
+			--end_[a];
+		}
+
+		size_type degree(size_type a) const{
+			return packed_ ? end_[a]-ptr_[a] : lists_.degree(a);
+		}
+
+		const_iterator begin(size_type a) const{
+			pack();
+			return entries_.empty() ? 0 : &entries_[0] + ptr_[a];
+		}
+
+		const_iterator end(size_type a) const{
+			pack();
+			return entries_.empty() ? 0 : &entries_[0] + end_[a];
+		}
+
+		void clear(size_type a){
+			if (packed_)
+				end_[a] = ptr_[a];
+			else
+				lists_.clear(a);
+		}
+
+		void clear(){
+			lists_.clear();
+			nodes_ = 0;
+			packed_ = false;
+			ptr_.assign(1,0);
+			end_.clear();
+			entries_.clear();
+		}
+
+		/** Packs now, e.g. before handing the graph to several reader threads */
+		void freeze() const{
+			pack();
+		}
+
+	private:
+		void pack() const{
+			if (packed_)
+				return;
+			ptr_.assign((size_t)nodes_+1,0);
+			for (size_type a = 0; a < nodes_; ++a)
+				ptr_[a+1] = ptr_[a] + lists_.degree(a);
+			entries_.resize(ptr_[nodes_]);
+			end_.resize(nodes_);
+			for (size_type a = 0; a < nodes_; ++a){
+				copy(lists_.begin(a),lists_.end(a),entries_.begin()+ptr_[a]);
+				end_[a] = ptr_[a+1];
+			}
+			lists_.clear();
+			packed_ = true;
+		}
+
+		void unpack(){
+			if (!packed_)
+				return;
+			for (size_type a = 0; a < nodes_; ++a){
+				lists_.add_node();
+				for (size_type k = ptr_[a]; k < end_[a]; ++k)
+					lists_.insert(a,entries_[k].first,entries_[k].second);
+			}
+			ptr_.assign(1,0);
+			end_.clear();
+			vector<entry_type>().swap(entries_);
+			packed_ = false;
+		}
+
+		mutable Sorted_adjacency<> lists_;
+		size_type nodes_;
+		mutable bool packed_;
+		mutable vector<size_type> ptr_;		//start of each row
+		mutable vector<size_type> end_;		//end of each row, before ptr_ of the next after erasures
+		mutable vector<entry_type> entries_;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef CS207_BANDIT_HPP
+#define CS207_BANDIT_HPP
+
+/** @file Bandit.hpp
+ * @brief Online model selection over a Manager's models as a contextual bandit
+ */
+
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** @class 	Bandit
+ * @brief 	Routes prediction requests to the models of a Manager and learns online which one is best
+ * @tparam  MT	The Manager type whose models are the arms
+ * @tparam  C	The number of contexts. Each context keeps its own arm statistics,
+ *		so e.g. queries bucketed by number of joins can each settle on a different model.
+ *
+ * Every prediction picks an arm (a Manager slot id) with UCB1 or Thompson sampling.
+ * When the executor knows the true cardinality, feedback() turns the q-error
+ * max(estimate/actual, actual/estimate) of that prediction into a loss of log(q-error)
+ * and updates the arm in O(1). Lower mean loss is better.
+ *
+ * With decay < 1 the statistics are discounted (discounted UCB): every feedback in a
+ * context multiplies the statistics of all its arms by decay, not only those of the arm
+ * that was pulled. An arm left idle therefore loses weight, its exploration bonus (or
+ * Thompson posterior width) grows back, and it is tried again, so an arm that got
+ * better after a workload shift is found. Each arm keeps the step of its last update
+ * and the discount decay^(steps since) is applied when it is read or next updated,
+ * so a feedback still costs O(1).
+ *
+ * choose() and feedback() are thread-safe. choose() reads the statistics without locking;
+ * feedback() holds a per-arm spinlock for the few instructions of the update.
+ */
+template <typename MT, unsigned C = 1>
+class Bandit{
+ public:
+
+	typedef typename MT::size_type size_type;
+	typedef Bandit bandit_type;
+
+	enum policy_type {UCB, THOMPSON};
+
+	/** Constructs a bandit over the models currently held by @a mt
+	 * @param[in] exploration	scales the UCB bonus / Thompson posterior width
+	 * @param[in] decay		in (0,1]; each feedback in a context multiplies the statistics
+	 *				of every arm of that context by @a decay, so older feedback
+	 *				is gradually forgotten
+	 */
+	Bandit(MT& mt, policy_type policy = UCB, double exploration = 1.0, double decay = 1.0)
+	  :mt_(&mt),policy_(policy),exploration_(exploration),decay_(decay){
+		assert(decay > 0.0 && decay <= 1.0);
+		reset();
+	}
+
+	~Bandit() = default;
+
+	Bandit& operator=(const Bandit&) = delete;
+
+	/** Forgets all feedback */
+	void reset(){
+		for (size_type c = 0; c < C; ++c){
+			step_[c].store(0,memory_order_relaxed);
+			for (size_type a = 0; a < 4; ++a){
+				arm_stats& s = stats_[c][a];
+				s.count_.store(0.0,memory_order_relaxed);
+				s.sum_.store(0.0,memory_order_relaxed);
+				s.sum_sq_.store(0.0,memory_order_relaxed);
+				s.step_.store(0,memory_order_relaxed);
+				s.lock_.clear();
+			}
+		}
+	}
+
+	/** Returns the arm (Manager slot id) to use for a prediction in context @a ctx
+	 * @pre	@a ctx < C and the Manager holds at least one model
+	 * Complexity: O(1), at most 4 arms are scored
+	 */
+	size_type choose(size_type ctx = 0){
+		assert(ctx < C);
+		size_type best = 0;
+		double best_score = 0.0;
+		unsigned long long now = step_[ctx].load(memory_order_relaxed);
+
+		// discounted count, sum and sum of squares of every arm with a model
+		double n[4], sum[4], sum_sq[4], total = 0.0;
+		for (size_type a = 1; a < 5; ++a){
+			if (!mt_->has_model(a))
+				continue;
+			const arm_stats& s = stats_[ctx][a-1];
+			double w = discount(now,s.step_.load(memory_order_relaxed));
+			n[a-1] = w*s.count_.load(memory_order_relaxed);
+			sum[a-1] = w*s.sum_.load(memory_order_relaxed);
+			sum_sq[a-1] = w*s.sum_sq_.load(memory_order_relaxed);
+			if (!(n[a-1] > 1e-12))
+				return a; //an arm never tried, or idle until its weight vanished, goes first
+			total += n[a-1];
+		}
+		double log_total = log(total + 1.0);
+
+		for (size_type a = 1; a < 5; ++a){
+			if (!mt_->has_model(a))
+				continue;
+			double na = n[a-1];
+			double mean = sum[a-1]/na;
+			double score;
+			if (policy_ == UCB){
+				score = mean - exploration_*sqrt(2.0*log_total/na);
+			}else{
+				// sample variance shrunk toward 1 by one pseudo-observation, so an arm
+				// whose losses were all equal still gets drawn away from its mean
+				double var = (sum_sq[a-1] - sum[a-1]*mean + 1.0)/(na + 1.0);
+				if (var < 0.0)
+					var = 0.0;
+				score = mean + exploration_*sqrt(var/na)*standard_normal();
+			}
+			if (best == 0 || score < best_score){
+				best = a;
+				best_score = score;
+			}
+		}
+		assert(best != 0);
+		return best;
+	}
+
+	/** Predicts @a n rows with the arm chosen for context @a ctx
+	 * @param[in]  x		row-major @a n x @a d features
+	 * @param[out] y_hat	@a n predictions
+	 * @return 		the arm used, to be passed back to feedback()
+	 */
+	size_type predict(const double* x, size_type n, size_type d, double* y_hat, size_type ctx = 0){
+		size_type arm = choose(ctx);
+		mt_->predict_model(arm,x,n,d,y_hat);
+		return arm;
+	}
+
+	/** Reports the realized cardinality @a actual for a prediction @a estimate made by @a arm
+	 * Estimates and cardinalities below 1 are treated as 1, as usual for q-error.
+	 * Complexity: O(1)
+	 */
+	void feedback(size_type arm, double estimate, double actual, size_type ctx = 0){
+		assert(arm < 5 && arm > 0 && ctx < C);
+		if (estimate < 1.0)
+			estimate = 1.0;
+		if (actual < 1.0)
+			actual = 1.0;
+		double loss = fabs(log(estimate/actual));
+
+		unsigned long long now = step_[ctx].fetch_add(1,memory_order_relaxed) + 1;
+		arm_stats& s = stats_[ctx][arm-1];
+		while (s.lock_.test_and_set(memory_order_acquire))
+			;
+		// bring the arm to step now; a feedback that lost the race to a later one is discounted instead
+		unsigned long long last = s.step_.load(memory_order_relaxed);
+		double w = 1.0;
+		if (now > last){
+			double f = discount(now,last);
+			s.count_.store(f*s.count_.load(memory_order_relaxed), memory_order_relaxed);
+			s.sum_.store(f*s.sum_.load(memory_order_relaxed), memory_order_relaxed);
+			s.sum_sq_.store(f*s.sum_sq_.load(memory_order_relaxed), memory_order_relaxed);
+			s.step_.store(now,memory_order_relaxed);
+		}else{
+			w = discount(last,now);
+		}
+		s.count_.store(s.count_.load(memory_order_relaxed) + w, memory_order_relaxed);
+		s.sum_.store(s.sum_.load(memory_order_relaxed) + w*loss, memory_order_relaxed);
+		s.sum_sq_.store(s.sum_sq_.load(memory_order_relaxed) + w*loss*loss, memory_order_relaxed);
+		s.lock_.clear(memory_order_release);
+	}
+
+	/** Returns the (discounted) number of feedbacks received by @a arm in context @a ctx */
+	double pulls(size_type arm, size_type ctx = 0) const{
+		assert(arm < 5 && arm > 0 && ctx < C);
+		const arm_stats& s = stats_[ctx][arm-1];
+		return discount(step_[ctx].load(memory_order_relaxed),s.step_.load(memory_order_relaxed))*s.count_.load(memory_order_relaxed);
+	}
+
+	/** Returns the mean q-error (geometric mean of the realized q-errors) of @a arm */
+	double mean_qerror(size_type arm, size_type ctx = 0) const{
+		double n = pulls(arm,ctx);
+		if (n <= 0.0)
+			return 1.0;
+		const arm_stats& s = stats_[ctx][arm-1];
+		return exp(s.sum_.load(memory_order_relaxed)/s.count_.load(memory_order_relaxed));
+	}
+
+ private:
+
+	/** Statistics for one arm, padded to a cache line so concurrent updates to
+	 * different arms do not contend */
+	struct alignas(64) arm_stats{
+		atomic<double> count_;
+		atomic<double> sum_;	//sum of log q-errors
+		atomic<double> sum_sq_;
+		atomic<unsigned long long> step_;	//context step the statistics are discounted to
+		atomic_flag lock_;
+	};
+
+	/** decay^(now - then), the weight at step @a now of statistics discounted to step @a then */
+	double discount(unsigned long long now, unsigned long long then) const{
+		if (decay_ == 1.0 || now <= then)
+			return 1.0;
+		return pow(decay_,(double) (now-then));
+	}
+
+	/** Draws from N(0,1) with a per-thread generator, so choose() never locks */
+	static double standard_normal(){
+		static thread_local minstd_rand gen(random_device{}());
+		static thread_local normal_distribution<double> dist(0.0,1.0);
+		return dist(gen);
+	}
+
+	MT* mt_;
+	policy_type policy_;
+	double exploration_;
+	double decay_;
+	arm_stats stats_[C][4];
+	atomic<unsigned long long> step_[C];	//feedbacks received per context
+};
+
+#endif
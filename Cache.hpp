@@ -0,0 +1,238 @@
+#ifndef CS207_CACHE_HPP
+#define CS207_CACHE_HPP
+
+/** @file Cache.hpp
+ * @brief A bounded, concurrent cache of predictions in front of a Manager
+ */
+
+#include "Hash.hpp"
+#include "Matrix.hpp"
+#include <atomic>
+#include <vector>
+#include <cassert>
+using namespace std;
+
+/** @class 	Prediction_cache
+ * @brief 	Memoizes Manager predictions keyed by a fingerprint of the feature vector
+ * @tparam  MT	The Manager type whose models are cached
+ *
+ * A key is the 64-bit hash of a feature row together with the model's slot id and
+ * Manager version, so replacing or touching a model makes its old entries unreachable
+ * and they are evicted over time. Two different rows with the same 64-bit
+ * fingerprint would share an entry; at the table sizes used here that is negligible.
+ *
+ * The table is set-associative open addressing: a key may live in any of the
+ * @a ways slots of its bucket and a full bucket evicts with CLOCK (second chance).
+ * Buckets are striped over spinlocks, so lookups and inserts from different threads
+ * only contend when they hit the same stripe.
+ */
+template <typename MT>
+class Prediction_cache{
+ public:
+
+	typedef typename MT::size_type size_type;
+	typedef Prediction_cache cache_type;
+
+	/** Slots per bucket */
+	enum { ways = 8 };
+
+	/** Constructs a cache of at least @a capacity entries with @a stripes locks
+	 * @pre	@a stripes is a power of two
+	 */
+	Prediction_cache(MT& mt, size_type capacity = 1 << 16, size_type stripes = 64)
+	  :mt_(&mt),locks_(stripes){
+		assert(stripes > 0 && (stripes & (stripes-1)) == 0);
+		num_buckets_ = 1;
+		while (num_buckets_*ways < capacity || num_buckets_ < stripes)
+			num_buckets_ <<= 1;
+		slots_.resize(num_buckets_*ways);
+		hands_.resize(num_buckets_);
+		for (size_type i = 0; i < locks_.size(); ++i)
+			locks_[i].flag_.clear();
+		clear();
+	}
+
+	~Prediction_cache() = default;
+
+	Prediction_cache& operator=(const Prediction_cache&) = delete;
+
+	/** Drops every entry and resets the hit statistics
+	 * Safe while other threads look up and insert: it takes every stripe lock, in
+	 * order, before touching the table, so it waits for the lookups in flight.
+	 */
+	void clear(){
+		for (size_type i = 0; i < locks_.size(); ++i)
+			lock(i);
+		for (size_type i = 0; i < slots_.size(); ++i)
+			slots_[i] = slot();
+		for (size_type i = 0; i < hands_.size(); ++i)
+			hands_[i] = 0;
+		hits_.store(0);
+		misses_.store(0);
+		for (size_type i = 0; i < locks_.size(); ++i)
+			unlock(i);
+	}
+
+	/** Returns the prediction of the model in slot @a id for the row @a x of @a d features
+	 * On a miss the model's batch predict is called for the single row and the result stored.
+	 */
+	double predict(size_type id, const double* x, size_type d){
+		uint64_t key = hash_doubles(x,d);
+		size_type version = mt_->version(id);
+		double y = 0.0;
+		if (lookup(key,id,version,y))
+			return y;
+		mt_->predict_model(id,x,1,d,&y);
+		insert(key,id,version,y);
+		return y;
+	}
+
+	/** Predicts @a n rows with the model in slot @a id, going to the model only for misses
+	 * @param[in]  x		row-major @a n x @a d features
+	 * @param[out] y_hat	@a n predictions
+	 *
+	 * The missed rows are gathered and predicted in one batch call.
+	 */
+	void predict(size_type id, const double* x, size_type n, size_type d, double* y_hat){
+		static thread_local vector<double> rows;
+		static thread_local vector<uint64_t> keys;
+		static thread_local vector<size_type> where;
+		static thread_local vector<double> out;
+		rows.clear();
+		keys.clear();
+		where.clear();
+
+		size_type version = mt_->version(id);
+		for (size_type i = 0; i < n; ++i){
+			const double* row = x + (size_t)i*d;
+			uint64_t key = hash_doubles(row,d);
+			if (!lookup(key,id,version,y_hat[i])){
+				rows.insert(rows.end(),row,row+d);
+				keys.push_back(key);
+				where.push_back(i);
+			}
+		}
+		if (where.empty())
+			return;
+
+		out.resize(where.size());
+		mt_->predict_model(id,&rows[0],where.size(),d,&out[0]);
+		for (size_type j = 0; j < where.size(); ++j){
+			y_hat[where[j]] = out[j];
+			insert(keys[j],id,version,out[j]);
+		}
+	}
+
+	/** Looks up the entry for fingerprint @a key of model @a id at @a version
+	 * @return true and sets @a y on a hit
+	 */
+	bool lookup(uint64_t key, size_type id, size_type version, double& y){
+		size_type b = bucket(key);
+		lock(b);
+		slot* s = &slots_[(size_t)b*ways];
+		for (size_type w = 0; w < ways; ++w){
+			if (s[w].used_ && s[w].key_ == key && s[w].model_ == id && s[w].version_ == version){
+				s[w].ref_ = 1;
+				y = s[w].value_;
+				unlock(b);
+				hits_.fetch_add(1,memory_order_relaxed);
+				return true;
+			}
+		}
+		unlock(b);
+		misses_.fetch_add(1,memory_order_relaxed);
+		return false;
+	}
+
+	/** Stores @a y for fingerprint @a key of model @a id at @a version
+	 * An entry for the same key and model is overwritten in place (e.g. an older
+	 * version), otherwise an empty slot is used, otherwise CLOCK picks a victim.
+	 */
+	void insert(uint64_t key, size_type id, size_type version, double y){
+		size_type b = bucket(key);
+		lock(b);
+		slot* s = &slots_[(size_t)b*ways];
+		size_type target = ways;
+		for (size_type w = 0; w < ways; ++w){
+			if (s[w].used_ && s[w].key_ == key && s[w].model_ == id){
+				target = w;
+				break;
+			}
+			if (!s[w].used_ && target == ways)
+				target = w;
+		}
+		if (target == ways){
+			unsigned char& hand = hands_[b];
+			while (s[hand].ref_){
+				s[hand].ref_ = 0;
+				hand = (hand+1) % ways;
+			}
+			target = hand;
+			hand = (hand+1) % ways;
+		}
+		s[target].key_ = key;
+		s[target].value_ = y;
+		s[target].version_ = version;
+		s[target].model_ = id;
+		s[target].ref_ = 0;
+		s[target].used_ = 1;
+		unlock(b);
+	}
+
+	/** Number of entries the cache can hold */
+	size_type capacity() const{
+		return slots_.size();
+	}
+
+	unsigned long long hits() const{
+		return hits_.load();
+	}
+
+	unsigned long long misses() const{
+		return misses_.load();
+	}
+
+ private:
+
+	struct slot{
+		uint64_t key_;
+		double value_;
+		size_type version_;
+		unsigned char model_;
+		unsigned char ref_;	//CLOCK reference bit
+		unsigned char used_;
+		slot():key_(0),value_(0.0),version_(0),model_(0),ref_(0),used_(0){
+		}
+	};
+
+	/** A spinlock on its own cache line: padded to 64 bytes and kept in an
+	 * aligned_vector, since operator new need not honor alignas(64) before C++17 */
+	struct stripe_lock{
+		atomic_flag flag_;
+		char pad_[64 - sizeof(atomic_flag)];
+	};
+
+	size_type bucket(uint64_t key) const{
+		return (size_type) (key & (num_buckets_-1));
+	}
+
+	void lock(size_type b){
+		atomic_flag& f = locks_[b & (locks_.size()-1)].flag_;
+		while (f.test_and_set(memory_order_acquire))
+			;
+	}
+
+	void unlock(size_type b){
+		locks_[b & (locks_.size()-1)].flag_.clear(memory_order_release);
+	}
+
+	MT* mt_;
+	size_type num_buckets_;
+	vector<slot> slots_;
+	vector<unsigned char> hands_;
+	aligned_vector<stripe_lock> locks_;
+	atomic<unsigned long long> hits_;
+	atomic<unsigned long long> misses_;
+};
+
+#endif
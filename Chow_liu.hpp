@@ -0,0 +1,322 @@
+#ifndef CS207_CHOW_LIU_HPP
+#define CS207_CHOW_LIU_HPP
+
+/** @file Chow_liu.hpp
+ * @brief Chow-Liu tree Bayesian network over sample columns for selectivity estimation
+ */
+
+#include "Graph.hpp"
+#include "Tree.hpp"
+#include "Parallel.hpp"
+#include <vector>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** Column of a Chow-Liu tree: the value of a Graph node */
+struct chow_liu_column{
+	unsigned column_;
+	vector<double> marginal_;	//P(bin)
+};
+
+/** Dependency between two columns: the value of a Graph edge */
+struct chow_liu_dependency{
+	unsigned parent_;		//column nearer the root
+	unsigned child_;
+	double mutual_information_;
+	vector<double> cpt_;		//P(child bin | parent bin), one row per parent bin
+};
+
+/** @class 	Chow_liu_tree
+ * @brief 	The tree-shaped Bayesian network over the columns that maximizes the likelihood
+ *
+ * fit() discretizes every column (Binned_features), computes the mutual information of
+ * every pair of columns from their joint histograms, split over threads, and keeps the
+ * maximum spanning tree of that complete graph (Prim). The tree is a Graph whose nodes
+ * are columns with their marginals and whose edges hold the conditional probability
+ * table of the child column given the parent column, rooted at column 0.
+ *
+ * probability() conditions on one range per column: each column's evidence is the
+ * fraction of each of its bins inside the range (values are assumed uniform between
+ * the smallest and largest training value of a bin), and one upward pass of belief
+ * propagation sums out the tree. Subtrees without a constraint are skipped, since
+ * their messages are all ones.
+ */
+class Chow_liu_tree{
+	public:
+		typedef unsigned size_type;
+		typedef Graph<chow_liu_column,chow_liu_dependency> graph_type;
+
+		/** @param[in] max_bins	bins per column, at most 256
+		 *  @param[in] alpha	pseudo-count added to every cell of a joint histogram
+		 *  @param[in] threads	threads for the pairwise mutual information, 0 for all cores
+		 */
+		Chow_liu_tree(size_type max_bins = 32, double alpha = 0.1, unsigned threads = 0)
+		  :max_bins_(max_bins),alpha_(alpha),threads_(threads),d_(0),rows_(0.0){
+			assert(max_bins >= 2 && max_bins <= 256 && alpha > 0.0);
+		}
+
+		/** Learns the tree from @a n row-major rows of @a d columns
+		 * Complexity: O(n*d^2) for the pairwise histograms, O(d^2) for the spanning tree
+		 */
+		void fit(const double* x, size_type n, size_type d){
+			assert(n > 0 && d > 0);
+			d_ = d;
+			rows_ = n;
+			bf_.fit(x,n,d,max_bins_,threads_);
+			bin_ranges(x,n,d);
+			pairwise_information();
+			build_tree();
+		}
+
+		/** Learns the tree from the samples a Sampler policy holds, each sample one row */
+		template <typename Policy>
+		void fit(Policy p){
+			const auto& s = p.samples();
+			assert(!s.empty());
+			size_type d = s[0].size();
+			vector<double> x((size_t)s.size()*d);
+			for (size_type i = 0; i < s.size(); ++i){
+				assert(s[i].size() == d);
+				copy(s[i].begin(),s[i].end(),&x[(size_t)i*d]);
+			}
+			fit(&x[0],s.size(),d);
+		}
+
+		/** Probability that a row satisfies lo[j] <= x[j] <= hi[j] for every column j
+		 * Pass -HUGE_VAL / HUGE_VAL for an unconstrained bound.
+		 * Complexity: O(sum over constrained subtrees of bins(parent)*bins(child))
+		 */
+		double probability(const double* lo, const double* hi) const{
+			assert(d_ > 0);
+			static thread_local vector<double> belief;
+			static thread_local vector<unsigned char> active;
+			belief.resize(belief_offset_.back());
+			active.assign(d_,0);
+			for (size_type j = 0; j < d_; ++j){
+				if (lo[j] == -HUGE_VAL && hi[j] == HUGE_VAL)
+					continue;
+				evidence(j,lo[j],hi[j],&belief[belief_offset_[j]]);
+				active[j] = 1;
+			}
+			// children before parents: reverse breadth-first order
+			for (size_type k = d_; k-- > 1;){
+				size_type j = order_[k];
+				if (!active[j])
+					continue;
+				size_type p = parent_[j];
+				const vector<double>& cpt = graph_.edge(edge_[j]).value().cpt_;
+				size_type bj = bf_.num_bins(j), bp = bf_.num_bins(p);
+				double* bel = &belief[belief_offset_[j]];
+				double* pb = &belief[belief_offset_[p]];
+				if (!active[p]){
+					for (size_type b = 0; b < bp; ++b)
+						pb[b] = 1.0;
+					active[p] = 1;
+				}
+				for (size_type b = 0; b < bp; ++b){
+					const double* row = &cpt[(size_t)b*bj];
+					double m = 0.0;
+					for (size_type c = 0; c < bj; ++c)
+						m += row[c]*bel[c];
+					pb[b] *= m;
+				}
+			}
+			size_type r = order_[0];
+			if (!active[r])
+				return 1.0;
+			const vector<double>& marginal = graph_.node(r).value().marginal_;
+			const double* bel = &belief[belief_offset_[r]];
+			double s = 0.0;
+			for (size_type b = 0; b < marginal.size(); ++b)
+				s += marginal[b]*bel[b];
+			return s;
+		}
+
+		/** Estimated number of rows satisfying the ranges, relative to the rows learned from */
+		double cardinality(const double* lo, const double* hi) const{
+			return probability(lo,hi)*rows_;
+		}
+
+		/** Mutual information (nats) between columns @a a and @a b, as estimated by fit() */
+		double mutual_information(size_type a, size_type b) const{
+			return mi_[(size_t)a*d_+b];
+		}
+
+		/** The learned tree: node i is column i, edges hold the conditional tables */
+		const graph_type& graph() const{
+			return graph_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+	private:
+
+		/** Smallest and largest training value of every bin of every column */
+		void bin_ranges(const double* x, size_type n, size_type d){
+			bin_lo_.assign((size_t)d*256,HUGE_VAL);
+			bin_hi_.assign((size_t)d*256,-HUGE_VAL);
+			for (size_type j = 0; j < d; ++j){
+				const unsigned char* c = bf_.column(j);
+				double* lo = &bin_lo_[(size_t)j*256];
+				double* hi = &bin_hi_[(size_t)j*256];
+				for (size_type i = 0; i < n; ++i){
+					double v = x[(size_t)i*d+j];
+					lo[c[i]] = v < lo[c[i]] ? v : lo[c[i]];
+					hi[c[i]] = v > hi[c[i]] ? v : hi[c[i]];
+				}
+			}
+		}
+
+		/** Fraction of each bin of column @a j inside [lo, hi], written to @a w */
+		void evidence(size_type j, double lo, double hi, double* w) const{
+			const double* bl = &bin_lo_[(size_t)j*256];
+			const double* bh = &bin_hi_[(size_t)j*256];
+			for (size_type b = 0; b < bf_.num_bins(j); ++b){
+				if (bl[b] > bh[b] || hi < bl[b] || lo > bh[b])
+					w[b] = 0.0;
+				else if (bl[b] == bh[b] || (lo <= bl[b] && hi >= bh[b]))
+					w[b] = 1.0;
+				else
+					w[b] = ((hi < bh[b] ? hi : bh[b]) - (lo > bl[b] ? lo : bl[b]))/(bh[b]-bl[b]);
+			}
+		}
+
+		/** Smoothed joint histogram of the columns @a a and @a b, a's bins as rows */
+		void joint(size_type a, size_type b, vector<double>& h) const{
+			size_type ba = bf_.num_bins(a), bb = bf_.num_bins(b);
+			h.assign((size_t)ba*bb,alpha_);
+			const unsigned char* ca = bf_.column(a);
+			const unsigned char* cb = bf_.column(b);
+			for (size_type i = 0; i < bf_.rows(); ++i)
+				h[(size_t)ca[i]*bb+cb[i]] += 1.0;
+		}
+
+		void pairwise_information(){
+			size_type d = d_;
+			mi_.assign((size_t)d*d,0.0);
+			vector<size_type> pa, pb;
+			for (size_type a = 0; a < d; ++a){
+				for (size_type b = a+1; b < d; ++b){
+					pa.push_back(a);
+					pb.push_back(b);
+				}
+			}
+			parallel_for(0,pa.size(),[&](size_t lo, size_t hi, unsigned){
+				vector<double> h, ra, rb;
+				for (size_t k = lo; k < hi; ++k){
+					size_type a = pa[k], b = pb[k];
+					size_type ba = bf_.num_bins(a), bb = bf_.num_bins(b);
+					joint(a,b,h);
+					ra.assign(ba,0.0);
+					rb.assign(bb,0.0);
+					double total = 0.0;
+					for (size_type u = 0; u < ba; ++u){
+						for (size_type v = 0; v < bb; ++v){
+							double c = h[(size_t)u*bb+v];
+							ra[u] += c;
+							rb[v] += c;
+							total += c;
+						}
+					}
+					double mi = 0.0;
+					for (size_type u = 0; u < ba; ++u)
+						for (size_type v = 0; v < bb; ++v){
+							double c = h[(size_t)u*bb+v];
+							mi += c/total*log(c*total/(ra[u]*rb[v]));
+						}
+					mi_[(size_t)a*d+b] = mi_[(size_t)b*d+a] = mi;
+				}
+			},threads_,1);
+		}
+
+		/** Prim's maximum spanning tree over mi_, stored in graph_ and the evaluation order */
+		void build_tree(){
+			size_type d = d_;
+			graph_.clear();
+			for (size_type j = 0; j < d; ++j){
+				chow_liu_column col;
+				col.column_ = j;
+				col.marginal_.assign(bf_.num_bins(j),0.0);
+				const unsigned char* c = bf_.column(j);
+				for (size_type i = 0; i < bf_.rows(); ++i)
+					col.marginal_[c[i]] += 1.0;
+				for (size_type b = 0; b < col.marginal_.size(); ++b)
+					col.marginal_[b] /= bf_.rows();
+				graph_.add_node(Point(),col);
+			}
+
+			parent_.assign(d,0);
+			edge_.assign(d,0);
+			order_.assign(1,0);
+			vector<unsigned char> in_tree(d,0);
+			vector<double> best(d,-HUGE_VAL);
+			vector<size_type> from(d,0);
+			in_tree[0] = 1;
+			for (size_type j = 1; j < d; ++j){
+				best[j] = mi_[j];
+				from[j] = 0;
+			}
+			vector<double> h;
+			for (size_type k = 1; k < d; ++k){
+				size_type next = 0;
+				double m = -HUGE_VAL;
+				for (size_type j = 0; j < d; ++j){
+					if (!in_tree[j] && best[j] > m){
+						m = best[j];
+						next = j;
+					}
+				}
+				in_tree[next] = 1;
+				order_.push_back(next);
+				size_type p = from[next];
+				parent_[next] = p;
+
+				chow_liu_dependency dep;
+				dep.parent_ = p;
+				dep.child_ = next;
+				dep.mutual_information_ = m;
+				joint(p,next,h);
+				size_type bp = bf_.num_bins(p), bc = bf_.num_bins(next);
+				for (size_type u = 0; u < bp; ++u){
+					double s = 0.0;
+					for (size_type v = 0; v < bc; ++v)
+						s += h[(size_t)u*bc+v];
+					for (size_type v = 0; v < bc; ++v)
+						h[(size_t)u*bc+v] /= s;
+				}
+				dep.cpt_ = h;
+				edge_[next] = graph_.add_edge(graph_.node(p),graph_.node(next),dep).index();
+
+				for (size_type j = 0; j < d; ++j){
+					if (!in_tree[j] && mi_[(size_t)next*d+j] > best[j]){
+						best[j] = mi_[(size_t)next*d+j];
+						from[j] = next;
+					}
+				}
+			}
+
+			belief_offset_.assign(d+1,0);
+			for (size_type j = 0; j < d; ++j)
+				belief_offset_[j+1] = belief_offset_[j] + bf_.num_bins(j);
+		}
+
+		size_type max_bins_;
+		double alpha_;
+		unsigned threads_;
+		size_type d_;
+		double rows_;
+		Binned_features bf_;
+		vector<double> bin_lo_;
+		vector<double> bin_hi_;
+		vector<double> mi_;
+		graph_type graph_;
+		vector<size_type> order_;	//columns in the order Prim added them, root first
+		vector<size_type> parent_;
+		vector<size_type> edge_;	//index of the edge to the parent in graph_
+		vector<size_type> belief_offset_;
+};
+
+#endif
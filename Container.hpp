@@ -2,8 +2,234 @@
  ** Standardizes all inserts, pops, updates, etc for a container so that these functions are independent of type
  **/
 
+#include <vector>
+#include <iterator>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <cstddef>
+#include <cassert>
+
 using namespace std;
 
+/** @class 	Ring_buffer
+ ** @brief 	Growable circular array: a storage policy for Container with O(1) push and pop at both ends
+ **
+ ** Capacity is a power of two and doubles when full, so push_back() and push_front()
+ ** are amortized O(1) and pop_front()/pop_back() are O(1). Container<Ring_buffer<T> >
+ ** gets O(1) pop(), since erasing begin() or the last element moves nothing.
+ ** Iterators are random access and are invalidated by any push or erase.
+ **/
+template <typename T>
+class Ring_buffer{
+ public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	/** Elements are their own keys, as in a set **/
+	typedef T key_type;
+
+	class iterator{
+	 public:
+		typedef T value_type;
+		typedef T* pointer;
+		typedef T& reference;
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef std::ptrdiff_t difference_type;
+
+		iterator():r_(0),i_(0){
+		}
+
+		T& operator*() const{
+			return (*r_)[i_];
+		}
+
+		T* operator->() const{
+			return &(*r_)[i_];
+		}
+
+		iterator& operator++(){
+			++i_;
+			return *this;
+		}
+
+		iterator& operator--(){
+			--i_;
+			return *this;
+		}
+
+		iterator operator+(difference_type k) const{
+			return iterator(r_,i_+k);
+		}
+
+		iterator operator-(difference_type k) const{
+			return iterator(r_,i_-k);
+		}
+
+		difference_type operator-(const iterator& it) const{
+			return (difference_type) i_ - (difference_type) it.i_;
+		}
+
+		bool operator==(const iterator& it) const{
+			return r_ == it.r_ && i_ == it.i_;
+		}
+
+		bool operator!=(const iterator& it) const{
+			return !((*this)==it);
+		}
+
+		bool operator<(const iterator& it) const{
+			return i_ < it.i_;
+		}
+
+	 private:
+		friend class Ring_buffer;
+		iterator(Ring_buffer* r, size_type i):r_(r),i_(i){
+		}
+
+		Ring_buffer* r_;
+		size_type i_;	//position from the front
+	};
+
+	Ring_buffer(size_type capacity = 16):buf_(),mask_(0),head_(0),size_(0){
+		size_type c = 1;
+		while (c < capacity)
+			c <<= 1;
+		buf_.resize(c);
+		mask_ = c-1;
+	}
+
+	iterator begin(){
+		return iterator(this,0);
+	}
+
+	iterator end(){
+		return iterator(this,size_);
+	}
+
+	/** Element @a k from the front **/
+	reference operator[](size_type k){
+		assert(k < size_);
+		return buf_[(head_+k) & mask_];
+	}
+
+	reference front(){
+		assert(size_ > 0);
+		return buf_[head_];
+	}
+
+	reference back(){
+		assert(size_ > 0);
+		return buf_[(head_+size_-1) & mask_];
+	}
+
+	void push_back(const T& a){
+		if (size_ == buf_.size())
+			grow();
+		buf_[(head_+size_) & mask_] = a;
+		++size_;
+	}
+
+	void push_front(const T& a){
+		if (size_ == buf_.size())
+			grow();
+		head_ = (head_-1) & mask_;
+		buf_[head_] = a;
+		++size_;
+	}
+
+	void pop_front(){
+		assert(size_ > 0);
+		buf_[head_] = T();
+		head_ = (head_+1) & mask_;
+		--size_;
+	}
+
+	void pop_back(){
+		assert(size_ > 0);
+		--size_;
+		buf_[(head_+size_) & mask_] = T();
+	}
+
+	/** Appends @a a, as Container::push() expects of its storage **/
+	iterator insert(const T& a){
+		push_back(a);
+		return end()-1;
+	}
+
+	/** O(1) at either end, else O(distance to the back) **/
+	void erase(iterator it){
+		size_type i = it.i_;
+		assert(i < size_);
+		if (i == 0){
+			pop_front();
+			return;
+		}
+		for (size_type k = i; k+1 < size_; ++k)
+			(*this)[k] = (*this)[k+1];
+		pop_back();
+	}
+
+	/** Erases the first element equal to @a k, if any **/
+	void erase(const key_type& k){
+		iterator it = find(k);
+		if (it != end())
+			erase(it);
+	}
+
+	iterator find(const key_type& k){
+		for (size_type i = 0; i < size_; ++i)
+			if ((*this)[i] == k)
+				return iterator(this,i);
+		return end();
+	}
+
+	template <typename It>
+	void insert(It first, It last){
+		for (; first != last; ++first)
+			push_back(*first);
+	}
+
+	void clear(){
+		while (size_ > 0)
+			pop_back();
+		head_ = 0;
+	}
+
+	size_type size() const{
+		return size_;
+	}
+
+	size_type capacity() const{
+		return buf_.size();
+	}
+
+	bool empty() const{
+		return size_ == 0;
+	}
+
+ private:
+	/** Doubles the capacity, moving the elements to the front of the new array **/
+	void grow(){
+		vector<T> b(buf_.size()*2);
+		for (size_type k = 0; k < size_; ++k)
+			b[k] = buf_[(head_+k) & mask_];
+		buf_.swap(b);
+		mask_ = buf_.size()-1;
+		head_ = 0;
+	}
+
+	vector<T> buf_;
+	size_type mask_;
+	size_type head_;
+	size_type size_;
+};
+
 template <typename V>
 class Container{
  private:
@@ -41,21 +267,50 @@ class Container{
 		return *begin();
 	}
 
+	/** @pre !empty() **/
 	reference back(){
-		if (empty())
-			return *(back());
-		else
-			return *(begin()+(size()-1));
+		assert(!empty());
+		return *(begin()+(size()-1));
 	}
 
+	/** Removes and returns the front element, in O(1) for Ring_buffer storage
+	 ** @pre !empty()
+	 **/
 	value_type pop(){
+		assert(!empty());
 		value_type a = front();
 		v_.erase(begin());
 		return a;
 	}
 
 	value_type push(const value_type& a){
-		return v_.insert(a);
+		v_.insert(a);
+		return a;
+	}
+
+	/** Double-ended access, for storage with push_front/push_back such as Ring_buffer **/
+	void push_back(const value_type& a){
+		v_.push_back(a);
+	}
+
+	void push_front(const value_type& a){
+		v_.push_front(a);
+	}
+
+	/** @pre !empty() **/
+	value_type pop_front(){
+		assert(!empty());
+		value_type a = v_.front();
+		v_.pop_front();
+		return a;
+	}
+
+	/** @pre !empty() **/
+	value_type pop_back(){
+		assert(!empty());
+		value_type a = v_.back();
+		v_.pop_back();
+		return a;
 	}
 
 	void clear(){
@@ -96,9 +351,200 @@ class Container{
 		V v_;
 };
 
+/** @class 	Concurrent_queue
+ ** @brief 	Bounded multi-producer multi-consumer FIFO for handing work between threads
+ **
+ ** The lock-free ring of Vyukov's bounded MPMC queue: each cell carries a sequence
+ ** number that says whether it is ready for the producer or the consumer of the
+ ** current lap, so try_push() and try_pop() claim a position with one
+ ** compare-and-swap and never block. Capacity is rounded up to a power of two.
+ **
+ ** push() and pop() block while the queue is full or empty. Waiters sleep on a
+ ** condition variable that producers and consumers only touch when someone waits,
+ ** so the uncontended path stays lock-free. After close() no element is accepted:
+ ** push() and try_push() return false, as do pushes blocked at the time, while
+ ** pop() still drains what is left and then returns false.
+ **/
+template <typename T>
+class Concurrent_queue{
+ public:
+	typedef T value_type;
+	typedef size_t size_type;
+
+	Concurrent_queue(size_type capacity = 1024):cells_(),mask_(0),enqueue_(0),dequeue_(0),waiting_(0),closed_(false){
+		size_type c = 2;
+		while (c < capacity)
+			c <<= 1;
+		cells_.reset(new cell[c]);
+		for (size_type i = 0; i < c; ++i)
+			cells_[i].seq_.store(i,memory_order_relaxed);
+		mask_ = c-1;
+	}
+
+	Concurrent_queue(const Concurrent_queue&) = delete;
+	Concurrent_queue& operator=(const Concurrent_queue&) = delete;
+
+	/** Appends @a v unless the queue is full or closed
+	 ** @return false if it was full or closed
+	 **/
+	bool try_push(const T& v){
+		if (closed_.load() || !enqueue(v))
+			return false;
+		wake();
+		return true;
+	}
+
+	/** Removes the front element into @a v unless the queue is empty
+	 ** @return false if it was empty
+	 **/
+	bool try_pop(T& v){
+		if (!dequeue(v))
+			return false;
+		wake();
+		return true;
+	}
+
+	/** Appends @a v, waiting while the queue is full
+	 ** @return false if the queue is closed, before or while waiting; @a v is then not added
+	 **/
+	bool push(const T& v){
+		return wait_for([&](){ return !closed_.load() && enqueue(v); });
+	}
 
+	/** Removes the front element into @a v, waiting while the queue is empty
+	 ** @return false once the queue is closed and empty
+	 **/
+	bool pop(T& v){
+		return wait_for([&](){ return dequeue(v); });
+	}
 
+	/** Wakes every blocked push() and pop(); pushes fail from now on, pops once the queue is empty **/
+	void close(){
+		{
+			lock_guard<mutex> lock(m_);
+			closed_.store(true);
+		}
+		cv_.notify_all();
+	}
 
+	bool closed() const{
+		return closed_.load();
+	}
 
+	/** Number of elements, exact only when no other thread is pushing or popping **/
+	size_type size() const{
+		size_type e = enqueue_.load(), d = dequeue_.load();
+		return e > d ? e-d : 0;
+	}
 
+	bool empty() const{
+		return size() == 0;
+	}
 
+	size_type capacity() const{
+		return mask_+1;
+	}
+
+ private:
+	struct cell{
+		atomic<size_type> seq_;
+		T data_;
+	};
+
+	/** One Vyukov enqueue: claim the cell whose sequence equals the position, fill it, publish pos+1 **/
+	bool enqueue(const T& v){
+		size_type pos = enqueue_.load(memory_order_relaxed);
+		cell* c;
+		for (;;){
+			c = &cells_[pos & mask_];
+			size_type seq = c->seq_.load(memory_order_acquire);
+			ptrdiff_t dif = (ptrdiff_t) seq - (ptrdiff_t) pos;
+			if (dif == 0){
+				if (enqueue_.compare_exchange_weak(pos,pos+1,memory_order_relaxed))
+					break;
+			}else if (dif < 0){
+				return false;
+			}else{
+				pos = enqueue_.load(memory_order_relaxed);
+			}
+		}
+		c->data_ = v;
+		c->seq_.store(pos+1,memory_order_release);
+		return true;
+	}
+
+	/** One Vyukov dequeue: claim the cell published for this lap, empty it, free it for the next lap **/
+	bool dequeue(T& v){
+		size_type pos = dequeue_.load(memory_order_relaxed);
+		cell* c;
+		for (;;){
+			c = &cells_[pos & mask_];
+			size_type seq = c->seq_.load(memory_order_acquire);
+			ptrdiff_t dif = (ptrdiff_t) seq - (ptrdiff_t) (pos+1);
+			if (dif == 0){
+				if (dequeue_.compare_exchange_weak(pos,pos+1,memory_order_relaxed))
+					break;
+			}else if (dif < 0){
+				return false;
+			}else{
+				pos = dequeue_.load(memory_order_relaxed);
+			}
+		}
+		v = c->data_;
+		c->data_ = T();
+		c->seq_.store(pos+mask_+1,memory_order_release);
+		return true;
+	}
+
+	/** Retries @a attempt, spinning briefly and then sleeping until another thread makes progress **/
+	template <typename F>
+	bool wait_for(F attempt){
+		for (unsigned spin = 0; spin < 64; ++spin){
+			bool ok = attempt();
+			if (ok || closed_.load()){
+				if (ok || (ok = attempt()))
+					wake();
+				return ok;
+			}
+			this_thread::yield();
+		}
+		unique_lock<mutex> lock(m_);
+		waiting_.fetch_add(1);
+		// pairs with the fence in wake(): either it sees waiting_ > 0 or attempt() sees its update
+		atomic_thread_fence(memory_order_seq_cst);
+		bool ok;
+		while (!(ok = attempt()) && !closed_.load())
+			cv_.wait(lock);
+		waiting_.fetch_sub(1);
+		lock.unlock();
+		if (!ok)
+			ok = attempt();
+		if (ok)
+			wake();
+		return ok;
+	}
+
+	/** Called after every successful push or pop; wakes sleepers if there are any **/
+	void wake(){
+		atomic_thread_fence(memory_order_seq_cst);
+		if (waiting_.load(memory_order_relaxed) > 0){
+			{
+				lock_guard<mutex> lock(m_);
+			}
+			cv_.notify_all();
+		}
+	}
+
+	unique_ptr<cell[]> cells_;
+	size_type mask_;
+	// producers and consumers each get their own cache line
+	char pad0_[64];
+	atomic<size_type> enqueue_;
+	char pad1_[64 - sizeof(atomic<size_type>)];
+	atomic<size_type> dequeue_;
+	char pad2_[64 - sizeof(atomic<size_type>)];
+	atomic<unsigned> waiting_;
+	atomic<bool> closed_;
+	mutex m_;
+	condition_variable cv_;
+};
@@ -0,0 +1,178 @@
+#ifndef CS207_FEATURE_HASHER_HPP
+#define CS207_FEATURE_HASHER_HPP
+
+/** @file Feature_hasher.hpp
+ * @brief Signed feature hashing of query predicates and plan operators into sparse rows
+ */
+
+#include "Hash.hpp"
+#include "Sparse.hpp"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** Comparison or plan operator of a token; any other small integer works as well */
+enum feature_op {OP_EQ = 1, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_LIKE, OP_IN, OP_IS_NULL,
+                 OP_SCAN, OP_INDEX_SCAN, OP_JOIN, OP_HASH_JOIN, OP_MERGE_JOIN, OP_SORT, OP_AGGREGATE};
+
+/** @class 	feature_token
+ * @brief 	One (table, column, operator, literal bucket) fact about a subplan
+ *
+ * Tables and columns are the planner's numeric ids (catalog oids, attribute
+ * numbers), so nothing is formatted or interned on the hot path. A token without
+ * a column or a literal leaves them 0, e.g. a plan operator over one table.
+ * value_ is the feature's weight, 1 for an indicator.
+ */
+struct feature_token{
+	uint32_t table_;
+	uint32_t column_;
+	uint32_t op_;
+	int32_t bucket_;
+	double value_;
+};
+
+/** Bucket of a literal on a signed log scale: @a per_octave buckets per doubling of |v|+1
+ * Literals of similar magnitude share a bucket, so a model generalizes across them.
+ */
+inline int32_t literal_bucket(double v, unsigned per_octave = 2){
+	double b = floor(log2(1.0 + fabs(v))*per_octave);
+	return v < 0.0 ? -(int32_t) b - 1 : (int32_t) b;
+}
+
+/** Token for the predicate "table.column op literal" */
+inline feature_token predicate_token(uint32_t table, uint32_t column, uint32_t op, double literal, unsigned per_octave = 2){
+	feature_token t = {table, column, op, literal_bucket(literal,per_octave), 1.0};
+	return t;
+}
+
+/** Token for a plan operator over @a table (0 if none), weighted by @a value, e.g. estimated rows */
+inline feature_token operator_token(uint32_t op, uint32_t table = 0, double value = 1.0){
+	feature_token t = {table, 0, op, 0, value};
+	return t;
+}
+
+/** @class 	Feature_hasher
+ * @brief 	Maps bags of tokens to rows of 2^bits features (the hashing trick)
+ *
+ * Token t goes to feature h(t) mod 2^bits with weight sign(h(t)) * t.value_, where
+ * h hashes the four token fields with two hash_round steps and the splitmix64
+ * finalizer (Hash.hpp), and the sign is the top bit of h. Signed hashing makes
+ * collisions cancel in expectation, so inner products are unbiased.
+ * Tokens landing on one feature are summed and zero sums dropped.
+ *
+ * hash_row() writes into caller buffers and does not allocate; a subplan with a few
+ * dozen tokens takes well under a microsecond. transform() appends the row to a
+ * Csr_matrix for Linear_regression and the online learner (Sparse.hpp).
+ */
+class Feature_hasher{
+	public:
+		typedef unsigned size_type;
+
+		/** @param[in] bits	log2 of the number of features, at most 31
+		 *  @param[in] seed	hash seed; hashers with different seeds are independent
+		 */
+		Feature_hasher(size_type bits = 18, bool use_sign = true, uint64_t seed = 0)
+		  :bits_(bits),mask_(((uint64_t) 1 << bits) - 1),use_sign_(use_sign),seed_(hash_mix(seed + 0x9e3779b97f4a7c15ULL)){
+			assert(bits > 0 && bits < 32);
+		}
+
+		/** 64-bit hash of a token; the low bits pick the feature, the top bit its sign */
+		uint64_t hash(const feature_token& t) const{
+			uint64_t h = hash_round(seed_,((uint64_t) t.table_ << 32) | t.column_);
+			h = hash_round(h,((uint64_t) t.op_ << 32) | (uint32_t) t.bucket_);
+			return hash_mix(h);
+		}
+
+		/** Feature index of token @a t */
+		size_type index(const feature_token& t) const{
+			return (size_type) (hash(t) & mask_);
+		}
+
+		/** Hashes @a n tokens into one sparse row
+		 * @param[out] idx, val	at least @a n entries; the row's sorted feature indices and values
+		 * @return 		the number of nonzeros written
+		 * Complexity: O(n^2) by insertion sort, the fastest order for the few dozen tokens of a subplan
+		 */
+		size_type hash_row(const feature_token* t, size_type n, unsigned* idx, double* val) const{
+			size_type nnz = 0;
+			for (size_type k = 0; k < n; ++k){
+				uint64_t h = hash(t[k]);
+				unsigned j = (unsigned) (h & mask_);
+				double v = (use_sign_ && (h >> 63)) ? -t[k].value_ : t[k].value_;
+				size_type p = nnz;
+				while (p > 0 && idx[p-1] > j){
+					idx[p] = idx[p-1];
+					val[p] = val[p-1];
+					--p;
+				}
+				if (p > 0 && idx[p-1] == j){
+					// collision: merge and close the gap opened above
+					val[p-1] += v;
+					for (; p < nnz; ++p){
+						idx[p] = idx[p+1];
+						val[p] = val[p+1];
+					}
+					continue;
+				}
+				idx[p] = j;
+				val[p] = v;
+				++nnz;
+			}
+			size_type m = 0;
+			for (size_type k = 0; k < nnz; ++k){
+				if (val[k] != 0.0){
+					idx[m] = idx[k];
+					val[m] = val[k];
+					++m;
+				}
+			}
+			return m;
+		}
+
+		/** Appends the row of @a n tokens to @a x, which must have dims() columns */
+		void transform(const feature_token* t, size_type n, Csr_matrix& x){
+			assert(x.cols() == dims());
+			if (idx_.size() < n){
+				idx_.resize(n);
+				val_.resize(n);
+			}
+			size_type nnz = n ? hash_row(t,n,&idx_[0],&val_[0]) : 0;
+			x.push_back(nnz ? &idx_[0] : 0,nnz ? &val_[0] : 0,nnz);
+		}
+
+		/** Writes the row of @a n tokens densely to @a row (dims() values) */
+		void transform(const feature_token* t, size_type n, double* row) const{
+			for (size_type j = 0; j < dims(); ++j)
+				row[j] = 0.0;
+			for (size_type k = 0; k < n; ++k){
+				uint64_t h = hash(t[k]);
+				row[h & mask_] += (use_sign_ && (h >> 63)) ? -t[k].value_ : t[k].value_;
+			}
+		}
+
+		/** An empty Csr_matrix of the right width for transform() */
+		Csr_matrix make_matrix() const{
+			return Csr_matrix(0,dims());
+		}
+
+		/** Number of features, 2^bits */
+		size_type dims() const{
+			return (size_type) mask_ + 1;
+		}
+
+		size_type bits() const{
+			return bits_;
+		}
+
+	private:
+		size_type bits_;
+		uint64_t mask_;
+		bool use_sign_;
+		uint64_t seed_;
+		vector<unsigned> idx_;
+		vector<double> val_;
+};
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef CS207_FIXED_HPP
+#define CS207_FIXED_HPP
+
+/** @file Fixed.hpp
+ * @brief Fixed-dimension feature vectors and model forms specialized on the feature count
+ */
+
+#include "Regression.hpp"
+#include "Gbt.hpp"
+#include "Forest.hpp"
+#include "Pipeline.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <limits>
+#include <cassert>
+using namespace std;
+
+/** @class 	FixedFeatures
+ * @brief 	N features on the stack, N known at compile time
+ *
+ * Every loop over a FixedFeatures has a constant trip count, so g++ -O3 unrolls
+ * it completely and keeps short vectors in registers.
+ */
+template <unsigned N, typename T = double>
+struct FixedFeatures{
+	typedef T value_type;
+	typedef unsigned size_type;
+	enum { dims = N };
+
+	T elem[N];
+
+	FixedFeatures(){
+		for (size_type j = 0; j < N; ++j)
+			elem[j] = T();
+	}
+
+	/** Copies the first N values of @a x */
+	explicit FixedFeatures(const T* x){
+		for (size_type j = 0; j < N; ++j)
+			elem[j] = x[j];
+	}
+
+	T& operator[](size_type j){
+		return elem[j];
+	}
+
+	const T& operator[](size_type j) const{
+		return elem[j];
+	}
+
+	T* data(){
+		return elem;
+	}
+
+	const T* data() const{
+		return elem;
+	}
+
+	size_type size() const{
+		return N;
+	}
+
+	bool operator==(const FixedFeatures& f) const{
+		for (size_type j = 0; j < N; ++j)
+			if (elem[j] != f.elem[j])
+				return false;
+		return true;
+	}
+
+	bool operator!=(const FixedFeatures& f) const{
+		return !((*this)==f);
+	}
+};
+
+/** Inner product of two N-vectors, unrolled */
+template <unsigned N>
+inline double fixed_dot(const double* KERNEL_RESTRICT a, const double* KERNEL_RESTRICT b){
+	double s = 0.0;
+	for (unsigned j = 0; j < N; ++j)
+		s += a[j]*b[j];
+	return s;
+}
+
+/** @class 	Fixed_linear
+ * @brief 	A fitted Linear_regression with its N weights in a fixed array
+ */
+template <unsigned N>
+struct Fixed_linear{
+	public:
+		typedef unsigned size_type;
+
+		Fixed_linear():b_(0.0){
+			for (size_type j = 0; j < N; ++j)
+				w_[j] = 0.0;
+		}
+
+		void build(const Linear_regression& m){
+			assert(m.dims() == N);
+			vector<double> w = m.get_params();
+			for (size_type j = 0; j < N; ++j)
+				w_[j] = w[j];
+			b_ = w[N];
+		}
+
+		double predict(const double* x) const{
+			return b_ + fixed_dot<N>(x,w_);
+		}
+
+	private:
+		double w_[N];
+		double b_;
+};
+
+/** @class 	Fixed_trees
+ * @brief 	A tree ensemble over N features, walked one row at a time
+ *
+ * Nodes are laid out as in Flat_ensemble (breadth-first, child_ + (x > threshold_),
+ * leaves pointing to themselves), with feature indices checked against N once at
+ * build time. A single row, which is what a planner estimating one subplan has,
+ * walks four trees at a time: their steps are independent loads, so they overlap
+ * instead of waiting on each other as in a walk of one tree after another. Each
+ * group of four takes the depth of its deepest tree, without a branch on the comparisons.
+ */
+template <unsigned N>
+struct Fixed_trees{
+	public:
+		typedef unsigned size_type;
+
+		/** Trees walked together by predict() */
+		enum { group = 4 };
+
+		Fixed_trees():base_(0.0),scale_(1.0){
+		}
+
+		void build(const Gradient_boosting& m){
+			build(m.trees(),m.base(),1.0);
+		}
+
+		void build(const Random_forest& m){
+			build(m.trees(),0.0,m.trees().empty() ? 1.0 : 1.0/m.trees().size());
+		}
+
+		/** A prediction is base + scale * (sum of the tree outputs) */
+		void build(const vector<Regression_tree>& trees, double base, double scale){
+			base_ = base;
+			scale_ = scale;
+			nodes_.clear();
+			values_.clear();
+			size_type groups = (trees.size()+group-1)/group;
+			roots_.assign((size_t)groups*group,0);
+			depths_.assign(groups,0);
+			vector<unsigned> level, next;
+			for (size_type t = 0; t < trees.size(); ++t){
+				const vector<tree_node>& src = trees[t].nodes_;
+				roots_[t] = nodes_.size();
+				level.assign(1,0);
+				unsigned depth = 0;
+				while (!level.empty()){
+					unsigned first = nodes_.size();
+					unsigned child = first + level.size();
+					next.clear();
+					for (size_type k = 0; k < level.size(); ++k){
+						const tree_node& s = src[level[k]];
+						fixed_node f;
+						if (s.feature_ < 0){
+							f.threshold_ = numeric_limits<double>::infinity();
+							f.feature_ = 0;
+							f.child_ = first + k;
+						}else{
+							assert((unsigned) s.feature_ < N);
+							f.threshold_ = s.threshold_;
+							f.feature_ = s.feature_;
+							f.child_ = child;
+							child += 2;
+							next.push_back(s.left_);
+							next.push_back(s.right_);
+						}
+						nodes_.push_back(f);
+						values_.push_back(s.value_);
+					}
+					if (!next.empty())
+						++depth;
+					level.swap(next);
+				}
+				if (depth > depths_[t/group])
+					depths_[t/group] = depth;
+			}
+			// a missing tree of the last group is one leaf of value 0
+			for (size_type t = trees.size(); t < roots_.size(); ++t){
+				fixed_node f;
+				f.threshold_ = numeric_limits<double>::infinity();
+				f.feature_ = 0;
+				f.child_ = nodes_.size();
+				roots_[t] = nodes_.size();
+				nodes_.push_back(f);
+				values_.push_back(0.0);
+			}
+		}
+
+		double predict(const double* x) const{
+			if (depths_.empty())
+				return base_;	//no trees
+			const fixed_node* nodes = &nodes_[0];
+			const double* values = &values_[0];
+			double acc = 0.0;
+			for (size_type g = 0; g < depths_.size(); ++g){
+				const unsigned* r = &roots_[(size_t)g*group];
+				unsigned k0 = r[0], k1 = r[1], k2 = r[2], k3 = r[3];
+				for (unsigned s = depths_[g]; s > 0; --s){
+					k0 = nodes[k0].child_ + (x[nodes[k0].feature_] > nodes[k0].threshold_);
+					k1 = nodes[k1].child_ + (x[nodes[k1].feature_] > nodes[k1].threshold_);
+					k2 = nodes[k2].child_ + (x[nodes[k2].feature_] > nodes[k2].threshold_);
+					k3 = nodes[k3].child_ + (x[nodes[k3].feature_] > nodes[k3].threshold_);
+				}
+				acc += (values[k0] + values[k1]) + (values[k2] + values[k3]);
+			}
+			return base_ + scale_*acc;
+		}
+
+	private:
+		/** 16 bytes, as flat_node in Flat_ensemble */
+		struct fixed_node{
+			double threshold_;
+			unsigned feature_;
+			unsigned child_;
+		};
+
+		vector<fixed_node> nodes_;
+		vector<double> values_;
+		vector<unsigned> roots_;	//group trees per group, padded with leaves
+		vector<unsigned> depths_;	//one per group
+		double base_;
+		double scale_;
+};
+
+/** @class 	Fixed_scaler
+ * @brief 	A fitted Standardize stage (Pipeline.hpp) over N features, applied in place
+ */
+template <unsigned N>
+struct Fixed_scaler{
+	public:
+		typedef unsigned size_type;
+
+		Fixed_scaler(){
+			for (size_type j = 0; j < N; ++j){
+				mean_[j] = 0.0;
+				inv_sd_[j] = 1.0;
+			}
+		}
+
+		void build(const Standardize& s){
+			assert(s.mean().size() == N);
+			for (size_type j = 0; j < N; ++j){
+				mean_[j] = s.mean()[j];
+				inv_sd_[j] = s.inv_sd()[j];
+			}
+		}
+
+		void apply(FixedFeatures<N>& x) const{
+			for (size_type j = 0; j < N; ++j)
+				x[j] = (x[j]-mean_[j])*inv_sd_[j];
+		}
+
+	private:
+		double mean_[N];
+		double inv_sd_[N];
+};
+
+/** The fixed-dimension form of each model */
+template <typename M, unsigned N>
+struct fixed_model;
+
+/** @class 	Fixed_standardized
+ * @brief 	A fitted Pipeline_model<Pipeline<Standardize>, M> over N features
+ *
+ * The row is copied into a FixedFeatures, scaled in place by a Fixed_scaler and
+ * handed to the fixed form of M, so scaling and model are both unrolled and a single
+ * row never touches the heap or the pipeline's scratch rows.
+ */
+template <unsigned N, typename M>
+struct Fixed_standardized{
+	public:
+		typedef unsigned size_type;
+		typedef typename fixed_model<M,N>::type model_type;
+
+		void build(const Pipeline_model<Pipeline<Standardize>,M>& m){
+			scaler_.build(m.pipeline().stages().head_);
+			model_.build(m.model());
+		}
+
+		double predict(const double* x) const{
+			FixedFeatures<N> f(x);
+			scaler_.apply(f);
+			return model_.predict(f.data());
+		}
+
+	private:
+		Fixed_scaler<N> scaler_;
+		model_type model_;
+};
+
+template <typename M, unsigned N>
+struct fixed_model<Pipeline_model<Pipeline<Standardize>,M>,N>{
+	typedef Fixed_standardized<N,M> type;
+};
+
+template <unsigned N>
+struct fixed_model<Linear_regression,N>{
+	typedef Fixed_linear<N> type;
+};
+
+template <unsigned N>
+struct fixed_model<Gradient_boosting,N>{
+	typedef Fixed_trees<N> type;
+};
+
+template <unsigned N>
+struct fixed_model<Random_forest,N>{
+	typedef Fixed_trees<N> type;
+};
+
+/** @class 	Fixed
+ * @brief 	A model M with a fast path for exactly N features
+ *
+ * After fit() on N features the model is also compiled to its fixed form, and
+ * predict() uses it whenever it is called with d == N; any other width (or a model
+ * fit on another width) takes M's own dynamic path. It is a drop-in Manager slot,
+ * e.g. Manager<Fixed<8, Linear_regression>, Gradient_boosting>, and also predicts a
+ * single FixedFeatures<N> without touching the heap. A model behind a standardizing
+ * pipeline, Fixed<8, Pipeline_model<Pipeline<Standardize>, Linear_regression> >,
+ * gets the scaling unrolled into the same fixed path (Fixed_standardized).
+ * Call compile() after changing the parameters of M in place.
+ */
+template <unsigned N, typename M>
+struct Fixed: public M{
+	public:
+		typedef typename M::size_type size_type;
+		typedef typename fixed_model<M,N>::type fixed_type;
+		typedef FixedFeatures<N> features_type;
+
+		/** Takes the constructor arguments of M */
+		using M::M;
+
+		Fixed():M(),f_(),compiled_(false){
+		}
+
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			M::fit(x,n,d,y);
+			compile();
+		}
+
+		/** Rebuilds the fixed form from M, if M has N features */
+		void compile(){
+			compiled_ = M::dims() == N;
+			if (compiled_)
+				f_.build(*this);
+		}
+
+		/** True if predict() can take the fixed path */
+		bool compiled() const{
+			return compiled_;
+		}
+
+		double predict(const features_type& x) const{
+			if (compiled_)
+				return f_.predict(x.data());
+			double y;
+			M::predict(x.data(),1,N,&y);
+			return y;
+		}
+
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			if (!compiled_ || d != N){
+				M::predict(x,n,d,y_hat);
+				return;
+			}
+			for (size_type i = 0; i < n; ++i)
+				y_hat[i] = f_.predict(x+(size_t)i*N);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (M::dims() == 0)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		bool operator==(const Fixed& r) const{
+			return M::operator==(r) && (compiled_==r.compiled_);
+		}
+
+		bool operator!=(const Fixed& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+		fixed_type f_;
+		bool compiled_ = false;
+};
+
+#endif
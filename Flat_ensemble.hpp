@@ -0,0 +1,139 @@
+#ifndef CS207_FLAT_ENSEMBLE_HPP
+#define CS207_FLAT_ENSEMBLE_HPP
+
+/** @file Flat_ensemble.hpp
+ * @brief Compiled, pointer-free layout of a tree ensemble for batched inference
+ */
+
+#include "Tree.hpp"
+#include <vector>
+#include <limits>
+#include <cassert>
+using namespace std;
+
+/** @class 	Flat_ensemble
+ * @brief 	The trees of an ensemble flattened into one breadth-first node array
+ *
+ * Each tree is laid out level by level with the two children of a node next to each
+ * other, so a step is child_ + (x[feature_] > threshold_) with no branch on the
+ * comparison. A leaf is its own child with threshold +inf, so rows that reach a leaf
+ * early stay there while the others finish, and every row of a tree takes exactly
+ * depth(tree) steps.
+ *
+ * predict() pushes a block of rows through one tree at a time: the nodes of that tree
+ * stay in cache for the whole block and the steps of different rows are independent.
+ * Values must not be NaN (as for Binned_features).
+ */
+class Flat_ensemble{
+	public:
+		typedef unsigned size_type;
+
+		/** Rows pushed through a tree together */
+		enum { block_rows = 64 };
+
+		Flat_ensemble():base_(0.0),scale_(1.0){
+		}
+
+		/** Flattens @a trees; a prediction is base + scale * (sum of the tree outputs) */
+		void build(const vector<Regression_tree>& trees, double base = 0.0, double scale = 1.0){
+			base_ = base;
+			scale_ = scale;
+			nodes_.clear();
+			values_.clear();
+			roots_.assign(trees.size(),0);
+			depths_.assign(trees.size(),0);
+			vector<unsigned> level, next;
+			for (size_type t = 0; t < trees.size(); ++t){
+				const vector<tree_node>& src = trees[t].nodes_;
+				assert(!src.empty());
+				roots_[t] = nodes_.size();
+				level.assign(1,0);
+				unsigned depth = 0;
+				// each level is appended in order, and the children of its nodes right after it
+				while (!level.empty()){
+					unsigned first = nodes_.size();
+					unsigned child = first + level.size();
+					next.clear();
+					for (size_type k = 0; k < level.size(); ++k){
+						const tree_node& s = src[level[k]];
+						flat_node f;
+						if (s.feature_ < 0){
+							f.threshold_ = numeric_limits<double>::infinity();
+							f.feature_ = 0;
+							f.child_ = first + k;
+						}else{
+							f.threshold_ = s.threshold_;
+							f.feature_ = s.feature_;
+							f.child_ = child;
+							child += 2;
+							next.push_back(s.left_);
+							next.push_back(s.right_);
+						}
+						nodes_.push_back(f);
+						values_.push_back(s.value_);
+					}
+					if (!next.empty())
+						++depth;
+					level.swap(next);
+				}
+				depths_[t] = depth;
+			}
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat
+		 * @pre @a d is larger than every feature index the trees split on
+		 */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			unsigned node[block_rows];
+			double acc[block_rows];
+			const flat_node* nodes = nodes_.empty() ? 0 : &nodes_[0];
+			const double* values = values_.empty() ? 0 : &values_[0];
+			for (size_type start = 0; start < n; start += block_rows){
+				size_type b = n-start < (size_type) block_rows ? n-start : (size_type) block_rows;
+				const double* xb = x+(size_t)start*d;
+				for (size_type r = 0; r < b; ++r)
+					acc[r] = 0.0;
+				for (size_type t = 0; t < roots_.size(); ++t){
+					unsigned root = roots_[t];
+					for (size_type r = 0; r < b; ++r)
+						node[r] = root;
+					for (unsigned s = 0; s < depths_[t]; ++s){
+						for (size_type r = 0; r < b; ++r){
+							const flat_node& f = nodes[node[r]];
+							node[r] = f.child_ + (xb[(size_t)r*d+f.feature_] > f.threshold_);
+						}
+					}
+					for (size_type r = 0; r < b; ++r)
+						acc[r] += values[node[r]];
+				}
+				for (size_type r = 0; r < b; ++r)
+					y_hat[start+r] = base_ + scale_*acc[r];
+			}
+		}
+
+		size_type num_trees() const{
+			return roots_.size();
+		}
+
+		size_type num_nodes() const{
+			return nodes_.size();
+		}
+
+	private:
+
+		/** 16 bytes, so four nodes share a cache line */
+		struct flat_node{
+			double threshold_;
+			unsigned feature_;
+			unsigned child_;	//left child; the right one is child_+1
+		};
+
+		vector<flat_node> nodes_;
+		vector<double> values_;
+		vector<unsigned> roots_;
+		vector<unsigned> depths_;
+		double base_;
+		double scale_;
+};
+
+#endif
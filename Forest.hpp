@@ -0,0 +1,188 @@
+#ifndef CS207_FOREST_HPP
+#define CS207_FOREST_HPP
+
+/** @file Forest.hpp
+ * @brief Random forest regression with out-of-bag error
+ */
+
+#include "Tree.hpp"
+#include "Flat_ensemble.hpp"
+#include "Thread_pool.hpp"
+#include "Parallel.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cassert>
+using namespace std;
+
+/** @class 	Random_forest
+ * @brief 	Bagged CART regression trees with the Manager model interface
+ *
+ * fit() bins the features once and shares them read-only between the trees. Each tree
+ * is one task on a Thread_pool: it draws a bootstrap sample as a vector of row indices
+ * (the rows themselves are never copied) and grows a variance-reduction tree on it with
+ * Tree_builder, trying a random subset of the features at every split.
+ *
+ * The rows a tree did not draw are its out-of-bag rows. Averaging, for every row, the
+ * trees that left it out gives an estimate of the test error without a held-out set
+ * or cross validation, see oob_error() and Selector::best_model_oob(). Each tree keeps
+ * one bit per row for its draw until the rows are averaged, in parallel over rows.
+ * predict() runs on the flattened copy of the trees (Flat_ensemble).
+ */
+struct Random_forest{
+	public:
+		typedef unsigned size_type;
+
+		/** Deep trees with small leaves, one tree per thread */
+		static tree_options default_options(){
+			tree_options opt;
+			opt.max_depth_ = 16;
+			opt.min_samples_leaf_ = 5;
+			opt.lambda_ = 0.0;
+			return opt;
+		}
+
+		/** @param[in] num_trees	number of bootstrap trees
+		 *  @param[in] opt	tree growth limits; max_features_ == 0 tries d/3 features per
+		 *			split, and threads_ sizes the pool the trees are built on
+		 *  @param[in] max_bins	bins per feature, at most 256
+		 *  @param[in] seed	the forest is deterministic for a given seed, whatever the threads
+		 */
+		Random_forest(size_type num_trees = 100, tree_options opt = default_options(), size_type max_bins = 256, unsigned seed = 1)
+		  :num_trees_(num_trees),opt_(opt),max_bins_(max_bins),seed_(seed),d_(0),trees_(),oob_error_(0.0),oob_rows_(0),has_fit_(false){
+			assert(num_trees > 0);
+		}
+
+		/** Fits the forest to @a n rows of @a d features and computes the out-of-bag error
+		 * Complexity: O(num_trees*n*(d + depth)/threads)
+		 */
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			assert(n > 0 && d > 0);
+			d_ = d;
+			Binned_features bf;
+			bf.fit(x,n,d,max_bins_,opt_.threads_);
+
+			// g = -y and unit hessians make Tree_builder leaves the mean of their rows
+			vector<double> g(n);
+			for (size_type i = 0; i < n; ++i)
+				g[i] = -y[i];
+			tree_options topt = opt_;
+			topt.threads_ = 1;
+			if (topt.max_features_ == 0)
+				topt.max_features_ = d/3 > 0 ? d/3 : 1;
+
+			trees_.assign(num_trees_,Regression_tree());
+			vector< vector<uint64_t> > in_bag(num_trees_);
+			{
+				Thread_pool pool(opt_.threads_);
+				for (size_type t = 0; t < num_trees_; ++t){
+					pool.submit([&,t](){
+						grow_tree(t,bf,topt,&g[0],in_bag[t]);
+					});
+				}
+				pool.wait();
+			}
+
+			// every row sums the trees that left it out in tree order, so the error does
+			// not depend on which tree finished first
+			vector<double> err(n);
+			vector<unsigned char> has_oob(n);
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned){
+				for (size_t i = lo; i < hi; ++i){
+					double sum = 0.0;
+					size_type count = 0;
+					for (size_type t = 0; t < num_trees_; ++t){
+						if ((in_bag[t][i/64] >> (i%64)) & 1)
+							continue;
+						sum += trees_[t].predict(x+i*d);
+						++count;
+					}
+					has_oob[i] = count > 0;
+					err[i] = count > 0 ? (sum/count - y[i])*(sum/count - y[i]) : 0.0;
+				}
+			},opt_.threads_);
+
+			oob_error_ = 0.0;
+			oob_rows_ = 0;
+			for (size_type i = 0; i < n; ++i){
+				oob_error_ += err[i];
+				oob_rows_ += has_oob[i];
+			}
+			if (oob_rows_ > 0)
+				oob_error_ /= oob_rows_;
+			flat_.build(trees_,0.0,1.0/trees_.size());
+			has_fit_ = true;
+		}
+
+		/** Writes the mean prediction of the trees for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(has_fit_ && d == d_);
+			flat_.predict(x,n,d,y_hat);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (!has_fit_)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		/** Mean squared out-of-bag error of the last fit() */
+		double oob_error() const{
+			return oob_error_;
+		}
+
+		/** Training rows left out by at least one tree (all of them unless the forest is tiny) */
+		size_type oob_rows() const{
+			return oob_rows_;
+		}
+
+		const vector<Regression_tree>& trees() const{
+			return trees_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+		bool operator==(const Random_forest& r) const{
+			return (has_fit_==r.has_fit_) && (trees_==r.trees_);
+		}
+
+		bool operator!=(const Random_forest& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+
+		/** Grows tree @a t on its own bootstrap sample and marks the rows drawn in @a in_bag (one bit per row) */
+		void grow_tree(size_type t, const Binned_features& bf, const tree_options& topt, const double* g, vector<uint64_t>& in_bag){
+			size_type n = bf.rows();
+			mt19937 rng(seed_ + 0x9e3779b9u*(t+1));
+			uniform_int_distribution<size_type> draw(0,n-1);
+			vector<size_type> idx(n);
+			in_bag.assign(((size_t)n+63)/64,0);
+			for (size_type k = 0; k < n; ++k){
+				idx[k] = draw(rng);
+				in_bag[idx[k]/64] |= (uint64_t) 1 << (idx[k]%64);
+			}
+			Tree_builder builder(bf,topt);
+			builder.build(trees_[t],&idx[0],n,g,0,&rng);
+		}
+
+		size_type num_trees_;
+		tree_options opt_;
+		size_type max_bins_;
+		unsigned seed_;
+		size_type d_;
+		vector<Regression_tree> trees_;
+		Flat_ensemble flat_;
+		double oob_error_;
+		size_type oob_rows_;
+		bool has_fit_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef CS207_GBT_HPP
+#define CS207_GBT_HPP
+
+/** @file Gbt.hpp
+ * @brief Histogram-based gradient boosted regression trees
+ */
+
+#include "Tree.hpp"
+#include "Flat_ensemble.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <cassert>
+using namespace std;
+
+/** @class 	Gradient_boosting
+ * @brief 	Gradient boosted trees on squared loss with the Manager model interface
+ *
+ * fit() bins the features once (Binned_features) and grows every tree on the binned
+ * rows with Tree_builder, so split finding costs O(bins) per feature instead of a sort.
+ * Leaf values are shrunk by the learning rate. The training predictions are updated
+ * from the leaf row ranges the builder reports, without traversing the new tree.
+ * predict() runs on the flattened copy of the trees (Flat_ensemble).
+ */
+struct Gradient_boosting{
+	public:
+		typedef unsigned size_type;
+
+		/** @param[in] num_trees	boosting rounds
+		 *  @param[in] rate	learning rate (shrinkage)
+		 *  @param[in] opt	tree growth limits and threads
+		 *  @param[in] max_bins	bins per feature, at most 256
+		 */
+		Gradient_boosting(size_type num_trees = 100, double rate = 0.1, tree_options opt = tree_options(), size_type max_bins = 256)
+		  :num_trees_(num_trees),rate_(rate),opt_(opt),max_bins_(max_bins),d_(0),base_(0.0),trees_(),has_fit_(false){
+		}
+
+		/** Fits @a num_trees trees to @a n rows of @a d features
+		 * Complexity: O(n*d) per tree level plus O(d*bins) per node
+		 */
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			assert(n > 0 && d > 0);
+			d_ = d;
+			trees_.clear();
+			Binned_features bf;
+			bf.fit(x,n,d,max_bins_,opt_.threads_);
+
+			base_ = 0.0;
+			for (size_type i = 0; i < n; ++i)
+				base_ += y[i];
+			base_ /= n;
+			vector<double> pred(n,base_), g(n);
+			vector<size_type> idx(n);
+			for (size_type i = 0; i < n; ++i)
+				idx[i] = i;
+
+			Tree_builder builder(bf,opt_);
+			trees_.resize(num_trees_);
+			for (size_type t = 0; t < num_trees_; ++t){
+				for (size_type i = 0; i < n; ++i)
+					g[i] = pred[i]-y[i];
+				Regression_tree& tree = trees_[t];
+				builder.build(tree,&idx[0],n,&g[0],0);
+				for (size_type k = 0; k < tree.nodes_.size(); ++k)
+					tree.nodes_[k].value_ *= rate_;
+				const vector<Tree_builder::leaf_range>& leaves = builder.leaves();
+				for (size_type l = 0; l < leaves.size(); ++l){
+					double v = tree.nodes_[leaves[l].node_].value_;
+					for (size_type k = leaves[l].begin_; k < leaves[l].end_; ++k)
+						pred[idx[k]] += v;
+				}
+			}
+			flat_.build(trees_,base_);
+			has_fit_ = true;
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(has_fit_ && d == d_);
+			flat_.predict(x,n,d,y_hat);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (!has_fit_)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		/** The fitted trees; a prediction is base() plus the sum of their outputs */
+		const vector<Regression_tree>& trees() const{
+			return trees_;
+		}
+
+		double base() const{
+			return base_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+		bool operator==(const Gradient_boosting& r) const{
+			return (has_fit_==r.has_fit_) && (base_==r.base_) && (trees_==r.trees_);
+		}
+
+		bool operator!=(const Gradient_boosting& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+		size_type num_trees_;
+		double rate_;
+		tree_options opt_;
+		size_type max_bins_;
+		size_type d_;
+		double base_;
+		vector<Regression_tree> trees_;
+		Flat_ensemble flat_;
+		bool has_fit_;
+};
+
+#endif
@@ -4,10 +4,10 @@
 
 #include "CS207/Util.hpp"
 #include "Point.hpp"
+#include "Adjacency.hpp"
 #include <algorithm>
 #include <vector>
 #include <cassert>
-#include <map>
 //#include "omp.h"
 using namespace std;
 
@@ -15,14 +15,28 @@ using namespace std;
 /** @class 	Graph
  * @brief 	A template for 3D undirected graphs
  * @tparam  V	The value type for a node
+ * @tparam  E	The value type for an edge
+ * @tparam  A	The adjacency storage policy (Adjacency.hpp): Sorted_adjacency<> by default,
+ *		Hash_adjacency for constant-time edge tests on graphs that keep changing,
+ *		Csr_adjacency for graphs built once and then traversed, Map_adjacency for the tree map
  *
  * A Graph is a set of Nodes and Edges s.t. G = <N,E> for N = <n_0,n_1,...n_m-1> and E = <e_0, e_1, .. e_d-1> where @a m == the number of valid nodes and @a d == the number of valid edges
  * A Node is a proxy for the abstract representation of the data passed into to it
  * An Edge connects two nodes s.t. <N_i,N_j> == <N_j,N_i> for all i,j in the set of valid Nodes for this Graph subject to !(i==j)
  * Users can add and retrieve nodes and edges. There is at most one edge between any pair of distinct nodes.
+ *
+ * Removing an edge is O(1) plus erasing both directions from the adjacency policy:
+ * O(D) for Sorted_adjacency and Csr_adjacency, O(1) for Hash_adjacency, O(log D) for
+ * Map_adjacency, D the degree of the endpoints. Removing a node removes its edges. Removal
+ * leaves a tombstone at the removed index instead of renumbering, so the indexes of the
+ * other nodes and edges stay put and the iterators skip the holes. compact() renumbers
+ * the survivors to [0, num_nodes()) and [0, num_edges()) in one linear pass, e.g. after
+ * a bulk removal. Storage of removed nodes and edges is reused by later additions;
+ * Node and Edge handles carry a generation, so valid() detects a handle to an element
+ * that was removed even if its storage was reused since.
  * V describes a user-defined abstract representation of a node (i.e. Mass, Temperature, Weight).
  */
-template <typename V, typename E>
+template <typename V, typename E, typename A = Sorted_adjacency<> >
 class Graph {
  private:
    struct internal_node;
@@ -37,6 +51,9 @@ class Graph {
   /** Type of this graph. */
   typedef Graph graph_type;
 
+  /** Adjacency storage policy. */
+  typedef A adjacency_type;
+
   /** Predeclaration of Node type. */
   class Node;
 
@@ -68,7 +85,7 @@ class Graph {
   // CONSTRUCTOR AND DESTRUCTOR ----------------------
 
   /** Construct an empty graph. */
-  Graph(): nodes_(), edges_()  {
+  Graph(): nodes_(), i2u_(), free_nodes_(), edges_(), i2e_(), free_edges_(), num_nodes_(0), num_edges_(0) {
   }
 
   /** Default destructor */
@@ -86,16 +103,18 @@ class Graph {
     friend class Graph;
     Graph* graph_;
     size_type uid_;
+    size_type gen_;
 
     internal_node& fetch() const{
+	 assert(valid());
 	 return graph_->nodes_[uid_];
     }
-    Node(const Graph* graph,size_type uid):graph_(const_cast<Graph*>(graph)), uid_(uid){
+    Node(const Graph* graph,size_type uid):graph_(const_cast<Graph*>(graph)), uid_(uid), gen_(graph->nodes_[uid].gen_){
     };
 
    public:
     /** Returns an invalid node. */
-    Node() {
+    Node(): graph_(0), uid_(0), gen_(0) {
     }
 
     /** Returns this node's position. */
@@ -110,11 +129,17 @@ class Graph {
     }
 
     /** Returns this node's index
-	@post	[0, graph_size) */
+	@post	[0, node_index_bound()), and [0, graph_size) after compact() */
     size_type index() const {
       return fetch().index_;
     }
 
+    /** Returns true if this node has not been removed from its graph */
+    bool valid() const {
+      return graph_ != 0 && uid_ < graph_->nodes_.size() && graph_->nodes_[uid_].gen_ == gen_
+          && graph_->nodes_[uid_].index_ != adjacency::npos;
+    }
+
     /** Returns the value of this node */
     node_value_type& value(){
       return fetch().value_;
@@ -127,13 +152,13 @@ class Graph {
 
     /** Returns the number of edges connected to this node */
     size_type degree() const{
-        return graph_->adjmap_[uid_].size();
+        return graph_->adj_.degree(uid_);
     }
 
     /** Returns the equality of this node to another node @a n
 	@post graph==n.graph && uid==n.uid */
     bool operator==(const Node& n) const{
-        return this->uid_== n.uid_ && graph_==n.graph_;
+        return this->uid_== n.uid_ && gen_==n.gen_ && graph_==n.graph_;
     }
 
     /** Returns true if this node has a smaller uid than node @a n */
@@ -143,12 +168,12 @@ class Graph {
 
     /** Returns an iterator to the first incident edge */
     incident_iterator edge_begin() const{
-        return incident_iterator(this->graph_, *this, 0);
+        return incident_iterator(this->graph_, graph_->adj_.begin(uid_));
     }
 
     /** Returns an iterator to the last incident edge */
     incident_iterator edge_end() const{
-        return incident_iterator(this->graph_, *this, graph_->adjmap_[uid_].size());
+        return incident_iterator(this->graph_, graph_->adj_.end(uid_));
     }
 
   };
@@ -158,6 +183,13 @@ class Graph {
    * Complexity: O(1).
    */
   size_type size() const {
+    return num_nodes_;
+  }
+
+  /** One past the largest node index: size() plus the tombstones left by remove_node()
+   * until the next compact().
+   */
+  size_type node_index_bound() const {
     return i2u_.size();
   }
 
@@ -169,28 +201,39 @@ class Graph {
   /** Add a node to the graph, returning the added node.
    * @param[in] position The new node's position
    * @post new size() == old size() + 1
-   * @post result_node.index() == old size()
+   * @post result_node.index() == old node_index_bound()
    * @post result_node.value() == val
    * Complexity: O(1) amortized operations.
    */
   Node add_node(const Point& position,const node_value_type & val = node_value_type ()) {
-    internal_node newNode{i2u_.size(),position,val};
-    nodes_.push_back(newNode);
-    i2u_.push_back(nodes_.size()-1);
-	 map<size_type, size_type> tmp_map;
-	 tmp_map.clear();
-	 adjmap_.push_back(tmp_map);
-    return Node(this, nodes_.size()-1);
+    size_type uid;
+    if (free_nodes_.empty()){
+      uid = nodes_.size();
+      internal_node newNode{(size_type) i2u_.size(),position,val,0};
+      nodes_.push_back(newNode);
+      adj_.add_node();
+    }else{
+      // reuse the storage of a removed node; its generation was bumped on removal
+      uid = free_nodes_.back();
+      free_nodes_.pop_back();
+      internal_node& n = nodes_[uid];
+      n.index_ = i2u_.size();
+      n.point_ = position;
+      n.value_ = val;
+    }
+    i2u_.push_back(uid);
+    ++num_nodes_;
+    return Node(this, uid);
   }
 
   /** Return the node with index @a i.
-   * @pre 0 <= @a i < size()
+   * @pre 0 <= @a i < node_index_bound() and node @a i has not been removed
    * @post result_node.index() == i
    *
    * Complexity: O(1).
    */
   Node node(size_type i) const {
-    assert(i < size());
+    assert(i < node_index_bound() && i2u_[i] != adjacency::npos);
     return Node(this,i2u_[i]);
 
   }
@@ -201,22 +244,55 @@ class Graph {
    * @post new size() == old size() - 1
    *
    * Can invalidate outstanding iterators. @a n becomes invalid, as do any
-   * other Node objects equal to @a n. All other Node objects remain valid.
+   * other Node objects equal to @a n. All other Node objects remain valid,
+   * and so do their indexes: index n.index() becomes a tombstone until compact().
    *
-   * Complexity: Polynomial in size().
+   * Complexity: n.degree() edge removals, each as remove_edge(Edge) for the policy
+   * (see the class comment): O(n.degree() * D) for Sorted_adjacency and Csr_adjacency,
+   * D the largest degree of a neighbor, O(n.degree()) for Hash_adjacency. With
+   * Csr_adjacency the first removal after an addition also packs, O(N + E), once.
    */
   void remove_node(const Node& n) {
-    auto it  = n.edge_begin();
-    while (it != n.edge_end()){
-       	remove_edge(*it);
-    }
-
-    auto it_end = i2u_.end();
-    for (auto it = i2u_.begin()+n.index()+1; it < it_end; ++it )
-	--nodes_[(*it)].index_;
+    assert(n.valid() && n.graph_ == this);
+    while (n.degree() > 0){
+       	remove_edge(*n.edge_begin());
+    }
+
+    internal_node& in = nodes_[n.uid_];
+    i2u_[in.index_] = adjacency::npos;
+    in.index_ = adjacency::npos;
+    in.value_ = node_value_type();
+    ++in.gen_;
+    free_nodes_.push_back(n.uid_);
+    adj_.clear(n.uid_);
+    --num_nodes_;
+  }
 
-    i2u_.erase (i2u_.begin()+n.index());
-    this->adjmap_.erase(adjmap_.begin()+n.index());
+  /** Renumber the nodes and edges to [0, num_nodes()) and [0, num_edges()),
+   * dropping the tombstones left by removals. Relative order is kept.
+   * @post node_index_bound() == num_nodes() && edge_index_bound() == num_edges()
+   *
+   * Invalidates node and edge indexes and iterators; Node and Edge objects remain valid.
+   *
+   * Complexity: O(node_index_bound() + edge_index_bound()), one pass over each index.
+   */
+  void compact() {
+    size_type k = 0;
+    for (size_type i = 0; i < i2u_.size(); ++i){
+      if (i2u_[i] == adjacency::npos)
+	continue;
+      nodes_[i2u_[i]].index_ = k;
+      i2u_[k++] = i2u_[i];
+    }
+    i2u_.resize(k);
+    k = 0;
+    for (size_type i = 0; i < i2e_.size(); ++i){
+      if (i2e_[i] == adjacency::npos)
+	continue;
+      edges_[i2e_[i]].index_ = k;
+      i2e_[k++] = i2e_[i];
+    }
+    i2e_.resize(k);
   }
 
   /** Remove all nodes and edges from this graph.
@@ -229,7 +305,11 @@ class Graph {
     edges_.clear();
     i2u_.clear();
     i2e_.clear();
-    adjmap_.clear();
+    free_nodes_.clear();
+    free_edges_.clear();
+    num_nodes_ = 0;
+    num_edges_ = 0;
+    adj_.clear();
   }
 
   // EDGES
@@ -245,17 +325,25 @@ class Graph {
     friend class Graph;
     Graph* graph_;
     size_type edgeId_;
+    size_type gen_;
 
     internal_edge& fetch() const{
+	assert(valid());
 	return graph_->edges_[edgeId_];
     }
 
-    Edge(const Graph* graph, size_type edgeId):graph_(const_cast<Graph*>(graph)), edgeId_(edgeId){
+    Edge(const Graph* graph, size_type edgeId):graph_(const_cast<Graph*>(graph)), edgeId_(edgeId), gen_(graph->edges_[edgeId].gen_){
     };
 
    public:
     /** Construct an invalid Edge. */
-    Edge() {
+    Edge(): graph_(0), edgeId_(0), gen_(0) {
+    }
+
+    /** Returns true if this edge has not been removed from its graph */
+    bool valid() const{
+      return graph_ != 0 && edgeId_ < graph_->edges_.size() && graph_->edges_[edgeId_].gen_ == gen_
+          && graph_->edges_[edgeId_].index_ != adjacency::npos;
     }
 
     /** Returns a node of this Edge */
@@ -306,16 +394,23 @@ class Graph {
    * Complexity: O(1)
    */
   size_type num_edges() const {
+    return num_edges_;
+  }
+
+  /** One past the largest edge index: num_edges() plus the tombstones left by
+   * remove_edge() until the next compact().
+   */
+  size_type edge_index_bound() const {
     return i2e_.size();
   }
 
   /** Returns the edge with index @a i.
-   * @pre 0 <= @a i < num_edges()
+   * @pre 0 <= @a i < edge_index_bound() and edge @a i has not been removed
    *
    * Complexity: O(1)
    */
   Edge edge(size_type i) const {
-    assert(i < num_edges());
+    assert(i < edge_index_bound() && i2e_[i] != adjacency::npos);
     return Edge(this, i2e_[i]);
   }
 
@@ -324,10 +419,10 @@ class Graph {
    * @return true if, for some @a i, edge(@a i) connects @a a and @a b.
    *
    * Complexity: No more than O(num_nodes() + num_edges()), hopefully less
-   * Currently O(log(D))
+   * O(log(D)) for Sorted_adjacency, Csr_adjacency and Map_adjacency, O(1) expected for Hash_adjacency
    */
   bool has_edge(const Node& a, const Node& b) const {
-	return adjmap_[a.uid_].count(b.uid_) > 0;
+	return adj_.find(a.uid_,b.uid_) != adjacency::npos;
   }
 
   /** Add an edge to the graph, or return the current edge if it already exists.
@@ -343,18 +438,30 @@ class Graph {
    * Complexity: No more than O(num_nodes() + num_edges()), hopefully less
    */
   Edge add_edge(const Node& a, const Node& b, const edge_value_type& val = edge_value_type ()) {
-    if (has_edge(a,b)){
-	return Edge(this,adjmap_[a.uid_][b.uid_]);
+    size_type found = adj_.find(a.uid_,b.uid_);
+    if (found != adjacency::npos){
+	return Edge(this,found);
     }
 
     size_type idx = i2e_.size();
-    size_type uid = edges_.size();
-
-    internal_edge newEdge{a.index(),b.index(),idx,val};
-    edges_.push_back(newEdge);
+    size_type uid;
+    if (free_edges_.empty()){
+      uid = edges_.size();
+      internal_edge newEdge{a.uid_,b.uid_,idx,val,0};
+      edges_.push_back(newEdge);
+    }else{
+      uid = free_edges_.back();
+      free_edges_.pop_back();
+      internal_edge& e = edges_[uid];
+      e.node_a_ = a.uid_;
+      e.node_b_ = b.uid_;
+      e.index_ = idx;
+      e.value_ = val;
+    }
     i2e_.push_back(uid);
-    adjmap_[a.uid_][b.uid_] = uid;
-    adjmap_[b.uid_][a.uid_] = uid;
+    ++num_edges_;
+    adj_.insert(a.uid_,b.uid_,uid);
+    adj_.insert(b.uid_,a.uid_,uid);
     return Edge(this,uid);
   }
 
@@ -369,15 +476,12 @@ class Graph {
    * implementation can assume that @a e is definitely an edge of the graph.
    * This might allow a faster implementation.
    *
-   * Complexity: No more than O(num_nodes() + num_edges()), currently O(num_edges())
+   * Complexity: one adjacency lookup plus remove_edge(Edge)
    */
   size_type remove_edge(const Node& a, const Node& b) {
-    if (has_edge(a,b)){
-        size_type euid = adjmap_[a.uid_][b.uid_];
-        i2e_.erase(Edge(this,euid).index());
-        adjmap_[a.uid_].erase(b.uid_);
-        adjmap_[b.uid_].erase(a.uid_);
-        return 1;
+    size_type euid = adj_.find(a.uid_,b.uid_);
+    if (euid != adjacency::npos){
+        return remove_edge(Edge(this,euid));
     }else{
 	return 0;
     }
@@ -394,17 +498,23 @@ class Graph {
    * implementation can assume that @a e is definitely an edge of the graph.
    * This might allow a faster implementation.
    *
-   * Can invalidate edge indexes -- in other words, old edge(@a i) might not
-   * equal new edge(@a i). Can invalidate all edge and incident iterators.
-   * Invalidates any edges equal to Edge(@a a, @a b). Must not invalidate
-   * other outstanding Edge objects.
+   * Does not renumber the other edges: index e.index() becomes a tombstone until
+   * compact(). Can invalidate incident iterators. Invalidates any edges equal to
+   * Edge(@a a, @a b). Must not invalidate other outstanding Edge objects.
    *
-   * Complexity: No more than O(num_nodes() + num_edges()), hopefully less
+   * Complexity: O(1) plus erasing both directions from the adjacency policy
    */
   size_type remove_edge(const Edge& e) {
-    i2e_.erase(i2e_.begin()+e.index());
-    adjmap_[e.node1().uid_].erase(e.node2().uid_);
-    adjmap_[e.node2().uid_].erase(e.node1().uid_);
+    assert(e.valid() && e.graph_ == this);
+    internal_edge& ie = edges_[e.edgeId_];
+    adj_.erase(ie.node_a_,ie.node_b_);
+    adj_.erase(ie.node_b_,ie.node_a_);
+    i2e_[ie.index_] = adjacency::npos;
+    ie.index_ = adjacency::npos;
+    ie.value_ = edge_value_type();
+    ++ie.gen_;
+    free_edges_.push_back(e.edgeId_);
+    --num_edges_;
     return 1;
   }
 
@@ -436,15 +546,18 @@ class Graph {
         return it;
     }
 
-    /** Increments the node_iterator and returns a node_iterator */
+    /** Increments the node_iterator past any tombstones and returns a node_iterator */
     node_iterator& operator++(){
         nIteratorId_++;
+        skip();
         return *this;
     }
 
-    /** Decrements the iterator */
+    /** Decrements the iterator to the previous live node */
     node_iterator& operator--(){
-        --nIteratorId_++;
+        do{
+          --nIteratorId_;
+        }while (graph_->i2u_[nIteratorId_] == adjacency::npos);
         return *this;
     }
 
@@ -471,7 +584,14 @@ class Graph {
     Graph* graph_;
     size_type nIteratorId_;
     node_iterator(const Graph* graph,size_type nIteratorId):graph_(const_cast<Graph*>(graph)), nIteratorId_(nIteratorId){
+        skip();
     };
+
+    /** Moves forward to the next live index, or to the end */
+    void skip(){
+        while (nIteratorId_ < graph_->i2u_.size() && graph_->i2u_[nIteratorId_] == adjacency::npos)
+          ++nIteratorId_;
+    }
   };
 
   /** Returns an iterator to the first node in the graph */
@@ -481,7 +601,7 @@ class Graph {
 
   /** Returns an iterator to one past the last node in the graph*/
   node_iterator node_end() const{
-      return node_iterator(this, size());
+      return node_iterator(this, node_index_bound());
   }
 
   /** @class Graph::edge_iterator
@@ -509,27 +629,30 @@ class Graph {
         return Edge(graph_,graph_->i2e_[eIteratorId_]);
     }
 
-    /** Increments the position of this iterator and retursn an edge_iterator option */
+    /** Increments the position of this iterator past any tombstones and retursn an edge_iterator option */
     edge_iterator& operator++(){
         eIteratorId_++;
+        skip();
         return *this;
     }
 
-    /** Decrements the iterator */
+    /** Decrements the iterator to the previous live edge */
     edge_iterator& operator--(){
-        --eIteratorId_++;
+        do{
+          --eIteratorId_;
+        }while (graph_->i2e_[eIteratorId_] == adjacency::npos);
         return *this;
     }
 
     /** Accesses the iterator at a random location */
     edge_iterator& operator-(edge_iterator& a){
-        eIteratorId_= eIteratorId_ - a.ieIteratorId_;
+        eIteratorId_= eIteratorId_ - a.eIteratorId_;
         return *this;
     }
 
     /** Accesses the iterator at a random location */
     edge_iterator& operator+(edge_iterator& a){
-        eIteratorId_= eIteratorId_ + a.ieIteratorId_;
+        eIteratorId_= eIteratorId_ + a.eIteratorId_;
         return *this;
     }
 
@@ -544,7 +667,15 @@ class Graph {
     Graph* graph_;
     size_type eIteratorId_;
 
-    edge_iterator(const Graph* graph,size_type eIteratorId):graph_(const_cast<Graph*>(graph)), eIteratorId_(eIteratorId){};
+    edge_iterator(const Graph* graph,size_type eIteratorId):graph_(const_cast<Graph*>(graph)), eIteratorId_(eIteratorId){
+        skip();
+    };
+
+    /** Moves forward to the next live index, or to the end */
+    void skip(){
+        while (eIteratorId_ < graph_->i2e_.size() && graph_->i2e_[eIteratorId_] == adjacency::npos)
+          ++eIteratorId_;
+    }
   };
 
   /** Returns an edge_iterator to the first edge in the graph*/
@@ -580,56 +711,60 @@ class Graph {
 
     /** Returns the Edge this object points at */
     Edge operator*() const{
-       auto it = graph_->adjmap_[thisnode_].begin();
-       std::advance(it,adjedgeId_);
-       size_type edgeIndex  =  it->second;
-       return graph_->edge(edgeIndex);
+       return Edge(graph_,it_->second);
     }
 
     /** Increments the incident_iterator and returns a reference to this iterator */
     incident_iterator& operator++(){
-        ++adjedgeId_;
+        ++it_;
         return *this;
     }
 
     /** Tests the equality between this iterator and @a it */
     bool operator==(const incident_iterator& it) const{
-        return (this->adjedgeId_ == it.adjedgeId_ && this->thisnode_ == it.thisnode_ && this->graph_ == it.graph_);
+        return (this->it_ == it.it_ && this->graph_ == it.graph_);
     }
 
    private:
     friend class Graph;
     Graph* graph_;
-    size_type adjedgeId_;
-    size_type thisnode_;
+    typename adjacency_type::const_iterator it_;
 
-    incident_iterator(const Graph* graph, Node n, size_type aid):graph_(const_cast<Graph*>(graph)),adjedgeId_(aid),thisnode_(n.uid_){
+    incident_iterator(const Graph* graph, typename adjacency_type::const_iterator it):graph_(const_cast<Graph*>(graph)),it_(it){
     };
 
   };
 
  private:
+     /* index_ == adjacency::npos once removed; gen_ counts removals of this uid */
      struct internal_node {
       size_type index_;
       Point point_;
       node_value_type value_;
+      size_type gen_;
      };
 
      vector<internal_node> nodes_;
-     vector<size_type> i2u_;
+     vector<size_type> i2u_;		//node uid of each index, npos for a tombstone
+     vector<size_type> free_nodes_;	//uids of removed nodes, reused by add_node
 
      struct internal_edge {
       size_type node_a_;
       size_type node_b_;
       size_type index_;
       edge_value_type value_;
+      size_type gen_;
      };
 
      vector<internal_edge> edges_;
-     vector<size_type> i2e_;
+     vector<size_type> i2e_;		//edge uid of each index, npos for a tombstone
+     vector<size_type> free_edges_;	//uids of removed edges, reused by add_edge
+
+     size_type num_nodes_;
+     size_type num_edges_;
      
-     /* adjmap_[node_a_idx][node_b_idx] = edge_idx && O(1) Access Time */
-     vector< map<size_type,size_type> > adjmap_;
+     /* (node_b_uid, edge_uid) pairs of the edges of each node uid */
+     adjacency_type adj_;
 };
 
 
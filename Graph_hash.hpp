@@ -0,0 +1,415 @@
+#ifndef CS207_GRAPH_HASH_HPP
+#define CS207_GRAPH_HASH_HPP
+
+/** @file Graph_hash.hpp
+ * @brief Canonical hashing of labeled graphs (Weisfeiler-Lehman) and a memo of subplan estimates keyed on it
+ */
+
+#include "Graph.hpp"
+#include "Join_enumerator.hpp"
+#include "Hash.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+using namespace std;
+
+/** 128-bit digest of a labeled graph */
+struct graph_digest{
+	uint64_t hi_;
+	uint64_t lo_;
+
+	bool operator==(const graph_digest& d) const{
+		return hi_ == d.hi_ && lo_ == d.lo_;
+	}
+
+	bool operator!=(const graph_digest& d) const{
+		return !((*this)==d);
+	}
+};
+
+/** Label of every node or edge the same: hashes the unlabeled structure */
+struct no_label{
+	template <typename T>
+	uint64_t operator()(const T&) const{
+		return 0;
+	}
+};
+
+/** Label from the bits of a double, e.g. a selectivity; -0.0 and 0.0 alike */
+inline uint64_t double_label(double v){
+	v += 0.0;
+	uint64_t w;
+	memcpy(&w,&v,8);
+	return w;
+}
+
+/** @class 	Wl_hasher
+ * @brief 	Isomorphism-invariant 128-bit digests of labeled graphs by Weisfeiler-Lehman refinement
+ *
+ * Every node starts with (a hash of) its label. Each round replaces a node's label by
+ * a hash of it and the sorted multiset of (edge label, neighbor label) pairs, until
+ * the number of distinct labels stops growing or max_rounds is reached. The digest
+ * hashes the node and edge counts and the sorted multiset of final labels. Labels are
+ * kept in two independently seeded 64-bit lanes, so the digest is 128 bits all the way.
+ *
+ * Nothing depends on node numbering, pointers or the platform, so isomorphic graphs
+ * get equal digests in any run. Non-isomorphic graphs that 1-WL cannot tell apart
+ * (e.g. some regular graphs with identical labels) also collide; join graphs, whose
+ * node labels are tables and filters, rarely are. Cost: O(rounds * (N + E log D)).
+ */
+class Wl_hasher{
+	public:
+		typedef unsigned size_type;
+
+		/** @param[in] max_rounds	refinement rounds at most, 0 for until stable (at most N) */
+		Wl_hasher(size_type max_rounds = 0, uint64_t seed = 0)
+		  :max_rounds_(max_rounds),seed_a_(hash_mix(seed + 0x9e3779b97f4a7c15ULL)),seed_b_(hash_mix(seed + 0x632be59bd9b4e019ULL)){
+		}
+
+		/** Digest of a graph given in compressed sparse rows
+		 * @param[in] n		nodes
+		 * @param[in] label	n node labels
+		 * @param[in] ptr	n+1 offsets: the neighbors of node v are nbr[ptr[v]..ptr[v+1])
+		 * @param[in] nbr	neighbor of each entry; an undirected edge appears from both ends
+		 * @param[in] elabel	edge label of each entry
+		 */
+		graph_digest digest(size_type n, const uint64_t* label, const size_type* ptr, const size_type* nbr, const uint64_t* elabel){
+			cur_.resize(n);
+			next_.resize(n);
+			for (size_type v = 0; v < n; ++v){
+				cur_[v].a_ = hash_mix(hash_round(seed_a_,label[v]));
+				cur_[v].b_ = hash_mix(hash_round(seed_b_,label[v]));
+			}
+			size_type rounds = max_rounds_ ? max_rounds_ : n;
+			size_type classes = distinct(cur_);
+			for (size_type r = 0; r < rounds; ++r){
+				for (size_type v = 0; v < n; ++v){
+					msg_.clear();
+					for (size_type k = ptr[v]; k < ptr[v+1]; ++k){
+						lane m;
+						m.a_ = hash_round(cur_[nbr[k]].a_,elabel[k]);
+						m.b_ = hash_round(cur_[nbr[k]].b_,~elabel[k]);
+						msg_.push_back(m);
+					}
+					sort(msg_.begin(),msg_.end());
+					uint64_t a = hash_round(seed_a_,cur_[v].a_), b = hash_round(seed_b_,cur_[v].b_);
+					for (size_type k = 0; k < msg_.size(); ++k){
+						a = hash_round(a,msg_[k].a_);
+						b = hash_round(b,msg_[k].b_);
+					}
+					next_[v].a_ = hash_mix(a ^ msg_.size());
+					next_[v].b_ = hash_mix(b ^ msg_.size());
+				}
+				cur_.swap(next_);
+				size_type c = distinct(cur_);
+				// refinement only splits classes; no new split means the partition is stable
+				if (c == classes && !max_rounds_)
+					break;
+				classes = c;
+			}
+			sort(cur_.begin(),cur_.end());
+			uint64_t a = hash_round(seed_a_,((uint64_t) n << 32) | ptr[n]);
+			uint64_t b = hash_round(seed_b_,((uint64_t) ptr[n] << 32) | n);
+			for (size_type v = 0; v < n; ++v){
+				a = hash_round(a,cur_[v].a_);
+				b = hash_round(b,cur_[v].b_);
+			}
+			graph_digest d = {hash_mix(b),hash_mix(a)};
+			return d;
+		}
+
+		/** Digest of @a g, labeling node n with nl(n) and edge e with el(e) */
+		template <typename V, typename E, typename A, typename NL, typename EL>
+		graph_digest digest(const Graph<V,E,A>& g, NL nl, EL el){
+			vector<bool> all(g.node_index_bound(),true);
+			return digest(g,all,nl,el);
+		}
+
+		/** Digest of the unlabeled structure of @a g */
+		template <typename V, typename E, typename A>
+		graph_digest digest(const Graph<V,E,A>& g){
+			return digest(g,no_label(),no_label());
+		}
+
+		/** Digest of the subgraph of @a g induced by the nodes whose index has @a mask set
+		 * @pre mask.size() >= g.node_index_bound()
+		 * Complexity: O(nodes of g) to map indexes, then O(size of the subgraph) per round
+		 */
+		template <typename V, typename E, typename A, typename NL, typename EL>
+		graph_digest digest(const Graph<V,E,A>& g, const vector<bool>& mask, NL nl, EL el){
+			assert(mask.size() >= g.node_index_bound());
+			local_.assign(g.node_index_bound(),adjacency::npos);
+			label_.clear();
+			size_type n = 0;
+			for (auto it = g.node_begin(); it != g.node_end(); ++it){
+				if (!mask[(*it).index()])
+					continue;
+				local_[(*it).index()] = n++;
+				label_.push_back(nl(*it));
+			}
+			ptr_.assign(1,0);
+			nbr_.clear();
+			elabel_.clear();
+			for (auto it = g.node_begin(); it != g.node_end(); ++it){
+				if (!mask[(*it).index()])
+					continue;
+				for (auto e = (*it).edge_begin(); e != (*it).edge_end(); ++e){
+					size_type u = (*e).node1() == *it ? (*e).node2().index() : (*e).node1().index();
+					if (local_[u] == adjacency::npos)
+						continue;
+					nbr_.push_back(local_[u]);
+					elabel_.push_back(el(*e));
+				}
+				ptr_.push_back(nbr_.size());
+			}
+			return digest(n,label_.empty() ? 0 : &label_[0],&ptr_[0],nbr_.empty() ? 0 : &nbr_[0],elabel_.empty() ? 0 : &elabel_[0]);
+		}
+
+		/** Digest of the subplan @a s of a join query: relations labeled by table and
+		 * filtered rows, predicates by selectivity
+		 */
+		graph_digest digest(const join_query& q, relation_set s){
+			assert(s != 0);
+			local_.resize(q.n_);
+			label_.clear();
+			size_type n = 0;
+			for (relation_set r = s; r; r &= r-1){
+				size_type v = lowest_relation(r);
+				local_[v] = n++;
+				label_.push_back(hash_round(q.table_[v],double_label(q.log_rows_[v])));
+			}
+			// count, then place, the entries of the predicates inside s
+			ptr_.assign((size_t)n+1,0);
+			for (size_type k = 0; k < q.predicates_.size(); ++k){
+				const join_query::predicate& p = q.predicates_[k];
+				if ((s >> p.a_ & 1) && (s >> p.b_ & 1)){
+					++ptr_[local_[p.a_]+1];
+					++ptr_[local_[p.b_]+1];
+				}
+			}
+			for (size_type v = 0; v < n; ++v)
+				ptr_[v+1] += ptr_[v];
+			nbr_.resize(ptr_[n]);
+			elabel_.resize(ptr_[n]);
+			fill_.assign(ptr_.begin(),ptr_.end()-1);
+			for (size_type k = 0; k < q.predicates_.size(); ++k){
+				const join_query::predicate& p = q.predicates_[k];
+				if ((s >> p.a_ & 1) && (s >> p.b_ & 1)){
+					size_type a = local_[p.a_], b = local_[p.b_];
+					uint64_t l = double_label(p.log_selectivity_);
+					nbr_[fill_[a]] = b;
+					elabel_[fill_[a]++] = l;
+					nbr_[fill_[b]] = a;
+					elabel_[fill_[b]++] = l;
+				}
+			}
+			return digest(n,&label_[0],&ptr_[0],nbr_.empty() ? 0 : &nbr_[0],elabel_.empty() ? 0 : &elabel_[0]);
+		}
+
+	private:
+		struct lane{
+			uint64_t a_;
+			uint64_t b_;
+			bool operator<(const lane& l) const{
+				return a_ < l.a_ || (a_ == l.a_ && b_ < l.b_);
+			}
+			bool operator==(const lane& l) const{
+				return a_ == l.a_ && b_ == l.b_;
+			}
+		};
+
+		/** Number of distinct labels */
+		size_type distinct(const vector<lane>& l){
+			sorted_.assign(l.begin(),l.end());
+			sort(sorted_.begin(),sorted_.end());
+			return unique(sorted_.begin(),sorted_.end()) - sorted_.begin();
+		}
+
+		size_type max_rounds_;
+		uint64_t seed_a_;
+		uint64_t seed_b_;
+		vector<lane> cur_, next_, msg_, sorted_;
+		vector<size_type> local_, ptr_, nbr_, fill_;
+		vector<uint64_t> label_, elabel_;
+};
+
+/** @class 	Estimate_memo
+ * @brief 	Bounded table from graph digests to cardinality estimates
+ *
+ * Set-associative, as Prediction_cache (Cache.hpp): a digest may live in any of the
+ * @a ways slots of its bucket, and a full bucket evicts with CLOCK (second chance),
+ * so a memo kept for a whole workload never holds more than capacity() entries and
+ * keeps the subplans that recur. Entries are tagged with the version of the model that
+ * made them (Manager::version()); sync() with a new version empties the table, so a
+ * refit model never serves stale estimates.
+ */
+class Estimate_memo{
+	public:
+		typedef unsigned size_type;
+
+		/** Slots per bucket */
+		enum { ways = 8 };
+
+		/** Constructs a memo of at least @a capacity entries */
+		Estimate_memo(size_type capacity = 1 << 12):slots_(),hands_(),mask_(0),size_(0),version_(0),hits_(0),misses_(0),evictions_(0){
+			size_type b = 1;
+			while (b*ways < capacity)
+				b <<= 1;
+			slots_.resize((size_t)b*ways);
+			hands_.resize(b);
+			mask_ = b-1;
+		}
+
+		/** Finds the estimate of @a k into @a y
+		 * @return false if there is none
+		 */
+		bool lookup(const graph_digest& k, double& y){
+			slot* s = &slots_[(size_t)(k.lo_ & mask_)*ways];
+			for (size_type w = 0; w < ways; ++w){
+				if (s[w].used_ && s[w].key_ == k){
+					s[w].ref_ = true;
+					y = s[w].value_;
+					++hits_;
+					return true;
+				}
+			}
+			++misses_;
+			return false;
+		}
+
+		/** Sets the estimate of @a k to @a y
+		 * An entry for @a k is overwritten, otherwise an empty slot of its bucket is
+		 * used, otherwise CLOCK evicts the first entry not looked up since the hand
+		 * last passed it.
+		 */
+		void insert(const graph_digest& k, double y){
+			size_t b = k.lo_ & mask_;
+			slot* s = &slots_[b*ways];
+			size_type target = ways;
+			for (size_type w = 0; w < ways; ++w){
+				if (s[w].used_ && s[w].key_ == k){
+					s[w].value_ = y;
+					return;
+				}
+				if (!s[w].used_ && target == ways)
+					target = w;
+			}
+			if (target == ways){
+				unsigned char& hand = hands_[b];
+				while (s[hand].ref_){
+					s[hand].ref_ = false;
+					hand = (hand+1) % ways;
+				}
+				target = hand;
+				hand = (hand+1) % ways;
+				++evictions_;
+			}else{
+				++size_;
+			}
+			s[target].key_ = k;
+			s[target].value_ = y;
+			s[target].ref_ = false;
+			s[target].used_ = true;
+		}
+
+		/** Empties the table if @a version is not the model version its entries came from */
+		void sync(size_type version){
+			if (version != version_)
+				clear();
+			version_ = version;
+		}
+
+		void clear(){
+			slots_.assign(slots_.size(),slot());
+			hands_.assign(hands_.size(),0);
+			size_ = 0;
+		}
+
+		size_type size() const{
+			return size_;
+		}
+
+		/** Number of entries the memo can hold */
+		size_type capacity() const{
+			return slots_.size();
+		}
+
+		size_t hits() const{
+			return hits_;
+		}
+
+		size_t misses() const{
+			return misses_;
+		}
+
+		/** Entries dropped to make room since construction */
+		size_t evictions() const{
+			return evictions_;
+		}
+
+	private:
+		struct slot{
+			graph_digest key_;
+			double value_;
+			bool ref_;	//CLOCK reference bit
+			bool used_;
+			slot():key_(),value_(0.0),ref_(false),used_(false){
+				key_.hi_ = key_.lo_ = 0;
+			}
+		};
+
+		vector<slot> slots_;
+		vector<unsigned char> hands_;
+		size_t mask_;
+		size_type size_;
+		size_type version_;
+		size_t hits_;
+		size_t misses_;
+		size_t evictions_;
+};
+
+/** @class 	Subplan_memo
+ * @brief 	Memo of subplan cardinalities for Join_enumerator::optimize(est, memo)
+ *
+ * A subplan is keyed by the Wl_hasher digest of its induced join graph, so the same
+ * tables joined by the same predicates under the same filters hit the memo in any
+ * later query, whatever the relation numbering there. Call sync() with the model's
+ * Manager::version() before each query.
+ */
+class Subplan_memo{
+	public:
+		typedef unsigned size_type;
+		typedef graph_digest key_type;
+
+		Subplan_memo(size_type capacity = 1 << 12):hasher_(),table_(capacity){
+		}
+
+		bool lookup(const join_query& q, relation_set s, double& rows, key_type& k){
+			k = hasher_.digest(q,s);
+			return table_.lookup(k,rows);
+		}
+
+		void insert(const key_type& k, double rows){
+			table_.insert(k,rows);
+		}
+
+		void sync(size_type version){
+			table_.sync(version);
+		}
+
+		Wl_hasher& hasher(){
+			return hasher_;
+		}
+
+		Estimate_memo& table(){
+			return table_;
+		}
+
+	private:
+		Wl_hasher hasher_;
+		Estimate_memo table_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef CS207_HASH_HPP
+#define CS207_HASH_HPP
+
+/** @file Hash.hpp
+ * @brief Fast non-cryptographic 64-bit hashing of feature vectors and tokens
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+/** Finalizer of splitmix64: a bijective mix of all 64 bits of @a h */
+inline uint64_t hash_mix(uint64_t h){
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+/** Folds the value @a v into the running hash @a seed. Order sensitive. */
+inline uint64_t hash_combine(uint64_t seed, uint64_t v){
+	return hash_mix(seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+/** Absorbs one 64-bit word into a hash state without the full finalizer */
+inline uint64_t hash_round(uint64_t h, uint64_t w){
+	h ^= w*0x87c37b91114253d5ULL;
+	h = (h << 31) | (h >> 33);
+	return h*0x4cf5ad432745937fULL;
+}
+
+/** Hashes @a len bytes starting at @a p */
+inline uint64_t hash_bytes(const void* p, size_t len, uint64_t seed = 0){
+	const unsigned char* c = (const unsigned char*) p;
+	uint64_t h = seed ^ (len*0x9e3779b97f4a7c15ULL);
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8){
+		uint64_t w;
+		memcpy(&w, c+i, 8);
+		h = hash_round(h,w);
+	}
+	if (i < len){
+		uint64_t w = 0;
+		memcpy(&w, c+i, len-i);
+		h = hash_round(h,w);
+	}
+	return hash_mix(h);
+}
+
+/** Hashes the values of @a n doubles. -0.0 and 0.0 hash alike. */
+inline uint64_t hash_doubles(const double* x, size_t n, uint64_t seed = 0){
+	uint64_t h = seed ^ (n*0x9e3779b97f4a7c15ULL);
+	for (size_t i = 0; i < n; ++i){
+		double v = x[i] + 0.0;
+		uint64_t w;
+		memcpy(&w, &v, 8);
+		h = hash_round(h,w);
+	}
+	return hash_mix(h);
+}
+
+#endif
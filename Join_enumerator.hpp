@@ -0,0 +1,543 @@
+#ifndef CS207_JOIN_ENUMERATOR_HPP
+#define CS207_JOIN_ENUMERATOR_HPP
+
+/** @file Join_enumerator.hpp
+ * @brief Join-order enumeration (DPccp) over a Graph join graph, with learned subplan cardinalities
+ */
+
+#include "Graph.hpp"
+#include "Hash.hpp"
+#include "Matrix.hpp"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+using namespace std;
+
+/** Relation of a query: the value of a join graph node */
+struct join_relation{
+	unsigned table_;	//catalog id of the table
+	double rows_;		//rows after the relation's own filters
+};
+
+/** Join predicate between two relations: the value of a join graph edge */
+struct join_predicate{
+	double selectivity_;	//fraction of the cross product that it keeps
+};
+
+/** A query: relations joined by predicates. Built once, then enumerated, so CSR adjacency */
+typedef Graph<join_relation,join_predicate,Csr_adjacency> join_graph;
+
+/** Set of relations of a query, bit i for relation i of the enumerator */
+typedef uint64_t relation_set;
+
+/** Lowest relation of @a s */
+inline unsigned lowest_relation(relation_set s){
+	return __builtin_ctzll(s);
+}
+
+/** Number of relations in @a s */
+inline unsigned count_relations(relation_set s){
+	return __builtin_popcountll(s);
+}
+
+/** @class 	join_query
+ * @brief 	A join graph as bitsets, the form the enumerator and featurizers read
+ */
+struct join_query{
+	typedef unsigned size_type;
+
+	/** An edge between relations a_ and b_ */
+	struct predicate{
+		size_type a_;
+		size_type b_;
+		double log_selectivity_;
+	};
+
+	size_type n_;				//relations, at most 64
+	vector<relation_set> neighbors_;	//per relation
+	vector<double> log_rows_;		//per relation
+	vector<unsigned> table_;		//per relation
+	vector<size_type> node_index_;		//Graph index of each relation
+	vector<predicate> predicates_;
+
+	/** Relations adjacent to @a s and not in it */
+	relation_set neighborhood(relation_set s) const{
+		relation_set n = 0;
+		for (relation_set r = s; r; r &= r-1)
+			n |= neighbors_[lowest_relation(r)];
+		return n & ~s;
+	}
+};
+
+/** @class 	Join_features
+ * @brief 	Default subplan featurizer: the independence estimate and the shape of the subplan
+ *
+ * Row of a relation set s: [relations, predicates inside s, sum of log rows, sum of
+ * log selectivities, largest log rows]. Columns 2 + 3 are the log of the textbook
+ * (independence) cardinality estimate, which a learned model then corrects.
+ * A featurizer provides dims() and operator()(query, s, row).
+ */
+struct Join_features{
+	typedef unsigned size_type;
+
+	size_type dims() const{
+		return 5;
+	}
+
+	void operator()(const join_query& q, relation_set s, double* row) const{
+		double rows = 0.0, largest = 0.0;
+		for (relation_set r = s; r; r &= r-1){
+			double l = q.log_rows_[lowest_relation(r)];
+			rows += l;
+			largest = l > largest ? l : largest;
+		}
+		double sel = 0.0;
+		size_type edges = 0;
+		for (size_type k = 0; k < q.predicates_.size(); ++k){
+			const join_query::predicate& p = q.predicates_[k];
+			if ((s >> p.a_ & 1) && (s >> p.b_ & 1)){
+				sel += p.log_selectivity_;
+				++edges;
+			}
+		}
+		row[0] = count_relations(s);
+		row[1] = edges;
+		row[2] = rows;
+		row[3] = sel;
+		row[4] = largest;
+	}
+};
+
+/** @class 	Independence_estimator
+ * @brief 	The textbook estimate, log cardinality = sum of log rows + sum of log selectivities
+ *
+ * A model over Join_features rows, for a baseline against learned models.
+ */
+struct Independence_estimator{
+	typedef unsigned size_type;
+
+	void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+		for (size_type i = 0; i < n; ++i)
+			y_hat[i] = x[(size_t)i*d+2] + x[(size_t)i*d+3];
+	}
+};
+
+/** Memo of optimize() that remembers nothing. A memo provides key_type,
+ * bool lookup(query, s, rows, key) and insert(key, rows); see Subplan_memo (Graph_hash.hpp).
+ */
+struct no_join_memo{
+	typedef char key_type;
+
+	bool lookup(const join_query&, relation_set, double&, key_type&){
+		return false;
+	}
+
+	void insert(const key_type&, double){
+	}
+};
+
+/** One join of a plan: relations left_ and right_, giving rows_ at a C_out cost_ so far */
+struct join_step{
+	relation_set left_;
+	relation_set right_;
+	double rows_;
+	double cost_;
+};
+
+/** A bushy join tree as its joins in post order; the last step joins every relation */
+struct join_plan{
+	vector<join_step> steps_;
+	double rows_;
+	double cost_;
+};
+
+/** Work done by one Join_enumerator::optimize() call */
+struct join_stats{
+	size_t subplans_;		//connected subgraphs, each estimated once
+	size_t pairs_;			//csg-cmp pairs considered by the DP
+	double estimate_ms_;		//featurizing and model time
+	double enumerate_ms_;		//DP time
+};
+
+/** @class 	Join_enumerator
+ * @brief 	Optimal bushy join order under C_out by DPccp, with cardinalities from a model
+ * @tparam  F	Subplan featurizer, Join_features by default
+ *
+ * DPccp (Moerkotte and Neumann, VLDB 2006) enumerates exactly the pairs of
+ * disjoint connected subgraphs (csg) joined by a predicate (their connected complement,
+ * cmp), so no cross product is ever considered and no pair is generated twice.
+ * Relation sets are 64-bit masks, so a query has at most 64 relations.
+ *
+ * optimize() first enumerates every connected subgraph, featurizes them all into one
+ * matrix and estimates them with a single batched predict() of the model (a Manager,
+ * or any model with predict(x, n, d, y_hat)); it then runs the DP over the csg-cmp
+ * pairs, where C_out(join of s1, s2) = |s1 u s2| + C_out(s1) + C_out(s2). The model
+ * predicts log cardinalities unless log_target is false. stats() splits the time
+ * between estimation and enumeration, and plan_cost() prices a plan under another
+ * estimator (e.g. the true cardinalities), so estimator latency and accuracy can be
+ * traced to planning time and plan quality. optimize(est, memo) first looks each
+ * subplan up in a memo, so subplans already estimated in earlier queries skip the model.
+ *
+ * The DP table is a flat array indexed by the relation set when the query's connected
+ * subgraphs fill enough of its 2^n entries, and a hash table otherwise (chains, stars
+ * and anything above dense_relations relations).
+ */
+template <typename F = Join_features>
+class Join_enumerator{
+	public:
+		typedef unsigned size_type;
+		typedef chrono::high_resolution_clock clock;
+
+		/** Largest query whose DP table may be a flat array of 2^n entries; it is one
+		 * if 2^n <= max(dense_min, dense_fill * connected subgraphs)
+		 */
+		enum { dense_relations = 20, dense_min = 1024, dense_fill = 8 };
+
+		Join_enumerator(bool log_target = true, F features = F())
+		  :f_(features),log_target_(log_target),q_(),dense_(false),dense_dp_(),dp_(),stats_(){
+		}
+
+		/** Reads the relations and predicates of @a g; indexes may have tombstones
+		 * @pre 0 < g.num_nodes() <= 64
+		 */
+		template <typename A>
+		void load(const Graph<join_relation,join_predicate,A>& g){
+			assert(g.num_nodes() > 0 && g.num_nodes() <= 64);
+			q_.n_ = g.num_nodes();
+			q_.neighbors_.assign(q_.n_,0);
+			q_.log_rows_.clear();
+			q_.table_.clear();
+			q_.node_index_.clear();
+			q_.predicates_.clear();
+			vector<size_type> bit(g.node_index_bound(),0);
+			for (auto it = g.node_begin(); it != g.node_end(); ++it){
+				bit[(*it).index()] = q_.node_index_.size();
+				q_.node_index_.push_back((*it).index());
+				q_.log_rows_.push_back(log((*it).value().rows_ > 1.0 ? (*it).value().rows_ : 1.0));
+				q_.table_.push_back((*it).value().table_);
+			}
+			for (auto it = g.edge_begin(); it != g.edge_end(); ++it){
+				join_query::predicate p;
+				p.a_ = bit[(*it).node1().index()];
+				p.b_ = bit[(*it).node2().index()];
+				p.log_selectivity_ = log((*it).value().selectivity_);
+				q_.predicates_.push_back(p);
+				q_.neighbors_[p.a_] |= (relation_set) 1 << p.b_;
+				q_.neighbors_[p.b_] |= (relation_set) 1 << p.a_;
+			}
+		}
+
+		/** Best plan for the loaded query with cardinalities from @a est
+		 * @return the plan, or one with no steps and infinite cost if the join graph
+		 * is disconnected (no plan without a cross product)
+		 */
+		template <typename Est>
+		join_plan optimize(Est& est){
+			no_join_memo m;
+			return optimize(est,m);
+		}
+
+		/** Best plan with cardinalities from @a memo where it has them, else from @a est,
+		 * which are then added to @a memo; returns as optimize(est)
+		 */
+		template <typename Est, typename Memo>
+		join_plan optimize(Est& est, Memo& memo){
+			clock::time_point t0 = clock::now();
+			dp_.clear();
+			sets_.clear();
+			enumerate_csg(csg_collector(sets_));
+			estimate(est,sets_,rows_,memo);
+			// a flat table only pays while the connected subgraphs fill enough of it:
+			// a 20-relation chain has 210 of 2^20 sets
+			dense_ = q_.n_ <= dense_relations && ((size_t) 1 << q_.n_) <= max((size_t) dense_min,dense_fill*sets_.size());
+			dp_entry none = {0,0,0.0,numeric_limits<double>::infinity()};
+			if (dense_)
+				dense_dp_.assign((size_t) 1 << q_.n_,none);
+			else
+				dp_.reserve(sets_.size());
+			for (size_t k = 0; k < sets_.size(); ++k){
+				dp_entry e = {0,0,rows_[k],count_relations(sets_[k]) == 1 ? 0.0 : none.cost_};
+				if (dense_)
+					dense_dp_[sets_[k]] = e;
+				else
+					dp_[sets_[k]] = e;
+			}
+			clock::time_point t1 = clock::now();
+			stats_.subplans_ = sets_.size();
+			stats_.pairs_ = 0;
+			enumerate_ccp(dp_updater(*this));
+			clock::time_point t2 = clock::now();
+			stats_.estimate_ms_ = chrono::duration<double,milli>(t1-t0).count();
+			stats_.enumerate_ms_ = chrono::duration<double,milli>(t2-t1).count();
+			if (!reached(all())){
+				join_plan p;
+				p.rows_ = 0.0;
+				p.cost_ = none.cost_;
+				return p;
+			}
+			return extract(all());
+		}
+
+		/** Best plan with the model in slot @a id of Manager @a mt */
+		template <typename MT>
+		join_plan optimize(MT& mt, size_type id){
+			manager_slot<MT> s = {&mt,id};
+			return optimize(s);
+		}
+
+		/** C_out of @a p with the cardinalities of @a est instead of those it was planned with */
+		template <typename Est>
+		double plan_cost(const join_plan& p, Est& est){
+			vector<relation_set> s;
+			for (size_type k = 0; k < p.steps_.size(); ++k)
+				s.push_back(p.steps_[k].left_ | p.steps_[k].right_);
+			vector<double> rows;
+			no_join_memo m;
+			estimate(est,s,rows,m);
+			double c = 0.0;
+			for (size_type k = 0; k < rows.size(); ++k)
+				c += rows[k];
+			return c;
+		}
+
+		/** Calls f(s) for every connected subgraph s of the query, smaller relations first */
+		template <typename Fn>
+		void enumerate_csg(Fn f) const{
+			for (size_type i = q_.n_; i-- > 0;){
+				relation_set v = (relation_set) 1 << i;
+				f(v);
+				csg_rec(v,upto(i),f);
+			}
+		}
+
+		/** Calls f(s1, s2) for every csg-cmp pair: disjoint connected s1 and s2 with an
+		 * edge between them. Each unordered pair comes once, and both halves of a pair
+		 * come before any pair whose union contains them.
+		 */
+		template <typename Fn>
+		void enumerate_ccp(Fn f) const{
+			pair_emitter<Fn> p = {this,&f};
+			enumerate_csg(p);
+		}
+
+		const join_query& query() const{
+			return q_;
+		}
+
+		/** Set of all relations of the query */
+		relation_set all() const{
+			return q_.n_ == 64 ? ~(relation_set) 0 : (((relation_set) 1 << q_.n_) - 1);
+		}
+
+		/** Graph indexes of the relations in @a s */
+		vector<size_type> relations(relation_set s) const{
+			vector<size_type> r;
+			for (; s; s &= s-1)
+				r.push_back(q_.node_index_[lowest_relation(s)]);
+			return r;
+		}
+
+		const join_stats& stats() const{
+			return stats_;
+		}
+
+		size_type dims() const{
+			return f_.dims();
+		}
+
+	private:
+		struct dp_entry{
+			relation_set left_;
+			relation_set right_;
+			double rows_;
+			double cost_;	//infinity until a plan is found; also for sets never enumerated
+		};
+
+		struct set_hash{
+			size_t operator()(relation_set s) const{
+				return (size_t) hash_mix(s);
+			}
+		};
+
+		template <typename MT>
+		struct manager_slot{
+			MT* mt_;
+			size_type id_;
+			void predict(const double* x, size_type n, size_type d, double* y_hat){
+				mt_->predict_model(id_,x,n,d,y_hat);
+			}
+		};
+
+		struct csg_collector{
+			vector<relation_set>* s_;
+			explicit csg_collector(vector<relation_set>& s):s_(&s){
+			}
+			void operator()(relation_set s) const{
+				s_->push_back(s);
+			}
+		};
+
+		/** EnumerateCmp of DPccp for every csg it is handed */
+		template <typename Fn>
+		struct pair_emitter{
+			const Join_enumerator* e_;
+			Fn* f_;
+			void operator()(relation_set s1) const{
+				e_->enumerate_cmp(s1,*f_);
+			}
+		};
+
+		/** Emits (s1, s2) for a fixed s1 into the DP table */
+		template <typename Fn>
+		struct cmp_emitter{
+			relation_set s1_;
+			Fn* f_;
+			void operator()(relation_set s2) const{
+				(*f_)(s1_,s2);
+			}
+		};
+
+		struct dp_updater{
+			Join_enumerator* e_;
+			explicit dp_updater(Join_enumerator& e):e_(&e){
+			}
+			void operator()(relation_set s1, relation_set s2) const{
+				e_->update(s1,s2);
+			}
+		};
+
+		/** Relations 0..i */
+		static relation_set upto(size_type i){
+			return i >= 63 ? ~(relation_set) 0 : (((relation_set) 2 << i) - 1);
+		}
+
+		/** EnumerateCsgRec: connected supersets of @a s through neighbors outside @a x */
+		template <typename Fn>
+		void csg_rec(relation_set s, relation_set x, Fn& f) const{
+			relation_set n = q_.neighborhood(s) & ~x;
+			if (!n)
+				return;
+			// nonempty subsets of n in increasing order, so smaller sets come first
+			for (relation_set sub = n & (~n+1); sub; sub = (sub-n) & n)
+				f(s | sub);
+			for (relation_set sub = n & (~n+1); sub; sub = (sub-n) & n)
+				csg_rec(s | sub,x | n,f);
+		}
+
+		/** EnumerateCmp: connected complements of @a s1 above its lowest relation */
+		template <typename Fn>
+		void enumerate_cmp(relation_set s1, Fn& f) const{
+			relation_set x = upto(lowest_relation(s1)) | s1;
+			relation_set n = q_.neighborhood(s1) & ~x;
+			cmp_emitter<Fn> c = {s1,&f};
+			for (size_type i = 64; n && i-- > 0;){
+				relation_set v = (relation_set) 1 << i;
+				if (!(n & v))
+					continue;
+				c(v);
+				csg_rec(v,x | (upto(i) & n),c);
+			}
+		}
+
+		void update(relation_set s1, relation_set s2){
+			++stats_.pairs_;
+			const dp_entry& a = entry(s1);
+			const dp_entry& b = entry(s2);
+			dp_entry& u = entry(s1 | s2);
+			assert(a.cost_ < numeric_limits<double>::infinity() && b.cost_ < numeric_limits<double>::infinity());
+			double c = u.rows_ + a.cost_ + b.cost_;
+			if (c < u.cost_){
+				u.cost_ = c;
+				u.left_ = s1;
+				u.right_ = s2;
+			}
+		}
+
+		/** Row estimates of the sets @a s: those @a memo lacks in one batched predict() */
+		template <typename Est, typename Memo>
+		void estimate(Est& est, const vector<relation_set>& s, vector<double>& rows, Memo& memo){
+			size_type d = f_.dims();
+			rows.resize(s.size());
+			vector<size_t> miss;
+			vector<typename Memo::key_type> keys;
+			typename Memo::key_type key = typename Memo::key_type();
+			for (size_t k = 0; k < s.size(); ++k){
+				if (!memo.lookup(q_,s[k],rows[k],key)){
+					miss.push_back(k);
+					keys.push_back(key);
+				}
+			}
+			x_.resize(miss.size(),d);
+			for (size_t k = 0; k < miss.size(); ++k)
+				f_(q_,s[miss[k]],&x_(k,0));
+			vector<double> y(miss.size());
+			if (!miss.empty())
+				est.predict(x_.data(),miss.size(),d,&y[0]);
+			for (size_t k = 0; k < miss.size(); ++k){
+				double r = log_target_ ? exp(y[k]) : y[k];
+				rows[miss[k]] = r > 1.0 ? r : 1.0;
+				memo.insert(keys[k],rows[miss[k]]);
+			}
+		}
+
+		/** Whether the DP found a plan for @a s */
+		bool reached(relation_set s) const{
+			if (dense_)
+				return dense_dp_[s].cost_ < numeric_limits<double>::infinity();
+			typename dp_table::const_iterator it = dp_.find(s);
+			return it != dp_.end() && it->second.cost_ < numeric_limits<double>::infinity();
+		}
+
+		/** DP entry of an enumerated set */
+		dp_entry& entry(relation_set s){
+			if (dense_)
+				return dense_dp_[s];
+			typename dp_table::iterator it = dp_.find(s);
+			assert(it != dp_.end());
+			return it->second;
+		}
+
+		const dp_entry& entry(relation_set s) const{
+			return const_cast<Join_enumerator*>(this)->entry(s);
+		}
+
+		join_plan extract(relation_set s) const{
+			join_plan p;
+			const dp_entry& e = entry(s);
+			assert(e.cost_ < numeric_limits<double>::infinity());
+			extract(s,p.steps_);
+			p.rows_ = e.rows_;
+			p.cost_ = e.cost_;
+			return p;
+		}
+
+		void extract(relation_set s, vector<join_step>& steps) const{
+			const dp_entry& e = entry(s);
+			if (count_relations(s) == 1)
+				return;
+			extract(e.left_,steps);
+			extract(e.right_,steps);
+			join_step j = {e.left_,e.right_,e.rows_,e.cost_};
+			steps.push_back(j);
+		}
+
+		typedef unordered_map<relation_set,dp_entry,set_hash> dp_table;
+
+		F f_;
+		bool log_target_;
+		join_query q_;
+		bool dense_;
+		vector<dp_entry> dense_dp_;	//indexed by relation set, when dense_
+		dp_table dp_;
+		join_stats stats_;
+		vector<relation_set> sets_;
+		vector<double> rows_;
+		Matrix<double> x_;
+};
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef CS207_KDTREE_HPP
+#define CS207_KDTREE_HPP
+
+/** @file Kdtree.hpp
+ * @brief A kd-tree over points of any dimension with exact and approximate k-nearest search
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+using namespace std;
+
+/** @class 	Kd_tree
+ * @brief 	Spatial index over d-dimensional points, addressed by insertion id
+ *
+ * Internal nodes split on the dimension of largest spread at its median, so points
+ * with x[dim_] <= split_ are on the left and points with x[dim_] >= split_ on the right.
+ * The points themselves live in leaf buckets of up to 2*leaf_size points, stored
+ * column by column so a leaf is scanned with one vectorizable loop per dimension.
+ *
+ * insert() adds a point to its leaf and splits the leaf once it is full, so the tree
+ * stays balanced enough for a workload that keeps adding query vectors. A leaf of
+ * identical points cannot be split: it is marked uniform and just grows, without
+ * another split attempt until a point different from its own arrives.
+ *
+ * knn() with eps > 0 is the (1+eps)-approximate search: a subtree is skipped unless
+ * it may hold a point closer than the current k-th distance divided by (1+eps).
+ */
+class Kd_tree{
+	public:
+		typedef unsigned size_type;
+
+		/** One result of knn() */
+		struct neighbor{
+			size_type id_;
+			double dist_sq_;	//squared Euclidean distance to the query
+			bool operator<(const neighbor& b) const{
+				return dist_sq_ < b.dist_sq_;
+			}
+		};
+
+		Kd_tree(size_type leaf_size = 32):leaf_size_(leaf_size),d_(0),size_(0){
+			assert(leaf_size > 0);
+		}
+
+		/** Replaces the contents with @a n row-major points of dimension @a d, ids 0 to n-1
+		 * Complexity: O(d*n*log(n))
+		 */
+		void build(const double* x, size_type n, size_type d){
+			assert(d > 0);
+			clear();
+			d_ = d;
+			size_ = n;
+			if (n == 0)
+				return;
+			vector<size_type> idx(n);
+			for (size_type i = 0; i < n; ++i)
+				idx[i] = i;
+			build(x,&idx[0],n);
+		}
+
+		/** Adds @a p (dims() values) and returns its id; the first insert into an empty tree sets dims() to @a d */
+		size_type insert(const double* p, size_type d){
+			if (size_ == 0 && nodes_.empty())
+				d_ = d;
+			assert(d == d_);
+			size_type id = size_++;
+			if (nodes_.empty()){
+				nodes_.push_back(kd_node());
+				nodes_[0].leaf_ = new_leaf();
+			}
+			size_type k = 0;
+			while (nodes_[k].dim_ >= 0)
+				k = p[nodes_[k].dim_] < nodes_[k].split_ ? nodes_[k].left_ : nodes_[k].right_;
+			size_type l = nodes_[k].leaf_;
+			kd_leaf& leaf = leaves_[l];
+			if (leaf.uniform_)
+				for (size_type j = 0; j < d_ && leaf.uniform_; ++j)
+					leaf.uniform_ = p[j] == leaf.cols_[(size_t)j*leaf.cap_];
+			append(leaf,p,id);
+			if (!leaf.uniform_ && leaf.ids_.size() > 2*leaf_size_)
+				split_leaf(k);
+			return id;
+		}
+
+		/** The @a k points nearest to @a q, closest first, written to @a out
+		 * @param[in] eps	0 for the exact neighbors, > 0 for a (1+eps)-approximation
+		 * Safe to call from several threads at once.
+		 */
+		void knn(const double* q, size_type k, vector<neighbor>& out, double eps = 0.0) const{
+			out.clear();
+			if (nodes_.empty() || k == 0)
+				return;
+			double scale = (1.0+eps)*(1.0+eps);
+			search(0,q,k,scale,out);
+			sort_heap(out.begin(),out.end());
+		}
+
+		void clear(){
+			nodes_.clear();
+			leaves_.clear();
+			size_ = 0;
+		}
+
+		size_type size() const{
+			return size_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+		size_type leaf_size() const{
+			return leaf_size_;
+		}
+
+	private:
+
+		struct kd_node{
+			int dim_;		//-1 for a leaf
+			double split_;
+			size_type left_;
+			size_type right_;
+			size_type leaf_;	//bucket of a leaf
+			kd_node():dim_(-1),split_(0.0),left_(0),right_(0),leaf_(0){
+			}
+		};
+
+		/** Points of a leaf: coordinate j of point p is cols_[j*cap_ + p] */
+		struct kd_leaf{
+			vector<double> cols_;
+			vector<size_type> ids_;
+			size_type cap_;
+			bool uniform_;		//all points equal and the leaf already too full: no split
+		};
+
+		size_type new_leaf(){
+			leaves_.push_back(kd_leaf());
+			kd_leaf& leaf = leaves_.back();
+			leaf.cap_ = 2*leaf_size_+1;
+			leaf.cols_.resize((size_t)leaf.cap_*d_);
+			leaf.uniform_ = false;
+			return leaves_.size()-1;
+		}
+
+		void append(kd_leaf& leaf, const double* p, size_type id){
+			size_type m = leaf.ids_.size();
+			if (m == leaf.cap_){
+				vector<double> cols((size_t)2*leaf.cap_*d_);
+				for (size_type j = 0; j < d_; ++j)
+					copy(&leaf.cols_[(size_t)j*leaf.cap_],&leaf.cols_[(size_t)j*leaf.cap_]+m,&cols[(size_t)j*2*leaf.cap_]);
+				leaf.cols_.swap(cols);
+				leaf.cap_ *= 2;
+			}
+			for (size_type j = 0; j < d_; ++j)
+				leaf.cols_[(size_t)j*leaf.cap_+m] = p[j];
+			leaf.ids_.push_back(id);
+		}
+
+		/** Builds the subtree of the points idx[0, m) and returns its root */
+		size_type build(const double* x, size_type* idx, size_type m){
+			size_type k = nodes_.size();
+			nodes_.push_back(kd_node());
+			int dim = -1;
+			double spread = 0.0;
+			if (m > leaf_size_){
+				for (size_type j = 0; j < d_; ++j){
+					double lo = x[(size_t)idx[0]*d_+j], hi = lo;
+					for (size_type i = 1; i < m; ++i){
+						double v = x[(size_t)idx[i]*d_+j];
+						lo = v < lo ? v : lo;
+						hi = v > hi ? v : hi;
+					}
+					if (hi-lo > spread){
+						spread = hi-lo;
+						dim = j;
+					}
+				}
+			}
+			if (dim < 0){
+				size_type l = new_leaf();
+				for (size_type i = 0; i < m; ++i)
+					append(leaves_[l],x+(size_t)idx[i]*d_,idx[i]);
+				leaves_[l].uniform_ = m > leaf_size_;
+				nodes_[k].leaf_ = l;
+				return k;
+			}
+			size_type mid = m/2;
+			nth_element(idx,idx+mid,idx+m,[x,dim,this](size_type a, size_type b){
+				return x[(size_t)a*d_+dim] < x[(size_t)b*d_+dim];
+			});
+			nodes_[k].dim_ = dim;
+			nodes_[k].split_ = x[(size_t)idx[mid]*d_+dim];
+			size_type left = build(x,idx,mid);
+			size_type right = build(x,idx+mid,m-mid);
+			nodes_[k].left_ = left;
+			nodes_[k].right_ = right;
+			return k;
+		}
+
+		/** Turns the full leaf node @a k into a split node with two leaves */
+		void split_leaf(size_type k){
+			size_type l = nodes_[k].leaf_;
+			size_type m = leaves_[l].ids_.size();
+			int dim = -1;
+			double spread = 0.0;
+			for (size_type j = 0; j < d_; ++j){
+				const double* c = &leaves_[l].cols_[(size_t)j*leaves_[l].cap_];
+				double lo = *min_element(c,c+m), hi = *max_element(c,c+m);
+				if (hi-lo > spread){
+					spread = hi-lo;
+					dim = j;
+				}
+			}
+			if (dim < 0){
+				leaves_[l].uniform_ = true;
+				return;
+			}
+
+			kd_leaf old;
+			old.cols_.swap(leaves_[l].cols_);
+			old.ids_.swap(leaves_[l].ids_);
+			old.cap_ = leaves_[l].cap_;
+			const double* c = &old.cols_[(size_t)dim*old.cap_];
+			vector<double> vals(c,c+m);
+			nth_element(vals.begin(),vals.begin()+m/2,vals.end());
+			double split = vals[m/2];
+			bool low = split == *min_element(c,c+m);	//then the left side takes the ties
+
+			// the old bucket is reused for the left child
+			leaves_[l].cap_ = 2*leaf_size_+1;
+			leaves_[l].cols_.assign((size_t)leaves_[l].cap_*d_,0.0);
+			size_type r = new_leaf();
+			vector<double> p(d_);
+			for (size_type i = 0; i < m; ++i){
+				for (size_type j = 0; j < d_; ++j)
+					p[j] = old.cols_[(size_t)j*old.cap_+i];
+				bool left = low ? (c[i] <= split) : (c[i] < split);
+				append(leaves_[left ? l : r],&p[0],old.ids_[i]);
+			}
+
+			size_type left = nodes_.size();
+			nodes_.push_back(kd_node());
+			nodes_.push_back(kd_node());
+			nodes_[left].leaf_ = l;
+			nodes_[left+1].leaf_ = r;
+			nodes_[k].dim_ = dim;
+			nodes_[k].split_ = split;
+			nodes_[k].left_ = left;
+			nodes_[k].right_ = left+1;
+		}
+
+		void search(size_type k, const double* q, size_type num, double scale, vector<neighbor>& heap) const{
+			const kd_node& nd = nodes_[k];
+			if (nd.dim_ < 0){
+				scan(leaves_[nd.leaf_],q,num,heap);
+				return;
+			}
+			double diff = q[nd.dim_] - nd.split_;
+			size_type near = diff < 0.0 ? nd.left_ : nd.right_;
+			size_type far = diff < 0.0 ? nd.right_ : nd.left_;
+			search(near,q,num,scale,heap);
+			if (heap.size() < num || diff*diff*scale < heap.front().dist_sq_)
+				search(far,q,num,scale,heap);
+		}
+
+		/** Brute force over one bucket, keeping the @a num best in the max-heap @a heap */
+		void scan(const kd_leaf& leaf, const double* q, size_type num, vector<neighbor>& heap) const{
+			static thread_local vector<double> dist;
+			size_type m = leaf.ids_.size();
+			if (m == 0)
+				return;
+			dist.assign(m,0.0);
+			double* __restrict__ ds = &dist[0];
+			for (size_type j = 0; j < d_; ++j){
+				const double* __restrict__ c = &leaf.cols_[(size_t)j*leaf.cap_];
+				double qj = q[j];
+				for (size_type i = 0; i < m; ++i){
+					double t = c[i]-qj;
+					ds[i] += t*t;
+				}
+			}
+			for (size_type i = 0; i < m; ++i){
+				if (heap.size() < num){
+					neighbor nb = {leaf.ids_[i],ds[i]};
+					heap.push_back(nb);
+					push_heap(heap.begin(),heap.end());
+				}else if (ds[i] < heap.front().dist_sq_){
+					pop_heap(heap.begin(),heap.end());
+					heap.back().id_ = leaf.ids_[i];
+					heap.back().dist_sq_ = ds[i];
+					push_heap(heap.begin(),heap.end());
+				}
+			}
+		}
+
+		size_type leaf_size_;
+		size_type d_;
+		size_type size_;
+		vector<kd_node> nodes_;
+		vector<kd_leaf> leaves_;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef CS207_KERNELS_HPP
+#define CS207_KERNELS_HPP
+
+/** @file Kernels.hpp
+ * @brief Dense vector kernels shared by the models
+ *
+ * Like the reductions in Loss.hpp these keep independent partial sums over
+ * non-aliasing pointers so g++ -O3 vectorizes them.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+using namespace std;
+
+#define KERNEL_RESTRICT __restrict__
+
+/** Returns the inner product of the @a n-vectors @a a and @a b */
+inline double dot_product(const double* KERNEL_RESTRICT a, const double* KERNEL_RESTRICT b, size_t n){
+	double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		s0 += a[i]*b[i];
+		s1 += a[i+1]*b[i+1];
+		s2 += a[i+2]*b[i+2];
+		s3 += a[i+3]*b[i+3];
+	}
+	for (; i < n; ++i)
+		s0 += a[i]*b[i];
+	return (s0+s1)+(s2+s3);
+}
+
+/** y += alpha*x over @a n elements */
+inline void axpy(double alpha, const double* KERNEL_RESTRICT x, double* KERNEL_RESTRICT y, size_t n){
+	for (size_t i = 0; i < n; ++i)
+		y[i] += alpha*x[i];
+}
+
+/** Returns the inner product of the int8 @a n-vectors @a a and @a b, accumulated in 32 bits
+ * Exact for n < 2^17. Integer sums may be reordered freely, so the plain loop vectorizes
+ * (widening multiply-add) without split accumulators.
+ */
+inline int32_t dot_product_i8(const int8_t* KERNEL_RESTRICT a, const int8_t* KERNEL_RESTRICT b, size_t n){
+	int32_t s = 0;
+	for (size_t i = 0; i < n; ++i)
+		s += (int32_t) a[i]*(int32_t) b[i];
+	return s;
+}
+
+/** acc = W x for an int8 @a m x @a d matrix W stored transposed: W(h, j) == wt[j*m + h]
+ * Accumulated in 32 bits. The inner loop runs over the @a m outputs with one int16
+ * product each (127*127 fits), so it vectorizes without a horizontal sum per output.
+ */
+inline void gemv_i8_t(const int8_t* KERNEL_RESTRICT wt, const int8_t* KERNEL_RESTRICT x, int32_t* KERNEL_RESTRICT acc, size_t m, size_t d){
+	for (size_t h = 0; h < m; ++h)
+		acc[h] = 0;
+	for (size_t j = 0; j < d; ++j){
+		int16_t xj = x[j];
+		const int8_t* KERNEL_RESTRICT w = wt + j*m;
+		for (size_t h = 0; h < m; ++h)
+			acc[h] += (int16_t) (w[h]*xj);
+	}
+}
+
+/** Quantizes @a n values to int8: q[i] = round(x[i]*inv_scale), saturated to [-127, 127]
+ * Halves round up. The clamps and the rounding are written without branches so the
+ * loop vectorizes; ternaries would not be turned into min/max without -ffast-math.
+ */
+inline void quantize_i8(const double* KERNEL_RESTRICT x, double inv_scale, int8_t* KERNEL_RESTRICT q, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		double v = x[i]*inv_scale;
+		v = 0.5*(v + 127.0 - fabs(v - 127.0));	//min(v, 127) without a branch
+		v = 0.5*(v - 127.0 + fabs(v + 127.0));	//max(v, -127)
+		q[i] = (int8_t) ((int32_t) (v + 127.5) - 127);	//v + 127.5 >= 0, so truncation rounds
+	}
+}
+
+/** Same with one scale per element: q[i] = round(x[i]*inv_scale[i]) */
+inline void quantize_i8(const double* KERNEL_RESTRICT x, const double* KERNEL_RESTRICT inv_scale, int8_t* KERNEL_RESTRICT q, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		double v = x[i]*inv_scale[i];
+		v = 0.5*(v + 127.0 - fabs(v - 127.0));	//min(v, 127) without a branch
+		v = 0.5*(v - 127.0 + fabs(v + 127.0));	//max(v, -127)
+		q[i] = (int8_t) ((int32_t) (v + 127.5) - 127);	//v + 127.5 >= 0, so truncation rounds
+	}
+}
+
+#endif
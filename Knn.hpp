@@ -0,0 +1,139 @@
+#ifndef CS207_KNN_HPP
+#define CS207_KNN_HPP
+
+/** @file Knn.hpp
+ * @brief k-nearest-neighbor regression over a Kd_tree of past feature vectors
+ */
+
+#include "Kdtree.hpp"
+#include "Point.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <cassert>
+using namespace std;
+
+/** @class 	Knn_regression
+ * @brief 	Predicts the mean target of the k stored rows nearest to a query
+ *
+ * fit() indexes a training set; insert() and update() add rows one at a time, so
+ * the model follows a workload as new queries are observed without being refit.
+ * With eps > 0 the neighbors come from the (1+eps)-approximate search of Kd_tree.
+ * With distance weighting a neighbor counts 1/(dist + 1e-12), and an exact match
+ * dominates the prediction.
+ */
+struct Knn_regression{
+	public:
+		typedef unsigned size_type;
+
+		Knn_regression(size_type k = 5, double eps = 0.0, bool weighted = false, size_type leaf_size = 32)
+		  :k_(k),eps_(eps),weighted_(weighted),tree_(leaf_size),y_(),consumed_(0){
+			assert(k > 0 && eps >= 0.0);
+		}
+
+		/** Indexes @a n rows of @a d features and their targets, replacing the stored rows */
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			tree_.build(x,n,d);
+			y_.assign(y,y+n);
+			consumed_ = 0;
+		}
+
+		/** Adds one row of @a d features with target @a y */
+		void insert(const double* x, size_type d, double y){
+			tree_.insert(x,d);
+			y_.push_back(y);
+		}
+
+		/** Inserts the samples a Sampler policy collected since the last update
+		 * Each sample holds the features followed by the target, as for Online_learner.
+		 * @return 	the number of samples inserted
+		 */
+		template <typename Policy>
+		size_type update(Policy p){
+			const auto& s = p.samples();
+			if (s.size() < consumed_)
+				consumed_ = 0;
+			size_type n = s.size() - consumed_;
+			for (size_type i = consumed_; i < s.size(); ++i){
+				size_type d = s[i].size()-1;
+				assert(d > 0);
+				row_.assign(s[i].begin(),s[i].begin()+d);
+				insert(&row_[0],d,s[i][d]);
+			}
+			consumed_ = s.size();
+			return n;
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(size() > 0 && d == tree_.dims());
+			vector<Kd_tree::neighbor> nb;
+			for (size_type i = 0; i < n; ++i)
+				y_hat[i] = estimate(x+(size_t)i*d,nb);
+		}
+
+		/** Prediction for a three-feature query */
+		double predict(const Point& p) const{
+			assert(size() > 0 && tree_.dims() == 3);
+			vector<Kd_tree::neighbor> nb;
+			return estimate(p.elem,nb);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (size() == 0)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		/** Number of stored rows */
+		size_type size() const{
+			return tree_.size();
+		}
+
+		size_type dims() const{
+			return tree_.dims();
+		}
+
+		const Kd_tree& index() const{
+			return tree_;
+		}
+
+		bool operator==(const Knn_regression& r) const{
+			return (k_==r.k_) && (y_==r.y_) && (size()==r.size());
+		}
+
+		bool operator!=(const Knn_regression& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+
+		double estimate(const double* q, vector<Kd_tree::neighbor>& nb) const{
+			tree_.knn(q,k_,nb,eps_);
+			if (!weighted_){
+				double s = 0.0;
+				for (size_type j = 0; j < nb.size(); ++j)
+					s += y_[nb[j].id_];
+				return s/nb.size();
+			}
+			double s = 0.0, w = 0.0;
+			for (size_type j = 0; j < nb.size(); ++j){
+				double wj = 1.0/(sqrt(nb[j].dist_sq_) + 1e-12);
+				s += wj*y_[nb[j].id_];
+				w += wj;
+			}
+			return s/w;
+		}
+
+		size_type k_;
+		double eps_;
+		bool weighted_;
+		Kd_tree tree_;
+		vector<double> y_;
+		size_type consumed_;
+		vector<double> row_;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef CS207_LOSS_HPP
+#define CS207_LOSS_HPP
+
+/** @file Loss.hpp
+ * @brief Loss functions over contiguous arrays of targets and predictions
+ *
+ * Every kernel takes @a y (targets) and @a y_hat (predictions) as arrays of @a n
+ * doubles. The reductions keep four independent partial sums and the arrays are
+ * declared non-aliasing, so -O3 turns the loops into packed SIMD code.
+ *
+ * The functors at the bottom (L2_loss, L1_loss, ...) wrap the kernels for
+ * Selector: operator()(y, y_hat) is the loss of a single example, sum() the
+ * total over an array and elementwise() the per-example losses.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+#define LOSS_RESTRICT __restrict__
+
+/** Sum of squared errors */
+inline double l2_loss(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n){
+	double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		double e0 = y[i]-y_hat[i], e1 = y[i+1]-y_hat[i+1];
+		double e2 = y[i+2]-y_hat[i+2], e3 = y[i+3]-y_hat[i+3];
+		a0 += e0*e0; a1 += e1*e1; a2 += e2*e2; a3 += e3*e3;
+	}
+	for (; i < n; ++i){
+		double e = y[i]-y_hat[i];
+		a0 += e*e;
+	}
+	return (a0+a1)+(a2+a3);
+}
+
+/** Sum of absolute errors */
+inline double l1_loss(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n){
+	double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		a0 += fabs(y[i]-y_hat[i]);
+		a1 += fabs(y[i+1]-y_hat[i+1]);
+		a2 += fabs(y[i+2]-y_hat[i+2]);
+		a3 += fabs(y[i+3]-y_hat[i+3]);
+	}
+	for (; i < n; ++i)
+		a0 += fabs(y[i]-y_hat[i]);
+	return (a0+a1)+(a2+a3);
+}
+
+/** Huber loss of a single error @a e: quadratic within @a delta, linear outside */
+inline double huber(double e, double delta){
+	double a = fabs(e);
+	double c = a < delta ? a : delta;
+	return c*(a - 0.5*c);
+}
+
+/** Sum of Huber losses */
+inline double huber_loss(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n, double delta = 1.0){
+	double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		a0 += huber(y[i]-y_hat[i],delta);
+		a1 += huber(y[i+1]-y_hat[i+1],delta);
+		a2 += huber(y[i+2]-y_hat[i+2],delta);
+		a3 += huber(y[i+3]-y_hat[i+3],delta);
+	}
+	for (; i < n; ++i)
+		a0 += huber(y[i]-y_hat[i],delta);
+	return (a0+a1)+(a2+a3);
+}
+
+/** Binary cross-entropy of a single example; @a p is clipped to [eps, 1-eps] */
+inline double log_loss(double y, double p, double eps = 1e-15){
+	p = p < eps ? eps : (p > 1.0-eps ? 1.0-eps : p);
+	return -(y*log(p) + (1.0-y)*log(1.0-p));
+}
+
+/** Sum of binary cross-entropies for labels @a y in {0,1} and probabilities @a p */
+inline double log_loss(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT p, size_t n, double eps = 1e-15){
+	double a0 = 0.0, a1 = 0.0;
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2){
+		a0 += log_loss(y[i],p[i],eps);
+		a1 += log_loss(y[i+1],p[i+1],eps);
+	}
+	for (; i < n; ++i)
+		a0 += log_loss(y[i],p[i],eps);
+	return a0+a1;
+}
+
+/** q-error of a single estimate: max(y/y_hat, y_hat/y), both clamped to at least 1 */
+inline double qerror(double y, double y_hat){
+	double a = y < 1.0 ? 1.0 : y;
+	double b = y_hat < 1.0 ? 1.0 : y_hat;
+	return a > b ? a/b : b/a;
+}
+
+/** Per-example q-errors written to @a q */
+inline void qerror(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n, double* LOSS_RESTRICT q){
+	for (size_t i = 0; i < n; ++i)
+		q[i] = qerror(y[i],y_hat[i]);
+}
+
+/** Sum of q-errors */
+inline double qerror_loss(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n){
+	double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		a0 += qerror(y[i],y_hat[i]);
+		a1 += qerror(y[i+1],y_hat[i+1]);
+		a2 += qerror(y[i+2],y_hat[i+2]);
+		a3 += qerror(y[i+3],y_hat[i+3]);
+	}
+	for (; i < n; ++i)
+		a0 += qerror(y[i],y_hat[i]);
+	return (a0+a1)+(a2+a3);
+}
+
+/** Summary of the q-error distribution of a set of estimates */
+struct qerror_summary{
+	double mean_;
+	double median_;
+	double p95_;
+	double max_;
+	qerror_summary():mean_(1.0),median_(1.0),p95_(1.0),max_(1.0){
+	}
+};
+
+/** Computes mean, median, 95th percentile and maximum q-error
+ * @param[in]  y, y_hat	targets and estimates
+ * @param[out] scratch	@a n doubles of workspace, holds the q-errors in no particular order on return
+ *
+ * Complexity: O(n); the percentiles use selection rather than a full sort.
+ */
+inline qerror_summary summarize_qerror(const double* y, const double* y_hat, size_t n, double* scratch){
+	qerror_summary s;
+	if (n == 0)
+		return s;
+	qerror(y,y_hat,n,scratch);
+
+	double sum = 0.0, m0 = 1.0, m1 = 1.0;
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2){
+		sum += scratch[i] + scratch[i+1];
+		m0 = scratch[i] > m0 ? scratch[i] : m0;
+		m1 = scratch[i+1] > m1 ? scratch[i+1] : m1;
+	}
+	for (; i < n; ++i){
+		sum += scratch[i];
+		m0 = scratch[i] > m0 ? scratch[i] : m0;
+	}
+	s.mean_ = sum/n;
+	s.max_ = m0 > m1 ? m0 : m1;
+
+	// p95 first: the median selection below only reorders the lower part
+	size_t k95 = (size_t) ceil(0.95*n) - 1;
+	nth_element(scratch, scratch+k95, scratch+n);
+	s.p95_ = scratch[k95];
+	size_t k50 = (n-1)/2;
+	nth_element(scratch, scratch+k50, scratch+k95+1);
+	s.median_ = scratch[k50];
+	if (n % 2 == 0)
+		s.median_ = 0.5*(s.median_ + *min_element(scratch+k50+1, scratch+k95+1));
+	return s;
+}
+
+
+/** Squared error */
+struct L2_loss{
+	double operator()(double y, double y_hat) const{
+		return (y-y_hat)*(y-y_hat);
+	}
+	double sum(const double* y, const double* y_hat, size_t n) const{
+		return l2_loss(y,y_hat,n);
+	}
+	void elementwise(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n, double* LOSS_RESTRICT out) const{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = (y[i]-y_hat[i])*(y[i]-y_hat[i]);
+	}
+};
+
+/** Absolute error */
+struct L1_loss{
+	double operator()(double y, double y_hat) const{
+		return fabs(y-y_hat);
+	}
+	double sum(const double* y, const double* y_hat, size_t n) const{
+		return l1_loss(y,y_hat,n);
+	}
+	void elementwise(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n, double* LOSS_RESTRICT out) const{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = fabs(y[i]-y_hat[i]);
+	}
+};
+
+/** Huber loss with threshold @a delta_ */
+struct Huber_loss{
+	double delta_;
+	Huber_loss(double delta = 1.0):delta_(delta){
+	}
+	double operator()(double y, double y_hat) const{
+		return huber(y-y_hat,delta_);
+	}
+	double sum(const double* y, const double* y_hat, size_t n) const{
+		return huber_loss(y,y_hat,n,delta_);
+	}
+	void elementwise(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT y_hat, size_t n, double* LOSS_RESTRICT out) const{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = huber(y[i]-y_hat[i],delta_);
+	}
+};
+
+/** Binary cross-entropy; predictions are probabilities */
+struct Log_loss{
+	double operator()(double y, double p) const{
+		return log_loss(y,p);
+	}
+	double sum(const double* y, const double* p, size_t n) const{
+		return log_loss(y,p,n);
+	}
+	void elementwise(const double* LOSS_RESTRICT y, const double* LOSS_RESTRICT p, size_t n, double* LOSS_RESTRICT out) const{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = log_loss(y[i],p[i]);
+	}
+};
+
+/** q-error, the usual accuracy measure for cardinality estimates */
+struct Qerror_loss{
+	double operator()(double y, double y_hat) const{
+		return qerror(y,y_hat);
+	}
+	double sum(const double* y, const double* y_hat, size_t n) const{
+		return qerror_loss(y,y_hat,n);
+	}
+	void elementwise(const double* y, const double* y_hat, size_t n, double* out) const{
+		qerror(y,y_hat,n,out);
+	}
+};
+
+#endif
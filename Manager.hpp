@@ -1,3 +1,9 @@
+#ifndef CS207_MANAGER_HPP
+#define CS207_MANAGER_HPP
+
+#include "Matrix.hpp"
+#include <atomic>
+
 /** meets domain: returns true if a sample meets a domain
 struct model parameters error from training 
  ** currently has support for up to 4 different models
@@ -23,13 +29,21 @@ class Manager{
 	//typedef typename GraphType::size_type size_type;
 
 	typedef unsigned size_type;
+	typedef double error_type;
 	//typedef typename GraphType::Node Model;
 	//typedef typename GraphType::Node model_type;
 	//ypedef typename GraphType::node_value_type model_info_type;
 	//typedef typename GraphType::node_iterator model_iterator;
 	typedef Manager manager_type;
 
+	/** Rows per block handed to each model by predict() **/
+	enum { batch_rows = 256 };
+
 	Manager():models_(),used_m1_(0),used_m2_(0),used_m3_(0),used_m4_(0){
+		for (size_type i = 0; i < 4; ++i){
+			risk_[i] = 0.0;
+			version_[i].store(0,memory_order_relaxed);
+		}
 	}
 
    ~Manager() = default;
@@ -44,18 +58,22 @@ class Manager{
 		if (m1 != M1()){
 			models_.m1_ = m1;
 			used_m1_ = 1;
+			bump(0);
 		}
 		if (m2 != M2()){
 			models_.m2_ = m2;
 			used_m2_ = 1;
+			bump(1);
 		}
 		if (m3 != M3()){
 			models_.m3_ = m3;
 			used_m3_ = 1;
+			bump(2);
 		}
 		if (m4 != M4()){
 			models_.m4_ = m4;
 			used_m4_ = 1;
+			bump(3);
 		}
 	}
 
@@ -77,6 +95,7 @@ class Manager{
 			models_.m4_ = M4();
 			used_m4_ = 0;
 		}
+		bump(id-1);
 	}
 
 	M1 model1(){
@@ -95,6 +114,123 @@ class Manager{
 		return models_.m4_;
 	}
 
+	/** Returns true if slot @a id (1-4) currently holds a model */
+	bool has_model(size_type id){
+		assert(id < 5 && id > 0);
+		if (id == 1)
+			return used_m1_;
+		if (id == 2)
+			return used_m2_;
+		if (id == 3)
+			return used_m3_;
+		return used_m4_;
+	}
+
+	/** Calls f(id, model) on every model held, in slot order. The models are
+	 ** passed by reference, so @a f may fit or otherwise update them in place.
+	 ** F must accept each of M1..M4 (a functor with a templated operator() does)
+	 **/
+	template <typename F>
+	void for_each_model(F& f){
+		if (used_m1_)
+			f(1, models_.m1_);
+		if (used_m2_)
+			f(2, models_.m2_);
+		if (used_m3_)
+			f(3, models_.m3_);
+		if (used_m4_)
+			f(4, models_.m4_);
+	}
+
+	/** Predicts @a n rows with several models at once.
+	 ** @param[in]  x	row-major @a n x @a d features
+	 ** @param[out] y1	@a n predictions of the model in slot 1, likewise @a y2 - @a y4
+	 **
+	 ** A null buffer (or an empty slot) skips that model, so any subset of the
+	 ** models can be run. Models must provide
+	 ** predict(const double* x, size_type n, size_type d, double* y_hat).
+	 ** Rows are handed out in blocks of batch_rows so every model reads a block
+	 ** of features while it is still in cache. Nothing is allocated here; each
+	 ** model writes straight into the caller's buffers.
+	 **/
+	void predict(const double* x, size_type n, size_type d, double* y1, double* y2 = 0, double* y3 = 0, double* y4 = 0){
+		for (size_type start = 0; start < n; start += batch_rows){
+			size_type b = n-start;
+			if (b > batch_rows)
+				b = batch_rows;
+			const double* xb = x + (size_t)start*d;
+			if (used_m1_ && y1)
+				models_.m1_.predict(xb,b,d,y1+start);
+			if (used_m2_ && y2)
+				models_.m2_.predict(xb,b,d,y2+start);
+			if (used_m3_ && y3)
+				models_.m3_.predict(xb,b,d,y3+start);
+			if (used_m4_ && y4)
+				models_.m4_.predict(xb,b,d,y4+start);
+		}
+	}
+
+	/** Predicts the rows of @a x with several models at once, as above.
+	 ** @param[out] y1	x.rows() predictions of the model in slot 1, likewise @a y2 - @a y4
+	 **
+	 ** A row-contiguous view goes straight to the pointer overload. Otherwise
+	 ** (a column-major matrix, a column subset, a transposed view) each block of
+	 ** batch_rows rows is gathered once into a reused row-major buffer that all
+	 ** the models then read. The buffer belongs to the calling thread, so several
+	 ** threads may predict through one Manager at once.
+	 **/
+	void predict(const Matrix_view<const double>& x, double* y1, double* y2 = 0, double* y3 = 0, double* y4 = 0){
+		if (x.row_contiguous()){
+			predict(x.data(),x.rows(),x.cols(),y1,y2,y3,y4);
+			return;
+		}
+		static thread_local aligned_vector<double> block;
+		size_type n = x.rows(), d = x.cols();
+		for (size_type start = 0; start < n; start += batch_rows){
+			size_type b = n-start;
+			if (b > batch_rows)
+				b = batch_rows;
+			const double* xb = contiguous_rows(x.rows(start,start+b),block);
+			predict(xb,b,d,y1 ? y1+start : 0,y2 ? y2+start : 0,y3 ? y3+start : 0,y4 ? y4+start : 0);
+		}
+	}
+
+	/** Predicts @a n rows with the model in slot @a id only
+	 ** @pre has_model(@a id)
+	 **/
+	void predict_model(size_type id, const double* x, size_type n, size_type d, double* y_hat){
+		assert(has_model(id));
+		if (id == 1)
+			models_.m1_.predict(x,n,d,y_hat);
+		else if (id == 2)
+			models_.m2_.predict(x,n,d,y_hat);
+		else if (id == 3)
+			models_.m3_.predict(x,n,d,y_hat);
+		else
+			models_.m4_.predict(x,n,d,y_hat);
+	}
+
+	/** Version of the model in slot @a id. It changes whenever the slot is
+	 ** replaced or cleared, so anything derived from the old model (cached
+	 ** predictions, compiled forms) can tell it is stale.
+	 **/
+	size_type version(size_type id){
+		assert(id < 5 && id > 0);
+		return version_[id-1].load(memory_order_acquire);
+	}
+
+	/** Marks the model in slot @a id as changed, e.g. after refitting it in place */
+	void touch(size_type id){
+		assert(id < 5 && id > 0);
+		bump(id-1);
+	}
+
+	/** Risk of the model in slot @a id, as recorded by the last Selector run */
+	error_type& model_risk(size_type id){
+		assert(id < 5 && id > 0);
+		return risk_[id-1];
+	}
+
 	
 
 /*	M& model_value(Model m){
@@ -110,6 +246,10 @@ class Manager{
 		used_m2_ = 0;
 		used_m3_ = 0;
 		used_m4_ = 0;
+		for (size_type i = 0; i < 4; ++i){
+			risk_[i] = 0.0;
+			bump(i);
+		}
 	}
 
 
@@ -132,7 +272,16 @@ class Manager{
 			}
 		};
 		
+		/** Advances the version of slot @a i (0-based) after its model changed; the
+		 ** release pairs with the acquire in version(), for caches on other threads
+		 **/
+		void bump(size_type i){
+			version_[i].fetch_add(1,memory_order_release);
+		}
+
 		model_info_type models_;
+		error_type risk_[4];
+		atomic<size_type> version_[4];
 
 		//GraphType* graph_;
 		bool used_m1_;
@@ -141,3 +290,5 @@ class Manager{
 		bool used_m4_;
 
 };
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef CS207_MATRIX_HPP
+#define CS207_MATRIX_HPP
+
+/** @file Matrix.hpp
+ * @brief Dense 64-byte-aligned feature matrices and strided views over them
+ */
+
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <cassert>
+using namespace std;
+
+/** @class 	aligned_allocator
+ * @brief 	Allocator whose blocks start on an @a Align-byte boundary (a cache line by default)
+ */
+template <typename T, size_t Align = 64>
+struct aligned_allocator{
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <typename U>
+	struct rebind{
+		typedef aligned_allocator<U,Align> other;
+	};
+
+	aligned_allocator(){
+	}
+
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U,Align>&){
+	}
+
+	T* allocate(size_t n){
+		void* p = 0;
+		if (posix_memalign(&p,Align,n*sizeof(T) > 0 ? n*sizeof(T) : Align) != 0)
+			throw bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t){
+		free(p);
+	}
+
+	template <typename U>
+	bool operator==(const aligned_allocator<U,Align>&) const{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const aligned_allocator<U,Align>&) const{
+		return false;
+	}
+};
+
+/** A vector whose data() is 64-byte aligned, e.g. for targets and predictions */
+template <typename T>
+using aligned_vector = vector<T, aligned_allocator<T> >;
+
+/** Storage order of a Matrix */
+enum matrix_layout {ROW_MAJOR, COL_MAJOR};
+
+/** @class 	Matrix_view
+ * @brief 	Non-owning rows x cols window into a matrix, with arbitrary row and column strides
+ *
+ * Element (i, j) is data()[i*row_stride() + j*col_stride()], so a view can be a block,
+ * a single row or column, or the transpose of another view without copying.
+ * Views of a Matrix stay valid until it is resized.
+ */
+template <typename T>
+class Matrix_view{
+	public:
+		typedef unsigned size_type;
+		typedef T value_type;
+
+		Matrix_view():data_(0),rows_(0),cols_(0),rs_(0),cs_(0){
+		}
+
+		Matrix_view(T* data, size_type rows, size_type cols, ptrdiff_t row_stride, ptrdiff_t col_stride)
+		  :data_(data),rows_(rows),cols_(cols),rs_(row_stride),cs_(col_stride){
+		}
+
+		/** A view of const elements converts from a view of mutable ones */
+		operator Matrix_view<const T>() const{
+			return Matrix_view<const T>(data_,rows_,cols_,rs_,cs_);
+		}
+
+		T& operator()(size_type i, size_type j) const{
+			assert(i < rows_ && j < cols_);
+			return data_[i*rs_ + j*cs_];
+		}
+
+		/** Row @a i as a 1 x cols() view */
+		Matrix_view row(size_type i) const{
+			assert(i < rows_);
+			return Matrix_view(data_+i*rs_,1,cols_,rs_,cs_);
+		}
+
+		/** Column @a j as a rows() x 1 view */
+		Matrix_view col(size_type j) const{
+			assert(j < cols_);
+			return Matrix_view(data_+j*cs_,rows_,1,rs_,cs_);
+		}
+
+		/** The @a nr x @a nc block starting at (@a r, @a c) */
+		Matrix_view block(size_type r, size_type c, size_type nr, size_type nc) const{
+			assert(r+nr <= rows_ && c+nc <= cols_);
+			return Matrix_view(data_+r*rs_+c*cs_,nr,nc,rs_,cs_);
+		}
+
+		/** Rows [@a begin, @a end) */
+		Matrix_view rows(size_type begin, size_type end) const{
+			return block(begin,0,end-begin,cols_);
+		}
+
+		Matrix_view transpose() const{
+			return Matrix_view(data_,cols_,rows_,cs_,rs_);
+		}
+
+		/** True if the view is plain row-major memory, usable as (const T* x, rows, cols) */
+		bool row_contiguous() const{
+			return cs_ == 1 && (rows_ <= 1 || rs_ == (ptrdiff_t) cols_);
+		}
+
+		T* data() const{
+			return data_;
+		}
+
+		size_type rows() const{
+			return rows_;
+		}
+
+		size_type cols() const{
+			return cols_;
+		}
+
+		ptrdiff_t row_stride() const{
+			return rs_;
+		}
+
+		ptrdiff_t col_stride() const{
+			return cs_;
+		}
+
+	private:
+		T* data_;
+		size_type rows_;
+		size_type cols_;
+		ptrdiff_t rs_;
+		ptrdiff_t cs_;
+};
+
+/** @class 	Matrix
+ * @brief 	Dense rows x cols matrix in one 64-byte-aligned block, row- or column-major
+ *
+ * A row-major Matrix<double> is the (const double* x, n, d) layout every model's
+ * fit() and predict() take, through data(). push_row() appends in amortized O(cols),
+ * so a feature matrix can be built one observation at a time.
+ */
+template <typename T, matrix_layout L = ROW_MAJOR>
+class Matrix{
+	public:
+		typedef unsigned size_type;
+		typedef T value_type;
+		typedef Matrix_view<T> view_type;
+		typedef Matrix_view<const T> const_view_type;
+
+		Matrix():v_(),rows_(0),cols_(0){
+		}
+
+		Matrix(size_type rows, size_type cols, T val = T()):v_((size_t)rows*cols,val),rows_(rows),cols_(cols){
+		}
+
+		/** Copies @a rows x @a cols row-major values */
+		Matrix(const T* x, size_type rows, size_type cols):v_(),rows_(0),cols_(cols){
+			reserve(rows);
+			for (size_type i = 0; i < rows; ++i)
+				push_row(x+(size_t)i*cols);
+		}
+
+		T& operator()(size_type i, size_type j){
+			assert(i < rows_ && j < cols_);
+			return v_[offset(i,j)];
+		}
+
+		const T& operator()(size_type i, size_type j) const{
+			assert(i < rows_ && j < cols_);
+			return v_[offset(i,j)];
+		}
+
+		/** Resizes to @a rows x @a cols; existing values are kept only if cols() is unchanged (row-major) */
+		void resize(size_type rows, size_type cols, T val = T()){
+			v_.resize((size_t)rows*cols,val);
+			rows_ = rows;
+			cols_ = cols;
+		}
+
+		void reserve(size_type rows){
+			v_.reserve((size_t)rows*cols_);
+		}
+
+		/** Appends a row of cols() values; the first row of an empty matrix may set cols()
+		 * Amortized O(cols) row-major, O(size) column-major.
+		 */
+		void push_row(const T* r, size_type cols = 0){
+			if (rows_ == 0 && cols > 0)
+				cols_ = cols;
+			assert(cols == 0 || cols == cols_);
+			if (L == ROW_MAJOR){
+				v_.insert(v_.end(),r,r+cols_);
+			}else{
+				aligned_vector<T> w((size_t)(rows_+1)*cols_);
+				for (size_type j = 0; j < cols_; ++j){
+					for (size_type i = 0; i < rows_; ++i)
+						w[(size_t)j*(rows_+1)+i] = v_[(size_t)j*rows_+i];
+					w[(size_t)j*(rows_+1)+rows_] = r[j];
+				}
+				v_.swap(w);
+			}
+			++rows_;
+		}
+
+		void clear(){
+			v_.clear();
+			rows_ = 0;
+		}
+
+		view_type view(){
+			return view_type(data(),rows_,cols_,row_stride(),col_stride());
+		}
+
+		const_view_type view() const{
+			return const_view_type(data(),rows_,cols_,row_stride(),col_stride());
+		}
+
+		const_view_type row(size_type i) const{
+			return view().row(i);
+		}
+
+		const_view_type col(size_type j) const{
+			return view().col(j);
+		}
+
+		const_view_type block(size_type r, size_type c, size_type nr, size_type nc) const{
+			return view().block(r,c,nr,nc);
+		}
+
+		/** Rows [@a begin, @a end) */
+		const_view_type rows(size_type begin, size_type end) const{
+			return view().rows(begin,end);
+		}
+
+		operator const_view_type() const{
+			return view();
+		}
+
+		T* data(){
+			return v_.empty() ? 0 : &v_[0];
+		}
+
+		const T* data() const{
+			return v_.empty() ? 0 : &v_[0];
+		}
+
+		size_type rows() const{
+			return rows_;
+		}
+
+		size_type cols() const{
+			return cols_;
+		}
+
+		/** Number of rows, as for the vector-backed X_type this replaces */
+		size_type size() const{
+			return rows_;
+		}
+
+		ptrdiff_t row_stride() const{
+			return L == ROW_MAJOR ? (ptrdiff_t) cols_ : 1;
+		}
+
+		ptrdiff_t col_stride() const{
+			return L == ROW_MAJOR ? 1 : (ptrdiff_t) rows_;
+		}
+
+		bool operator==(const Matrix& m) const{
+			return rows_ == m.rows_ && cols_ == m.cols_ && v_ == m.v_;
+		}
+
+		bool operator!=(const Matrix& m) const{
+			return !((*this)==m);
+		}
+
+	private:
+		size_t offset(size_type i, size_type j) const{
+			return L == ROW_MAJOR ? (size_t)i*cols_ + j : (size_t)j*rows_ + i;
+		}
+
+		aligned_vector<T> v_;
+		size_type rows_;
+		size_type cols_;
+};
+
+/** Row-major pointer to the elements of @a x: x.data() itself if it is contiguous,
+ *  else a copy gathered into @a buf
+ */
+template <typename T>
+const T* contiguous_rows(const Matrix_view<const T>& x, aligned_vector<T>& buf){
+	if (x.row_contiguous())
+		return x.data();
+	buf.resize((size_t)x.rows()*x.cols());
+	for (unsigned i = 0; i < x.rows(); ++i)
+		for (unsigned j = 0; j < x.cols(); ++j)
+			buf[(size_t)i*x.cols()+j] = x(i,j);
+	return buf.empty() ? 0 : &buf[0];
+}
+
+/** Fits model @a m to the rows of @a x and the targets @a y
+ * M takes fit(const double* x, n, d, const double* y), like every model in this tree.
+ */
+template <typename M>
+void fit_matrix(M& m, const Matrix_view<const double>& x, const double* y){
+	aligned_vector<double> buf;
+	m.fit(contiguous_rows(x,buf),x.rows(),x.cols(),y);
+}
+
+/** Predicts the rows of @a x with model @a m into @a y_hat (x.rows() values) */
+template <typename M>
+void predict_matrix(const M& m, const Matrix_view<const double>& x, double* y_hat){
+	aligned_vector<double> buf;
+	m.predict(contiguous_rows(x,buf),x.rows(),x.cols(),y_hat);
+}
+
+#endif
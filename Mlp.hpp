@@ -0,0 +1,185 @@
+#ifndef CS207_MLP_HPP
+#define CS207_MLP_HPP
+
+/** @file Mlp.hpp
+ * @brief A small one-hidden-layer perceptron for regression
+ */
+
+#include "Kernels.hpp"
+#include "Loss.hpp"
+#include "Sgd.hpp"
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** @class 	Mlp_regression
+ * @brief 	y = w2 . relu(W1 x + b1) + b2
+ *
+ * params() holds W1 (hidden x d, row-major), b1 (hidden), w2 (hidden) and b2 in that
+ * order. fit() runs mini-batch Adam over shuffled epochs; Online_learner (Sgd.hpp)
+ * can keep training it on new samples through init(), params() and gradient().
+ * At most max_hidden hidden units, so predict() keeps activations on the stack.
+ */
+struct Mlp_regression{
+	public:
+		typedef unsigned size_type;
+
+		enum { max_hidden = 256 };
+
+		Mlp_regression(size_type hidden = 16, size_type epochs = 20, size_type batch_size = 32, double rate = 0.01, unsigned seed = 1)
+		  :hidden_(hidden),epochs_(epochs),batch_size_(batch_size),rate_(rate),seed_(seed),d_(0),w_(),has_fit_(false){
+			assert(hidden > 0 && hidden <= max_hidden);
+		}
+
+		/** Fits the network to @a n rows of @a d features from a fresh initialization */
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			assert(n > 0 && d > 0);
+			init(d);
+			Sgd_optimizer opt(Sgd_optimizer::ADAM,rate_);
+			vector<size_type> order(n);
+			for (size_type i = 0; i < n; ++i)
+				order[i] = i;
+			vector<double> xb((size_t)batch_size_*d), yb(batch_size_), g(w_.size());
+			mt19937 gen(seed_);
+			for (size_type e = 0; e < epochs_; ++e){
+				shuffle(order.begin(),order.end(),gen);
+				for (size_type start = 0; start < n; start += batch_size_){
+					size_type b = n-start < batch_size_ ? n-start : batch_size_;
+					for (size_type i = 0; i < b; ++i){
+						const double* row = x+(size_t)order[start+i]*d;
+						copy(row,row+d,&xb[(size_t)i*d]);
+						yb[i] = y[order[start+i]];
+					}
+					gradient(&xb[0],b,d,&yb[0],&g[0]);
+					opt.step(&w_[0],&g[0],w_.size());
+				}
+			}
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(has_fit_ && d == d_);
+			double a[max_hidden];
+			for (size_type i = 0; i < n; ++i)
+				y_hat[i] = forward(x+(size_t)i*d,a);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (!has_fit_)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		/** Starts an untrained network of @a d inputs (scaled uniform initialization) */
+		void init(size_type d){
+			d_ = d;
+			w_.assign(num_params(),0.0);
+			mt19937 gen(seed_);
+			uniform_real_distribution<double> u1(-sqrt(6.0/(d+hidden_)),sqrt(6.0/(d+hidden_)));
+			uniform_real_distribution<double> u2(-sqrt(6.0/(hidden_+1)),sqrt(6.0/(hidden_+1)));
+			for (size_t k = 0; k < (size_t)hidden_*d; ++k)
+				w_[k] = u1(gen);
+			for (size_type h = 0; h < hidden_; ++h)
+				w_[w2_offset()+h] = u2(gen);
+			has_fit_ = true;
+		}
+
+		/** Gradient of half the mean squared error over @a n rows, written to @a g
+		 * @return 	half the mean squared error at the current parameters
+		 */
+		double gradient(const double* x, size_type n, size_type d, const double* y, double* g) const{
+			assert(has_fit_ && d == d_ && n > 0);
+			for (size_type k = 0; k < w_.size(); ++k)
+				g[k] = 0.0;
+			const double* w2 = &w_[w2_offset()];
+			double* gw1 = g;
+			double* gb1 = g + (size_t)hidden_*d;
+			double* gw2 = g + w2_offset();
+			double a[max_hidden];
+			double loss = 0.0;
+			for (size_type i = 0; i < n; ++i){
+				const double* row = x+(size_t)i*d;
+				double r = forward(row,a) - y[i];
+				loss += r*r;
+				double dout = r/n;
+				g[w_.size()-1] += dout;
+				axpy(dout,a,gw2,hidden_);
+				for (size_type h = 0; h < hidden_; ++h){
+					if (a[h] <= 0.0)
+						continue;
+					double dz = dout*w2[h];
+					gb1[h] += dz;
+					axpy(dz,row,gw1+(size_t)h*d,d);
+				}
+			}
+			return 0.5*loss/n;
+		}
+
+		vector<double>& params(){
+			return w_;
+		}
+
+		void set_params(vector<double> w){
+			assert(d_ > 0 && w.size() == num_params());
+			w_ = w;
+			has_fit_ = true;
+		}
+
+		vector<double> get_params() const{
+			return w_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+		size_type hidden() const{
+			return hidden_;
+		}
+
+		size_type num_params() const{
+			return hidden_*d_ + 2*hidden_ + 1;
+		}
+
+		bool operator==(const Mlp_regression& r) const{
+			return (w_==r.w_) && (has_fit_==r.has_fit_) && (hidden_==r.hidden_);
+		}
+
+		bool operator!=(const Mlp_regression& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+
+		size_t w2_offset() const{
+			return (size_t)hidden_*d_ + hidden_;
+		}
+
+		/** Output for one row, leaving the hidden activations in @a a */
+		double forward(const double* row, double* a) const{
+			const double* w1 = &w_[0];
+			const double* b1 = w1 + (size_t)hidden_*d_;
+			for (size_type h = 0; h < hidden_; ++h){
+				double z = b1[h] + dot_product(w1+(size_t)h*d_,row,d_);
+				a[h] = z > 0.0 ? z : 0.0;
+			}
+			return w_[w_.size()-1] + dot_product(&w_[w2_offset()],a,hidden_);
+		}
+
+		size_type hidden_;
+		size_type epochs_;
+		size_type batch_size_;
+		double rate_;
+		unsigned seed_;
+		size_type d_;
+		vector<double> w_;
+		bool has_fit_;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CS207_PARALLEL_HPP
+#define CS207_PARALLEL_HPP
+
+/** @file Parallel.hpp
+ * @brief Splitting loops over the workers of one long-lived Thread_pool
+ */
+
+#include "Thread_pool.hpp"
+#include <cstddef>
+using namespace std;
+
+/** The pool parallel_for() runs on: default_threads() workers, started on first use
+ * and kept until the program exits
+ */
+inline Thread_pool& shared_pool(){
+	static Thread_pool pool;
+	return pool;
+}
+
+/** Runs f(lo, hi, tid) over [@a begin, @a end) split into one contiguous chunk per thread
+ * @param[in] threads	number of chunks/threads, 0 for default_threads()
+ * @param[in] grain	minimum number of iterations per chunk; small ranges run inline
+ *
+ * The calling thread runs chunk 0 and the workers of shared_pool() the others, so no
+ * thread is started per call and loops inside an iterative solver stay cheap. @a tid is
+ * in [0, threads) and can index per-thread scratch space. Returns when every chunk is
+ * done; it may be nested inside another parallel_for() or a Thread_pool task.
+ */
+template <typename F>
+void parallel_for(size_t begin, size_t end, F f, unsigned threads = 0, size_t grain = 1024){
+	if (threads == 0)
+		threads = default_threads();
+	size_t n = end > begin ? end-begin : 0;
+	if (grain == 0)
+		grain = 1;
+	if (n/grain < threads)
+		threads = (unsigned) (n/grain > 0 ? n/grain : 1);
+	if (threads <= 1){
+		if (n > 0)
+			f(begin, end, 0u);
+		return;
+	}
+	shared_pool().run_chunks(begin,end,threads,f);
+}
+
+#endif
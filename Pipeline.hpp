@@ -0,0 +1,553 @@
+#ifndef CS207_PIPELINE_HPP
+#define CS207_PIPELINE_HPP
+
+/** @file Pipeline.hpp
+ * @brief Feature preprocessing stages chained at compile time and applied in one fused pass
+ */
+
+#include "Kernels.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cassert>
+using namespace std;
+
+/* A stage S provides
+ *   enum { needs_fit = 0 or 1 };
+ *   void begin_fit(size_type d);  void observe(const double* row);  void end_fit();
+ *   size_type out_dims(size_type d) const;
+ *   void apply(const double* in, size_type d, double* out) const;	//in != out
+ *   bool operator==(const S&) const;	//same options and fitted parameters
+ * begin_fit/observe/end_fit see every training row as it leaves the previous stages.
+ */
+
+/** @class 	Standardize
+ * @brief 	x_j -> (x_j - mean_j) / sd_j, with the moments fitted in one Welford pass
+ */
+struct Standardize{
+	public:
+		typedef unsigned size_type;
+		enum { needs_fit = 1 };
+
+		Standardize():n_(0.0){
+		}
+
+		void begin_fit(size_type d){
+			n_ = 0;
+			mean_.assign(d,0.0);
+			m2_.assign(d,0.0);
+		}
+
+		void observe(const double* row){
+			++n_;
+			for (size_type j = 0; j < mean_.size(); ++j){
+				double delta = row[j] - mean_[j];
+				mean_[j] += delta/n_;
+				m2_[j] += delta*(row[j] - mean_[j]);
+			}
+		}
+
+		/** A constant column gets a unit scale, so it maps to 0 */
+		void end_fit(){
+			inv_sd_.resize(mean_.size());
+			for (size_type j = 0; j < mean_.size(); ++j){
+				double var = n_ > 1 ? m2_[j]/(n_-1) : 0.0;
+				inv_sd_[j] = var > 0.0 ? 1.0/sqrt(var) : 1.0;
+			}
+		}
+
+		size_type out_dims(size_type d) const{
+			return d;
+		}
+
+		void apply(const double* KERNEL_RESTRICT in, size_type d, double* KERNEL_RESTRICT out) const{
+			assert(d == mean_.size());
+			const double* m = &mean_[0];
+			const double* s = &inv_sd_[0];
+			for (size_type j = 0; j < d; ++j)
+				out[j] = (in[j]-m[j])*s[j];
+		}
+
+		const vector<double>& mean() const{
+			return mean_;
+		}
+
+		/** 1/sd of every column, as fitted by end_fit() */
+		const vector<double>& inv_sd() const{
+			return inv_sd_;
+		}
+
+		bool operator==(const Standardize& s) const{
+			return mean_ == s.mean_ && inv_sd_ == s.inv_sd_;
+		}
+
+	private:
+		double n_;
+		vector<double> mean_;
+		vector<double> m2_;
+		vector<double> inv_sd_;
+};
+
+/** @class 	Log_transform
+ * @brief 	x_j -> sign(x_j) log(1 + |x_j|) on the columns [begin, end), e.g. row counts and costs
+ */
+struct Log_transform{
+	public:
+		typedef unsigned size_type;
+		enum { needs_fit = 0 };
+
+		Log_transform(size_type begin = 0, size_type end = UINT_MAX):begin_(begin),end_(end){
+		}
+
+		void begin_fit(size_type){
+		}
+
+		void observe(const double*){
+		}
+
+		void end_fit(){
+		}
+
+		size_type out_dims(size_type d) const{
+			return d;
+		}
+
+		void apply(const double* KERNEL_RESTRICT in, size_type d, double* KERNEL_RESTRICT out) const{
+			size_type b = begin_ < d ? begin_ : d, e = end_ < d ? end_ : d;
+			for (size_type j = 0; j < b; ++j)
+				out[j] = in[j];
+			for (size_type j = b; j < e; ++j)
+				out[j] = copysign(log1p(fabs(in[j])),in[j]);
+			for (size_type j = e; j < d; ++j)
+				out[j] = in[j];
+		}
+
+		bool operator==(const Log_transform& t) const{
+			return begin_ == t.begin_ && end_ == t.end_;
+		}
+
+	private:
+		size_type begin_;
+		size_type end_;
+};
+
+/** @class 	Bucketize
+ * @brief 	x_j -> index of its equal-depth bucket among @a buckets fitted per column
+ *
+ * Fitting keeps the observed values of every column and cuts them at their quantiles;
+ * a value equal to a cut point goes to the upper bucket.
+ */
+struct Bucketize{
+	public:
+		typedef unsigned size_type;
+		enum { needs_fit = 1 };
+
+		Bucketize(size_type buckets = 16):buckets_(buckets),d_(0){
+			assert(buckets > 1);
+		}
+
+		void begin_fit(size_type d){
+			d_ = d;
+			values_.assign(d,vector<double>());
+		}
+
+		void observe(const double* row){
+			for (size_type j = 0; j < d_; ++j)
+				values_[j].push_back(row[j]);
+		}
+
+		void end_fit(){
+			cuts_.assign((size_t)d_*(buckets_-1),HUGE_VAL);
+			for (size_type j = 0; j < d_; ++j){
+				vector<double>& v = values_[j];
+				if (v.empty())
+					continue;
+				sort(v.begin(),v.end());
+				for (size_type b = 1; b < buckets_; ++b)
+					cuts_[(size_t)j*(buckets_-1)+b-1] = v[(size_t)b*v.size()/buckets_];
+				vector<double>().swap(v);
+			}
+		}
+
+		size_type out_dims(size_type d) const{
+			return d;
+		}
+
+		void apply(const double* KERNEL_RESTRICT in, size_type d, double* KERNEL_RESTRICT out) const{
+			assert(d == d_);
+			for (size_type j = 0; j < d; ++j){
+				const double* c = &cuts_[(size_t)j*(buckets_-1)];
+				out[j] = (double) (upper_bound(c,c+buckets_-1,in[j]) - c);
+			}
+		}
+
+		bool operator==(const Bucketize& b) const{
+			return buckets_ == b.buckets_ && d_ == b.d_ && cuts_ == b.cuts_;
+		}
+
+	private:
+		size_type buckets_;
+		size_type d_;
+		vector<vector<double> > values_;	//only while fitting
+		vector<double> cuts_;			//buckets-1 per column
+};
+
+/** @class 	Polynomial
+ * @brief 	Degree-2 expansion: the d inputs, then x_j*x_k for every j <= k
+ */
+struct Polynomial{
+	public:
+		typedef unsigned size_type;
+		enum { needs_fit = 0 };
+
+		void begin_fit(size_type){
+		}
+
+		void observe(const double*){
+		}
+
+		void end_fit(){
+		}
+
+		size_type out_dims(size_type d) const{
+			return d + d*(d+1)/2;
+		}
+
+		void apply(const double* KERNEL_RESTRICT in, size_type d, double* KERNEL_RESTRICT out) const{
+			for (size_type j = 0; j < d; ++j)
+				out[j] = in[j];
+			double* p = out + d;
+			for (size_type j = 0; j < d; ++j){
+				double xj = in[j];
+				for (size_type k = j; k < d; ++k)
+					*p++ = xj*in[k];
+			}
+		}
+
+		bool operator==(const Polynomial&) const{
+			return true;
+		}
+};
+
+/** Stages S... applied in order. The recursion is resolved at compile time, so a
+ * row runs through the stages with every apply() inlined; intermediate results
+ * ping-pong between two scratch rows @a s1 and @a s2.
+ */
+template <typename... S>
+struct Stage_chain;
+
+template <typename S>
+struct Stage_chain<S>{
+	typedef unsigned size_type;
+	enum { size = 1 };
+
+	Stage_chain(S head = S()):head_(head){
+	}
+
+	size_type out_dims(size_type d) const{
+		return head_.out_dims(d);
+	}
+
+	size_type max_dims(size_type d) const{
+		return head_.out_dims(d) > d ? head_.out_dims(d) : d;
+	}
+
+	void apply(const double* in, size_type d, double* out, double*, double*) const{
+		head_.apply(in,d,out);
+	}
+
+	bool needs_fit(size_type k) const{
+		(void) k;
+		return S::needs_fit;
+	}
+
+	void begin_fit(size_type k, size_type d){
+		(void) k;
+		head_.begin_fit(d);
+	}
+
+	void observe(size_type k, const double* row, size_type, double*, double*){
+		(void) k;
+		head_.observe(row);
+	}
+
+	void end_fit(size_type k){
+		(void) k;
+		head_.end_fit();
+	}
+
+	bool operator==(const Stage_chain& c) const{
+		return head_ == c.head_;
+	}
+
+	S head_;
+};
+
+template <typename S, typename T, typename... R>
+struct Stage_chain<S,T,R...>{
+	typedef unsigned size_type;
+	typedef Stage_chain<T,R...> tail_type;
+	enum { size = 1 + tail_type::size };
+
+	Stage_chain():head_(),tail_(){
+	}
+
+	Stage_chain(S head, T next, R... rest):head_(head),tail_(next,rest...){
+	}
+
+	size_type out_dims(size_type d) const{
+		return tail_.out_dims(head_.out_dims(d));
+	}
+
+	size_type max_dims(size_type d) const{
+		size_type m = tail_.max_dims(head_.out_dims(d));
+		return m > d ? m : d;
+	}
+
+	void apply(const double* in, size_type d, double* out, double* s1, double* s2) const{
+		head_.apply(in,d,s1);
+		tail_.apply(s1,head_.out_dims(d),out,s2,s1);
+	}
+
+	bool needs_fit(size_type k) const{
+		return k == 0 ? (bool) S::needs_fit : tail_.needs_fit(k-1);
+	}
+
+	/** Starts fitting stage @a k, whose input has @a d columns before stage 0 */
+	void begin_fit(size_type k, size_type d){
+		if (k == 0)
+			head_.begin_fit(d);
+		else
+			tail_.begin_fit(k-1,head_.out_dims(d));
+	}
+
+	/** Runs @a row through the stages before @a k and hands it to stage @a k */
+	void observe(size_type k, const double* row, size_type d, double* s1, double* s2){
+		if (k == 0){
+			head_.observe(row);
+			return;
+		}
+		head_.apply(row,d,s1);
+		tail_.observe(k-1,s1,head_.out_dims(d),s2,s1);
+	}
+
+	void end_fit(size_type k){
+		if (k == 0)
+			head_.end_fit();
+		else
+			tail_.end_fit(k-1);
+	}
+
+	bool operator==(const Stage_chain& c) const{
+		return head_ == c.head_ && tail_ == c.tail_;
+	}
+
+	S head_;
+	tail_type tail_;
+};
+
+/** @class 	Pipeline
+ * @brief 	Preprocessing stages fitted once and applied as one fused pass
+ *
+ * Pipeline<Log_transform, Standardize, Polynomial> p; p.fit(policy, d); then
+ * p.transform(x, n, d, out) takes every row through all three stages while it is
+ * in cache and writes only the final features, instead of one pass and one full
+ * matrix copy per stage. transform_row() does the same for a single row, e.g. at
+ * predict time (see Pipeline_model).
+ *
+ * Stage k is fitted on the rows as they leave stages 0..k-1, in one pass over the
+ * training rows per stage that needs fitting; no intermediate matrix is stored.
+ */
+template <typename... S>
+class Pipeline{
+	public:
+		typedef unsigned size_type;
+		typedef Stage_chain<S...> chain_type;
+
+		Pipeline():chain_(),d_(0),width_(0){
+		}
+
+		Pipeline(S... stages):chain_(stages...),d_(0),width_(0){
+		}
+
+		/** Fits the stages on @a n row-major rows of @a d features */
+		void fit(const double* x, size_type n, size_type d){
+			fit_rows(n,d,[&](size_type i, double*){
+				return x+(size_t)i*d;
+			});
+		}
+
+		/** Fits the stages on the samples a Sampler policy holds
+		 * @param[in] d	leading elements of each sample that are features, 0 for all
+		 *		(e.g. size-1 when each sample ends with its target)
+		 */
+		template <typename Policy>
+		void fit(Policy p, size_type d = 0){
+			const auto& s = p.samples();
+			assert(!s.empty());
+			if (d == 0)
+				d = s[0].size();
+			fit_rows(s.size(),d,[&](size_type i, double* buf){
+				assert(s[i].size() >= d);
+				for (size_type j = 0; j < d; ++j)
+					buf[j] = s[i][j];
+				return (const double*) buf;
+			});
+		}
+
+		/** Writes the transformed @a n rows to @a out, n x out_dims() row-major */
+		void transform(const double* x, size_type n, size_type d, double* out) const{
+			assert(d == d_);
+			size_type od = out_dims();
+			double* s1 = scratch(0);
+			double* s2 = scratch(1);
+			for (size_type i = 0; i < n; ++i)
+				chain_.apply(x+(size_t)i*d,d,out+(size_t)i*od,s1,s2);
+		}
+
+		/** Writes the transformed row @a in (dims() values) to @a out (out_dims() values) */
+		void transform_row(const double* in, double* out) const{
+			chain_.apply(in,d_,out,scratch(0),scratch(1));
+		}
+
+		/** Number of input features */
+		size_type dims() const{
+			return d_;
+		}
+
+		/** Number of features after the last stage */
+		size_type out_dims() const{
+			return chain_.out_dims(d_);
+		}
+
+		/** The stages, as nested head_ / tail_ members */
+		chain_type& stages(){
+			return chain_;
+		}
+
+		const chain_type& stages() const{
+			return chain_;
+		}
+
+		/** Same input width and every stage with the same options and fitted parameters */
+		bool operator==(const Pipeline& p) const{
+			return d_ == p.d_ && chain_ == p.chain_;
+		}
+
+	private:
+
+		template <typename Rows>
+		void fit_rows(size_type n, size_type d, Rows rows){
+			assert(n > 0 && d > 0);
+			d_ = d;
+			width_ = chain_.max_dims(d);
+			vector<double> buf(d);
+			for (size_type k = 0; k < (size_type) chain_type::size; ++k){
+				if (!chain_.needs_fit(k))
+					continue;
+				chain_.begin_fit(k,d);
+				for (size_type i = 0; i < n; ++i)
+					chain_.observe(k,rows(i,&buf[0]),d,scratch(0),scratch(1));
+				chain_.end_fit(k);
+			}
+		}
+
+		/** Scratch row @a i (0 or 1) of this thread, wide enough for any stage's output */
+		double* scratch(size_type i) const{
+			static thread_local vector<double> rows;
+			if (rows.size() < 2*(size_t)width_)
+				rows.resize(2*(size_t)width_);
+			return &rows[0] + (size_t)i*width_;
+		}
+
+		chain_type chain_;
+		size_type d_;
+		size_type width_;	//widest row between two stages
+};
+
+/** @class 	Pipeline_model
+ * @brief 	A model M trained and evaluated on the output of a Pipeline P
+ *
+ * fit() fits the pipeline on the training rows, transforms them in one fused pass and
+ * fits M. predict() transforms lazily, block_rows rows at a time into a small buffer,
+ * so raw features go straight in at predict time and no transformed copy of a large
+ * input is made. Works as a Manager slot like M itself: operator== compares the fitted
+ * pipeline as well as the model, so two slots that differ only in preprocessing differ.
+ */
+template <typename P, typename M>
+struct Pipeline_model{
+	public:
+		typedef unsigned size_type;
+		enum { block_rows = 64 };
+
+		Pipeline_model(P p = P(), M m = M()):p_(p),m_(m),fitted_(false){
+		}
+
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			p_.fit(x,n,d);
+			xt_.resize((size_t)n*p_.out_dims());
+			p_.transform(x,n,d,&xt_[0]);
+			m_.fit(&xt_[0],n,p_.out_dims(),y);
+			vector<double>().swap(xt_);
+			fitted_ = true;
+		}
+
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(fitted_ && d == p_.dims());
+			size_type od = p_.out_dims();
+			static thread_local vector<double> block;
+			block.resize((size_t)block_rows*od);
+			for (size_type start = 0; start < n; start += block_rows){
+				size_type b = n-start < (size_type) block_rows ? n-start : (size_type) block_rows;
+				p_.transform(x+(size_t)start*d,b,d,&block[0]);
+				m_.predict(&block[0],b,od,y_hat+start);
+			}
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (!fitted_)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		size_type dims() const{
+			return p_.dims();
+		}
+
+		P& pipeline(){
+			return p_;
+		}
+
+		const P& pipeline() const{
+			return p_;
+		}
+
+		M& model(){
+			return m_;
+		}
+
+		const M& model() const{
+			return m_;
+		}
+
+		bool operator==(const Pipeline_model& r) const{
+			return (m_==r.m_) && (p_==r.p_) && (fitted_==r.fitted_);
+		}
+
+		bool operator!=(const Pipeline_model& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+		P p_;
+		M m_;
+		bool fitted_;
+		vector<double> xt_;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef CS207_QUANTIZE_HPP
+#define CS207_QUANTIZE_HPP
+
+/** @file Quantize.hpp
+ * @brief int8 inference for the linear and MLP models, with post-training calibration
+ */
+
+#include "Kernels.hpp"
+#include "Loss.hpp"
+#include "Regression.hpp"
+#include "Mlp.hpp"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** Symmetric int8 scales of the @a d input features from @a n calibration rows
+ * @post scale[j] == max_i |x[i][j]| / 127 (1 for a constant-zero feature) and inv_scale[j] == 1/scale[j]
+ */
+inline void calibrate_inputs(const double* x, unsigned n, unsigned d, vector<double>& scale, vector<double>& inv_scale){
+	scale.assign(d,0.0);
+	for (unsigned i = 0; i < n; ++i){
+		const double* row = x+(size_t)i*d;
+		for (unsigned j = 0; j < d; ++j)
+			scale[j] = fabs(row[j]) > scale[j] ? fabs(row[j]) : scale[j];
+	}
+	inv_scale.resize(d);
+	for (unsigned j = 0; j < d; ++j){
+		scale[j] = scale[j] > 0.0 ? scale[j]/127.0 : 1.0;
+		inv_scale[j] = 1.0/scale[j];
+	}
+}
+
+/** Quantizes the @a n values @a w to @a q with one symmetric scale, which is returned */
+inline double quantize_channel(const double* w, size_t n, int8_t* q){
+	double m = 0.0;
+	for (size_t i = 0; i < n; ++i)
+		m = fabs(w[i]) > m ? fabs(w[i]) : m;
+	double scale = m > 0.0 ? m/127.0 : 1.0;
+	quantize_i8(w,1.0/scale,q,n);
+	return scale;
+}
+
+/** @class 	Quantized_linear
+ * @brief 	int8 copy of a fitted Linear_regression
+ *
+ * Each input feature gets a calibrated scale s_j, which is folded into its weight
+ * before the weights are quantized, so a prediction is
+ * b + r * sum_j qw_j * round(x_j / s_j) with one int8 dot product. Rows are quantized
+ * into a per-thread scratch row, so predict() allocates only on a thread's first call.
+ */
+struct Quantized_linear{
+	public:
+		typedef unsigned size_type;
+
+		Quantized_linear():d_(0),scale_(1.0),b_(0.0){
+		}
+
+		/** Quantizes @a m, calibrating the input scales on @a n rows of @a d features */
+		void build(const Linear_regression& m, const double* x, size_type n, size_type d){
+			assert(m.dims() == d && n > 0);
+			d_ = d;
+			vector<double> w = m.get_params();
+			vector<double> in_scale;
+			calibrate_inputs(x,n,d,in_scale,inv_in_);
+			for (size_type j = 0; j < d; ++j)
+				w[j] *= in_scale[j];
+			w_.resize(d);
+			scale_ = quantize_channel(&w[0],d,&w_[0]);
+			b_ = w[d];
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(d == d_);
+			static thread_local vector<int8_t> qx;
+			qx.resize(d);
+			for (size_type i = 0; i < n; ++i){
+				quantize_i8(x+(size_t)i*d,&inv_in_[0],&qx[0],d);
+				y_hat[i] = b_ + scale_*dot_product_i8(&w_[0],&qx[0],d);
+			}
+		}
+
+		/** Bytes of quantized weights and scales */
+		size_t bytes() const{
+			return w_.size() + inv_in_.size()*sizeof(double) + 2*sizeof(double);
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+	private:
+		size_type d_;
+		vector<double> inv_in_;
+		vector<int8_t> w_;
+		double scale_;
+		double b_;
+};
+
+/** @class 	Quantized_mlp
+ * @brief 	int8 copy of a fitted Mlp_regression
+ *
+ * The first layer has one scale per hidden unit (per output channel), with the input
+ * scales folded in as for Quantized_linear, and is stored transposed so it is applied
+ * with gemv_i8_t. The hidden activations are quantized with
+ * one scale calibrated on the largest activation the calibration rows produce.
+ * Biases stay in double. predict() reuses a per-thread scratch row as Quantized_linear does.
+ */
+struct Quantized_mlp{
+	public:
+		typedef unsigned size_type;
+
+		Quantized_mlp():d_(0),hidden_(0),inv_a_(1.0),scale2_(1.0),b2_(0.0){
+		}
+
+		/** Quantizes @a m, calibrating the input and activation scales on @a n rows of @a d features */
+		void build(const Mlp_regression& m, const double* x, size_type n, size_type d){
+			assert(m.dims() == d && n > 0);
+			d_ = d;
+			hidden_ = m.hidden();
+			vector<double> w = m.get_params();
+			vector<double> in_scale;
+			calibrate_inputs(x,n,d,in_scale,inv_in_);
+
+			w1_.resize((size_t)hidden_*d);
+			scale1_.resize(hidden_);
+			vector<int8_t> q(d);
+			for (size_type h = 0; h < hidden_; ++h){
+				double* row = &w[(size_t)h*d];
+				for (size_type j = 0; j < d; ++j)
+					row[j] *= in_scale[j];
+				scale1_[h] = quantize_channel(row,d,&q[0]);
+				for (size_type j = 0; j < d; ++j)
+					w1_[(size_t)j*hidden_+h] = q[j];
+			}
+			const double* b1 = &w[(size_t)hidden_*d];
+			b1_.assign(b1,b1+hidden_);
+
+			// calibrate the activations through the quantized first layer
+			double a_max = 0.0, a[Mlp_regression::max_hidden];
+			vector<int8_t> qx(d);
+			for (size_type i = 0; i < n; ++i){
+				hidden_layer(x+(size_t)i*d,&qx[0],a);
+				for (size_type h = 0; h < hidden_; ++h)
+					a_max = a[h] > a_max ? a[h] : a_max;
+			}
+			double a_scale = a_max > 0.0 ? a_max/127.0 : 1.0;
+			inv_a_ = 1.0/a_scale;
+
+			vector<double> w2(&w[(size_t)hidden_*d+hidden_],&w[(size_t)hidden_*d+2*hidden_]);
+			for (size_type h = 0; h < hidden_; ++h)
+				w2[h] *= a_scale;
+			w2_.resize(hidden_);
+			scale2_ = quantize_channel(&w2[0],hidden_,&w2_[0]);
+			b2_ = w.back();
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(d == d_);
+			static thread_local vector<int8_t> qx;
+			qx.resize(d);
+			double a[Mlp_regression::max_hidden];
+			int8_t qa[Mlp_regression::max_hidden];
+			for (size_type i = 0; i < n; ++i){
+				hidden_layer(x+(size_t)i*d,&qx[0],a);
+				quantize_i8(a,inv_a_,qa,hidden_);
+				y_hat[i] = b2_ + scale2_*dot_product_i8(&w2_[0],qa,hidden_);
+			}
+		}
+
+		/** Bytes of quantized weights, biases and scales */
+		size_t bytes() const{
+			return w1_.size() + w2_.size() + (inv_in_.size() + scale1_.size() + b1_.size() + 3)*sizeof(double);
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+	private:
+
+		/** ReLU activations of one row into @a a, using @a qx as scratch for the quantized row */
+		void hidden_layer(const double* row, int8_t* qx, double* a) const{
+			int32_t acc[Mlp_regression::max_hidden];
+			quantize_i8(row,&inv_in_[0],qx,d_);
+			gemv_i8_t(&w1_[0],qx,acc,hidden_,d_);
+			for (size_type h = 0; h < hidden_; ++h){
+				double z = b1_[h] + scale1_[h]*acc[h];
+				a[h] = z > 0.0 ? z : 0.0;
+			}
+		}
+
+		size_type d_;
+		size_type hidden_;
+		vector<double> inv_in_;
+		vector<int8_t> w1_;		//d x hidden
+		vector<double> scale1_;
+		vector<double> b1_;
+		double inv_a_;
+		vector<int8_t> w2_;
+		double scale2_;
+		double b2_;
+};
+
+/** The int8 form of each quantizable model */
+template <typename M>
+struct quantized_model;
+
+template <>
+struct quantized_model<Linear_regression>{
+	typedef Quantized_linear type;
+};
+
+template <>
+struct quantized_model<Mlp_regression>{
+	typedef Quantized_mlp type;
+};
+
+/** @class 	Quantizable
+ * @brief 	A model M that can switch its predictions to an int8 copy of itself
+ *
+ * Use it as the slot type to make quantization selectable per model in a Manager,
+ * e.g. Manager<Quantizable<Linear_regression>, Mlp_regression> quantizes only slot 1.
+ * quantize() calibrates on a sample of representative rows (such as recent subplan
+ * features) and makes predict() and score() use the int8 weights until the next fit()
+ * or dequantize(). Updates through params() or set_params() do not reach the int8
+ * copy; call quantize() again after them.
+ */
+template <typename M>
+struct Quantizable: public M{
+	public:
+		typedef typename M::size_type size_type;
+		typedef typename quantized_model<M>::type quantized_type;
+
+		/** Takes the constructor arguments of M */
+		using M::M;
+
+		Quantizable():M(),q_(),quantized_(false){
+		}
+
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			M::fit(x,n,d,y);
+			quantized_ = false;
+		}
+
+		/** Builds the int8 copy from @a n calibration rows of @a d features and predicts with it */
+		void quantize(const double* x, size_type n, size_type d){
+			q_.build(*this,x,n,d);
+			quantized_ = true;
+		}
+
+		/** Goes back to predicting with the double weights */
+		void dequantize(){
+			quantized_ = false;
+		}
+
+		bool quantized() const{
+			return quantized_;
+		}
+
+		const quantized_type& int8_model() const{
+			return q_;
+		}
+
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			if (quantized_)
+				q_.predict(x,n,d,y_hat);
+			else
+				M::predict(x,n,d,y_hat);
+		}
+
+		/** Sum of squared errors over @a n rows, with the weights predict() uses */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (M::dims() == 0)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		bool operator==(const Quantizable& r) const{
+			return M::operator==(r) && (quantized_==r.quantized_);
+		}
+
+		bool operator!=(const Quantizable& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+		quantized_type q_;
+		bool quantized_ = false;
+};
+
+#endif
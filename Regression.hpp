@@ -0,0 +1,580 @@
+#ifndef CS207_REGRESSION_HPP
+#define CS207_REGRESSION_HPP
+
+/** @file Regression.hpp
+ * @brief Linear and ridge regression for use with Manager and Selector
+ */
+
+#include "Kernels.hpp"
+#include "Sparse.hpp"
+#include "Loss.hpp"
+#include "Parallel.hpp"
+#include <vector>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** @class 	Linear_regression
+ * @brief 	Least squares (ridge when lambda > 0) regression with an intercept
+ *
+ * fit() centers the features and solves (Xc^T Xc + lambda*I) w = Xc^T yc.
+ * With at most cg_dims features and at least as many rows as features the
+ * Gram matrix is accumulated block by block and factored by Cholesky. The blocks
+ * are split over threads, each summing a private Gram matrix, while those fit in
+ * partial_bytes; above that (wide problems on many cores) the rows of the one
+ * shared Gram matrix are split over the threads instead, each reading every block. Wider problems use conjugate gradient with
+ * matrix-free products, warm started from the previous fit of the same width.
+ *
+ * The workspace is kept between fits, so refitting on data of the same shape
+ * does not allocate. predict() never allocates. A fit on data holding a NaN or
+ * infinity leaves the model unfitted (fitted() is false).
+ *
+ * fit(), predict(), score() and gradient() also take a Csr_matrix (Sparse.hpp).
+ * Centering is then applied implicitly (Xc = X - 1 mean^T) so only stored entries
+ * are touched: the Gram matrix is X^T X - n mean mean^T, accumulated from the
+ * pairs of nonzeros of each row, and every CG product is O(nnz).
+ *
+ * get_params() returns the d weights followed by the intercept. init(),
+ * params() and gradient() let Online_learner (Sgd.hpp) train it incrementally.
+ */
+struct Linear_regression{
+	public:
+		typedef unsigned size_type;
+
+		/** Number of features above which fit() switches to conjugate gradient */
+		enum { cg_dims = 2048 };
+		/** Rows per block when accumulating the Gram matrix */
+		enum { block_rows = 64 };
+		/** Most memory, over all threads, for private Gram matrices */
+		enum { partial_bytes = 64 << 20 };
+		/** Times a singular Gram matrix is retried with a tenfold jitter before fit() gives up */
+		enum { max_jitters = 64 };
+
+		/** @param[in] lambda	ridge penalty, 0 for ordinary least squares
+		 *  @param[in] threads	threads used by fit(), 0 for all cores
+		 */
+		Linear_regression(double lambda = 0.0, unsigned threads = 0)
+		  :lambda_(lambda),threads_(threads),d_(0),w_(),has_fit_(false),y_mean_(0.0){
+		}
+
+		/** Fits the model to @a n rows of @a d features
+		 * @param[in] x	row-major @a n x @a d features
+		 * @param[in] y	@a n targets
+		 * @post	fitted() is false if @a x or @a y holds a NaN or infinity
+		 * Complexity: O(n*d^2 + d^3) for Cholesky, O(n*d) per CG iteration
+		 */
+		void fit(const double* x, size_type n, size_type d, const double* y){
+			assert(n > 0 && d > 0);
+			bool warm = has_fit_ && d_ == d;
+			d_ = d;
+			w_.resize(d+1);
+			unsigned threads = threads_ ? threads_ : default_threads();
+
+			column_means(x,n,d,y,threads);
+			if (!finite_means(d))
+				has_fit_ = false;
+			else if (d > n || d > cg_dims)
+				has_fit_ = solve_cg(x,n,d,y,threads,warm);
+			else
+				has_fit_ = solve_cholesky(x,n,d,y,threads);
+			if (!has_fit_)
+				return;
+
+			w_[d] = y_mean_ - dot_product(&mean_[0],&w_[0],d);
+		}
+
+		/** Fits the model to the rows of the sparse matrix @a x
+		 * Complexity: O(sum_i nnz_i^2 + d^3) for Cholesky, O(nnz + d) per CG iteration
+		 */
+		void fit(const Csr_matrix& x, const double* y){
+			size_type n = x.rows(), d = x.cols();
+			assert(n > 0 && d > 0);
+			bool warm = has_fit_ && d_ == d;
+			d_ = d;
+			w_.resize(d+1);
+			unsigned threads = threads_ ? threads_ : default_threads();
+
+			column_means(x,n,d,y,threads);
+			if (!finite_means(d))
+				has_fit_ = false;
+			else if (d > n || d > cg_dims)
+				has_fit_ = solve_cg(x,n,d,y,threads,warm);
+			else
+				has_fit_ = solve_sparse_cholesky(x,n,d,y,threads);
+			if (!has_fit_)
+				return;
+
+			w_[d] = y_mean_ - dot_product(&mean_[0],&w_[0],d);
+		}
+
+		/** Writes the predictions for @a n rows of @a d features to @a y_hat */
+		void predict(const double* x, size_type n, size_type d, double* y_hat) const{
+			assert(has_fit_ && d == d_);
+			const double* w = &w_[0];
+			double b = w_[d];
+			for (size_type i = 0; i < n; ++i)
+				y_hat[i] = b + dot_product(x+(size_t)i*d,w,d);
+		}
+
+		/** Writes the predictions for the rows of @a x to @a y_hat */
+		void predict(const Csr_matrix& x, double* y_hat) const{
+			assert(has_fit_ && x.cols() == d_);
+			const double* w = &w_[0];
+			double b = w_[d_];
+			for (size_type i = 0; i < x.rows(); ++i)
+				y_hat[i] = b + x.dot(i,w);
+		}
+
+		/** Sum of squared errors over @a n rows */
+		double score(const double* x, size_type n, size_type d, const double* y) const{
+			if (!has_fit_)
+				return 0.0;
+			vector<double> y_hat(n);
+			predict(x,n,d,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],n);
+		}
+
+		/** Sum of squared errors over the rows of @a x */
+		double score(const Csr_matrix& x, const double* y) const{
+			if (!has_fit_ || x.rows() == 0)
+				return 0.0;
+			vector<double> y_hat(x.rows());
+			predict(x,&y_hat[0]);
+			return l2_loss(y,&y_hat[0],x.rows());
+		}
+
+		/** Sets the d weights followed by the intercept */
+		void set_params(vector<double> w){
+			assert(w.size() > 1);
+			w_ = w;
+			d_ = w.size()-1;
+			has_fit_ = true;
+		}
+
+		vector<double> get_params() const{
+			return w_;
+		}
+
+		/** False before the first fit() and after a fit() on data with a NaN or infinity */
+		bool fitted() const{
+			return has_fit_;
+		}
+
+		/** Number of features the model was fit on */
+		size_type dims() const{
+			return d_;
+		}
+
+		/** Starts an untrained model of @a d features with all parameters zero */
+		void init(size_type d){
+			d_ = d;
+			w_.assign(d+1,0.0);
+			has_fit_ = true;
+		}
+
+		/** Parameters in get_params() order, for in-place updates by an optimizer */
+		vector<double>& params(){
+			return w_;
+		}
+
+		/** Gradient of half the mean squared error over @a n rows, written to @a g
+		 * @param[out] g	dims()+1 values, in params() order
+		 * @return 		half the mean squared error at the current parameters
+		 */
+		double gradient(const double* x, size_type n, size_type d, const double* y, double* g) const{
+			assert(has_fit_ && d == d_ && n > 0);
+			for (size_type j = 0; j <= d; ++j)
+				g[j] = 0.0;
+			const double* w = &w_[0];
+			double loss = 0.0;
+			for (size_type i = 0; i < n; ++i){
+				const double* row = x+(size_t)i*d;
+				double r = w[d] + dot_product(row,w,d) - y[i];
+				loss += r*r;
+				axpy(r/n,row,g,d);
+				g[d] += r/n;
+			}
+			return 0.5*loss/n;
+		}
+
+		/** gradient() over the rows of a sparse batch, in O(nnz + d) */
+		double gradient(const Csr_matrix& x, const double* y, double* g) const{
+			size_type n = x.rows(), d = x.cols();
+			assert(has_fit_ && d == d_ && n > 0);
+			for (size_type j = 0; j <= d; ++j)
+				g[j] = 0.0;
+			const double* w = &w_[0];
+			double loss = 0.0;
+			for (size_type i = 0; i < n; ++i){
+				double r = w[d] + x.dot(i,w) - y[i];
+				loss += r*r;
+				x.axpy(i,r/n,g);
+				g[d] += r/n;
+			}
+			return 0.5*loss/n;
+		}
+
+		bool operator==(const Linear_regression& r) const{
+			return (w_==r.w_) && (has_fit_==r.has_fit_) && (lambda_==r.lambda_);
+		}
+
+		bool operator!=(const Linear_regression& r) const{
+			return !((*this)==r);
+		}
+
+	private:
+
+		/** Row @a i of dense row-major or CSR features, dotted with or added to a dense vector */
+		static double row_dot(const double* x, size_t i, size_type d, const double* v){
+			return dot_product(x+i*d,v,d);
+		}
+
+		static double row_dot(const Csr_matrix& x, size_t i, size_type, const double* v){
+			return x.dot(i,v);
+		}
+
+		static void row_axpy(double alpha, const double* x, size_t i, size_type d, double* y){
+			axpy(alpha,x+i*d,y,d);
+		}
+
+		static void row_axpy(double alpha, const Csr_matrix& x, size_t i, size_type, double* y){
+			x.axpy(i,alpha,y);
+		}
+
+		/** Feature means into mean_ and the target mean into y_mean_ */
+		template <typename X>
+		void column_means(const X& x, size_type n, size_type d, const double* y, unsigned threads){
+			part_.assign((size_t)threads*(d+1),0.0);
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned t){
+				double* s = &part_[(size_t)t*(d+1)];
+				for (size_t i = lo; i < hi; ++i){
+					row_axpy(1.0,x,i,d,s);
+					s[d] += y[i];
+				}
+			},threads);
+			mean_.assign(d+1,0.0);
+			for (unsigned t = 0; t < threads; ++t)
+				axpy(1.0,&part_[(size_t)t*(d+1)],&mean_[0],d+1);
+			for (size_type j = 0; j <= d; ++j)
+				mean_[j] /= n;
+			y_mean_ = mean_[d];
+		}
+
+		/** True if no feature or target mean is a NaN or infinity, i.e. the data holds none */
+		bool finite_means(size_type d) const{
+			for (size_type j = 0; j <= d; ++j)
+				if (!isfinite(mean_[j]))
+					return false;
+			return true;
+		}
+
+		/** Accumulates Xc^T Xc and Xc^T yc, then solves by Cholesky */
+		bool solve_cholesky(const double* x, size_type n, size_type d, const double* y, unsigned threads){
+			size_t dd = (size_t)d*d;
+			size_t stride = dd + d + (size_t)d*block_rows + block_rows;
+			if (threads > 1 && (size_t)threads*stride*sizeof(double) > (size_t)partial_bytes){
+				return solve_cholesky_shared(x,n,d,y,threads);
+			}
+			part_.assign((size_t)threads*stride,0.0);
+
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned t){
+				double* g = &part_[(size_t)t*stride];
+				double* r = g + dd;
+				double* cols = r + d;
+				double* yc = cols + (size_t)d*block_rows;
+				for (size_t start = lo; start < hi; start += block_rows){
+					size_t b = hi-start < (size_t)block_rows ? hi-start : (size_t)block_rows;
+					// transpose the centered block so every column is contiguous
+					for (size_t i = 0; i < b; ++i){
+						const double* row = x+(start+i)*d;
+						for (size_type j = 0; j < d; ++j)
+							cols[(size_t)j*block_rows+i] = row[j]-mean_[j];
+						yc[i] = y[start+i]-y_mean_;
+					}
+					for (size_type j = 0; j < d; ++j){
+						const double* cj = cols+(size_t)j*block_rows;
+						for (size_type k = j; k < d; ++k)
+							g[(size_t)j*d+k] += dot_product(cj,cols+(size_t)k*block_rows,b);
+						r[j] += dot_product(cj,yc,b);
+					}
+				}
+			},threads,block_rows);
+
+			gram_.assign(dd,0.0);
+			rhs_.assign(d,0.0);
+			for (unsigned t = 0; t < threads; ++t){
+				axpy(1.0,&part_[(size_t)t*stride],&gram_[0],dd);
+				axpy(1.0,&part_[(size_t)t*stride+dd],&rhs_[0],d);
+			}
+			return solve_gram(d);
+		}
+
+		/** solve_cholesky() without private Gram matrices: thread t owns the Gram rows
+		 * j = t mod threads, interleaved so the triangle is split evenly, and
+		 * centers and transposes every block into its own scratch
+		 */
+		bool solve_cholesky_shared(const double* x, size_type n, size_type d, const double* y, unsigned threads){
+			size_t dd = (size_t)d*d;
+			size_t stride = (size_t)d*block_rows + block_rows;
+			part_.assign((size_t)threads*stride,0.0);
+			gram_.assign(dd,0.0);
+			rhs_.assign(d,0.0);
+
+			parallel_for(0,threads,[&](size_t lo, size_t hi, unsigned t){
+				double* cols = &part_[(size_t)t*stride];
+				double* yc = cols + (size_t)d*block_rows;
+				for (size_t task = lo; task < hi; ++task){
+					for (size_t start = 0; start < n; start += block_rows){
+						size_t b = n-start < (size_t)block_rows ? n-start : (size_t)block_rows;
+						for (size_t i = 0; i < b; ++i){
+							const double* row = x+(start+i)*d;
+							for (size_type j = 0; j < d; ++j)
+								cols[(size_t)j*block_rows+i] = row[j]-mean_[j];
+							yc[i] = y[start+i]-y_mean_;
+						}
+						for (size_type j = task; j < d; j += threads){
+							const double* cj = cols+(size_t)j*block_rows;
+							for (size_type k = j; k < d; ++k)
+								gram_[(size_t)j*d+k] += dot_product(cj,cols+(size_t)k*block_rows,b);
+							rhs_[j] += dot_product(cj,yc,b);
+						}
+					}
+				}
+			},threads,1);
+			return solve_gram(d);
+		}
+
+		/** Accumulates X^T X and X^T y over the nonzeros, centers them, then solves by Cholesky
+		 * Private Gram matrices are limited to partial_bytes as in solve_cholesky(); above
+		 * that thread t accumulates only the Gram rows j = t mod threads.
+		 */
+		bool solve_sparse_cholesky(const Csr_matrix& x, size_type n, size_type d, const double* y, unsigned threads){
+			size_t dd = (size_t)d*d;
+			size_t stride = dd + d;
+			if (threads > 1 && (size_t)threads*stride*sizeof(double) > (size_t)partial_bytes){
+				gram_.assign(dd,0.0);
+				rhs_.assign(d,0.0);
+				parallel_for(0,threads,[&](size_t lo, size_t hi, unsigned){
+					const size_t* ptr = x.outer_ptr();
+					const unsigned* idx = x.inner_index();
+					const double* val = x.values();
+					for (size_t task = lo; task < hi; ++task){
+						for (size_t i = 0; i < n; ++i){
+							for (size_t a = ptr[i]; a < ptr[i+1]; ++a){
+								if (idx[a] % threads != task)
+									continue;
+								double* ga = &gram_[(size_t)idx[a]*d];
+								double va = val[a];
+								for (size_t b = a; b < ptr[i+1]; ++b)
+									ga[idx[b]] += va*val[b];
+								rhs_[idx[a]] += va*y[i];
+							}
+						}
+					}
+				},threads,1);
+				return center_gram(n,d);
+			}
+			part_.assign((size_t)threads*stride,0.0);
+
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned t){
+				double* g = &part_[(size_t)t*stride];
+				double* r = g + dd;
+				const size_t* ptr = x.outer_ptr();
+				const unsigned* idx = x.inner_index();
+				const double* val = x.values();
+				for (size_t i = lo; i < hi; ++i){
+					// upper triangle: indices within a row are increasing
+					for (size_t a = ptr[i]; a < ptr[i+1]; ++a){
+						double* ga = g + (size_t)idx[a]*d;
+						double va = val[a];
+						for (size_t b = a; b < ptr[i+1]; ++b)
+							ga[idx[b]] += va*val[b];
+						r[idx[a]] += va*y[i];
+					}
+				}
+			},threads,block_rows);
+
+			gram_.assign(dd,0.0);
+			rhs_.assign(d,0.0);
+			for (unsigned t = 0; t < threads; ++t){
+				axpy(1.0,&part_[(size_t)t*stride],&gram_[0],dd);
+				axpy(1.0,&part_[(size_t)t*stride+dd],&rhs_[0],d);
+			}
+			return center_gram(n,d);
+		}
+
+		/** Turns the uncentered X^T X and X^T y in gram_ and rhs_ into Xc^T Xc and Xc^T yc, then solves */
+		bool center_gram(size_type n, size_type d){
+			for (size_type j = 0; j < d; ++j){
+				double nm = n*mean_[j];
+				for (size_type k = j; k < d; ++k)
+					gram_[(size_t)j*d+k] -= nm*mean_[k];
+				rhs_[j] -= nm*y_mean_;
+			}
+			return solve_gram(d);
+		}
+
+		/** Solves (gram_ + lambda*I) w = rhs_, given the upper triangle of gram_
+		 * @return false, leaving w_ undefined, if the data held a NaN or infinity
+		 */
+		bool solve_gram(size_type d){
+			for (size_type j = 0; j < d; ++j){
+				gram_[(size_t)j*d+j] += lambda_;
+				for (size_type k = j+1; k < d; ++k)
+					gram_[(size_t)k*d+j] = gram_[(size_t)j*d+k];
+			}
+
+			// a singular Gram matrix (collinear features, lambda == 0) gets a growing jitter
+			double trace = 0.0;
+			for (size_type j = 0; j < d; ++j)
+				trace += gram_[(size_t)j*d+j];
+			double jitter = 0.0;
+			for (size_type tries = 0; !cholesky(d,jitter); ++tries){
+				if (tries == max_jitters || !isfinite(trace))
+					return false;	//a NaN or infinity in the features
+				jitter = jitter == 0.0 ? 1e-12*(trace/d + 1.0) : jitter*10.0;
+			}
+
+			// L z = r, then L^T w = z
+			double* w = &w_[0];
+			for (size_type j = 0; j < d; ++j){
+				double s = rhs_[j] - dot_product(&chol_[(size_t)j*d],w,j);
+				w[j] = s/chol_[(size_t)j*d+j];
+			}
+			for (size_type j = d; j-- > 0; ){
+				double s = w[j];
+				for (size_type k = j+1; k < d; ++k)
+					s -= chol_[(size_t)k*d+j]*w[k];
+				w[j] = s/chol_[(size_t)j*d+j];
+			}
+			return finite_weights(d);
+		}
+
+		/** True if none of the first @a d weights is a NaN or infinity (e.g. from a NaN target) */
+		bool finite_weights(size_type d) const{
+			for (size_type j = 0; j < d; ++j)
+				if (!isfinite(w_[j]))
+					return false;
+			return true;
+		}
+
+		/** Factors gram_ + jitter*I into chol_ = L (row-major, lower triangle)
+		 * @return false if the matrix is not numerically positive definite
+		 */
+		bool cholesky(size_type d, double jitter){
+			chol_.assign((size_t)d*d,0.0);
+			for (size_type j = 0; j < d; ++j){
+				double* lj = &chol_[(size_t)j*d];
+				for (size_type k = 0; k <= j; ++k){
+					const double* lk = &chol_[(size_t)k*d];
+					double s = gram_[(size_t)j*d+k] - dot_product(lj,lk,k);
+					if (k == j){
+						s += jitter;
+						if (!(s > 0.0))
+							return false;
+						lj[j] = sqrt(s);
+					}else{
+						lj[k] = s/lk[k];
+					}
+				}
+			}
+			return true;
+		}
+
+		/** out = Xc^T Xc v + lambda*v, using @a tmp (n) for Xc v */
+		template <typename X>
+		void normal_product(const X& x, size_type n, size_type d, const double* v, double* out, double* tmp, unsigned threads){
+			double mv = dot_product(&mean_[0],v,d);
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned){
+				for (size_t i = lo; i < hi; ++i)
+					tmp[i] = row_dot(x,i,d,v) - mv;
+			},threads);
+			transpose_product(x,n,d,tmp,out,threads);
+			axpy(lambda_,v,out,d);
+		}
+
+		/** out = Xc^T u */
+		template <typename X>
+		void transpose_product(const X& x, size_type n, size_type d, const double* u, double* out, unsigned threads){
+			part_.assign((size_t)threads*(d+1),0.0);
+			parallel_for(0,n,[&](size_t lo, size_t hi, unsigned t){
+				double* s = &part_[(size_t)t*(d+1)];
+				for (size_t i = lo; i < hi; ++i){
+					row_axpy(u[i],x,i,d,s);
+					s[d] += u[i];
+				}
+			},threads);
+			for (size_type j = 0; j < d; ++j)
+				out[j] = 0.0;
+			double usum = 0.0;
+			for (unsigned t = 0; t < threads; ++t){
+				axpy(1.0,&part_[(size_t)t*(d+1)],out,d);
+				usum += part_[(size_t)t*(d+1)+d];
+			}
+			axpy(-usum,&mean_[0],out,d);
+		}
+
+		/** Conjugate gradient on the normal equations */
+		template <typename X>
+		bool solve_cg(const X& x, size_type n, size_type d, const double* y, unsigned threads, bool warm){
+			rhs_.resize(d);
+			cg_.resize(3*(size_t)d + n);
+			double* r = &cg_[0];
+			double* p = r + d;
+			double* q = p + d;
+			double* tmp = q + d;
+			double* w = &w_[0];
+
+			for (size_type i = 0; i < n; ++i)
+				tmp[i] = y[i]-y_mean_;
+			transpose_product(x,n,d,tmp,&rhs_[0],threads);
+			if (!warm)
+				for (size_type j = 0; j < d; ++j)
+					w[j] = 0.0;
+
+			normal_product(x,n,d,w,q,tmp,threads);
+			for (size_type j = 0; j < d; ++j){
+				r[j] = rhs_[j]-q[j];
+				p[j] = r[j];
+			}
+			double rr = dot_product(r,r,d);
+			double tol = 1e-20*dot_product(&rhs_[0],&rhs_[0],d);
+			size_type max_iter = d < 1000 ? d : 1000;
+			for (size_type it = 0; it < max_iter && rr > tol; ++it){
+				normal_product(x,n,d,p,q,tmp,threads);
+				double pq = dot_product(p,q,d);
+				if (!(pq > 0.0))
+					break;
+				double alpha = rr/pq;
+				axpy(alpha,p,w,d);
+				axpy(-alpha,q,r,d);
+				double rr_new = dot_product(r,r,d);
+				double beta = rr_new/rr;
+				for (size_type j = 0; j < d; ++j)
+					p[j] = r[j] + beta*p[j];
+				rr = rr_new;
+			}
+			return finite_weights(d);
+		}
+
+		double lambda_;
+		unsigned threads_;
+		size_type d_;
+		vector<double> w_;
+		bool has_fit_;
+
+		//workspace kept between fits
+		double y_mean_;
+		vector<double> mean_;
+		vector<double> gram_;
+		vector<double> chol_;
+		vector<double> rhs_;
+		vector<double> part_;
+		vector<double> cg_;
+};
+
+template <>
+struct sparse_gradient<Linear_regression>: true_type{
+};
+
+#endif
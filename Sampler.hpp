@@ -195,6 +195,13 @@ class Sampler{
 		//TODO
 	}
 
+	/** Returns the samples without copying them. Valid until the policy
+	 ** collects, is cleared or the Sampler adds a policy.
+	 **/
+	const Samples& samples(){
+		return fetch_samples();
+	}
+
 	/*-----------Helpers-------------*/
 
 	size_type get_id(){
@@ -1,3 +1,14 @@
+#ifndef CS207_SELECTOR_HPP
+#define CS207_SELECTOR_HPP
+
+#include "Manager.hpp"
+#include "Loss.hpp"
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cassert>
 
 /** Meets domain: returns true if a sample meets a domain
 struct model parameters error from training **/
@@ -5,8 +16,8 @@ struct model parameters error from training **/
 /**M = model_value_type and D = domain_value_type
 	X = value type for the features
 	Y = value_type for the predicted value
-	L = loss function to determine the risk of a model**/
-template <typename M, typename X, typename Y>
+	L = loss function to determine the risk of a model (see Loss.hpp)**/
+template <typename M, typename X, typename Y, typename L = L2_loss>
 class Selector{
 //add Cross_validation to this
  public:
@@ -16,55 +27,382 @@ class Selector{
 	//typedef D domain_value_type;
 	typedef X X_value_type;
 	typedef Y y_value_type;
+	typedef L loss_type;
 
-	/** Graph typedefs **/
+	/** Manager typedefs **/
 	typedef Manager<M> ManagerType;
 	typedef typename ManagerType::size_type size_type;
 	typedef typename ManagerType::error_type error_type;
-	typedef typename ManagerType::Model Model;
-	typedef typename ManagerType::Model model_type;
-	typedef typename ManagerType::model_iterator model_iterator;
+	/** Models are addressed by their Manager slot id (1-4) **/
+	typedef size_type Model;
+	typedef Model model_type;
 	typedef std::chrono::high_resolution_clock clock;
 	typedef Selector selector_type;
 
+	/** Options for race().
+	 ** Test points are streamed in mini-batches of @a batch_size_. Per-example
+	 ** losses are clipped to [0, loss_range_] so the confidence bounds hold, and
+	 ** @a delta_ bounds the probability that the best model is ever dropped.
+	 ** None of the losses in Loss.hpp is bounded, so the range has no default: it
+	 ** should cover nearly all losses of the models raced, e.g. a high percentile of
+	 ** the q-errors on a validation set (q-errors are at least 1). Losses that hit it
+	 ** count as equal, so race_clipped() reports how many did.
+	 **/
+	struct race_options{
+		size_type batch_size_;
+		double delta_;
+		double loss_range_;
+		bool bernstein_;	//empirical Bernstein bound (true) or Hoeffding (false)
+		explicit race_options(double loss_range):batch_size_(256),delta_(0.05),loss_range_(loss_range),bernstein_(true){
+		}
+	};
+
+	/** Accuracy and inference cost of one model, as measured by profile().
+	 ** Latencies are per predict call on a batch of the requested size.
+	 **/
+	struct model_profile{
+		Model id_;
+		error_type risk_;	//mean loss over the benchmark set
+		double mean_ns_;
+		double p99_ns_;
+		bool pareto_;		//no other model is both as accurate and as fast
+		model_profile():id_(0),risk_(0.0),mean_ns_(0.0),p99_ns_(0.0),pareto_(false){
+		}
+	};
+
 	//user should define cv constant
-	Selector(){
+	Selector(L loss = L()):loss_(loss),race_evaluations_(0),race_clipped_(0){
 	}
 
    ~Selector() = default;
 
    Selector& operator=(const Selector&) = delete;
 
-	void train(ManagerType mt, Model m, X& x, Y& y){
-		mt.model_value(m).train(x,y);
+	//perform cross validation
+
+	/** Total loss of the predictions @a y2 against the targets @a y1 **/
+	error_type calculate_loss(ManagerType& mt, Model m, Y& y1, Y& y2){
+		(void) mt;
+		(void) m;
+		assert(y1.size()==y2.size());
+		error_type loss_val = 0.0;
+		auto it2 = y2.begin();
+		for (auto it1 = y1.begin(); it1 != y1.end(); ++it1, ++it2)
+			loss_val += loss_(*it1,*it2);
+		return loss_val;
 	}
 
-	Y predict(ManagerType mt, Model m, X& x){
-		return mt.model_value(m).predict(x);
+	/** Total loss of @a n predictions @a y_hat against the targets @a y **/
+	error_type calculate_loss(const double* y, const double* y_hat, size_type n){
+		return loss_.sum(y,y_hat,n);
 	}
 
-	//perform cross validation
+	/** Fits the model in slot @a m to the rows of @a x and the x.rows() targets @a y **/
+	void train(ManagerType& mt, Model m, const Matrix_view<const double>& x, const double* y){
+		fit_matrix(model_value(mt,m),x,y);
+	}
 
-	error_type calculate_loss(ManagerType mt, Model m, Y& y1, Y& y2){
-		return mt.model_value(m).loss(y1,y2);
+	/** Predicts the rows of @a x with the model in slot @a m into @a y_hat (x.rows() values) **/
+	void predict(ManagerType& mt, Model m, const Matrix_view<const double>& x, double* y_hat){
+		mt.predict_model(m,contiguous_rows(x,gather_),x.rows(),x.cols(),y_hat);
 	}
 
-	Model best_model(ManagerType mt, X& x_train, X& x_test, Y& y_train, Y& y_test){
+	/** Fits every model to the training rows and returns the slot id of the one with
+	 ** the lowest total loss over the test rows. The features are matrices of any
+	 ** layout or views, the targets arrays of x_train.rows() and x_test.rows() values.
+	 ** @post 	mt.model_risk(m) == total loss of m over the test rows
+	 **/
+	Model best_model(ManagerType& mt, const Matrix_view<const double>& x_train, const Matrix_view<const double>& x_test, const double* y_train, const double* y_test){
 		double min_loss = DBL_MAX;
-		model_iterator best_model = ManagerType::Model();
-		Y y_hat;
-
-		for(auto it = mt.model_begin(); it < mt.model_end(); ++it){
-			train(mt,(*it),x_train,y_train);			
-			y_hat = predict(mt,(*it),x_test);
-			error_type loss = calculate_loss(mt,(*it),y_test,y_hat);
-			mt.model_risk(*it) = loss;
+		Model best = 0;
+		size_type n = x_test.rows();
+		y_hat_.resize(n);
+		const double* xt = contiguous_rows(x_test,gather_);
+
+		for(Model m = 1; m < 5; ++m){
+			if (!mt.has_model(m))
+				continue;
+			train(mt,m,x_train,y_train);
+			mt.predict_model(m,xt,n,x_test.cols(),&y_hat_[0]);
+			error_type loss = calculate_loss(y_test,&y_hat_[0],n);
+			mt.model_risk(m) = loss;
 			if (loss < min_loss){
 				min_loss = loss;
-				best_model = it;
+				best = m;
+			}
+		}
+		return best;
+	}
+
+	/** Selects among fitted models by their out-of-bag error, without a test set or
+	 ** cross validation. M must provide oob_error(), e.g. Random_forest (Forest.hpp).
+	 ** @post 	mt.model_risk(m) == out-of-bag mean squared error of m
+	 **/
+	Model best_model_oob(ManagerType& mt){
+		double min_loss = DBL_MAX;
+		Model best = 0;
+		for(Model m = 1; m < 5; ++m){
+			if (!mt.has_model(m))
+				continue;
+			error_type loss = model_value(mt,m).oob_error();
+			mt.model_risk(m) = loss;
+			if (loss < min_loss){
+				min_loss = loss;
+				best = m;
+			}
+		}
+		return best;
+	}
+
+	/** Selects among already fitted models by racing them over a test set.
+	 ** @param[in] x_test	row-major @a n x @a d test features
+	 ** @param[in] y_test	@a n targets
+	 ** @param[in] opt	batching and confidence; its loss range is required
+	 ** @return 			slot id of the model with the lowest mean loss among the survivors
+	 ** @post 			mt.model_risk(m) == mean loss of m over the points it was evaluated on
+	 **
+	 ** Each surviving model predicts the next mini-batch through
+	 ** predict(const double*, size_type, size_type, double*). After every batch
+	 ** a model whose lower confidence bound on the risk is above the smallest
+	 ** upper bound is dropped, so a clearly worse model stops costing predictions
+	 ** after a few batches. With a single survivor the race ends early.
+	 ** Complexity: O(n*d*k) predictions in the worst case, k = num_models()
+	 **/
+	Model race(ManagerType& mt, const double* x_test, const double* y_test, size_type n, size_type d, race_options opt){
+		assert(opt.batch_size_ > 0 && opt.loss_range_ > 0);
+		race_evaluations_ = 0;
+		race_clipped_ = 0;
+
+		size_type num_alive = 0;
+		for(Model m = 1; m < 5; ++m){
+			alive_[m-1] = mt.has_model(m);
+			count_[m-1] = 0;
+			sum_[m-1] = 0.0;
+			sum_sq_[m-1] = 0.0;
+			num_alive += alive_[m-1];
+		}
+		if (num_alive == 0)
+			return 0;
+
+		// union bound over every model and every round of the race
+		size_type rounds = (n + opt.batch_size_ - 1)/opt.batch_size_;
+		double log_term = log(3.0*num_alive*(rounds > 0 ? rounds : 1)/opt.delta_);
+		y_hat_.resize(opt.batch_size_);
+		loss_buf_.resize(opt.batch_size_);
+
+		for(size_type start = 0; start < n && num_alive > 1; start += opt.batch_size_){
+			size_type b = (n-start < opt.batch_size_) ? n-start : opt.batch_size_;
+			for(Model m = 1; m < 5; ++m){
+				if (!alive_[m-1])
+					continue;
+				model_value(mt,m).predict(x_test+(size_t)start*d,b,d,&y_hat_[0]);
+				loss_.elementwise(y_test+start,&y_hat_[0],b,&loss_buf_[0]);
+				for(size_type i = 0; i < b; ++i){
+					double l = loss_buf_[i];
+					if (l > opt.loss_range_){
+						l = opt.loss_range_;
+						++race_clipped_;
+					}
+					sum_[m-1] += l;
+					sum_sq_[m-1] += l*l;
+				}
+				count_[m-1] += b;
+				race_evaluations_ += b;
+			}
+
+			double min_upper = DBL_MAX;
+			for(size_type i = 0; i < 4; ++i){
+				if (!alive_[i])
+					continue;
+				upper_[i] = mean(i) + radius(i,opt,log_term);
+				if (upper_[i] < min_upper)
+					min_upper = upper_[i];
+			}
+			for(size_type i = 0; i < 4; ++i){
+				if (alive_[i] && mean(i)-radius(i,opt,log_term) > min_upper){
+					alive_[i] = false;
+					--num_alive;
+				}
 			}
-		} 
-		return *best_model;
+		}
+
+		Model best = 0;
+		double min_loss = DBL_MAX;
+		for(Model m = 1; m < 5; ++m){
+			if (!mt.has_model(m))
+				continue;
+			mt.model_risk(m) = mean(m-1);
+			if (alive_[m-1] && mean(m-1) < min_loss){
+				min_loss = mean(m-1);
+				best = m;
+			}
+		}
+		return best;
+	}
+
+	/** race() over a feature matrix (any layout or view) and its x.rows() targets **/
+	Model race(ManagerType& mt, const Matrix_view<const double>& x_test, const double* y_test, race_options opt){
+		return race(mt,contiguous_rows(x_test,gather_),y_test,x_test.rows(),x_test.cols(),opt);
+	}
+
+	/** Number of (model, test point) predictions made by the last race() **/
+	size_type race_evaluations() const{
+		return race_evaluations_;
 	}
 
+	/** Number of those predictions whose loss was clipped to the loss range. If it is a
+	 ** large share of race_evaluations(), the range is too small to tell models apart.
+	 **/
+	size_type race_clipped() const{
+		return race_clipped_;
+	}
+
+	/** Measures risk and inference latency of every fitted model over a benchmark set.
+	 ** @param[in] x, y	row-major @a n x @a d features and @a n targets
+	 ** @param[in] batch	rows per predict call, e.g. 1 for a single subplan or the
+	 **			number of subplans the planner estimates at once
+	 ** @return 		one profile per model, with the Pareto frontier of (risk, p99) marked
+	 ** @post 		mt.model_risk(m) == risk of m
+	 **
+	 ** Each call is timed separately, after one warm-up call per model.
+	 **/
+	vector<model_profile> profile(ManagerType& mt, const double* x, const double* y, size_type n, size_type d, size_type batch = 1){
+		assert(batch > 0 && n > 0);
+		vector<model_profile> prof;
+		vector<double> y_hat(n);
+		vector<double> ns;
+		ns.reserve((n+batch-1)/batch);
+
+		for(Model m = 1; m < 5; ++m){
+			if (!mt.has_model(m))
+				continue;
+			mt.predict_model(m,x,(batch < n ? batch : n),d,&y_hat[0]);
+			ns.clear();
+			for(size_type start = 0; start < n; start += batch){
+				size_type b = (n-start < batch) ? n-start : batch;
+				typename clock::time_point t0 = clock::now();
+				mt.predict_model(m,x+(size_t)start*d,b,d,&y_hat[start]);
+				typename clock::time_point t1 = clock::now();
+				ns.push_back(std::chrono::duration<double,std::nano>(t1-t0).count());
+			}
+
+			model_profile p;
+			p.id_ = m;
+			p.risk_ = loss_.sum(y,&y_hat[0],n)/n;
+			double total = 0.0;
+			for(size_type i = 0; i < ns.size(); ++i)
+				total += ns[i];
+			p.mean_ns_ = total/ns.size();
+			size_type k = (size_type) ceil(0.99*ns.size()) - 1;
+			nth_element(ns.begin(),ns.begin()+k,ns.end());
+			p.p99_ns_ = ns[k];
+			mt.model_risk(m) = p.risk_;
+			prof.push_back(p);
+		}
+
+		for(size_type i = 0; i < prof.size(); ++i){
+			prof[i].pareto_ = true;
+			for(size_type j = 0; j < prof.size(); ++j){
+				if (j != i && dominates(prof[j],prof[i])){
+					prof[i].pareto_ = false;
+					break;
+				}
+			}
+		}
+		return prof;
+	}
+
+	/** profile() over a feature matrix (any layout or view) and its x.rows() targets **/
+	vector<model_profile> profile(ManagerType& mt, const Matrix_view<const double>& x, const double* y, size_type batch = 1){
+		return profile(mt,contiguous_rows(x,gather_),y,x.rows(),x.cols(),batch);
+	}
+
+	/** Most accurate model whose p99 latency fits in @a budget_ns.
+	 ** If no model fits, the one with the lowest p99 latency is returned.
+	 **/
+	Model best_model_within(const vector<model_profile>& prof, double budget_ns) const{
+		Model best = 0, fastest = 0;
+		double min_risk = DBL_MAX, min_p99 = DBL_MAX;
+		for(size_type i = 0; i < prof.size(); ++i){
+			if (prof[i].p99_ns_ <= budget_ns && prof[i].risk_ < min_risk){
+				min_risk = prof[i].risk_;
+				best = prof[i].id_;
+			}
+			if (prof[i].p99_ns_ < min_p99){
+				min_p99 = prof[i].p99_ns_;
+				fastest = prof[i].id_;
+			}
+		}
+		return best != 0 ? best : fastest;
+	}
+
+	/** Model minimizing risk + @a ns_weight * mean latency (in ns) **/
+	Model best_model_weighted(const vector<model_profile>& prof, double ns_weight) const{
+		Model best = 0;
+		double min_cost = DBL_MAX;
+		for(size_type i = 0; i < prof.size(); ++i){
+			double cost = prof[i].risk_ + ns_weight*prof[i].mean_ns_;
+			if (cost < min_cost){
+				min_cost = cost;
+				best = prof[i].id_;
+			}
+		}
+		return best;
+	}
+
+ private:
+
+	/** Returns the model stored in slot @a m of @a mt **/
+	M& model_value(ManagerType& mt, Model m){
+		fetch_model f(m);
+		mt.for_each_model(f);
+		assert(f.m_ != 0);
+		return *(f.m_);
+	}
+
+	struct fetch_model{
+		Model id_;
+		M* m_;
+		fetch_model(Model id):id_(id),m_(0){
+		}
+		void operator()(size_type id, M& m){
+			if (id == id_)
+				m_ = &m;
+		}
+	};
+
+	/** True if @a a is at least as good as @a b in risk and p99 latency and better in one **/
+	static bool dominates(const model_profile& a, const model_profile& b){
+		return a.risk_ <= b.risk_ && a.p99_ns_ <= b.p99_ns_
+			&& (a.risk_ < b.risk_ || a.p99_ns_ < b.p99_ns_);
+	}
+
+	double mean(size_type i) const{
+		return count_[i] > 0 ? sum_[i]/count_[i] : 0.0;
+	}
+
+	/** Half-width of the confidence interval on the risk of model @a i **/
+	double radius(size_type i, const race_options& opt, double log_term) const{
+		double t = count_[i];
+		if (!opt.bernstein_)
+			return opt.loss_range_*sqrt(log_term/(2.0*t));
+		double var = sum_sq_[i]/t - mean(i)*mean(i);
+		if (var < 0.0)
+			var = 0.0;
+		return sqrt(2.0*var*log_term/t) + 3.0*opt.loss_range_*log_term/t;
+	}
+
+	bool alive_[4];
+	size_type count_[4];
+	double sum_[4];
+	double sum_sq_[4];
+	double upper_[4];
+	L loss_;
+	size_type race_evaluations_;
+	size_type race_clipped_;
+	vector<double> y_hat_;
+	vector<double> loss_buf_;
+	aligned_vector<double> gather_;	//row-major copy of a strided test view
 };
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef CS207_SGD_HPP
+#define CS207_SGD_HPP
+
+/** @file Sgd.hpp
+ * @brief Mini-batch SGD/Adam and an online learner fed by Sampler policies
+ */
+
+#include "Sparse.hpp"
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cassert>
+using namespace std;
+
+/** @class 	Sgd_optimizer
+ * @brief 	Plain SGD or Adam updates on a flat parameter array
+ *
+ * The moment estimates are sized on the first step and kept, so steps do not allocate.
+ */
+struct Sgd_optimizer{
+	public:
+		enum method_type {SGD, ADAM};
+
+		Sgd_optimizer(method_type method = ADAM, double rate = 0.01, double l2 = 0.0,
+		              double beta1 = 0.9, double beta2 = 0.999, double eps = 1e-8)
+		  :method_(method),rate_(rate),l2_(l2),beta1_(beta1),beta2_(beta2),eps_(eps),t_(0){
+		}
+
+		/** Forgets the moment estimates */
+		void reset(){
+			m_.clear();
+			v_.clear();
+			t_ = 0;
+		}
+
+		/** Updates the @a n parameters @a p with the gradient @a g
+		 * An l2 penalty adds l2*p to the gradient (weight decay).
+		 */
+		void step(double* p, const double* g, size_t n){
+			if (method_ == SGD){
+				for (size_t i = 0; i < n; ++i)
+					p[i] -= rate_*(g[i] + l2_*p[i]);
+				return;
+			}
+			if (m_.size() != n){
+				m_.assign(n,0.0);
+				v_.assign(n,0.0);
+				t_ = 0;
+			}
+			++t_;
+			double c1 = 1.0/(1.0-pow(beta1_,(double) t_));
+			double c2 = 1.0/(1.0-pow(beta2_,(double) t_));
+			double* m = &m_[0];
+			double* v = &v_[0];
+			for (size_t i = 0; i < n; ++i){
+				double gi = g[i] + l2_*p[i];
+				m[i] = beta1_*m[i] + (1.0-beta1_)*gi;
+				v[i] = beta2_*v[i] + (1.0-beta2_)*gi*gi;
+				p[i] -= rate_*(m[i]*c1)/(sqrt(v[i]*c2) + eps_);
+			}
+		}
+
+		double& rate(){
+			return rate_;
+		}
+
+	private:
+		method_type method_;
+		double rate_;
+		double l2_;
+		double beta1_;
+		double beta2_;
+		double eps_;
+		unsigned long t_;
+		vector<double> m_;
+		vector<double> v_;
+};
+
+/** @class 	Online_learner
+ * @brief 	Keeps a model up to date with the samples a Sampler policy collects
+ * @tparam  M	A model with dims(), init(d), params() and
+ *		gradient(const double* x, n, d, const double* y, double* g), e.g. Linear_regression or Mlp_regression
+ * @tparam  SamplerType	The Sampler the policy belongs to
+ *
+ * Each sample is a sequence of numbers whose last element is the target and whose
+ * other elements are the features. update() reads only the samples added since the
+ * previous call, in mini-batches, and takes one optimizer step per batch starting from
+ * the model's current parameters, so a fitted model is warm started rather than retrained.
+ * If the policy's samples were cleared in between, the learner starts over at the first sample.
+ *
+ * Call update() after the policy collects, e.g. after Sampler::start_collections().
+ *
+ * For a model with a sparse gradient (sparse_gradient<M>, e.g. Linear_regression), a
+ * mini-batch whose fraction of nonzero features is at most sparse_density is handed
+ * to the model as a Csr_matrix, so one-hot features cost nothing in the gradient.
+ */
+template <typename M, typename SamplerType>
+class Online_learner{
+	public:
+		typedef typename SamplerType::Policy policy_type;
+		typedef typename SamplerType::size_type size_type;
+
+		/** Largest fraction of nonzero features for which a batch is passed sparse */
+		static constexpr double sparse_density = 0.25;
+
+		Online_learner(M& m, policy_type p, Sgd_optimizer opt = Sgd_optimizer(), size_type batch_size = 32)
+		  :m_(&m),p_(p),opt_(opt),batch_size_(batch_size),consumed_(0),loss_(0.0){
+			assert(batch_size > 0);
+		}
+
+		/** Trains on the samples added since the last update
+		 * @return 	the number of samples consumed
+		 */
+		size_type update(){
+			const typename SamplerType::Samples& s = p_.samples();
+			if (s.size() < consumed_)
+				consumed_ = 0;
+			size_type n = s.size() - consumed_;
+			if (n == 0)
+				return 0;
+
+			size_type d = s[consumed_].size()-1;
+			assert(d > 0);
+			if (m_->dims() != d)
+				m_->init(d);
+			x_.resize((size_t)batch_size_*d);
+			y_.resize(batch_size_);
+
+			size_type done = 0;
+			while (done < n){
+				size_type b = 0;
+				size_t nnz = 0;
+				for (; b < batch_size_ && done < n; ++b, ++done){
+					const typename SamplerType::Samples::value_type& row = s[consumed_+done];
+					assert(row.size() == d+1);
+					for (size_type j = 0; j < d; ++j){
+						x_[(size_t)b*d+j] = row[j];
+						nnz += (row[j] != 0);
+					}
+					y_[b] = row[d];
+				}
+				vector<double>& w = m_->params();
+				g_.resize(w.size());
+				loss_ = batch_gradient(b,d,nnz,sparse_gradient<M>());
+				opt_.step(&w[0],&g_[0],w.size());
+			}
+			consumed_ += n;
+			return n;
+		}
+
+		/** Number of the policy's samples consumed so far */
+		size_type consumed() const{
+			return consumed_;
+		}
+
+		/** Training loss of the last mini-batch, before its update */
+		double last_loss() const{
+			return loss_;
+		}
+
+		Sgd_optimizer& optimizer(){
+			return opt_;
+		}
+
+	private:
+
+		/** Gradient of the @a b rows in x_ into g_; the sparse form if M has one and the batch is sparse enough */
+		double batch_gradient(size_type b, size_type d, size_t nnz, true_type){
+			if (nnz > sparse_density*b*d)
+				return batch_gradient(b,d,nnz,false_type());
+			csr_.clear();
+			for (size_type i = 0; i < b; ++i)
+				csr_.push_dense(&x_[(size_t)i*d],d);
+			return m_->gradient(csr_,&y_[0],&g_[0]);
+		}
+
+		double batch_gradient(size_type b, size_type d, size_t, false_type){
+			return m_->gradient(&x_[0],b,d,&y_[0],&g_[0]);
+		}
+
+		M* m_;
+		policy_type p_;
+		Sgd_optimizer opt_;
+		size_type batch_size_;
+		size_type consumed_;
+		double loss_;
+		vector<double> x_;
+		vector<double> y_;
+		vector<double> g_;
+		Csr_matrix csr_;
+};
+
+#endif
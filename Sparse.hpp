@@ -0,0 +1,283 @@
+#ifndef CS207_SPARSE_HPP
+#define CS207_SPARSE_HPP
+
+/** @file Sparse.hpp
+ * @brief Compressed sparse feature matrices (CSR/CSC) and their kernels
+ */
+
+#include "Kernels.hpp"
+#include "Matrix.hpp"
+#include <vector>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+using namespace std;
+
+/** Returns sum_k val[k]*w[idx[k]] over the @a nnz stored entries of a sparse vector */
+inline double sparse_dot(const unsigned* KERNEL_RESTRICT idx, const double* KERNEL_RESTRICT val, size_t nnz, const double* KERNEL_RESTRICT w){
+	double s0 = 0.0, s1 = 0.0;
+	size_t k = 0;
+	for (; k + 2 <= nnz; k += 2){
+		s0 += val[k]*w[idx[k]];
+		s1 += val[k+1]*w[idx[k+1]];
+	}
+	if (k < nnz)
+		s0 += val[k]*w[idx[k]];
+	return s0+s1;
+}
+
+/** y[idx[k]] += alpha*val[k] over the @a nnz stored entries of a sparse vector */
+inline void sparse_axpy(double alpha, const unsigned* KERNEL_RESTRICT idx, const double* KERNEL_RESTRICT val, size_t nnz, double* KERNEL_RESTRICT y){
+	for (size_t k = 0; k < nnz; ++k)
+		y[idx[k]] += alpha*val[k];
+}
+
+/** @class 	Sparse_matrix
+ * @brief 	Compressed sparse matrix: CSR for ROW_MAJOR, CSC for COL_MAJOR
+ *
+ * The matrix is a sequence of outer slices (rows for CSR, columns for CSC), each
+ * holding the sorted inner indices and values of its nonzeros. Slice k occupies
+ * positions [outer_ptr()[k], outer_ptr()[k+1]) of inner_index() and values().
+ * Storage is 12 bytes per nonzero plus 8 per slice, against 8*rows*cols dense.
+ *
+ * push_back() appends a slice, so a CSR matrix is built one observation at a time;
+ * converting to the other layout (a transpose of the storage) is O(nnz + rows + cols).
+ */
+template <matrix_layout L = ROW_MAJOR>
+class Sparse_matrix{
+	public:
+		typedef unsigned size_type;
+
+		Sparse_matrix():rows_(0),cols_(0),ptr_(1,0),idx_(),val_(){
+		}
+
+		/** An all-zero @a rows x @a cols matrix */
+		Sparse_matrix(size_type rows, size_type cols):rows_(rows),cols_(cols),ptr_((size_t)outer()+1,0),idx_(),val_(){
+		}
+
+		/** Keeps the nonzeros of @a n row-major rows of @a d dense features */
+		Sparse_matrix(const double* x, size_type n, size_type d):rows_(L == ROW_MAJOR ? 0 : n),cols_(L == ROW_MAJOR ? d : 0),ptr_(1,0),idx_(),val_(){
+			if (L == ROW_MAJOR){
+				for (size_type i = 0; i < n; ++i)
+					push_dense(x+(size_t)i*d,d);
+			}else{
+				Sparse_matrix<ROW_MAJOR> r(x,n,d);
+				*this = Sparse_matrix(r);
+			}
+		}
+
+		/** Converts from the other layout with a counting sort of the entries */
+		template <matrix_layout L2>
+		explicit Sparse_matrix(const Sparse_matrix<L2>& a):rows_(a.rows()),cols_(a.cols()),ptr_(),idx_(a.nnz()),val_(a.nnz()){
+			if (L2 == L){
+				ptr_.assign(a.outer_ptr(),a.outer_ptr()+a.outer()+1);
+				copy(a.inner_index(),a.inner_index()+a.nnz(),idx_.begin());
+				copy(a.values(),a.values()+a.nnz(),val_.begin());
+				return;
+			}
+			size_type n_out = outer();
+			ptr_.assign((size_t)n_out+1,0);
+			const unsigned* ai = a.inner_index();
+			for (size_t k = 0; k < a.nnz(); ++k)
+				++ptr_[ai[k]+1];
+			for (size_type j = 0; j < n_out; ++j)
+				ptr_[j+1] += ptr_[j];
+			vector<size_t> next(ptr_.begin(),ptr_.end()-1);
+			// slices of a are visited in order, so every new slice stays sorted
+			for (size_type s = 0; s < a.outer(); ++s){
+				for (size_t k = a.outer_ptr()[s]; k < a.outer_ptr()[s+1]; ++k){
+					size_t p = next[ai[k]]++;
+					idx_[p] = s;
+					val_[p] = a.values()[k];
+				}
+			}
+		}
+
+		/** Appends an outer slice (a row of a CSR matrix) with @a nnz entries
+		 * @pre idx is strictly increasing and below the inner dimension
+		 */
+		void push_back(const unsigned* idx, const double* val, size_t nnz){
+			for (size_t k = 0; k < nnz; ++k){
+				assert(idx[k] < inner() && (k == 0 || idx[k-1] < idx[k]));
+				idx_.push_back(idx[k]);
+				val_.push_back(val[k]);
+			}
+			ptr_.push_back(idx_.size());
+			if (L == ROW_MAJOR)
+				++rows_;
+			else
+				++cols_;
+		}
+
+		/** Appends the nonzeros of a dense slice of @a len values
+		 * The first slice of an empty matrix sets the inner dimension.
+		 */
+		void push_dense(const double* v, size_type len){
+			if (outer() == 0)
+				(L == ROW_MAJOR ? cols_ : rows_) = len;
+			assert(len == inner());
+			for (size_type j = 0; j < len; ++j){
+				if (v[j] != 0.0){
+					idx_.push_back(j);
+					val_.push_back(v[j]);
+				}
+			}
+			ptr_.push_back(idx_.size());
+			if (L == ROW_MAJOR)
+				++rows_;
+			else
+				++cols_;
+		}
+
+		void reserve(size_type slices, size_t nnz){
+			ptr_.reserve((size_t)slices+1);
+			idx_.reserve(nnz);
+			val_.reserve(nnz);
+		}
+
+		/** Removes every slice, keeping the inner dimension */
+		void clear(){
+			(L == ROW_MAJOR ? rows_ : cols_) = 0;
+			ptr_.assign(1,0);
+			idx_.clear();
+			val_.clear();
+		}
+
+		/** Element (i, j), by binary search in its slice */
+		double operator()(size_type i, size_type j) const{
+			assert(i < rows_ && j < cols_);
+			size_type s = L == ROW_MAJOR ? i : j, t = L == ROW_MAJOR ? j : i;
+			const unsigned* b = index_at(ptr_[s]);
+			const unsigned* e = index_at(ptr_[s+1]);
+			const unsigned* p = lower_bound(b,e,t);
+			return (p != e && *p == t) ? val_[p-index_at(0)] : 0.0;
+		}
+
+		/** Inner product of slice @a s with the dense vector @a w */
+		double dot(size_type s, const double* w) const{
+			size_t b = ptr_[s];
+			return sparse_dot(index_at(b),value_at(b),ptr_[s+1]-b,w);
+		}
+
+		/** y += alpha * slice @a s */
+		void axpy(size_type s, double alpha, double* y) const{
+			size_t b = ptr_[s];
+			sparse_axpy(alpha,index_at(b),value_at(b),ptr_[s+1]-b,y);
+		}
+
+		/** Writes slice @a s densely to @a v (inner() values) */
+		void densify(size_type s, double* v) const{
+			for (size_type j = 0; j < inner(); ++j)
+				v[j] = 0.0;
+			for (size_t k = ptr_[s]; k < ptr_[s+1]; ++k)
+				v[idx_[k]] = val_[k];
+		}
+
+		size_type rows() const{
+			return rows_;
+		}
+
+		size_type cols() const{
+			return cols_;
+		}
+
+		/** Number of slices: rows for CSR, columns for CSC */
+		size_type outer() const{
+			return L == ROW_MAJOR ? rows_ : cols_;
+		}
+
+		/** Length of a slice: columns for CSR, rows for CSC */
+		size_type inner() const{
+			return L == ROW_MAJOR ? cols_ : rows_;
+		}
+
+		size_t nnz() const{
+			return idx_.size();
+		}
+
+		/** Fraction of the entries that are stored */
+		double density() const{
+			return rows_ && cols_ ? (double) nnz()/((double) rows_*cols_) : 0.0;
+		}
+
+		/** Bytes of index and value storage */
+		size_t bytes() const{
+			return ptr_.size()*sizeof(size_t) + idx_.size()*sizeof(unsigned) + val_.size()*sizeof(double);
+		}
+
+		const size_t* outer_ptr() const{
+			return &ptr_[0];
+		}
+
+		const unsigned* inner_index() const{
+			return index_at(0);
+		}
+
+		const double* values() const{
+			return value_at(0);
+		}
+
+		bool operator==(const Sparse_matrix& a) const{
+			return rows_ == a.rows_ && cols_ == a.cols_ && ptr_ == a.ptr_ && idx_ == a.idx_ && val_ == a.val_;
+		}
+
+		bool operator!=(const Sparse_matrix& a) const{
+			return !((*this)==a);
+		}
+
+	private:
+		const unsigned* index_at(size_t k) const{
+			return idx_.empty() ? 0 : &idx_[0]+k;
+		}
+
+		const double* value_at(size_t k) const{
+			return val_.empty() ? 0 : &val_[0]+k;
+		}
+
+		size_type rows_;
+		size_type cols_;
+		vector<size_t> ptr_;
+		vector<unsigned> idx_;
+		vector<double> val_;
+};
+
+typedef Sparse_matrix<ROW_MAJOR> Csr_matrix;
+typedef Sparse_matrix<COL_MAJOR> Csc_matrix;
+
+/** y = A x, for x of a.cols() and y of a.rows() values
+ * CSR gathers one dot product per row; CSC scatters one axpy per column.
+ */
+template <matrix_layout L>
+void spmv(const Sparse_matrix<L>& a, const double* x, double* y){
+	if (L == ROW_MAJOR){
+		for (unsigned i = 0; i < a.rows(); ++i)
+			y[i] = a.dot(i,x);
+	}else{
+		for (unsigned i = 0; i < a.rows(); ++i)
+			y[i] = 0.0;
+		for (unsigned j = 0; j < a.cols(); ++j)
+			a.axpy(j,x[j],y);
+	}
+}
+
+/** out = A^T u, for u of a.rows() and out of a.cols() values */
+template <matrix_layout L>
+void spmv_t(const Sparse_matrix<L>& a, const double* u, double* out){
+	if (L == ROW_MAJOR){
+		for (unsigned j = 0; j < a.cols(); ++j)
+			out[j] = 0.0;
+		for (unsigned i = 0; i < a.rows(); ++i)
+			a.axpy(i,u[i],out);
+	}else{
+		for (unsigned j = 0; j < a.cols(); ++j)
+			out[j] = a.dot(j,u);
+	}
+}
+
+/** Models whose gradient() also takes a Csr_matrix batch; specialized by each such model */
+template <typename M>
+struct sparse_gradient: false_type{
+};
+
+#endif
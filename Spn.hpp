@@ -0,0 +1,460 @@
+#ifndef CS207_SPN_HPP
+#define CS207_SPN_HPP
+
+/** @file Spn.hpp
+ * @brief Sum-product network over sampled rows for range-query cardinality estimation
+ */
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** Learning parameters of Sum_product_network */
+struct spn_options{
+	unsigned max_bins_;		//histogram bins of a continuous column
+	unsigned min_rows_;		//fewer rows are modeled as independent columns
+	double corr_threshold_;		//columns with |Pearson r| above this stay together
+	unsigned max_depth_;
+	unsigned kmeans_iters_;
+	unsigned seed_;
+	spn_options():max_bins_(64),min_rows_(256),corr_threshold_(0.3),max_depth_(16),kmeans_iters_(10),seed_(1){
+	}
+};
+
+/** @class 	Sum_product_network
+ * @brief 	A tree of sum, product and histogram nodes modeling the joint distribution of rows
+ *
+ * Learned top-down as in DeepDB: a set of columns whose correlations with the others
+ * are all weak becomes a product node over the column groups (connected components of
+ * the |r| > corr_threshold_ graph), otherwise the rows are clustered by 2-means into a
+ * sum node weighted by cluster size. Single columns, and slices smaller than min_rows_,
+ * end in one-column histogram leaves.
+ *
+ * A column whose sampled values are all integers with at most max_bins_ distinct values
+ * is discrete: its leaves count each value exactly. Other columns use equal-depth bins
+ * and interpolate linearly inside a bin.
+ *
+ * The nodes are stored children first, so probability() is one pass over an array.
+ * insert() routes a new row down the learned structure (nearest centroid at sum
+ * nodes, every child at product nodes) and updates the counts; the structure itself
+ * is only relearned by fit().
+ *
+ * For a multi-table estimate, fit it on sampled join results, one column per attribute.
+ */
+class Sum_product_network{
+	public:
+		typedef unsigned size_type;
+
+		Sum_product_network(spn_options opt = spn_options()):opt_(opt),d_(0),rows_(0.0),consumed_(0){
+			assert(opt.max_bins_ > 0 && opt.min_rows_ > 0);
+		}
+
+		/** Learns the network from @a n row-major rows of @a d columns
+		 * Complexity: O(n*d^2) per level of the learned tree
+		 */
+		void fit(const double* x, size_type n, size_type d){
+			assert(n > 0 && d > 0);
+			d_ = d;
+			rows_ = n;
+			consumed_ = 0;
+			nodes_.clear();
+			child_.clear();
+			cum_.clear();
+			stats_.clear();
+			scope_.clear();
+			build_columns(x,n,d);
+
+			vector<size_type> rows(n), cols(d);
+			for (size_type i = 0; i < n; ++i)
+				rows[i] = i;
+			for (size_type j = 0; j < d; ++j)
+				cols[j] = j;
+			mt19937 rng(opt_.seed_);
+			learn(x,rows,cols,0,rng);
+		}
+
+		/** Learns the network from the samples a Sampler policy holds, each sample one row */
+		template <typename Policy>
+		void fit(Policy p){
+			const auto& s = p.samples();
+			assert(!s.empty());
+			size_type d = s[0].size();
+			vector<double> x((size_t)s.size()*d);
+			for (size_type i = 0; i < s.size(); ++i){
+				assert(s[i].size() == d);
+				copy(s[i].begin(),s[i].end(),&x[(size_t)i*d]);
+			}
+			fit(&x[0],s.size(),d);
+			consumed_ = s.size();
+		}
+
+		/** Adds one row of dims() values to the counts */
+		void insert(const double* row){
+			assert(!nodes_.empty());
+			add(nodes_.size()-1,row);
+			rows_ += 1.0;
+		}
+
+		/** Inserts the samples a policy collected since the last fit() or update()
+		 * @return 	the number of samples inserted
+		 */
+		template <typename Policy>
+		size_type update(Policy p){
+			const auto& s = p.samples();
+			if (s.size() < consumed_)
+				consumed_ = 0;
+			size_type n = s.size() - consumed_;
+			vector<double> row(d_);
+			for (size_type i = consumed_; i < s.size(); ++i){
+				assert(s[i].size() == d_);
+				copy(s[i].begin(),s[i].end(),row.begin());
+				insert(&row[0]);
+			}
+			consumed_ = s.size();
+			return n;
+		}
+
+		/** Probability that a row satisfies lo[j] <= x[j] <= hi[j] for every column j
+		 * Pass -HUGE_VAL / HUGE_VAL for an unconstrained bound.
+		 * Complexity: O(number of nodes), with a binary search per constrained leaf
+		 */
+		double probability(const double* lo, const double* hi) const{
+			assert(!nodes_.empty());
+			static thread_local vector<double> val;
+			val.resize(nodes_.size());
+			for (size_type k = 0; k < nodes_.size(); ++k){
+				const spn_node& nd = nodes_[k];
+				double v;
+				if (nd.type_ == LEAF){
+					v = leaf_mass(nd,lo[nd.column_],hi[nd.column_]);
+				}else if (nd.type_ == PRODUCT){
+					v = 1.0;
+					for (size_type c = nd.first_; c < nd.last_; ++c)
+						v *= val[child_[c]];
+				}else{
+					v = 0.0;
+					for (size_type c = nd.first_; c < nd.last_; ++c)
+						v += nodes_[child_[c]].count_*val[child_[c]];
+					v = nd.count_ > 0.0 ? v/nd.count_ : 0.0;
+				}
+				val[k] = v;
+			}
+			return val.back();
+		}
+
+		/** Estimated number of rows satisfying the ranges, relative to the rows seen */
+		double cardinality(const double* lo, const double* hi) const{
+			return probability(lo,hi)*rows_;
+		}
+
+		/** Rows learned from and inserted so far */
+		double rows() const{
+			return rows_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+		size_type num_nodes() const{
+			return nodes_.size();
+		}
+
+	private:
+
+		enum node_type {LEAF, PRODUCT, SUM};
+
+		struct spn_node{
+			node_type type_;
+			size_type first_;	//children are child_[first_, last_)
+			size_type last_;
+			size_type column_;	//leaf: its column
+			size_type cum_;		//leaf: offset of its cumulative bin counts in cum_
+			size_type stats_;	//sum: offset of the scope means, inverse deviations and centroids in stats_
+			size_type scope_;	//sum: offset of its columns in scope_
+			size_type scope_size_;
+			double count_;		//rows that reached the node
+		};
+
+		/** Bins of a column: discrete values, or the edges of continuous bins */
+		struct spn_column{
+			bool discrete_;
+			vector<double> edges_;
+
+			size_type num_bins() const{
+				return discrete_ ? edges_.size() : edges_.size()-1;
+			}
+
+			size_type bin(double v) const{
+				if (discrete_){
+					size_type b = upper_bound(edges_.begin(),edges_.end(),v) - edges_.begin();
+					return b > 0 ? b-1 : 0;
+				}
+				size_type b = upper_bound(edges_.begin(),edges_.end(),v) - edges_.begin();
+				b = b > 0 ? b-1 : 0;
+				return b < num_bins() ? b : num_bins()-1;
+			}
+		};
+
+		void build_columns(const double* x, size_type n, size_type d){
+			columns_.assign(d,spn_column());
+			vector<double> v(n);
+			for (size_type j = 0; j < d; ++j){
+				bool integral = true;
+				for (size_type i = 0; i < n; ++i){
+					v[i] = x[(size_t)i*d+j];
+					integral = integral && (v[i] == floor(v[i]));
+				}
+				sort(v.begin(),v.end());
+				spn_column& c = columns_[j];
+				vector<double> u(v.begin(),unique(v.begin(),v.end()));
+				c.discrete_ = integral && u.size() <= opt_.max_bins_;
+				if (c.discrete_){
+					c.edges_ = u;
+					continue;
+				}
+				c.edges_.push_back(v[0]);
+				for (size_type b = 1; b < opt_.max_bins_; ++b){
+					double e = v[(size_t)b*n/opt_.max_bins_];
+					if (e > c.edges_.back())
+						c.edges_.push_back(e);
+				}
+				if (v[n-1] > c.edges_.back())
+					c.edges_.push_back(v[n-1]);
+				else
+					c.edges_.push_back(c.edges_.back()+1.0);
+			}
+		}
+
+		size_type push(spn_node nd, const vector<size_type>& children){
+			nd.first_ = child_.size();
+			child_.insert(child_.end(),children.begin(),children.end());
+			nd.last_ = child_.size();
+			nodes_.push_back(nd);
+			return nodes_.size()-1;
+		}
+
+		static spn_node empty_node(node_type t, double count){
+			spn_node nd = {t,0,0,0,0,0,0,0,count};
+			return nd;
+		}
+
+		size_type make_leaf(const double* x, const vector<size_type>& rows, size_type col){
+			const spn_column& c = columns_[col];
+			spn_node nd = empty_node(LEAF,rows.size());
+			nd.column_ = col;
+			nd.cum_ = cum_.size();
+			size_type b = c.num_bins();
+			cum_.resize(cum_.size()+b+1,0.0);
+			double* cum = &cum_[nd.cum_];
+			for (size_type i = 0; i < rows.size(); ++i)
+				cum[c.bin(x[(size_t)rows[i]*d_+col])+1] += 1.0;
+			for (size_type k = 0; k < b; ++k)
+				cum[k+1] += cum[k];
+			return push(nd,vector<size_type>());
+		}
+
+		size_type make_independent(const double* x, const vector<size_type>& rows, const vector<size_type>& cols){
+			if (cols.size() == 1)
+				return make_leaf(x,rows,cols[0]);
+			vector<size_type> children;
+			for (size_type j = 0; j < cols.size(); ++j)
+				children.push_back(make_leaf(x,rows,cols[j]));
+			return push(empty_node(PRODUCT,rows.size()),children);
+		}
+
+		size_type learn(const double* x, const vector<size_type>& rows, const vector<size_type>& cols, unsigned depth, mt19937& rng){
+			if (cols.size() == 1 || rows.size() < opt_.min_rows_ || depth >= opt_.max_depth_)
+				return make_independent(x,rows,cols);
+
+			vector< vector<size_type> > groups;
+			column_groups(x,rows,cols,groups);
+			if (groups.size() > 1){
+				vector<size_type> children;
+				for (size_type g = 0; g < groups.size(); ++g)
+					children.push_back(learn(x,rows,groups[g],depth+1,rng));
+				return push(empty_node(PRODUCT,rows.size()),children);
+			}
+
+			// 2-means on the standardized columns of the slice
+			size_type k = cols.size();
+			vector<double> stats(4*k);
+			double* mean = &stats[0];
+			double* inv_sd = &stats[k];
+			double* cen = &stats[2*k];
+			moments(x,rows,cols,mean,inv_sd);
+			vector<unsigned char> label(rows.size());
+			uniform_int_distribution<size_type> pick(0,rows.size()-1);
+			size_type a = pick(rng), b = pick(rng);
+			for (size_type j = 0; j < k; ++j){
+				cen[j] = (x[(size_t)rows[a]*d_+cols[j]]-mean[j])*inv_sd[j];
+				cen[k+j] = (x[(size_t)rows[b]*d_+cols[j]]-mean[j])*inv_sd[j];
+			}
+			vector<double> acc(2*k);
+			size_type count[2] = {0,0};
+			for (unsigned it = 0; it < opt_.kmeans_iters_; ++it){
+				fill(acc.begin(),acc.end(),0.0);
+				count[0] = count[1] = 0;
+				for (size_type i = 0; i < rows.size(); ++i){
+					const double* row = x+(size_t)rows[i]*d_;
+					label[i] = nearest(row,&cols[0],k,mean,inv_sd,cen);
+					++count[label[i]];
+					for (size_type j = 0; j < k; ++j)
+						acc[label[i]*k+j] += (row[cols[j]]-mean[j])*inv_sd[j];
+				}
+				if (count[0] == 0 || count[1] == 0)
+					break;
+				for (size_type j = 0; j < 2*k; ++j)
+					cen[j] = acc[j]/count[j/k];
+			}
+			if (count[0] == 0 || count[1] == 0)
+				return make_independent(x,rows,cols);
+
+			vector<size_type> part[2];
+			for (size_type i = 0; i < rows.size(); ++i)
+				part[label[i]].push_back(rows[i]);
+			vector<size_type> children;
+			children.push_back(learn(x,part[0],cols,depth+1,rng));
+			children.push_back(learn(x,part[1],cols,depth+1,rng));
+
+			spn_node nd = empty_node(SUM,rows.size());
+			nd.stats_ = stats_.size();
+			stats_.insert(stats_.end(),stats.begin(),stats.end());
+			nd.scope_ = scope_.size();
+			nd.scope_size_ = k;
+			scope_.insert(scope_.end(),cols.begin(),cols.end());
+			return push(nd,children);
+		}
+
+		/** Means and inverse standard deviations (1 for a constant column) of the slice */
+		void moments(const double* x, const vector<size_type>& rows, const vector<size_type>& cols, double* mean, double* inv_sd) const{
+			size_type k = cols.size();
+			for (size_type j = 0; j < k; ++j){
+				double s = 0.0, ss = 0.0;
+				for (size_type i = 0; i < rows.size(); ++i){
+					double v = x[(size_t)rows[i]*d_+cols[j]];
+					s += v;
+					ss += v*v;
+				}
+				mean[j] = s/rows.size();
+				double var = ss/rows.size() - mean[j]*mean[j];
+				inv_sd[j] = var > 1e-24 ? 1.0/sqrt(var) : 1.0;
+			}
+		}
+
+		/** Splits @a cols into the connected components of the |r| > corr_threshold_ graph */
+		void column_groups(const double* x, const vector<size_type>& rows, const vector<size_type>& cols,
+		                   vector< vector<size_type> >& groups) const{
+			size_type k = cols.size();
+			vector<double> mean(k), inv_sd(k), z((size_t)rows.size()*k), corr((size_t)k*k,0.0);
+			moments(x,rows,cols,&mean[0],&inv_sd[0]);
+			for (size_type i = 0; i < rows.size(); ++i)
+				for (size_type j = 0; j < k; ++j)
+					z[(size_t)i*k+j] = (x[(size_t)rows[i]*d_+cols[j]]-mean[j])*inv_sd[j];
+			for (size_type i = 0; i < rows.size(); ++i){
+				const double* zi = &z[(size_t)i*k];
+				for (size_type a = 0; a < k; ++a)
+					for (size_type b = a+1; b < k; ++b)
+						corr[a*k+b] += zi[a]*zi[b];
+			}
+			vector<size_type> comp(k,k);
+			size_type num = 0;
+			for (size_type s = 0; s < k; ++s){
+				if (comp[s] < k)
+					continue;
+				vector<size_type> stack(1,s);
+				comp[s] = num;
+				while (!stack.empty()){
+					size_type a = stack.back();
+					stack.pop_back();
+					for (size_type b = 0; b < k; ++b){
+						double r = (a < b ? corr[a*k+b] : corr[b*k+a])/rows.size();
+						if (b != a && comp[b] == k && fabs(r) > opt_.corr_threshold_){
+							comp[b] = num;
+							stack.push_back(b);
+						}
+					}
+				}
+				++num;
+			}
+			groups.assign(num,vector<size_type>());
+			for (size_type j = 0; j < k; ++j)
+				groups[comp[j]].push_back(cols[j]);
+		}
+
+		/** Index (0 or 1) of the centroid nearest to @a row in the standardized scope */
+		static unsigned char nearest(const double* row, const size_type* cols, size_type k,
+		                             const double* mean, const double* inv_sd, const double* cen){
+			double d0 = 0.0, d1 = 0.0;
+			for (size_type j = 0; j < k; ++j){
+				double z = (row[cols[j]]-mean[j])*inv_sd[j];
+				d0 += (z-cen[j])*(z-cen[j]);
+				d1 += (z-cen[k+j])*(z-cen[k+j]);
+			}
+			return d1 < d0;
+		}
+
+		void add(size_type node, const double* row){
+			spn_node& nd = nodes_[node];
+			nd.count_ += 1.0;
+			if (nd.type_ == LEAF){
+				const spn_column& c = columns_[nd.column_];
+				double* cum = &cum_[nd.cum_];
+				for (size_type b = c.bin(row[nd.column_])+1; b <= c.num_bins(); ++b)
+					cum[b] += 1.0;
+			}else if (nd.type_ == PRODUCT){
+				for (size_type c = nd.first_; c < nd.last_; ++c)
+					add(child_[c],row);
+			}else{
+				size_type k = nd.scope_size_;
+				const double* s = &stats_[nd.stats_];
+				unsigned char c = nearest(row,&scope_[nd.scope_],k,s,s+k,s+2*k);
+				add(child_[nd.first_+c],row);
+			}
+		}
+
+		/** Fraction of the leaf's rows with lo <= x <= hi */
+		double leaf_mass(const spn_node& nd, double lo, double hi) const{
+			if (lo == -HUGE_VAL && hi == HUGE_VAL)
+				return 1.0;
+			if (nd.count_ <= 0.0 || lo > hi)
+				return 0.0;
+			const spn_column& c = columns_[nd.column_];
+			const double* cum = &cum_[nd.cum_];
+			const vector<double>& e = c.edges_;
+			if (c.discrete_){
+				size_type a = lower_bound(e.begin(),e.end(),lo) - e.begin();
+				size_type b = upper_bound(e.begin(),e.end(),hi) - e.begin();
+				return (cum[b]-cum[a])/nd.count_;
+			}
+			return (below(c,cum,hi)-below(c,cum,lo))/nd.count_;
+		}
+
+		/** Interpolated number of the leaf's rows with x <= v */
+		static double below(const spn_column& c, const double* cum, double v){
+			const vector<double>& e = c.edges_;
+			size_type nb = c.num_bins();
+			if (v <= e[0])
+				return 0.0;
+			if (v >= e[nb])
+				return cum[nb];
+			size_type b = upper_bound(e.begin(),e.end(),v) - e.begin() - 1;
+			return cum[b] + (cum[b+1]-cum[b])*(v-e[b])/(e[b+1]-e[b]);
+		}
+
+		spn_options opt_;
+		size_type d_;
+		double rows_;
+		size_type consumed_;
+		vector<spn_column> columns_;
+		vector<spn_node> nodes_;
+		vector<size_type> child_;
+		vector<double> cum_;
+		vector<double> stats_;
+		vector<size_type> scope_;
+};
+
+#endif
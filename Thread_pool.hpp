@@ -0,0 +1,241 @@
+#ifndef CS207_THREAD_POOL_HPP
+#define CS207_THREAD_POOL_HPP
+
+/** @file Thread_pool.hpp
+ * @brief A work-stealing pool of std::threads for tasks of uneven cost
+ */
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <cstddef>
+using namespace std;
+
+/** Number of threads to use when the caller passes 0 */
+inline unsigned default_threads(){
+	unsigned t = thread::hardware_concurrency();
+	return t > 0 ? t : 1;
+}
+
+/** @class 	Thread_pool
+ * @brief 	Runs submitted tasks on a fixed set of worker threads
+ *
+ * Every worker owns a deque. A task submitted from inside a worker goes to the back of
+ * that worker's deque; other tasks are dealt round-robin. A worker takes tasks from the
+ * back of its own deque and, when it is empty, steals from the front of the others, so
+ * a worker that drew cheap tasks keeps busy with the expensive ones of its neighbours.
+ *
+ * wait() blocks until every submitted task has finished, running queued tasks on the
+ * calling thread meanwhile. The destructor finishes the queued tasks and joins the workers.
+ *
+ * run_chunks() splits a loop over the workers and waits for that loop only, so the
+ * workers of one long-lived pool serve every parallel_for() (Parallel.hpp) instead of
+ * threads being started and joined per loop.
+ */
+class Thread_pool{
+	public:
+		typedef function<void()> task_type;
+
+		/** @param[in] threads	number of workers, 0 for default_threads() */
+		explicit Thread_pool(unsigned threads = 0):queues_(),workers_(),next_(0),queued_(0),pending_(0),stop_(false){
+			if (threads == 0)
+				threads = default_threads();
+			queues_.reserve(threads);
+			for (unsigned w = 0; w < threads; ++w)
+				queues_.push_back(new worker_queue());
+			workers_.reserve(threads);
+			for (unsigned w = 0; w < threads; ++w)
+				workers_.push_back(thread(&Thread_pool::run,this,w));
+		}
+
+		~Thread_pool(){
+			wait();
+			{
+				lock_guard<mutex> lk(m_);
+				stop_ = true;
+			}
+			work_cv_.notify_all();
+			for (size_t w = 0; w < workers_.size(); ++w)
+				workers_[w].join();
+			for (size_t w = 0; w < queues_.size(); ++w)
+				delete queues_[w];
+		}
+
+		Thread_pool(const Thread_pool&) = delete;
+		Thread_pool& operator=(const Thread_pool&) = delete;
+
+		/** Queues @a task to run on some worker */
+		void submit(task_type task){
+			++pending_;
+			unsigned w = (current().pool_ == this) ? current().worker_ : (next_++ % queues_.size());
+			{
+				lock_guard<mutex> lk(m_);
+				++queued_;
+			}
+			{
+				lock_guard<mutex> lk(queues_[w]->m_);
+				queues_[w]->q_.push_back(std::move(task));
+			}
+			work_cv_.notify_one();
+		}
+
+		/** Returns once every task submitted so far, and every task they submitted, is done */
+		void wait(){
+			unsigned self = (current().pool_ == this) ? current().worker_ : (unsigned) queues_.size();
+			while (pending_ > 0){
+				task_type task;
+				if (take(self,task)){
+					task();
+					finish();
+					continue;
+				}
+				unique_lock<mutex> lk(m_);
+				done_cv_.wait(lk,[this]{ return pending_ == 0 || queued_ > 0; });
+			}
+		}
+
+		/** Runs f(lo, hi, tid) over [@a begin, @a end) split into at most @a chunks contiguous
+		 * chunks, tid in [0, @a chunks): chunk 0 on the calling thread, the others as tasks.
+		 * Returns when those chunks are done, running queued tasks rather than sleeping
+		 * meanwhile, so it may be called from inside a task. Submitting a chunk copies
+		 * two words into the task, which std::function keeps without allocating.
+		 */
+		template <typename F>
+		void run_chunks(size_t begin, size_t end, unsigned chunks, F& f){
+			size_t n = end > begin ? end-begin : 0;
+			if (n == 0)
+				return;
+			size_t chunk = (n + chunks - 1)/chunks;
+			unsigned used = (unsigned) ((n + chunk - 1)/chunk);
+			chunk_job<F> job(f,begin,end,chunk,used-1);
+			chunk_job<F>* j = &job;
+			for (unsigned t = 1; t < used; ++t)
+				submit([j,t](){ j->run(t); });
+			job.run_chunk(0);
+
+			unsigned self = (current().pool_ == this) ? current().worker_ : (unsigned) queues_.size();
+			while (job.left_.load(memory_order_acquire) > 0){
+				task_type task;
+				if (take(self,task)){
+					task();
+					finish();
+				}else{
+					this_thread::yield();
+				}
+			}
+		}
+
+		/** Number of worker threads */
+		unsigned size() const{
+			return (unsigned) workers_.size();
+		}
+
+	private:
+
+		struct worker_queue{
+			mutex m_;
+			deque<task_type> q_;
+		};
+
+		/** One run_chunks() call: the loop body, its range and the chunks still running */
+		template <typename F>
+		struct chunk_job{
+			F* f_;
+			size_t begin_;
+			size_t end_;
+			size_t chunk_;
+			atomic<unsigned> left_;
+
+			chunk_job(F& f, size_t begin, size_t end, size_t chunk, unsigned left)
+			  :f_(&f),begin_(begin),end_(end),chunk_(chunk),left_(left){
+			}
+
+			void run_chunk(unsigned t){
+				size_t lo = begin_ + t*chunk_;
+				size_t hi = lo + chunk_ < end_ ? lo + chunk_ : end_;
+				(*f_)(lo,hi,t);
+			}
+
+			/** A task's chunk; the release pairs with the acquire in run_chunks() */
+			void run(unsigned t){
+				run_chunk(t);
+				left_.fetch_sub(1,memory_order_release);
+			}
+		};
+
+		/** The pool and worker index of the calling thread, if it is a worker */
+		struct worker_id{
+			const Thread_pool* pool_;
+			unsigned worker_;
+		};
+
+		static worker_id& current(){
+			static thread_local worker_id id = {0,0};
+			return id;
+		}
+
+		/** Pops from the back of deque @a self, else steals from the front of another */
+		bool take(unsigned self, task_type& task){
+			size_t k = queues_.size();
+			if (self < k){
+				lock_guard<mutex> lk(queues_[self]->m_);
+				if (!queues_[self]->q_.empty()){
+					task = std::move(queues_[self]->q_.back());
+					queues_[self]->q_.pop_back();
+					--queued_;
+					return true;
+				}
+			}
+			for (size_t i = 1; i <= k; ++i){
+				worker_queue& q = *queues_[(self+i) % k];
+				lock_guard<mutex> lk(q.m_);
+				if (!q.q_.empty()){
+					task = std::move(q.q_.front());
+					q.q_.pop_front();
+					--queued_;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void finish(){
+			if (--pending_ == 0){
+				lock_guard<mutex> lk(m_);
+				done_cv_.notify_all();
+			}
+		}
+
+		void run(unsigned w){
+			current().pool_ = this;
+			current().worker_ = w;
+			for (;;){
+				task_type task;
+				if (take(w,task)){
+					task();
+					finish();
+					continue;
+				}
+				unique_lock<mutex> lk(m_);
+				work_cv_.wait(lk,[this]{ return stop_ || queued_ > 0; });
+				if (stop_ && queued_ == 0)
+					return;
+			}
+		}
+
+		vector<worker_queue*> queues_;
+		vector<thread> workers_;
+		atomic<unsigned> next_;
+		atomic<size_t> queued_;		//tasks sitting in some deque
+		atomic<size_t> pending_;	//tasks submitted and not finished
+		bool stop_;
+		mutex m_;
+		condition_variable work_cv_;
+		condition_variable done_cv_;
+};
+
+#endif
@@ -0,0 +1,420 @@
+#ifndef CS207_TREE_HPP
+#define CS207_TREE_HPP
+
+/** @file Tree.hpp
+ * @brief Histogram-based regression trees shared by the tree ensembles
+ */
+
+#include "Parallel.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cassert>
+using namespace std;
+
+/** @class 	Binned_features
+ * @brief 	Features quantized to at most 256 bins, one byte per value, stored column by column
+ *
+ * The bin edges of a feature are quantiles of (a sample of) its values, so bin b of
+ * feature j holds the values v with threshold(j,b-1) < v <= threshold(j,b).
+ * Values must not be NaN.
+ */
+struct Binned_features{
+	public:
+		typedef unsigned size_type;
+
+		/** Rows sampled per feature to place the bin edges */
+		enum { sample_rows = 100000 };
+
+		Binned_features():n_(0),d_(0){
+		}
+
+		/** Computes the bin edges of each feature and bins every value
+		 * @param[in] x	row-major @a n x @a d features
+		 * @param[in] max_bins	in [2, 256]
+		 * Features are binned in parallel.
+		 */
+		void fit(const double* x, size_type n, size_type d, size_type max_bins = 256, unsigned threads = 0){
+			assert(n > 0 && d > 0 && max_bins >= 2 && max_bins <= 256);
+			n_ = n;
+			d_ = d;
+			edges_.assign(d,vector<double>());
+			codes_.resize((size_t)n*d);
+			parallel_for(0,d,[&](size_t lo, size_t hi, unsigned){
+				vector<double> vals;
+				size_t step = n > sample_rows ? n/sample_rows : 1;
+				for (size_t j = lo; j < hi; ++j){
+					vals.clear();
+					for (size_t i = 0; i < n; i += step)
+						vals.push_back(x[i*d+j]);
+					sort(vals.begin(),vals.end());
+					vals.erase(unique(vals.begin(),vals.end()),vals.end());
+					vector<double>& e = edges_[j];
+					if (vals.size() <= max_bins){
+						e.assign(vals.begin(),vals.end()-1);
+					}else{
+						for (size_t b = 1; b < max_bins; ++b){
+							double v = vals[b*vals.size()/max_bins];
+							if (e.empty() || e.back() < v)
+								e.push_back(v);
+						}
+					}
+					unsigned char* c = &codes_[j*n];
+					for (size_t i = 0; i < n; ++i)
+						c[i] = bin(j,x[i*d+j]);
+				}
+			},threads,1);
+		}
+
+		/** Bin of value @a v of feature @a j */
+		unsigned char bin(size_type j, double v) const{
+			const vector<double>& e = edges_[j];
+			return (unsigned char) (lower_bound(e.begin(),e.end(),v) - e.begin());
+		}
+
+		/** Bins of feature @a j for all rows */
+		const unsigned char* column(size_type j) const{
+			return &codes_[(size_t)j*n_];
+		}
+
+		/** Largest value in bin @a b of feature @a j
+		 * @pre	@a b < num_bins(j)-1
+		 */
+		double threshold(size_type j, size_type b) const{
+			return edges_[j][b];
+		}
+
+		size_type num_bins(size_type j) const{
+			return edges_[j].size()+1;
+		}
+
+		size_type rows() const{
+			return n_;
+		}
+
+		size_type dims() const{
+			return d_;
+		}
+
+	private:
+		size_type n_;
+		size_type d_;
+		vector< vector<double> > edges_;
+		vector<unsigned char> codes_;
+};
+
+/** A node of a regression tree. Rows with x[feature_] <= threshold_ go left. */
+struct tree_node{
+	int feature_;		//-1 for a leaf
+	unsigned char bin_;	//same split on binned rows: code <= bin_ goes left
+	double threshold_;
+	unsigned left_;
+	unsigned right_;
+	double value_;		//prediction of a leaf
+
+	bool operator==(const tree_node& t) const{
+		return feature_ == t.feature_ && threshold_ == t.threshold_ && left_ == t.left_
+			&& right_ == t.right_ && value_ == t.value_;
+	}
+};
+
+/** A binary regression tree stored as a vector of nodes, node 0 the root */
+struct Regression_tree{
+	vector<tree_node> nodes_;
+
+	/** Prediction for one row of features */
+	double predict(const double* row) const{
+		unsigned k = 0;
+		while (nodes_[k].feature_ >= 0)
+			k = row[nodes_[k].feature_] <= nodes_[k].threshold_ ? nodes_[k].left_ : nodes_[k].right_;
+		return nodes_[k].value_;
+	}
+
+	/** Number of levels below the root */
+	unsigned depth() const{
+		return nodes_.empty() ? 0 : depth(0);
+	}
+
+	bool operator==(const Regression_tree& t) const{
+		return nodes_ == t.nodes_;
+	}
+
+	private:
+		unsigned depth(unsigned k) const{
+			if (nodes_[k].feature_ < 0)
+				return 0;
+			unsigned l = depth(nodes_[k].left_), r = depth(nodes_[k].right_);
+			return 1 + (l > r ? l : r);
+		}
+};
+
+/** Growth limits for Tree_builder */
+struct tree_options{
+	unsigned max_depth_;
+	unsigned min_samples_leaf_;
+	double lambda_;		//l2 penalty on leaf values
+	double min_gain_;
+	unsigned max_features_;	//features tried per split, 0 for all
+	unsigned threads_;	//0 for all cores
+	tree_options():max_depth_(6),min_samples_leaf_(20),lambda_(1.0),min_gain_(1e-12),max_features_(0),threads_(0){
+	}
+};
+
+/** @class 	Tree_builder
+ * @brief 	Grows regression trees on Binned_features from per-row gradients and hessians
+ *
+ * A leaf predicts -G/(H + lambda) for the sums G and H of the gradients and hessians of
+ * its rows, and splits maximize G_L^2/(H_L+lambda) + G_R^2/(H_R+lambda) - G^2/(H+lambda).
+ * With squared loss this is gradient boosting; with g = -y, h = 1 and lambda = 0 it is
+ * the variance reduction of a CART regression tree.
+ *
+ * Each node keeps a histogram of (G, H, count) per feature and bin. Only the smaller
+ * child's histogram is built from its rows; the larger child's is the parent's minus
+ * the smaller one. Histograms of large nodes are built with the features split over threads.
+ */
+class Tree_builder{
+	public:
+		typedef unsigned size_type;
+
+		/** Rows of a leaf after build(): idx[begin_, end_) */
+		struct leaf_range{
+			unsigned node_;
+			size_type begin_;
+			size_type end_;
+		};
+
+		/** Nodes with fewer rows than this build their histogram on one thread */
+		enum { parallel_rows = 32768 };
+
+		Tree_builder(const Binned_features& bf, tree_options opt = tree_options())
+		  :bf_(&bf),opt_(opt),g_(0),h_(0),rng_(0){
+			features_.resize(bf.dims());
+			for (size_type j = 0; j < bf.dims(); ++j)
+				features_[j] = j;
+		}
+
+		~Tree_builder(){
+			for (size_type i = 0; i < pool_.size(); ++i)
+				delete pool_[i];
+		}
+
+		Tree_builder(const Tree_builder&) = delete;
+		Tree_builder& operator=(const Tree_builder&) = delete;
+
+		/** Grows @a t on the rows idx[0, m), which may repeat (bootstrap samples)
+		 * @param[in] g	gradient per row, indexed by row id
+		 * @param[in] h	hessian per row, or 0 for all ones
+		 * @param[in] rng	random source for the feature subsets, needed if max_features_ is set
+		 * @post @a idx is reordered so the rows of every leaf are contiguous, see leaves()
+		 */
+		void build(Regression_tree& t, size_type* idx, size_type m, const double* g, const double* h, mt19937* rng = 0){
+			assert(m > 0);
+			assert(opt_.max_features_ == 0 || rng != 0);
+			g_ = g;
+			h_ = h;
+			rng_ = rng;
+			t.nodes_.clear();
+			leaves_.clear();
+			t.nodes_.push_back(tree_node());
+
+			histogram* root = acquire();
+			fill_histogram(idx,0,m,*root);
+			double G = 0.0, H = 0.0;
+			const bin_stats* f0 = &(*root)[0];
+			for (size_type b = 0; b < 256; ++b){
+				G += f0[b].g_;
+				H += f0[b].h_;
+			}
+			grow(t,0,idx,0,m,root,0,G,H);
+		}
+
+		const vector<leaf_range>& leaves() const{
+			return leaves_;
+		}
+
+	private:
+
+		struct bin_stats{
+			double g_;
+			double h_;
+			size_type n_;
+		};
+		typedef vector<bin_stats> histogram;	//256 bins per feature
+
+		histogram* acquire(){
+			if (pool_free_.empty()){
+				pool_.push_back(new histogram((size_t)bf_->dims()*256));
+				return pool_.back();
+			}
+			histogram* hist = pool_free_.back();
+			pool_free_.pop_back();
+			return hist;
+		}
+
+		void release(histogram* hist){
+			pool_free_.push_back(hist);
+		}
+
+		/** Histogram of the rows idx[begin, end)
+		 * The gradients are first gathered in row order, so the per-feature passes
+		 * read them sequentially and only the one-byte bins are gathered.
+		 */
+		void fill_histogram(const size_type* idx, size_type begin, size_type end, histogram& hist){
+			size_type m = end-begin;
+			ordered_g_.resize(m);
+			for (size_type k = 0; k < m; ++k)
+				ordered_g_[k] = g_[idx[begin+k]];
+			if (h_){
+				ordered_h_.resize(m);
+				for (size_type k = 0; k < m; ++k)
+					ordered_h_[k] = h_[idx[begin+k]];
+			}
+			const double* g = &ordered_g_[0];
+			const double* h = h_ ? &ordered_h_[0] : 0;
+			const size_type* rows = idx+begin;
+
+			unsigned threads = (m >= parallel_rows) ? opt_.threads_ : 1;
+			parallel_for(0,bf_->dims(),[&](size_t lo, size_t hi, unsigned){
+				for (size_t j = lo; j < hi; ++j){
+					bin_stats* s = &hist[j*256];
+					for (size_type b = 0; b < 256; ++b){
+						s[b].g_ = 0.0;
+						s[b].h_ = 0.0;
+						s[b].n_ = 0;
+					}
+					const unsigned char* c = bf_->column(j);
+					if (h){
+						for (size_type k = 0; k < m; ++k){
+							bin_stats& sb = s[c[rows[k]]];
+							sb.g_ += g[k];
+							sb.h_ += h[k];
+							++sb.n_;
+						}
+					}else{
+						for (size_type k = 0; k < m; ++k){
+							bin_stats& sb = s[c[rows[k]]];
+							sb.g_ += g[k];
+							++sb.n_;
+						}
+						for (size_type b = 0; b < 256; ++b)
+							s[b].h_ = s[b].n_;
+					}
+				}
+			},threads,1);
+		}
+
+		void make_leaf(Regression_tree& t, unsigned node, size_type begin, size_type end, double G, double H){
+			tree_node& nd = t.nodes_[node];
+			nd.feature_ = -1;
+			nd.bin_ = 0;
+			nd.threshold_ = 0.0;
+			nd.left_ = nd.right_ = 0;
+			nd.value_ = -G/(H + opt_.lambda_);
+			leaf_range r = {node,begin,end};
+			leaves_.push_back(r);
+		}
+
+		void grow(Regression_tree& t, unsigned node, size_type* idx, size_type begin, size_type end,
+		          histogram* hist, unsigned depth, double G, double H){
+			size_type m = end-begin;
+			if (depth >= opt_.max_depth_ || m < 2*opt_.min_samples_leaf_ || m < 2){
+				make_leaf(t,node,begin,end,G,H);
+				release(hist);
+				return;
+			}
+
+			size_type nf = bf_->dims();
+			if (opt_.max_features_ > 0 && opt_.max_features_ < nf){
+				for (size_type k = 0; k < opt_.max_features_; ++k){
+					uniform_int_distribution<size_type> pick(k,nf-1);
+					swap(features_[k],features_[pick(*rng_)]);
+				}
+				nf = opt_.max_features_;
+			}
+
+			double lambda = opt_.lambda_;
+			double parent = G*G/(H + lambda);
+			double best_gain = opt_.min_gain_;
+			int best_f = -1;
+			size_type best_b = 0;
+			double best_gl = 0.0, best_hl = 0.0;
+			for (size_type k = 0; k < nf; ++k){
+				size_type j = features_[k];
+				const bin_stats* s = &(*hist)[(size_t)j*256];
+				double gl = 0.0, hl = 0.0;
+				size_type nl = 0;
+				size_type last = bf_->num_bins(j)-1;
+				for (size_type b = 0; b < last; ++b){
+					gl += s[b].g_;
+					hl += s[b].h_;
+					nl += s[b].n_;
+					if (nl < opt_.min_samples_leaf_)
+						continue;
+					if (m-nl < opt_.min_samples_leaf_)
+						break;
+					double gr = G-gl, hr = H-hl;
+					double gain = gl*gl/(hl + lambda) + gr*gr/(hr + lambda) - parent;
+					if (gain > best_gain){
+						best_gain = gain;
+						best_f = j;
+						best_b = b;
+						best_gl = gl;
+						best_hl = hl;
+					}
+				}
+			}
+			if (best_f < 0){
+				make_leaf(t,node,begin,end,G,H);
+				release(hist);
+				return;
+			}
+
+			const unsigned char* c = bf_->column(best_f);
+			unsigned char cut = (unsigned char) best_b;
+			size_type mid = partition(idx+begin,idx+end,[c,cut](size_type i){ return c[i] <= cut; }) - idx;
+
+			unsigned left = t.nodes_.size();
+			t.nodes_.push_back(tree_node());
+			t.nodes_.push_back(tree_node());
+			tree_node& nd = t.nodes_[node];
+			nd.feature_ = best_f;
+			nd.bin_ = cut;
+			nd.threshold_ = bf_->threshold(best_f,best_b);
+			nd.left_ = left;
+			nd.right_ = left+1;
+			nd.value_ = -G/(H + lambda);
+
+			// histogram subtraction: build the smaller child, derive the larger one
+			histogram* small = acquire();
+			bool left_small = (mid-begin) <= (end-mid);
+			if (left_small)
+				fill_histogram(idx,begin,mid,*small);
+			else
+				fill_histogram(idx,mid,end,*small);
+			size_t cells = (size_t)bf_->dims()*256;
+			for (size_t k = 0; k < cells; ++k){
+				(*hist)[k].g_ -= (*small)[k].g_;
+				(*hist)[k].h_ -= (*small)[k].h_;
+				(*hist)[k].n_ -= (*small)[k].n_;
+			}
+			histogram* lh = left_small ? small : hist;
+			histogram* rh = left_small ? hist : small;
+			grow(t,left,idx,begin,mid,lh,depth+1,best_gl,best_hl);
+			grow(t,left+1,idx,mid,end,rh,depth+1,G-best_gl,H-best_hl);
+		}
+
+		const Binned_features* bf_;
+		tree_options opt_;
+		const double* g_;
+		const double* h_;
+		mt19937* rng_;
+		vector<size_type> features_;
+		vector<leaf_range> leaves_;
+		vector<double> ordered_g_;
+		vector<double> ordered_h_;
+		vector<histogram*> pool_;
+		vector<histogram*> pool_free_;
+};
+
+#endif
@@ -14,14 +14,16 @@ using namespace std;
 //#include <limits.h>
 #include "Manager.hpp"
 #include "Selector.hpp"
+#include "Forest.hpp"
+#include "Regression.hpp"
 //#include <cstdlib>
 //#include <math.h>
 
 
 struct policy_value_type;
-struct X_type;
+typedef Matrix<double> X_type;
 typedef X_type X;
-struct Y_type;
+typedef aligned_vector<double> Y_type;
 typedef Y_type Y;
 
 //template <typename X>
@@ -40,7 +42,7 @@ typedef S C;
 
 
 struct LearningModelType; //This will be class of models a manager stores
-struct Regression_type; //This will be a type of Learning Model;
+typedef Linear_regression Regression_type; //This will be a type of Learning Model;
 //typedef LearningModelType<regression_type,X_type,Y_type> Regression;
 //typedef Manager<regression_type> ManagerType;
 
@@ -48,101 +50,6 @@ struct Regression_type; //This will be a type of Learning Model;
 //typedef SelectorType::error_type error_type;
 //typedef SelectorType::ManagerType Regression;
 
-//element must have a size() element as well 
-//must have an insert method as well
-template <typename V,typename Vec>
-struct V_type{
-	private:
-		Vec x_;
-
-	public:
-
-		typedef typename Vec::iterator iterator;
-
-		size_type size() const{
-			return x_.size();
-		}
-		
-		void add_vector(Vec t){
-			for (size_type i=0; i < t.size(); ++i)
-				x_.push_back(t[i]);
-		}	
-
-		/*void add_element(Vec::value_type s){
-			x_.push_back(s);
-		}*/
-
-		bool operator==(const V& y) const{
-			return y.x_ == x_;
-   	}
-
-		/*void remove_element(size_type idx){
-			vector<double> tmp;
-			tmp.copy(x_.begin(),x_.begin()+idx);
-			tmp.copy(x.begin()+idx+1,x.end());
-			x_ = tmp;
-
-			copy_if(x_.begin(),x_.end(),tmp.begin(), );
-		}*/
-	
-		bool operator<(const V& y) const{
-     return x_ < y.x_; 
-   }
-
-	iterator begin(){
-		return x_.begin();
-	}
-
-	iterator end(){
-		return x_.end();
-	}
-
-	void insert(V val){
-			x_.insert(x_.begin(),val);
-	}
-	
-
-};
-
-struct X_type: totally_ordered<X_type>, V_type<X_type, vector<double> >{
-	private:
-	vector<double> x_;
-
-	public:
-	void x(vector<double> t){
-		for (size_type i=0; i < t.size(); ++i)
-			x_.push_back(t[i]);
-	}
-
-	bool operator==(const X_type& x) const{
-		/*if (x.size() != x_.size())
-			return false;
-		for(size_type i=0; i< x.size(); ++i){
-        if (x[i] != x_[i])
-				return false;
-		return true;*/
-		return x_ == x.x_; 
-   }
-
-   bool operator<(const X_type& x) const{
-      return x_ < x.x_; 
-   }
-
-	vector<double>::iterator begin(){
-		return x_.begin();
-	}
-
-	vector<double>::iterator end(){
-		return x_.end();
-	}
-	
-};
-
-struct Y_type: totally_ordered<Y_type>, V_type<int, std::vector<int> >{
-
-};
-
-
 /*struct domain_value_type: domain_type<X>{
 	size_type id;
 	bool in_domain(X x){
@@ -152,7 +59,7 @@ struct Y_type: totally_ordered<Y_type>, V_type<int, std::vector<int> >{
 };*/
 
 
-struct random_forest_type;
+typedef Random_forest random_forest_type;
 typedef random_forest_type F;
 typedef Manager<F> RandomForest;
 
@@ -206,75 +113,6 @@ struct policy_value_type: pvt<C> {
 
 };
 
-//template <typename X, typename Y>
-struct Regression_type{
-	private:
-		vector<double> w_;
-		bool has_fit_;
-
-	public:
-		Regression_type():w_(),has_fit_(false){
-		}
-
-		void fit(X_type& x,Y_type& y){
-			(void) x;
-			(void) y;
-			cout << "Fitting parameters to training examples";
-			w_.clear();
-			w_.push_back(rand()%100);
-			w_.push_back(rand()%100);
-			w_.push_back(rand()%100);
-			w_.push_back(rand()%100);
-			has_fit_ = true;
-		}
-
-		Y predict(X_type& x){
-			(void) x;
-			//do some calculation 
-			Y_type y_hat;
-			for (size_type i=0; i < x.size(); ++i)
-				y_hat.insert(rand()%1000);
-			return y_hat;
-		}
-
-		double score(X_type x,Y_type y){
-			if (!has_fit_)
-				return 0.0;
-				
-			auto y_hat = predict(x);
-			assert(y_hat.size()==y.size());
-
-			auto it2 = y_hat.begin();
-			double loss_val = 0.0;
-			for (auto it1 = y.begin(); it1 < y.end(); ++it1, ++it2){
-				loss_val += pow((*it1)-(*it2),2);
-			}
-			return loss_val;
-		}
-
-		void set_params(vector<double> w){
-			w_.clear();
-			w_.insert(w_.begin(),w.begin(),w.end());
-		}
-
-		vector<double> get_params(){
-			return w_;
-		}
-		
-		void operator=(Regression_type r){
-			set_params(r.w_);
-			r.has_fit_ = has_fit_;
-		}
-
-		bool operator==(Regression_type r){
-			return (w_==r.w_) && (has_fit_==r.has_fit_);
-		}
-
-		bool operator!=(Regression_type r){
-			return !((*this)==r);
-		}
-};
-
 /*template <typename Q, typename X, typename Y>
 struct LearningModelType {
 	private:
@@ -346,10 +184,28 @@ int main(){
 	Samp.stats();
 
 	Manager<Regression_type,Regression_type> mgr;
-	Regression_type r1;
-
-	mgr.add_model(r1,r1);
+	Regression_type r1, r2(10.0);
+
+	X subplans(300,4);
+	Y cards(300);
+	for (size_type i=0; i < 300; ++i){
+		for (size_type j=0; j < 4; ++j)
+			subplans(i,j) = rand()%100;
+		cards[i] = 2*subplans(i,0) - subplans(i,3) + rand()%10;
+	}
+	r1.fit(subplans.data(),300,4,&cards[0]);
+	r2.fit(subplans.data(),300,4,&cards[0]);
+	mgr.add_model(r1,r2);
 	cout << "Number of models:" <<mgr.num_models() << endl;
+
+	vector<double> est1(300), est2(300);
+	mgr.predict(subplans,&est1[0],&est2[0]);
+	cout << "Estimated " << est1.size() << " subplans with each model" << endl;
+
+	Selector<Regression_type,X,Y> sel;
+	Matrix_view<const double> train = subplans.view().rows(0,200), held_out = subplans.view().rows(200,300);
+	size_type best = sel.best_model(mgr,train,held_out,&cards[0],&cards[200]);
+	cout << "Best model is " << best << " with loss " << mgr.model_risk(best) << endl;
 	/*
 	vector<double> vt;
 	vt.push_back(5.5);
@@ -0,0 +1,118 @@
+/** @file test_adjacency.cpp
+ * @brief Checks every Graph adjacency policy against a map per node under random edits
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Adjacency.hpp"
+#include <vector>
+#include <map>
+#include <random>
+#include <iostream>
+using namespace std;
+
+enum { nodes = 60, steps = 20000 };
+
+typedef map<unsigned,unsigned> list_type;
+
+/** True if the entries of @a a's list in @a adj are those of @a ref, in neighbor order if @a sorted */
+template <typename A>
+bool same_list(const A& adj, unsigned a, const list_type& ref, bool sorted){
+	if (adj.degree(a) != ref.size())
+		return false;
+	vector<pair<unsigned,unsigned> > got(adj.begin(a),adj.end(a));
+	if (!sorted)
+		sort(got.begin(),got.end());
+	return got == vector<pair<unsigned,unsigned> >(ref.begin(),ref.end());
+}
+
+/** Runs the same random inserts, erasures and clears on @a adj and on a map per node
+ * @return 0, or 1 after reporting the first mismatch
+ */
+template <typename A>
+int check_policy(A& adj, bool sorted, unsigned seed){
+	mt19937 gen(seed);
+	vector<list_type> ref;
+	unsigned next_edge = 0;
+	for (unsigned step = 0; step < steps; ++step){
+		if (ref.size() < 2 || (ref.size() < nodes && gen()%50 == 0)){
+			adj.add_node();
+			ref.push_back(list_type());
+			continue;
+		}
+		unsigned a = gen()%ref.size(), b = gen()%ref.size(), op = gen()%10;
+		if (op < 5){
+			if (ref[a].count(b) == 0){
+				adj.insert(a,b,next_edge);
+				ref[a][b] = next_edge++;
+			}
+		}else if (op < 8){
+			// erase an entry that is there, if a has any
+			if (!ref[a].empty()){
+				list_type::iterator it = ref[a].begin();
+				advance(it,gen()%ref[a].size());
+				adj.erase(a,it->first);
+				ref[a].erase(it);
+			}
+		}else if (op == 8){
+			// a traversal, which packs Csr_adjacency, between edits
+			CHECK(same_list(adj,a,ref[a],sorted));
+		}else if (gen()%20 == 0){
+			adj.clear(a);
+			ref[a].clear();
+		}
+		list_type::const_iterator it = ref[a].find(b);
+		CHECK(adj.find(a,b) == (it == ref[a].end() ? adjacency::npos : it->second));
+	}
+	for (unsigned a = 0; a < ref.size(); ++a){
+		CHECK(same_list(adj,a,ref[a],sorted));
+		for (unsigned b = 0; b < ref.size(); ++b){
+			list_type::const_iterator it = ref[a].find(b);
+			CHECK(adj.find(a,b) == (it == ref[a].end() ? adjacency::npos : it->second));
+		}
+	}
+	adj.clear();
+	adj.add_node();
+	CHECK(adj.degree(0) == 0 && adj.find(0,0) == adjacency::npos && adj.begin(0) == adj.end(0));
+	return 0;
+}
+
+int main(){
+	Map_adjacency m;
+	Sorted_adjacency<> s;
+	Sorted_adjacency<1> s1;
+	Hash_adjacency h;
+	Csr_adjacency c;
+	for (unsigned seed = 1; seed <= 3; ++seed){
+		CHECK(check_policy(m,true,seed) == 0);
+		CHECK(check_policy(s,true,seed) == 0);
+		CHECK(check_policy(s1,true,seed) == 0);
+		CHECK(check_policy(h,false,seed) == 0);
+		CHECK(check_policy(c,true,seed) == 0);
+	}
+
+	// a frozen Csr_adjacency answers as the lists it was packed from, and erasing keeps it packed
+	Csr_adjacency f;
+	Sorted_adjacency<> g;
+	for (unsigned a = 0; a < 5; ++a){
+		f.add_node();
+		g.add_node();
+	}
+	for (unsigned a = 0; a < 5; ++a)
+		for (unsigned b = 0; b < 5; ++b)
+			if (a != b){
+				f.insert(a,b,5*a+b);
+				g.insert(a,b,5*a+b);
+			}
+	f.freeze();
+	const Csr_adjacency::entry_type* row = f.begin(2);
+	f.erase(2,4);
+	g.erase(2,4);
+	CHECK(f.begin(2) == row && f.degree(2) == 3 && f.find(2,4) == adjacency::npos);
+	for (unsigned a = 0; a < 5; ++a)
+		CHECK(vector<Csr_adjacency::entry_type>(f.begin(a),f.end(a)) == vector<Csr_adjacency::entry_type>(g.begin(a),g.end(a)));
+
+	cout << "test_adjacency ok" << endl;
+	return 0;
+}
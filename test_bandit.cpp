@@ -0,0 +1,73 @@
+/** @file test_bandit.cpp
+ * @brief Checks that Bandit settles on the better arm and follows a workload shift
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Bandit.hpp"
+#include "Manager.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <iostream>
+using namespace std;
+
+typedef Manager<Linear_regression> manager_type;
+typedef Bandit<manager_type> bandit_type;
+
+/** Picks of arm 2 over @a steps rounds in which arm 1 always has q-error 2 and arm 2 has
+ * q-error 10 before step @a shift and 1 from then on, counted from step @a from
+ */
+unsigned drift(manager_type& mt, bandit_type::policy_type policy, double decay, unsigned steps, unsigned shift, unsigned from){
+	bandit_type b(mt,policy,1.0,decay);
+	unsigned picks = 0;
+	for (unsigned t = 0; t < steps; ++t){
+		unsigned arm = b.choose();
+		double q = arm == 1 ? 2.0 : (t < shift ? 10.0 : 1.0);
+		b.feedback(arm,q*100.0,100.0);
+		if (t >= from && arm == 2)
+			++picks;
+	}
+	return picks;
+}
+
+int main(){
+	// two distinct fitted models make two arms
+	vector<double> x(40), y(20);
+	for (unsigned i = 0; i < 20; ++i){
+		x[2*i] = i;
+		x[2*i+1] = i%3;
+		y[i] = 2.0*i + 1.0;
+	}
+	Linear_regression m1, m2(1.0);
+	m1.fit(&x[0],20,2,&y[0]);
+	m2.fit(&x[0],20,2,&y[0]);
+	manager_type mt;
+	mt.add_model(m1,m2);
+	CHECK(mt.has_model(1) && mt.has_model(2));
+
+	bandit_type::policy_type policies[2] = {bandit_type::UCB,bandit_type::THOMPSON};
+	for (unsigned p = 0; p < 2; ++p){
+		// before the shift arm 1 is better and is chosen almost always
+		CHECK(drift(mt,policies[p],0.99,1000,1000,500) < 100);
+
+		// after it the improved arm 2 is found again and takes most of the rest; a
+		// shorter memory (smaller decay) explores arm 1 more often
+		double decays[2] = {0.99,0.9};
+		for (unsigned k = 0; k < 2; ++k)
+			CHECK(drift(mt,policies[p],decays[k],11000,1000,1000) > 2*10000/3);
+	}
+
+	// the statistics of an idle arm are discounted too
+	bandit_type b(mt,bandit_type::UCB,1.0,0.5);
+	b.feedback(1,200.0,100.0);
+	b.feedback(2,200.0,100.0);
+	for (unsigned t = 0; t < 10; ++t)
+		b.feedback(2,200.0,100.0);
+	CHECK(b.pulls(1) < 1e-3);
+	CHECK(b.pulls(2) > 1.9 && b.pulls(2) < 2.0);
+	CHECK(fabs(b.mean_qerror(1) - 2.0) < 1e-12);
+
+	cout << "test_bandit ok" << endl;
+	return 0;
+}
@@ -0,0 +1,111 @@
+/** @file test_cache.cpp
+ * @brief Checks Prediction_cache hits, version invalidation, CLOCK eviction and concurrent use
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Cache.hpp"
+#include "Manager.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <iostream>
+using namespace std;
+
+typedef Manager<Linear_regression> manager_type;
+typedef Prediction_cache<manager_type> cache_type;
+
+enum { d = 4, rows = 500, threads = 8, per_thread = 20000 };
+
+int main(){
+	mt19937 gen(3);
+	uniform_real_distribution<double> u(0.0,10.0);
+	vector<double> x((size_t)rows*d), y(rows);
+	for (unsigned i = 0; i < rows; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = u(gen);
+		y[i] = x[(size_t)i*d] - 2.0*x[(size_t)i*d+1] + u(gen);
+	}
+	Linear_regression a, b(5.0);
+	a.fit(&x[0],rows,d,&y[0]);
+	b.fit(&x[0],rows/2,d,&y[0]);
+	vector<double> ya(rows), yb(rows);
+	a.predict(&x[0],rows,d,&ya[0]);
+	b.predict(&x[0],rows,d,&yb[0]);
+
+	manager_type mt;
+	mt.add_model(a);
+	cache_type c(mt,1024,16);
+
+	// a miss, then a hit with the same value
+	CHECK(c.predict(1,&x[0],d) == ya[0]);
+	CHECK(c.hits() == 0 && c.misses() == 1);
+	CHECK(c.predict(1,&x[0],d) == ya[0]);
+	CHECK(c.hits() == 1 && c.misses() == 1);
+
+	// touch() and replacing the model both make the old entries unreachable
+	mt.touch(1);
+	CHECK(c.predict(1,&x[0],d) == ya[0]);
+	CHECK(c.misses() == 2);
+	mt.add_model(b);
+	CHECK(c.predict(1,&x[0],d) == yb[0]);
+	CHECK(c.misses() == 3);
+	CHECK(c.predict(1,&x[0],d) == yb[0]);
+	CHECK(c.hits() == 2);
+
+	// the batch path gathers only the misses
+	vector<double> out(rows);
+	c.predict(1,&x[0],rows,d,&out[0]);
+	CHECK(c.hits() == 3 && c.misses() == 3 + rows - 1);
+	for (unsigned i = 0; i < rows; ++i)
+		CHECK(out[i] == yb[i]);
+
+	// at capacity CLOCK evicts: never more entries than slots, and a recent insert stays
+	cache_type small(mt,64,4);
+	unsigned n = 10*small.capacity();
+	vector<uint64_t> keys(n);
+	double v;
+	for (unsigned k = 0; k < n; ++k){
+		keys[k] = ((uint64_t) gen() << 32) | gen();
+		small.insert(keys[k],1,mt.version(1),k);
+		CHECK(small.lookup(keys[k],1,mt.version(1),v) && v == k);
+	}
+	unsigned held = 0;
+	for (unsigned k = 0; k < n; ++k)
+		held += small.lookup(keys[k],1,mt.version(1),v);
+	CHECK(held <= small.capacity() && held > small.capacity()/2);
+
+	// several threads predicting, one of them clearing now and then, always see the model's values
+	c.clear();
+	atomic<unsigned> wrong(0);
+	vector<thread> pool;
+	for (unsigned t = 0; t < threads; ++t){
+		pool.push_back(thread([&,t](){
+			mt19937 g(t+1);
+			double batch[8];
+			for (unsigned k = 0; k < per_thread; ++k){
+				unsigned i = g()%rows;
+				if (k % 4 == 0){
+					unsigned m = rows-i < 8 ? rows-i : 8;
+					c.predict(1,&x[(size_t)i*d],m,d,batch);
+					for (unsigned r = 0; r < m; ++r)
+						wrong += batch[r] != yb[i+r];
+				}else{
+					wrong += c.predict(1,&x[(size_t)i*d],d) != yb[i];
+				}
+				if (t == 0 && k % 5000 == 0)
+					c.clear();
+			}
+		}));
+	}
+	for (unsigned t = 0; t < threads; ++t)
+		pool[t].join();
+	CHECK(wrong == 0);
+	CHECK(c.hits() > 0);
+
+	cout << "test_cache ok" << endl;
+	return 0;
+}
@@ -0,0 +1,127 @@
+/** @file test_chow_liu.cpp
+ * @brief Checks Chow_liu_tree structure, mutual information and range estimates against direct counts
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Chow_liu.hpp"
+#include "Loss.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 20000, d = 5, queries = 2000 };
+
+/** Rows with lo[j] <= x[j] <= hi[j] for every column */
+double true_count(const vector<double>& x, const double* lo, const double* hi){
+	double c = 0.0;
+	for (unsigned i = 0; i < n; ++i){
+		bool in = true;
+		for (unsigned j = 0; j < d && in; ++j)
+			in = lo[j] <= x[(size_t)i*d+j] && x[(size_t)i*d+j] <= hi[j];
+		c += in;
+	}
+	return c;
+}
+
+/** Mutual information of two integer columns with values in [0, @a ka) and [0, @a kb),
+ * every cell of the joint counts smoothed by @a alpha
+ */
+double smoothed_mi(const vector<double>& x, unsigned a, unsigned ka, unsigned b, unsigned kb, double alpha){
+	vector<double> h((size_t)ka*kb,alpha), ra(ka,0.0), rb(kb,0.0);
+	for (unsigned i = 0; i < n; ++i)
+		h[(size_t)x[(size_t)i*d+a]*kb + (size_t)x[(size_t)i*d+b]] += 1.0;
+	double total = 0.0, mi = 0.0;
+	for (unsigned u = 0; u < ka; ++u)
+		for (unsigned v = 0; v < kb; ++v){
+			ra[u] += h[(size_t)u*kb+v];
+			rb[v] += h[(size_t)u*kb+v];
+			total += h[(size_t)u*kb+v];
+		}
+	for (unsigned u = 0; u < ka; ++u)
+		for (unsigned v = 0; v < kb; ++v){
+			double c = h[(size_t)u*kb+v];
+			mi += c/total*log(c*total/(ra[u]*rb[v]));
+		}
+	return mi;
+}
+
+/** Median of @a v */
+double median(vector<double> v){
+	nth_element(v.begin(),v.begin()+v.size()/2,v.end());
+	return v[v.size()/2];
+}
+
+int main(){
+	// a chain 0 -> 1 -> 2 of discrete columns, and 3 -> 4 with 4 continuous
+	mt19937 gen(59);
+	uniform_real_distribution<double> u(0.0,1.0);
+	vector<double> x((size_t)n*d);
+	for (unsigned i = 0; i < n; ++i){
+		double* r = &x[(size_t)i*d];
+		r[0] = gen()%8;
+		r[1] = r[0] + gen()%2;
+		r[2] = r[1] + gen()%2;
+		r[3] = gen()%6;
+		r[4] = 10.0*r[3] + 10.0*u(gen);
+	}
+	Chow_liu_tree cl(32,0.1,4);
+	cl.fit(&x[0],n,d);
+	const Chow_liu_tree::graph_type& g = cl.graph();
+	CHECK(cl.dims() == d && g.num_nodes() == d && g.num_edges() == d-1);
+	CHECK(g.has_edge(g.node(0),g.node(1)) && g.has_edge(g.node(1),g.node(2)) && g.has_edge(g.node(3),g.node(4)));
+
+	// mutual information of discrete pairs, where every value is its own bin
+	CHECK(fabs(cl.mutual_information(0,1) - smoothed_mi(x,0,8,1,9,0.1)) < 1e-9);
+	CHECK(fabs(cl.mutual_information(2,1) - smoothed_mi(x,1,9,2,10,0.1)) < 1e-9);
+	CHECK(fabs(cl.mutual_information(0,3) - smoothed_mi(x,0,8,3,6,0.1)) < 1e-9);
+	CHECK(cl.mutual_information(0,3) < 0.01 && cl.mutual_information(0,1) > 1.0);
+
+	// single-column ranges: exact at the root, within the smoothing elsewhere
+	vector<double> lo(d,-HUGE_VAL), hi(d,HUGE_VAL);
+	CHECK(cl.probability(&lo[0],&hi[0]) == 1.0);
+	for (unsigned j = 0; j < 4; ++j)
+		for (double a = 0.0; a <= 9.0; a += 1.0){
+			lo[j] = a;
+			hi[j] = a + 2.0;
+			double c = true_count(x,&lo[0],&hi[0]), e = cl.cardinality(&lo[0],&hi[0]);
+			CHECK(j == 0 ? fabs(e-c) < 1e-6 : fabs(e-c) <= 0.01*c + 1.0);
+			lo[j] = -HUGE_VAL;
+			hi[j] = HUGE_VAL;
+		}
+
+	// conjunctions over the chain: the tree is the true model, so the estimates are close
+	// to the counts and much closer than the independence assumption
+	vector<double> q_tree, q_ind;
+	for (unsigned t = 0; t < queries; ++t){
+		double p_ind = 1.0;
+		for (unsigned j = 0; j < d; ++j){
+			double span = j == 4 ? 60.0 : 10.0;
+			double a = floor(span*u(gen)), b = a + floor(0.5*span*u(gen));
+			bool used = j == 0 || j == 2 || gen()%3 == 0;
+			lo[j] = used ? a : -HUGE_VAL;
+			hi[j] = used ? b : HUGE_VAL;
+			vector<double> l(d,-HUGE_VAL), h(d,HUGE_VAL);
+			l[j] = lo[j];
+			h[j] = hi[j];
+			p_ind *= true_count(x,&l[0],&h[0])/n;
+		}
+		double c = true_count(x,&lo[0],&hi[0]);
+		if (c < 100.0)
+			continue;
+		q_tree.push_back(qerror(c,cl.cardinality(&lo[0],&hi[0])));
+		q_ind.push_back(qerror(c,p_ind*n));
+	}
+	CHECK(q_tree.size() > 100);
+	CHECK(median(q_tree) < 1.1);
+	sort(q_tree.begin(),q_tree.end());
+	CHECK(q_tree[q_tree.size()*95/100] < 1.5);
+	CHECK(median(q_tree) < median(q_ind));
+
+	cout << "test_chow_liu ok" << endl;
+	return 0;
+}
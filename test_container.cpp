@@ -0,0 +1,160 @@
+/** @file test_container.cpp
+ * @brief Checks Ring_buffer against std::deque and stresses Concurrent_queue with several producers and consumers
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Container.hpp"
+#include <deque>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <iostream>
+using namespace std;
+
+enum { producers = 4, consumers = 4, per_producer = 100000 };
+
+int main(){
+	// Ring_buffer end operations against a deque, across many growths and wraps
+	mt19937 gen(7);
+	Ring_buffer<int> r(4);
+	deque<int> ref;
+	for (unsigned step = 0; step < 200000; ++step){
+		unsigned op = gen()%5;
+		int v = (int) gen();
+		if (op == 0 || (op < 3 && ref.empty())){
+			r.push_back(v);
+			ref.push_back(v);
+		}else if (op == 1){
+			r.push_front(v);
+			ref.push_front(v);
+		}else if (op == 2){
+			r.pop_front();
+			ref.pop_front();
+		}else if (!ref.empty()){
+			r.pop_back();
+			ref.pop_back();
+		}
+		CHECK(r.size() == ref.size());
+		if (!ref.empty()){
+			CHECK(r.front() == ref.front() && r.back() == ref.back());
+			size_t k = gen()%ref.size();
+			CHECK(r[k] == ref[k]);
+		}
+	}
+	CHECK((r.capacity() & (r.capacity()-1)) == 0 && r.capacity() >= r.size());
+	for (size_t k = 0; k < ref.size(); ++k)
+		CHECK(*(r.begin()+k) == ref[k]);
+	CHECK(r.end() - r.begin() == (ptrdiff_t) ref.size());
+
+	// erase from the middle and by key keeps the order of the rest
+	Ring_buffer<int> e;
+	for (int i = 0; i < 10; ++i)
+		e.push_front(i);
+	e.erase(e.begin()+3);
+	e.erase(0);
+	int order[8] = {9,8,7,5,4,3,2,1};
+	CHECK(e.size() == 8);
+	for (unsigned k = 0; k < 8; ++k)
+		CHECK(e[k] == order[k]);
+	CHECK(e.find(6) == e.end() && e.find(4) == e.begin()+4);
+
+	// Container over a Ring_buffer: FIFO pop(), both ends
+	Container<Ring_buffer<int> > c;
+	for (int i = 0; i < 100; ++i)
+		CHECK(c.push(i) == i);
+	c.push_front(-1);
+	CHECK(c.back() == 99 && c.pop_back() == 99);
+	CHECK(c.pop() == -1);
+	for (int i = 0; i < 99; ++i)
+		CHECK(c.pop() == i);
+	CHECK(c.empty());
+
+	// every item pushed by several producers is popped exactly once, in each
+	// producer's order, through a queue small enough to fill up
+	Concurrent_queue<unsigned> q(64);
+	vector<vector<unsigned> > got(consumers);
+	vector<thread> threads;
+	for (unsigned p = 0; p < producers; ++p){
+		threads.push_back(thread([&q,p](){
+			for (unsigned i = 0; i < per_producer; ++i){
+				unsigned v = p*per_producer + i;
+				if (i % 2)
+					q.push(v);
+				else
+					while (!q.try_push(v))
+						this_thread::yield();
+			}
+		}));
+	}
+	for (unsigned k = 0; k < consumers; ++k){
+		threads.push_back(thread([&q,&got,k](){
+			unsigned v;
+			for (;;){
+				if (k % 2 || q.closed()){
+					if (!q.pop(v))
+						break;
+				}else if (!q.try_pop(v)){
+					this_thread::yield();
+					continue;
+				}
+				got[k].push_back(v);
+			}
+		}));
+	}
+	for (unsigned p = 0; p < producers; ++p)
+		threads[p].join();
+	q.close();
+	for (unsigned k = 0; k < consumers; ++k)
+		threads[producers+k].join();
+
+	vector<unsigned> seen((size_t)producers*per_producer,0);
+	for (unsigned k = 0; k < consumers; ++k){
+		vector<unsigned> last(producers,0);
+		vector<bool> any(producers,false);
+		for (size_t i = 0; i < got[k].size(); ++i){
+			unsigned v = got[k][i], p = v/per_producer;
+			CHECK(v < seen.size());
+			++seen[v];
+			CHECK(!any[p] || v > last[p]);
+			any[p] = true;
+			last[p] = v;
+		}
+	}
+	for (size_t v = 0; v < seen.size(); ++v)
+		CHECK(seen[v] == 1);
+	CHECK(q.empty());
+
+	// close() wakes a pop() blocked on an empty queue, which then returns false
+	Concurrent_queue<int> w(4);
+	int popped = 0;
+	bool pop_ok = true;
+	thread blocked_pop([&](){ pop_ok = w.pop(popped); });
+	this_thread::sleep_for(chrono::milliseconds(50));
+	w.close();
+	blocked_pop.join();
+	CHECK(!pop_ok);
+
+	// and a push() blocked on a full queue, which then returns false without adding
+	Concurrent_queue<int> f(4);
+	for (int i = 0; i < 4; ++i)
+		CHECK(f.try_push(i));
+	CHECK(!f.try_push(4));
+	bool push_ok = true;
+	thread blocked_push([&](){ push_ok = f.push(4); });
+	this_thread::sleep_for(chrono::milliseconds(50));
+	f.close();
+	blocked_push.join();
+	CHECK(!push_ok);
+	CHECK(!f.try_push(5) && !f.push(5));
+	// what was queued before close() is still drained
+	int v;
+	for (int i = 0; i < 4; ++i)
+		CHECK(f.pop(v) && v == i);
+	CHECK(!f.pop(v) && !f.try_pop(v));
+
+	cout << "test_container ok" << endl;
+	return 0;
+}
@@ -0,0 +1,89 @@
+/** @file test_feature_hasher.cpp
+ * @brief Checks that Feature_hasher sparse rows merge collisions exactly as the dense transform sums them
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Feature_hasher.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+/** A token over small domains, so bags repeat tokens and tokens collide */
+feature_token random_token(mt19937& gen){
+	if (gen()%4 == 0)
+		return operator_token(OP_SCAN + gen()%3,gen()%3,gen()%2 ? 1.0 : 0.5*(gen()%5));
+	return predicate_token(gen()%4,gen()%6,OP_EQ + gen()%4,(double)(gen()%1000) - 500.0);
+}
+
+int main(){
+	mt19937 gen(67);
+	unsigned bits[3] = {3,6,18};
+	for (unsigned b = 0; b < 3; ++b){
+		for (unsigned sign = 0; sign < 2; ++sign){
+			Feature_hasher fh(bits[b],sign == 1,b);
+			CHECK(fh.dims() == 1u << bits[b] && fh.bits() == bits[b]);
+			Csr_matrix x = fh.make_matrix();
+			vector<double> dense(fh.dims()), sparse(fh.dims());
+			vector<unsigned> idx(64);
+			vector<double> val(64);
+			for (unsigned rep = 0; rep < 300; ++rep){
+				unsigned n = gen()%64;
+				vector<feature_token> t(n+1);
+				for (unsigned k = 0; k < n; ++k)
+					t[k] = random_token(gen);
+				// the same token with opposite weights cancels
+				if (n > 2 && rep%3 == 0){
+					t[n-1] = t[0];
+					t[n-1].value_ = -t[0].value_;
+				}
+
+				// sorted distinct indices, no zeros, and the same sums as the dense row
+				unsigned nnz = fh.hash_row(&t[0],n,&idx[0],&val[0]);
+				fh.transform(&t[0],n,&dense[0]);
+				sparse.assign(fh.dims(),0.0);
+				for (unsigned k = 0; k < nnz; ++k){
+					CHECK(k == 0 || idx[k-1] < idx[k]);
+					CHECK(val[k] != 0.0);
+					sparse[idx[k]] = val[k];
+				}
+				for (unsigned j = 0; j < fh.dims(); ++j)
+					CHECK(fabs(sparse[j]-dense[j]) <= 1e-12);
+				for (unsigned k = 0; k < n; ++k)
+					CHECK(fh.index(t[k]) == (fh.hash(t[k]) & (fh.dims()-1)));
+
+				// the Csr row is the same row
+				fh.transform(&t[0],n,x);
+				CHECK(x.rows() == rep+1);
+				x.densify(rep,&sparse[0]);
+				for (unsigned j = 0; j < fh.dims(); ++j)
+					CHECK(fabs(sparse[j]-dense[j]) <= 1e-12);
+				if (!sign)
+					for (unsigned j = 0; j < fh.dims(); ++j)
+						CHECK(dense[j] >= 0.0);
+			}
+		}
+	}
+
+	// signs split evenly and seeds are independent
+	Feature_hasher a(20,true,1), b(20,true,2);
+	unsigned negative = 0, same = 0, tokens = 20000;
+	for (unsigned k = 0; k < tokens; ++k){
+		feature_token t = predicate_token(k%97,k/97,OP_LT,k);
+		negative += a.hash(t) >> 63;
+		same += a.index(t) == b.index(t);
+	}
+	CHECK(negative > 0.45*tokens && negative < 0.55*tokens);
+	CHECK(same < 10);
+
+	// literal buckets: per doubling of |v|+1, negatives apart from positives
+	CHECK(literal_bucket(0.0) == 0 && literal_bucket(1.0) == 2 && literal_bucket(3.0) == 4);
+	CHECK(literal_bucket(-1.0) == -3 && literal_bucket(1000.0) == literal_bucket(1010.0));
+	CHECK(literal_bucket(1000.0,1) == 9 && literal_bucket(1000.0) < literal_bucket(2000.0));
+
+	cout << "test_feature_hasher ok" << endl;
+	return 0;
+}
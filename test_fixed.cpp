@@ -0,0 +1,96 @@
+/** @file test_fixed.cpp
+ * @brief Checks the fixed-dimension model forms against the dynamic models they are compiled from
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Fixed.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { N = 6, rows = 2000 };
+
+/** True if the fixed form of @a f and the model @a m predict the same on the @a n rows of @a x */
+template <typename F, typename M>
+bool same_predictions(const F& f, const M& m, const vector<double>& x, unsigned n, unsigned d){
+	vector<double> a(n), b(n);
+	f.predict(&x[0],n,d,&a[0]);
+	m.predict(&x[0],n,d,&b[0]);
+	for (unsigned i = 0; i < n; ++i)
+		if (!(fabs(a[i]-b[i]) <= 1e-12*(1.0 + fabs(b[i]))))
+			return false;
+	return true;
+}
+
+int main(){
+	mt19937 gen(11);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)rows*N), y(rows);
+	for (unsigned i = 0; i < rows; ++i){
+		for (unsigned j = 0; j < N; ++j)
+			x[(size_t)i*N+j] = 10.0*j + u(gen);
+		y[i] = 3.0*x[(size_t)i*N] - x[(size_t)i*N+2]*x[(size_t)i*N+3] + 0.1*u(gen);
+	}
+
+	Fixed<N,Linear_regression> fl;
+	Linear_regression l;
+	fl.fit(&x[0],rows,N,&y[0]);
+	l.fit(&x[0],rows,N,&y[0]);
+	CHECK(fl.compiled());
+	CHECK(same_predictions(fl,l,x,rows,N));
+	FixedFeatures<N> row(&x[0]);
+	double y0;
+	l.predict(&x[0],1,N,&y0);
+	CHECK(fabs(fl.predict(row) - y0) <= 1e-12*(1.0 + fabs(y0)));
+
+	Fixed<N,Gradient_boosting> fg(30);
+	Gradient_boosting g(30);
+	fg.fit(&x[0],rows,N,&y[0]);
+	g.fit(&x[0],rows,N,&y[0]);
+	CHECK(fg.compiled());
+	CHECK(same_predictions(fg,g,x,rows,N));
+
+	Fixed<N,Random_forest> ff(10);
+	Random_forest f(10);
+	ff.fit(&x[0],rows,N,&y[0]);
+	f.fit(&x[0],rows,N,&y[0]);
+	CHECK(same_predictions(ff,f,x,rows,N));
+
+	typedef Pipeline_model<Pipeline<Standardize>,Linear_regression> scaled_type;
+	Fixed<N,scaled_type> fs;
+	scaled_type s;
+	fs.fit(&x[0],rows,N,&y[0]);
+	s.fit(&x[0],rows,N,&y[0]);
+	CHECK(fs.compiled());
+	CHECK(same_predictions(fs,s,x,rows,N));
+
+	// another width takes the dynamic path
+	vector<double> x3((size_t)rows*3);
+	for (unsigned i = 0; i < rows; ++i)
+		for (unsigned j = 0; j < 3; ++j)
+			x3[(size_t)i*3+j] = x[(size_t)i*N+j];
+	fl.fit(&x3[0],rows,3,&y[0]);
+	l.fit(&x3[0],rows,3,&y[0]);
+	CHECK(!fl.compiled());
+	CHECK(same_predictions(fl,l,x3,rows,3));
+
+	// an ensemble without trees predicts its base
+	Fixed<N,Gradient_boosting> empty(0);
+	empty.fit(&x[0],rows,N,&y[0]);
+	CHECK(empty.compiled());
+	double mean = 0.0;
+	for (unsigned i = 0; i < rows; ++i)
+		mean += y[i];
+	mean /= rows;
+	CHECK(fabs(empty.predict(row) - mean) <= 1e-12*(1.0 + fabs(mean)));
+	Fixed_trees<N> none;
+	none.build(Random_forest(1));
+	CHECK(none.predict(&x[0]) == 0.0);
+
+	cout << "test_fixed ok" << endl;
+	return 0;
+}
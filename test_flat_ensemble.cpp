@@ -0,0 +1,80 @@
+/** @file test_flat_ensemble.cpp
+ * @brief Checks the flattened ensemble layout against walking the trees it was built from
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Flat_ensemble.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { d = 5 };
+
+/** Grows node @a k of @a t into a random subtree at most @a depth deep; splits on a
+ * small set of thresholds so rows often land exactly on one
+ */
+void random_subtree(Regression_tree& t, unsigned k, unsigned depth, mt19937& gen){
+	uniform_real_distribution<double> u(-10.0,10.0);
+	t.nodes_[k].value_ = u(gen);
+	if (depth == 0 || gen()%4 == 0){
+		t.nodes_[k].feature_ = -1;
+		t.nodes_[k].left_ = t.nodes_[k].right_ = 0;
+		t.nodes_[k].threshold_ = 0.0;
+		return;
+	}
+	unsigned left = t.nodes_.size();
+	t.nodes_.push_back(tree_node());
+	t.nodes_.push_back(tree_node());
+	t.nodes_[k].feature_ = gen()%d;
+	t.nodes_[k].threshold_ = (double) (gen()%9) - 4.0;
+	t.nodes_[k].left_ = left;
+	t.nodes_[k].right_ = left+1;
+	random_subtree(t,left,depth-1,gen);
+	random_subtree(t,left+1,depth-1,gen);
+}
+
+int main(){
+	mt19937 gen(41);
+	for (unsigned rep = 0; rep < 50; ++rep){
+		vector<Regression_tree> trees(1 + gen()%12);
+		for (unsigned t = 0; t < trees.size(); ++t){
+			trees[t].nodes_.assign(1,tree_node());
+			random_subtree(trees[t],0,gen()%10,gen);
+		}
+		double base = (double) (gen()%7) - 3.0, scale = 1.0/(1 + gen()%4);
+		Flat_ensemble flat;
+		flat.build(trees,base,scale);
+		size_t nodes = 0;
+		for (unsigned t = 0; t < trees.size(); ++t)
+			nodes += trees[t].nodes_.size();
+		CHECK(flat.num_trees() == trees.size() && flat.num_nodes() == nodes);
+
+		// row counts around the block size; integer features hit the thresholds exactly
+		unsigned n = gen()%(3*Flat_ensemble::block_rows);
+		vector<double> x((size_t)n*d+1), y_hat(n+1,-1.0);
+		for (size_t k = 0; k < (size_t)n*d; ++k)
+			x[k] = gen()%2 ? (double) (gen()%11) - 5.0 : 12.0*((double) gen()/gen.max()) - 6.0;
+		flat.predict(&x[0],n,d,&y_hat[0]);
+		for (unsigned i = 0; i < n; ++i){
+			double s = 0.0;
+			for (unsigned t = 0; t < trees.size(); ++t)
+				s += trees[t].predict(&x[(size_t)i*d]);
+			CHECK(fabs(y_hat[i] - (base + scale*s)) <= 1e-12*(1.0 + fabs(base + scale*s)));
+		}
+		CHECK(y_hat[n] == -1.0);
+	}
+
+	// an ensemble without trees predicts its base
+	Flat_ensemble none;
+	none.build(vector<Regression_tree>(),2.5);
+	double row[d] = {0.0,0.0,0.0,0.0,0.0}, out = 0.0;
+	none.predict(row,1,d,&out);
+	CHECK(none.num_trees() == 0 && out == 2.5);
+
+	cout << "test_flat_ensemble ok" << endl;
+	return 0;
+}
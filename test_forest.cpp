@@ -0,0 +1,84 @@
+/** @file test_forest.cpp
+ * @brief Checks Random_forest against the mean of its trees, across thread counts, and its out-of-bag error
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Forest.hpp"
+#include "Selector.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 4000, d = 6, trees = 40 };
+
+/** Features and a nonlinear noisy target for @a rows rows */
+void make_data(mt19937& gen, unsigned rows, vector<double>& x, vector<double>& y){
+	uniform_real_distribution<double> u(-1.0,1.0);
+	x.resize((size_t)rows*d);
+	y.resize(rows);
+	for (unsigned i = 0; i < rows; ++i){
+		double* r = &x[(size_t)i*d];
+		for (unsigned j = 0; j < d; ++j)
+			r[j] = u(gen);
+		y[i] = 2.0*(r[0] > 0.0) + r[1]*r[2] + sin(3.0*r[3]) + 0.3*u(gen);
+	}
+}
+
+/** A forest of @a num_trees trees built with @a threads threads */
+Random_forest forest(unsigned num_trees, unsigned threads, unsigned seed = 1){
+	tree_options opt = Random_forest::default_options();
+	opt.threads_ = threads;
+	return Random_forest(num_trees,opt,256,seed);
+}
+
+int main(){
+	mt19937 gen(37);
+	vector<double> x, y, xt, yt;
+	make_data(gen,n,x,y);
+	make_data(gen,n,xt,yt);
+
+	// the same seed grows the same trees and out-of-bag error on any number of threads
+	Random_forest a = forest(trees,1), b = forest(trees,4), c = forest(trees,4,2);
+	a.fit(&x[0],n,d,&y[0]);
+	b.fit(&x[0],n,d,&y[0]);
+	c.fit(&x[0],n,d,&y[0]);
+	CHECK(a == b && a.oob_error() == b.oob_error());
+	CHECK(a != c);
+	CHECK(a.trees().size() == trees && a.oob_rows() == n);
+
+	// predict() is the mean of the tree walks
+	vector<double> y_hat(n);
+	b.predict(&xt[0],n,d,&y_hat[0]);
+	double test_mse = 0.0;
+	for (unsigned i = 0; i < n; ++i){
+		double s = 0.0;
+		for (unsigned t = 0; t < trees; ++t)
+			s += b.trees()[t].predict(&xt[(size_t)i*d]);
+		s /= trees;
+		CHECK(fabs(y_hat[i]-s) <= 1e-12*(1.0 + fabs(s)));
+		test_mse += (y_hat[i]-yt[i])*(y_hat[i]-yt[i])/n;
+	}
+
+	// the out-of-bag error estimates the error on fresh rows, and is above the training error
+	CHECK(b.oob_error() > 0.7*test_mse && b.oob_error() < 1.5*test_mse);
+	CHECK(b.score(&x[0],n,d,&y[0])/n < b.oob_error());
+
+	// and ranks models without a test set: a forest of stumps is clearly worse
+	tree_options shallow = Random_forest::default_options();
+	shallow.max_depth_ = 1;
+	Random_forest stumps(trees,shallow);
+	stumps.fit(&x[0],n,d,&y[0]);
+	CHECK(stumps.oob_error() > b.oob_error());
+	Manager<Random_forest> mt;
+	mt.add_model(stumps,b);
+	Selector<Random_forest,vector<double>,vector<double> > sel;
+	CHECK(sel.best_model_oob(mt) == 2);
+	CHECK(mt.model_risk(1) == stumps.oob_error() && mt.model_risk(2) == b.oob_error());
+
+	cout << "test_forest ok" << endl;
+	return 0;
+}
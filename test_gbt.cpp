@@ -0,0 +1,137 @@
+/** @file test_gbt.cpp
+ * @brief Checks Tree_builder splits against an exhaustive search and Gradient_boosting against its trees
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Gbt.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 3000, d = 4, min_leaf = 5 };
+
+/** Node of @a t reached by @a row */
+unsigned leaf_of(const Regression_tree& t, const double* row){
+	unsigned k = 0;
+	while (t.nodes_[k].feature_ >= 0)
+		k = row[t.nodes_[k].feature_] <= t.nodes_[k].threshold_ ? t.nodes_[k].left_ : t.nodes_[k].right_;
+	return k;
+}
+
+int main(){
+	// few distinct values per feature, so every bin holds one value and the binned
+	// split search sees the same candidate thresholds as an exhaustive one
+	mt19937 gen(31);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)n*d), y(n), g(n);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = (double) (gen()%(50 + 60*j))/7.0;
+		double* r = &x[(size_t)i*d];
+		y[i] = (r[1] > 4.0 ? 3.0 : 0.0) + 0.5*r[2] - 0.2*r[0]*r[3] + 0.3*u(gen);
+		g[i] = -y[i];
+	}
+	Binned_features bf;
+	bf.fit(&x[0],n,d);
+
+	// a stump with g = -y, unit hessians and no penalty is the best CART split
+	double G = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+		G += g[i];
+	int best_f = -1;
+	double best_v = 0.0, best_gain = 1e-12, best_left = 0.0, best_right = 0.0;
+	for (unsigned j = 0; j < d; ++j){
+		for (unsigned c = 0; c + 1 < 50 + 60*j; ++c){
+			double v = c/7.0, gl = 0.0;
+			unsigned nl = 0;
+			for (unsigned i = 0; i < n; ++i)
+				if (x[(size_t)i*d+j] <= v){
+					gl += g[i];
+					++nl;
+				}
+			if (nl < min_leaf || n-nl < min_leaf)
+				continue;
+			double gain = gl*gl/nl + (G-gl)*(G-gl)/(n-nl) - G*G/n;
+			if (gain > best_gain){
+				best_gain = gain;
+				best_f = j;
+				best_v = v;
+				best_left = -gl/nl;
+				best_right = -(G-gl)/(n-nl);
+			}
+		}
+	}
+	tree_options opt;
+	opt.max_depth_ = 1;
+	opt.min_samples_leaf_ = min_leaf;
+	opt.lambda_ = 0.0;
+	vector<unsigned> idx(n);
+	for (unsigned i = 0; i < n; ++i)
+		idx[i] = i;
+	Tree_builder stump_builder(bf,opt);
+	Regression_tree stump;
+	stump_builder.build(stump,&idx[0],n,&g[0],0);
+	CHECK(stump.nodes_.size() == 3 && best_f >= 0);
+	CHECK(stump.nodes_[0].feature_ == best_f && stump.nodes_[0].threshold_ == best_v);
+	const tree_node& l = stump.nodes_[stump.nodes_[0].left_];
+	const tree_node& r = stump.nodes_[stump.nodes_[0].right_];
+	CHECK(fabs(l.value_-best_left) < 1e-9 && fabs(r.value_-best_right) < 1e-9);
+
+	// in a deeper tree every leaf predicts the mean of the rows that reach it, and the
+	// leaf ranges the builder reports hold exactly those rows
+	opt.max_depth_ = 5;
+	Tree_builder builder(bf,opt);
+	Regression_tree tree;
+	builder.build(tree,&idx[0],n,&g[0],0);
+	vector<double> sum(tree.nodes_.size(),0.0);
+	vector<unsigned> count(tree.nodes_.size(),0);
+	for (unsigned i = 0; i < n; ++i){
+		unsigned k = leaf_of(tree,&x[(size_t)i*d]);
+		sum[k] += y[i];
+		++count[k];
+	}
+	const vector<Tree_builder::leaf_range>& leaves = builder.leaves();
+	unsigned covered = 0;
+	for (unsigned k = 0; k < leaves.size(); ++k){
+		unsigned node = leaves[k].node_;
+		CHECK(tree.nodes_[node].feature_ < 0);
+		CHECK(count[node] == leaves[k].end_-leaves[k].begin_ && count[node] >= min_leaf);
+		CHECK(fabs(tree.nodes_[node].value_ - sum[node]/count[node]) < 1e-9);
+		for (unsigned i = leaves[k].begin_; i < leaves[k].end_; ++i)
+			CHECK(leaf_of(tree,&x[(size_t)idx[i]*d]) == node);
+		covered += count[node];
+	}
+	CHECK(covered == n && tree.depth() <= 5);
+
+	// the boosted model predicts its base plus the sum of its trees, the same trees on
+	// any number of threads, and fits better with more rounds
+	double last = 1e300;
+	unsigned rounds[3] = {1,10,50};
+	for (unsigned k = 0; k < 3; ++k){
+		tree_options one, four;
+		one.threads_ = 1;
+		four.threads_ = 4;
+		Gradient_boosting a(rounds[k],0.1,one), b(rounds[k],0.1,four);
+		a.fit(&x[0],n,d,&y[0]);
+		b.fit(&x[0],n,d,&y[0]);
+		CHECK(a == b && a.trees().size() == rounds[k]);
+		vector<double> y_hat(n);
+		a.predict(&x[0],n,d,&y_hat[0]);
+		for (unsigned i = 0; i < n; ++i){
+			double s = a.base();
+			for (unsigned t = 0; t < a.trees().size(); ++t)
+				s += a.trees()[t].predict(&x[(size_t)i*d]);
+			CHECK(fabs(y_hat[i]-s) <= 1e-12*(1.0 + fabs(s)));
+		}
+		double score = a.score(&x[0],n,d,&y[0]);
+		CHECK(score < last);
+		last = score;
+	}
+
+	cout << "test_gbt ok" << endl;
+	return 0;
+}
@@ -0,0 +1,162 @@
+/** @file test_graph.cpp
+ * @brief Checks Graph removal by tombstone, handle generations and compact() against a reference set
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Graph.hpp"
+#include <vector>
+#include <map>
+#include <random>
+#include <iostream>
+using namespace std;
+
+enum { steps = 6000, max_nodes = 150, path = 5000 };
+
+/** Random additions, removals and compactions on a Graph with policy A, checked
+ * against the live node tags and a map from tag pairs to edge tags
+ * @return 0, or 1 after reporting the first mismatch
+ */
+template <typename A>
+int check_removal(unsigned seed){
+	typedef Graph<int,int,A> graph_type;
+	typedef typename graph_type::Node node_type;
+	typedef typename graph_type::Edge edge_type;
+	mt19937 gen(seed);
+	graph_type g;
+	vector<node_type> nh;		//handle of every node tag ever added
+	vector<edge_type> eh;		//handle of every edge tag ever added
+	vector<bool> node_live, edge_live;
+	map<pair<int,int>,int> edges;	//(smaller, larger node tag) -> edge tag
+	vector<int> live;
+	unsigned compactions = 0;
+
+	for (unsigned step = 1; step <= steps; ++step){
+		unsigned op = gen()%20;
+		if (live.size() < 2 || (op < 4 && live.size() < max_nodes)){
+			int tag = nh.size();
+			nh.push_back(g.add_node(Point(tag,0,0),tag));
+			node_live.push_back(true);
+			live.push_back(tag);
+			CHECK(nh.back().index() == g.node_index_bound()-1);
+		}else if (op < 6){
+			// removing a node drops its edges with it
+			unsigned k = gen()%live.size();
+			int tag = live[k];
+			g.remove_node(nh[tag]);
+			node_live[tag] = false;
+			live.erase(live.begin()+k);
+			for (map<pair<int,int>,int>::iterator it = edges.begin(); it != edges.end();){
+				if (it->first.first == tag || it->first.second == tag){
+					edge_live[it->second] = false;
+					edges.erase(it++);
+				}else{
+					++it;
+				}
+			}
+		}else if (op < 14){
+			int a = live[gen()%live.size()], b = live[gen()%live.size()];
+			if (a == b)
+				continue;
+			pair<int,int> key(min(a,b),max(a,b));
+			map<pair<int,int>,int>::iterator it = edges.find(key);
+			int tag = eh.size();
+			edge_type e = g.add_edge(nh[a],nh[b],tag);
+			if (it != edges.end()){
+				CHECK(e.value() == it->second);
+			}else{
+				eh.push_back(e);
+				edge_live.push_back(true);
+				edges[key] = tag;
+			}
+		}else if (op < 19 && !edges.empty()){
+			// by handle or by endpoints
+			map<pair<int,int>,int>::iterator it = edges.begin();
+			advance(it,gen()%edges.size());
+			if (op % 2)
+				CHECK(g.remove_edge(eh[it->second]) == 1);
+			else
+				CHECK(g.remove_edge(nh[it->first.second],nh[it->first.first]) == 1);
+			CHECK(g.remove_edge(nh[it->first.first],nh[it->first.second]) == 0);
+			edge_live[it->second] = false;
+			edges.erase(it);
+		}else if (op == 19){
+			g.compact();
+			++compactions;
+			CHECK(g.node_index_bound() == g.size() && g.edge_index_bound() == g.num_edges());
+		}
+		if (step % 100)
+			continue;
+
+		// handles of removed elements stay invalid after their storage is reused
+		CHECK(g.size() == live.size() && g.num_edges() == edges.size());
+		for (unsigned t = 0; t < nh.size(); ++t){
+			CHECK(nh[t].valid() == node_live[t]);
+			if (node_live[t])
+				CHECK(nh[t].value() == (int) t && g.node(nh[t].index()) == nh[t]);
+		}
+		for (unsigned t = 0; t < eh.size(); ++t){
+			CHECK(eh[t].valid() == edge_live[t]);
+			if (edge_live[t])
+				CHECK(eh[t].value() == (int) t && g.edge(eh[t].index()).value() == (int) t);
+		}
+
+		// iteration skips the tombstones and keeps the order of addition
+		vector<int> seen;
+		for (typename graph_type::node_iterator it = g.node_begin(); it != g.node_end(); ++it)
+			seen.push_back((*it).value());
+		CHECK(seen == live);
+		vector<int> seen_edges, ref_edges;
+		for (typename graph_type::edge_iterator it = g.edge_begin(); it != g.edge_end(); ++it)
+			seen_edges.push_back((*it).value());
+		for (map<pair<int,int>,int>::iterator it = edges.begin(); it != edges.end(); ++it)
+			ref_edges.push_back(it->second);
+		sort(ref_edges.begin(),ref_edges.end());
+		CHECK(seen_edges == ref_edges);
+
+		// the adjacency agrees with the edge set
+		for (unsigned i = 0; i < live.size(); ++i){
+			unsigned degree = 0;
+			for (unsigned j = 0; j < live.size(); ++j){
+				pair<int,int> key(min(live[i],live[j]),max(live[i],live[j]));
+				bool has = edges.count(key) > 0;
+				CHECK(g.has_edge(nh[live[i]],nh[live[j]]) == has);
+				degree += has;
+			}
+			CHECK(nh[live[i]].degree() == degree);
+			for (typename graph_type::incident_iterator it = nh[live[i]].edge_begin(); it != nh[live[i]].edge_end(); ++it)
+				CHECK((*it).valid() && edge_live[(*it).value()]);
+		}
+	}
+	CHECK(compactions > 0 && nh.size() > 2*max_nodes);
+
+	// bulk removal from a path leaves no edges, and compact() renumbers the survivors in order
+	graph_type p;
+	vector<node_type> ph;
+	for (int i = 0; i < path; ++i){
+		ph.push_back(p.add_node(Point(i,0,0),i));
+		if (i > 0)
+			p.add_edge(ph[i-1],ph[i],i);
+	}
+	for (int i = 0; i < path; i += 2)
+		p.remove_node(ph[i]);
+	CHECK(p.size() == path/2 && p.num_edges() == 0 && p.node_index_bound() == path);
+	p.compact();
+	for (int i = 1; i < path; i += 2)
+		CHECK(ph[i].valid() && ph[i].index() == (unsigned) i/2 && ph[i].degree() == 0);
+	CHECK(p.node_index_bound() == path/2 && p.edge_index_bound() == 0);
+	return 0;
+}
+
+int main(){
+	for (unsigned seed = 1; seed <= 2; ++seed){
+		CHECK(check_removal<Sorted_adjacency<> >(seed) == 0);
+		CHECK(check_removal<Hash_adjacency>(seed) == 0);
+		CHECK(check_removal<Csr_adjacency>(seed) == 0);
+		CHECK(check_removal<Map_adjacency>(seed) == 0);
+	}
+
+	cout << "test_graph ok" << endl;
+	return 0;
+}
@@ -0,0 +1,118 @@
+/** @file test_graph_hash.cpp
+ * @brief Checks Wl_hasher digests and the Subplan_memo they key
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Graph_hash.hpp"
+#include "Gbt.hpp"
+#include "Manager.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+struct table_label{
+	uint64_t operator()(const join_graph::Node& n) const{
+		return n.value().table_;
+	}
+};
+
+struct selectivity_label{
+	uint64_t operator()(const join_graph::Edge& e) const{
+		return double_label(e.value().selectivity_);
+	}
+};
+
+vector<unsigned> shuffled(unsigned n, mt19937& gen){
+	vector<unsigned> p(n);
+	for (unsigned i = 0; i < n; ++i)
+		p[i] = i;
+	shuffle(p.begin(),p.end(),gen);
+	return p;
+}
+
+int main(){
+	mt19937 gen(5);
+	Wl_hasher h;
+
+	for (unsigned t = 0; t < 100; ++t){
+		unsigned n = 3 + gen()%10;
+		join_graph a = random_join_graph(n,t,3,5), b = random_join_graph(n,t,3,5,shuffled(n,gen));
+
+		// renumbering the relations changes no digest
+		CHECK(h.digest(a,table_label(),selectivity_label()) == h.digest(b,table_label(),selectivity_label()));
+		CHECK(h.digest(a) == h.digest(b));
+		Join_enumerator<> ea, eb;
+		ea.load(a);
+		eb.load(b);
+		CHECK(h.digest(ea.query(),ea.all()) == h.digest(eb.query(),eb.all()));
+
+		// changing one label does
+		join_graph c = random_join_graph(n,t,3,5);
+		c.node(0).value().table_ = 99;
+		CHECK(h.digest(a,table_label(),selectivity_label()) != h.digest(c,table_label(),selectivity_label()));
+
+		// a masked digest is the digest of the induced subgraph
+		vector<bool> mask(n,false);
+		mask[0] = mask[1] = true;
+		join_graph s;
+		s.add_node(Point(),a.node(0).value());
+		s.add_node(Point(),a.node(1).value());
+		if (a.has_edge(a.node(0),a.node(1)))
+			s.add_edge(s.node(0),s.node(1),a.add_edge(a.node(0),a.node(1)).value());
+		CHECK(h.digest(a,mask,table_label(),selectivity_label()) == h.digest(s,table_label(),selectivity_label()));
+	}
+
+	// a renumbered repeat of a query finds every subplan in the memo
+	unsigned n = 12;
+	join_graph a = random_join_graph(n,42,3,5), b = random_join_graph(n,42,3,5,shuffled(n,gen));
+	vector<double> x(2000*5), y(2000);
+	for (unsigned i = 0; i < 2000; ++i){
+		for (unsigned j = 0; j < 5; ++j)
+			x[i*5+j] = gen()%20;
+		y[i] = x[i*5+2] + x[i*5+3];
+	}
+	Gradient_boosting gbt;
+	gbt.fit(&x[0],2000,5,&y[0]);
+	Manager<Gradient_boosting> mt;
+	mt.add_model(gbt);
+
+	Join_enumerator<> ea, eb;
+	ea.load(a);
+	eb.load(b);
+	Subplan_memo memo;
+	memo.sync(mt.version(1));
+	join_plan p0 = ea.optimize(mt,1);
+	join_plan p1 = ea.optimize(mt,memo);
+	size_t misses = memo.table().misses();
+	join_plan p2 = eb.optimize(mt,memo);
+	CHECK(memo.table().hits() >= ea.stats().subplans_);
+	CHECK(memo.table().misses() == misses);
+	CHECK(fabs(p0.cost_ - p1.cost_) <= 1e-9*p0.cost_ && fabs(p1.cost_ - p2.cost_) <= 1e-9*p1.cost_);
+
+	// a changed model empties the memo
+	mt.touch(1);
+	memo.sync(mt.version(1));
+	CHECK(memo.table().size() == 0);
+
+	// the memo never outgrows its capacity, and CLOCK keeps an entry that is looked up
+	Estimate_memo small(64);
+	graph_digest hot = {1,0};
+	small.insert(hot,1.0);
+	double v = 0.0;
+	for (unsigned i = 1; i <= 10000; ++i){
+		graph_digest k = {gen(),((uint64_t) gen() << 32) | gen()};
+		small.insert(k,i);
+		CHECK(small.size() <= small.capacity());
+		CHECK(small.lookup(hot,v) && v == 1.0);
+	}
+	CHECK(small.capacity() == 64 && small.size() == 64);
+	CHECK(small.evictions() == 10000 + 1 - 64);
+
+	cout << "test_graph_hash ok" << endl;
+	return 0;
+}
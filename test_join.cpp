@@ -0,0 +1,133 @@
+/** @file test_join.cpp
+ * @brief Checks Join_enumerator (DPccp) against an exhaustive DP over connected subsets
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Regression.hpp"
+#include "Manager.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+/** True if the relations of @a s are connected by predicates of @a q */
+bool connected(const join_query& q, relation_set s){
+	relation_set seen = s & (~s+1), front = seen;
+	while (front){
+		relation_set n = 0;
+		for (relation_set r = front; r; r &= r-1)
+			n |= q.neighbors_[lowest_relation(r)];
+		n &= s & ~seen;
+		seen |= n;
+		front = n;
+	}
+	return seen == s;
+}
+
+/** Optimal C_out by DPsub: every split of every connected set, O(3^n) */
+double exhaustive(const join_query& q, const vector<double>& rows){
+	relation_set all = ((relation_set) 1 << q.n_) - 1;
+	vector<double> best((size_t) 1 << q.n_,HUGE_VAL);
+	for (relation_set s = 1; s <= all; ++s){
+		if (!connected(q,s))
+			continue;
+		if (count_relations(s) == 1){
+			best[s] = 0.0;
+			continue;
+		}
+		for (relation_set a = (s-1) & s; a; a = (a-1) & s){
+			relation_set b = s & ~a;
+			if (a > b || !connected(q,a) || !connected(q,b) || !(q.neighborhood(a) & b))
+				continue;
+			best[s] = min(best[s],best[a] + best[b] + rows[s]);
+		}
+	}
+	return best[all];
+}
+
+int main(){
+	mt19937 gen(3);
+	Independence_estimator ind;
+	Join_features f;
+
+	// optimal cost equals the exhaustive DP on random graphs
+	for (unsigned trial = 0; trial < 200; ++trial){
+		unsigned n = 2 + gen()%9;
+		unsigned seed = gen();
+		join_graph g = random_join_graph(n,seed,seed%(n+1));
+		Join_enumerator<> je;
+		je.load(g);
+		join_plan p = je.optimize(ind);
+
+		vector<double> rows((size_t) 1 << n,0.0);
+		double row[5];
+		for (relation_set s = 1; s <= je.all(); ++s){
+			f(je.query(),s,row);
+			rows[s] = max(1.0,exp(row[2] + row[3]));
+		}
+		double b = exhaustive(je.query(),rows);
+		CHECK(fabs(b - p.cost_) <= 1e-6*b);
+		CHECK(p.steps_.size() == n-1);
+		CHECK((p.steps_.back().left_ | p.steps_.back().right_) == je.all());
+		CHECK(fabs(je.plan_cost(p,ind) - p.cost_) <= 1e-6*p.cost_);
+	}
+
+	// csg-cmp pairs: (n^3 - n)/6 for a chain, (3^n - 2^(n+1) + 1)/2 for a clique
+	for (unsigned clique = 0; clique < 2; ++clique){
+		unsigned n = clique ? 10 : 30;
+		join_graph g;
+		for (unsigned i = 0; i < n; ++i){
+			join_relation r = {i,1000.0*(1 + i%7)};
+			g.add_node(Point(),r);
+		}
+		for (unsigned i = 0; i < n; ++i)
+			for (unsigned j = i+1; j < n; ++j)
+				if (clique || j == i+1){
+					join_predicate p = {0.001};
+					g.add_edge(g.node(i),g.node(j),p);
+				}
+		Join_enumerator<> je;
+		je.load(g);
+		join_plan p = je.optimize(ind);
+		size_t pairs = clique ? ((size_t) pow(3.0,n) - ((size_t) 2 << n) + 1)/2 : ((size_t) n*n*n - n)/6;
+		CHECK(je.stats().pairs_ == pairs);
+		CHECK(p.steps_.size() == n-1);
+	}
+
+	// a Manager slot gives the same plan as the model itself
+	Linear_regression lr;
+	vector<double> x(200*5), y(200);
+	for (unsigned i = 0; i < 200; ++i){
+		for (unsigned j = 0; j < 5; ++j)
+			x[i*5+j] = gen()%10;
+		y[i] = x[i*5+2] + x[i*5+3];
+	}
+	lr.fit(&x[0],200,5,&y[0]);
+	Manager<Linear_regression> mt;
+	mt.add_model(lr);
+	join_graph g = random_join_graph(12,gen(),6);
+	Join_enumerator<> je;
+	je.load(g);
+	CHECK(je.optimize(mt,1).cost_ == je.optimize(lr).cost_);
+
+	// a disconnected graph has no plan without a cross product
+	join_graph d;
+	join_relation r = {0,100.0};
+	d.add_node(Point(),r);
+	d.add_node(Point(),r);
+	je.load(d);
+	join_plan p = je.optimize(ind);
+	CHECK(p.steps_.empty() && p.cost_ == HUGE_VAL);
+
+	// tombstones from removed relations are skipped
+	g.remove_node(g.node(0));
+	je.load(g);
+	CHECK(je.query().n_ == 11);
+
+	cout << "test_join ok" << endl;
+	return 0;
+}
@@ -0,0 +1,160 @@
+/** @file test_knn.cpp
+ * @brief Checks Kd_tree searches and Knn_regression against brute force, with duplicate points
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Knn.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { d = 3, k = 7, queries = 300 };
+
+/** Squared distance between two points of dimension d */
+double dist_sq(const double* a, const double* b){
+	double s = 0.0;
+	for (unsigned j = 0; j < d; ++j)
+		s += (a[j]-b[j])*(a[j]-b[j]);
+	return s;
+}
+
+/** Sorted squared distances from @a q to all @a n points of @a x */
+vector<double> brute_dists(const vector<double>& x, unsigned n, const double* q){
+	vector<double> s(n);
+	for (unsigned i = 0; i < n; ++i)
+		s[i] = dist_sq(&x[(size_t)i*d],q);
+	sort(s.begin(),s.end());
+	return s;
+}
+
+/** True if knn() on @a t returns, closest first, ids whose true distances are the k
+ * smallest (ties may pick any of the tied ids), or within (1+eps) of them
+ */
+bool knn_matches(const Kd_tree& t, const vector<double>& x, unsigned n, const double* q, double eps){
+	vector<Kd_tree::neighbor> nb;
+	t.knn(q,k,nb,eps);
+	vector<double> ref = brute_dists(x,n,q);
+	unsigned m = n < (unsigned) k ? n : (unsigned) k;
+	if (nb.size() != m)
+		return false;
+	vector<bool> seen(n,false);
+	for (unsigned j = 0; j < m; ++j){
+		if (nb[j].id_ >= n || seen[nb[j].id_])
+			return false;
+		seen[nb[j].id_] = true;
+		if (nb[j].dist_sq_ != dist_sq(&x[(size_t)nb[j].id_*d],q))
+			return false;
+		if (j > 0 && nb[j].dist_sq_ < nb[j-1].dist_sq_)
+			return false;
+		if (eps == 0.0 ? nb[j].dist_sq_ != ref[j] : nb[m-1].dist_sq_ > (1+eps)*(1+eps)*ref[m-1])
+			return false;
+	}
+	return true;
+}
+
+/** A sample source for Knn_regression::update() */
+struct fed_policy{
+	vector< vector<double> >* s_;
+	const vector< vector<double> >& samples(){
+		return *s_;
+	}
+};
+
+int main(){
+	mt19937 gen(43);
+	uniform_real_distribution<double> u(-1.0,1.0);
+
+	// coordinates on a coarse grid, so many points and distances coincide, plus one
+	// heavily repeated point
+	unsigned n = 3000;
+	vector<double> x((size_t)n*d);
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = i%5 == 0 ? 0.5 : (double) (gen()%9)/4.0 - 1.0;
+	vector<double> q((size_t)queries*d);
+	for (size_t c = 0; c < q.size(); ++c)
+		q[c] = c%7 == 0 ? 0.5 : u(gen);
+
+	// built at once, and grown by insert() from empty with small leaves
+	Kd_tree built(8), grown(4);
+	built.build(&x[0],n,d);
+	for (unsigned i = 0; i < n; ++i){
+		CHECK(grown.insert(&x[(size_t)i*d],d) == i);
+		if (i % 500 == 499)
+			for (unsigned s = 0; s < queries; s += 10)
+				CHECK(knn_matches(grown,x,i+1,&q[(size_t)s*d],0.0));
+	}
+	CHECK(built.size() == n && grown.size() == n && grown.dims() == d);
+	for (unsigned s = 0; s < queries; ++s){
+		CHECK(knn_matches(built,x,n,&q[(size_t)s*d],0.0));
+		CHECK(knn_matches(grown,x,n,&q[(size_t)s*d],0.0));
+		CHECK(knn_matches(built,x,n,&q[(size_t)s*d],0.5));
+		CHECK(knn_matches(grown,x,n,&q[(size_t)s*d],0.5));
+	}
+	CHECK(knn_matches(built,x,n,&x[0],0.0) && knn_matches(grown,x,n,&x[5*d],0.0));
+
+	// fewer points than k, and an empty tree
+	Kd_tree few;
+	few.build(&x[0],3,d);
+	CHECK(knn_matches(few,x,3,&q[0],0.0));
+	Kd_tree empty;
+	vector<Kd_tree::neighbor> nb(1);
+	empty.knn(&q[0],k,nb);
+	CHECK(nb.empty());
+
+	// regression on distinct points against the brute-force mean and inverse-distance weights
+	vector<double> xr((size_t)n*d), yr(n);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			xr[(size_t)i*d+j] = u(gen);
+		yr[i] = xr[(size_t)i*d] + 10.0*u(gen);
+	}
+	Knn_regression plain(k), weighted(k,0.0,true);
+	plain.fit(&xr[0],n,d,&yr[0]);
+	weighted.fit(&xr[0],n,d,&yr[0]);
+	vector<double> yp(queries), yw(queries);
+	plain.predict(&q[0],queries,d,&yp[0]);
+	weighted.predict(&q[0],queries,d,&yw[0]);
+	for (unsigned s = 0; s < queries; ++s){
+		vector< pair<double,unsigned> > all(n);
+		for (unsigned i = 0; i < n; ++i)
+			all[i] = make_pair(dist_sq(&xr[(size_t)i*d],&q[(size_t)s*d]),i);
+		partial_sort(all.begin(),all.begin()+k,all.end());
+		double mean = 0.0, ws = 0.0, wy = 0.0;
+		for (unsigned j = 0; j < (unsigned) k; ++j){
+			mean += yr[all[j].second]/k;
+			double w = 1.0/(sqrt(all[j].first) + 1e-12);
+			ws += w;
+			wy += w*yr[all[j].second];
+		}
+		CHECK(fabs(yp[s]-mean) <= 1e-12*(1.0 + fabs(mean)));
+		CHECK(fabs(yw[s]-wy/ws) <= 1e-12*(1.0 + fabs(wy/ws)));
+	}
+	Point p(q[0],q[1],q[2]);
+	CHECK(plain.predict(p) == yp[0]);
+
+	// rows fed through update() predict as the same rows given to fit()
+	vector< vector<double> > samples;
+	fed_policy fp = {&samples};
+	Knn_regression online(k);
+	for (unsigned start = 0; start < n; start += 1000){
+		for (unsigned i = start; i < start+1000; ++i){
+			samples.push_back(vector<double>(xr.begin()+(size_t)i*d,xr.begin()+(size_t)(i+1)*d));
+			samples.back().push_back(yr[i]);
+		}
+		CHECK(online.update(fp) == 1000);
+	}
+	CHECK(online.size() == n && online.update(fp) == 0);
+	vector<double> yo(queries);
+	online.predict(&q[0],queries,d,&yo[0]);
+	for (unsigned s = 0; s < queries; ++s)
+		CHECK(fabs(yo[s]-yp[s]) <= 1e-12*(1.0 + fabs(yp[s])));
+
+	cout << "test_knn ok" << endl;
+	return 0;
+}
@@ -0,0 +1,107 @@
+/** @file test_loss.cpp
+ * @brief Checks the unrolled loss kernels and q-error summaries against plain loops and a full sort
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Loss.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+/** True if @a a and @a b agree up to rounding of a sum of @a n terms */
+bool close(double a, double b){
+	return fabs(a-b) <= 1e-12*(1.0 + fabs(b));
+}
+
+/** Checks that sum() and elementwise() of @a loss agree with its single-example operator() */
+template <typename L>
+bool consistent(const L& loss, const vector<double>& y, const vector<double>& y_hat, size_t n){
+	vector<double> out(n+1,-1.0);
+	double ref = 0.0;
+	if (n > 0)
+		loss.elementwise(&y[0],&y_hat[0],n,&out[0]);
+	for (size_t i = 0; i < n; ++i){
+		double l = loss(y[i],y_hat[i]);
+		if (out[i] != l)
+			return false;
+		ref += l;
+	}
+	return out[n] == -1.0 && close(n > 0 ? loss.sum(&y[0],&y_hat[0],n) : 0.0, ref);
+}
+
+int main(){
+	mt19937 gen(23);
+	uniform_real_distribution<double> u(-5.0,5.0), p(0.0,1.0);
+	exponential_distribution<double> card(0.01);
+
+	// every length exercises the unrolled body and the remainder loop
+	for (size_t n = 0; n < 40; ++n){
+		vector<double> y(n+1), y_hat(n+1), label(n+1), prob(n+1), c(n+1), c_hat(n+1);
+		for (size_t i = 0; i < n; ++i){
+			y[i] = u(gen);
+			y_hat[i] = u(gen);
+			label[i] = gen()%2;
+			prob[i] = i%7 == 0 ? (double) (gen()%2) : p(gen);	//0 and 1 hit the clipping
+			c[i] = i%5 == 0 ? 0.0 : card(gen);			//below 1 is clamped
+			c_hat[i] = card(gen);
+		}
+		double l2 = 0.0, l1 = 0.0, hub = 0.0, ll = 0.0, q = 0.0;
+		for (size_t i = 0; i < n; ++i){
+			double e = y[i]-y_hat[i];
+			l2 += e*e;
+			l1 += fabs(e);
+			hub += fabs(e) <= 2.0 ? 0.5*e*e : 2.0*(fabs(e) - 1.0);
+			double pc = min(max(prob[i],1e-15),1.0-1e-15);
+			ll -= label[i]*log(pc) + (1.0-label[i])*log(1.0-pc);
+			double a = max(c[i],1.0), b = max(c_hat[i],1.0);
+			q += max(a/b,b/a);
+		}
+		const double* py = n ? &y[0] : 0;
+		const double* ph = n ? &y_hat[0] : 0;
+		CHECK(close(l2_loss(py,ph,n),l2));
+		CHECK(close(l1_loss(py,ph,n),l1));
+		CHECK(close(huber_loss(py,ph,n,2.0),hub));
+		CHECK(close(log_loss(n ? &label[0] : 0,n ? &prob[0] : 0,n),ll));
+		CHECK(close(qerror_loss(n ? &c[0] : 0,n ? &c_hat[0] : 0,n),q));
+
+		CHECK(consistent(L2_loss(),y,y_hat,n));
+		CHECK(consistent(L1_loss(),y,y_hat,n));
+		CHECK(consistent(Huber_loss(2.0),y,y_hat,n));
+		CHECK(consistent(Log_loss(),label,prob,n));
+		CHECK(consistent(Qerror_loss(),c,c_hat,n));
+	}
+	CHECK(qerror(1000.0,10.0) == 100.0 && qerror(10.0,1000.0) == 100.0 && qerror(0.0,0.5) == 1.0);
+
+	// the selection-based summary against sorted q-errors
+	for (size_t n = 1; n < 300; n += 7){
+		vector<double> c(n), c_hat(n), scratch(n), q(n);
+		for (size_t i = 0; i < n; ++i){
+			c[i] = card(gen);
+			c_hat[i] = i%3 == 0 ? c[i] : card(gen);	//ties at 1
+		}
+		qerror_summary s = summarize_qerror(&c[0],&c_hat[0],n,&scratch[0]);
+		double sum = 0.0;
+		for (size_t i = 0; i < n; ++i){
+			q[i] = qerror(c[i],c_hat[i]);
+			sum += q[i];
+		}
+		sort(q.begin(),q.end());
+		double median = n%2 ? q[n/2] : 0.5*(q[n/2-1] + q[n/2]);
+		CHECK(close(s.mean_,sum/n));
+		CHECK(s.median_ == median);
+		CHECK(s.p95_ == q[(size_t) ceil(0.95*n) - 1]);
+		CHECK(s.max_ == q[n-1]);
+		sort(scratch.begin(),scratch.end());
+		CHECK(scratch == q);
+	}
+	qerror_summary empty = summarize_qerror(0,0,0,0);
+	CHECK(empty.mean_ == 1.0 && empty.max_ == 1.0);
+
+	cout << "test_loss ok" << endl;
+	return 0;
+}
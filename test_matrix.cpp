@@ -0,0 +1,75 @@
+/** @file test_matrix.cpp
+ * @brief Checks Matrix views and Manager::predict on strided views, from several threads at once
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Matrix.hpp"
+#include "Manager.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <iostream>
+using namespace std;
+
+enum { n = 1000, d = 5, threads = 8 };
+
+int main(){
+	mt19937 gen(9);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	Matrix<double> x(n,d);
+	Matrix<double,COL_MAJOR> xc(n,d);
+	vector<double> y(n);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			xc(i,j) = x(i,j) = u(gen);
+		y[i] = x(i,0) + 3.0*x(i,4) + 0.1*u(gen);
+	}
+
+	// views address the same elements in either layout
+	CHECK(x.view().row_contiguous() && !xc.view().row_contiguous());
+	Matrix_view<const double> b = xc.block(10,1,20,3), t = x.view().transpose();
+	for (unsigned i = 0; i < 20; ++i)
+		for (unsigned j = 0; j < 3; ++j)
+			CHECK(b(i,j) == x(10+i,1+j));
+	CHECK(t.rows() == d && t.cols() == n && t(4,7) == x(7,4));
+	CHECK(xc.col(2)(5,0) == x(5,2) && x.row(5)(0,2) == x(5,2));
+
+	Linear_regression m1, m2(2.0);
+	m1.fit(x.data(),n,d,&y[0]);
+	m2.fit(x.data(),n,d,&y[0]);
+	Manager<Linear_regression> mt;
+	mt.add_model(m1,m2);
+	vector<double> r1(n), r2(n);
+	m1.predict(x.data(),n,d,&r1[0]);
+	m2.predict(x.data(),n,d,&r2[0]);
+
+	// a column-major view is gathered block by block and predicts as the row-major data
+	vector<double> y1(n), y2(n);
+	mt.predict(xc.view(),&y1[0],&y2[0]);
+	CHECK(y1 == r1 && y2 == r2);
+
+	// several threads predicting strided views through one Manager do not share scratch
+	atomic<unsigned> wrong(0);
+	vector<thread> pool;
+	for (unsigned t = 0; t < threads; ++t){
+		pool.push_back(thread([&,t](){
+			vector<double> a(n), c(n);
+			for (unsigned rep = 0; rep < 50; ++rep){
+				unsigned lo = (t*37 + rep*11) % (n/2);
+				mt.predict(xc.rows(lo,n),&a[0],&c[0]);
+				for (unsigned i = lo; i < n; ++i)
+					wrong += a[i-lo] != r1[i] || c[i-lo] != r2[i];
+			}
+		}));
+	}
+	for (unsigned t = 0; t < threads; ++t)
+		pool[t].join();
+	CHECK(wrong == 0);
+
+	cout << "test_matrix ok" << endl;
+	return 0;
+}
@@ -0,0 +1,81 @@
+/** @file test_parallel.cpp
+ * @brief Checks that parallel_for covers its range once per index, nests, and runs inside Thread_pool tasks
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Parallel.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <atomic>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 100000, threads = 8 };
+
+/** Sum of i over [0, n) computed by a parallel_for split into @a t chunks */
+unsigned long long chunked_sum(unsigned t){
+	atomic<unsigned long long> sum(0);
+	atomic<unsigned> bad_tid(0);
+	parallel_for(0,n,[&](size_t lo, size_t hi, unsigned tid){
+		unsigned long long s = 0;
+		for (size_t i = lo; i < hi; ++i)
+			s += i;
+		sum += s;
+		bad_tid += tid >= t;
+	},t,1);
+	return bad_tid == 0 ? sum.load() : 0;
+}
+
+int main(){
+	const unsigned long long total = (unsigned long long) n*(n-1)/2;
+
+	// every index once, chunk ids in range, for more chunks than workers too
+	for (unsigned t = 1; t <= 4*threads; t *= 2)
+		CHECK(chunked_sum(t) == total);
+
+	// small ranges run inline, empty ones not at all
+	unsigned calls = 0;
+	parallel_for(0,10,[&](size_t lo, size_t hi, unsigned tid){ calls += lo == 0 && hi == 10 && tid == 0; },threads);
+	parallel_for(5,5,[&](size_t, size_t, unsigned){ ++calls; },threads,1);
+	CHECK(calls == 1);
+
+	// nested inside another parallel_for and inside the tasks of a separate pool
+	atomic<unsigned> wrong(0);
+	parallel_for(0,threads,[&](size_t lo, size_t hi, unsigned){
+		for (size_t i = lo; i < hi; ++i)
+			wrong += chunked_sum(threads) != total;
+	},threads,1);
+	{
+		Thread_pool pool(4);
+		for (unsigned k = 0; k < 16; ++k)
+			pool.submit([&](){ wrong += chunked_sum(threads) != total; });
+		pool.wait();
+	}
+	CHECK(wrong == 0);
+
+	// a conjugate gradient fit spread over the shared pool matches the single-threaded one
+	mt19937 gen(5);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	unsigned rows = 300, d = 400;
+	vector<double> x((size_t)rows*d), y(rows);
+	for (size_t k = 0; k < x.size(); ++k)
+		x[k] = u(gen);
+	for (unsigned i = 0; i < rows; ++i)
+		y[i] = x[(size_t)i*d] - 2.0*x[(size_t)i*d+7] + 0.1*u(gen);
+	Linear_regression one(0.5,1), many(0.5,threads);
+	one.fit(&x[0],rows,d,&y[0]);
+	many.fit(&x[0],rows,d,&y[0]);
+	CHECK(one.fitted() && many.fitted());
+	vector<double> a(rows), b(rows);
+	one.predict(&x[0],rows,d,&a[0]);
+	many.predict(&x[0],rows,d,&b[0]);
+	for (unsigned i = 0; i < rows; ++i)
+		CHECK(fabs(a[i]-b[i]) <= 1e-8*(1.0 + fabs(a[i])));
+
+	cout << "test_parallel ok" << endl;
+	return 0;
+}
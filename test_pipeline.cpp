@@ -0,0 +1,103 @@
+/** @file test_pipeline.cpp
+ * @brief Checks the fused Pipeline pass and Pipeline_model against the stages applied one matrix at a time
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Pipeline.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 1000, d = 4 };
+
+typedef Pipeline<Log_transform,Standardize,Bucketize,Polynomial> pipeline_type;
+
+/** A policy holding rows of d features followed by the target */
+struct row_policy{
+	vector<vector<double> > s_;
+	const vector<vector<double> >& samples() const{
+		return s_;
+	}
+};
+
+/** Fits stage @a s on the @a rows rows of @a in and applies it, the unfused way */
+template <typename S>
+vector<double> fit_apply(S& s, const vector<double>& in, unsigned rows, unsigned w){
+	s.begin_fit(w);
+	for (unsigned i = 0; i < rows; ++i)
+		s.observe(&in[(size_t)i*w]);
+	s.end_fit();
+	unsigned ow = s.out_dims(w);
+	vector<double> out((size_t)rows*ow);
+	for (unsigned i = 0; i < rows; ++i)
+		s.apply(&in[(size_t)i*w],w,&out[(size_t)i*ow]);
+	return out;
+}
+
+int main(){
+	mt19937 gen(44);
+	exponential_distribution<double> e(0.01);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)n*d), y(n);
+	row_policy p;
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = j == 3 ? (double)(gen()%5) : e(gen)*(j == 2 ? -1.0 : 1.0);
+		y[i] = log1p(x[(size_t)i*d]) - 0.5*x[(size_t)i*d+3] + 0.1*u(gen);
+		p.s_.push_back(vector<double>(&x[(size_t)i*d],&x[(size_t)i*d]+d));
+		p.s_.back().push_back(y[i]);
+	}
+
+	// every stage fitted on the full output of the one before
+	Log_transform lt(0,3);
+	Standardize st;
+	Bucketize bk(8);
+	Polynomial py;
+	vector<double> ref = fit_apply(py,fit_apply(bk,fit_apply(st,fit_apply(lt,x,n,d),n,d),n,d),n,d);
+	unsigned od = py.out_dims(d);
+
+	// the fused pass, fitted from the matrix or from a policy, gives the same rows
+	pipeline_type a(lt,Standardize(),Bucketize(8),py), b(lt,Standardize(),Bucketize(8),py);
+	a.fit(&x[0],n,d);
+	b.fit(p,d);
+	CHECK(a == b && a.dims() == d && a.out_dims() == od);
+	CHECK(a.stages().tail_.head_ == st && a.stages().tail_.tail_.head_ == bk);
+	vector<double> out((size_t)n*od), row(od);
+	a.transform(&x[0],n,d,&out[0]);
+	CHECK(out == ref);
+	for (unsigned i = 0; i < n; i += 37){
+		b.transform_row(&x[(size_t)i*d],&row[0]);
+		for (unsigned j = 0; j < od; ++j)
+			CHECK(row[j] == ref[(size_t)i*od+j]);
+	}
+
+	// Pipeline_model predicts in blocks as the model fitted on the transformed matrix
+	Pipeline_model<pipeline_type,Linear_regression> pm(pipeline_type(lt,Standardize(),Bucketize(8),py),Linear_regression(0.1));
+	Pipeline_model<pipeline_type,Linear_regression> unfitted(pm);
+	CHECK(unfitted == pm && unfitted.score(&x[0],n,d,&y[0]) == 0.0);
+	pm.fit(&x[0],n,d,&y[0]);
+	CHECK(pm != unfitted && pm.pipeline() == a);
+	Linear_regression m(0.1);
+	m.fit(&ref[0],n,od,&y[0]);
+	CHECK(pm.model() == m);
+	vector<double> y1(n), y2(n);
+	unsigned part = n - 3;	//not a whole number of blocks
+	pm.predict(&x[0],part,d,&y1[0]);
+	m.predict(&ref[0],part,od,&y2[0]);
+	for (unsigned i = 0; i < part; ++i)
+		CHECK(y1[i] == y2[i]);
+	CHECK(pm.score(&x[0],n,d,&y[0]) == m.score(&ref[0],n,od,&y[0]));
+
+	// fitted models differing only in preprocessing differ
+	Pipeline_model<pipeline_type,Linear_regression> coarse(pipeline_type(lt,Standardize(),Bucketize(4),py),Linear_regression(0.1));
+	coarse.fit(&x[0],n,d,&y[0]);
+	CHECK(coarse != pm);
+
+	cout << "test_pipeline ok" << endl;
+	return 0;
+}
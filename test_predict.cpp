@@ -0,0 +1,72 @@
+/** @file test_predict.cpp
+ * @brief Checks Manager's batched predict across models against each model's own predict
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Manager.hpp"
+#include "Regression.hpp"
+#include "Gbt.hpp"
+#include "Forest.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+using namespace std;
+
+typedef Manager<Linear_regression,Gradient_boosting,Random_forest,Linear_regression> manager_type;
+
+enum { n = 1000, d = 5 };	//n not a whole number of batch_rows blocks
+
+int main(){
+	mt19937 gen(29);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)n*d), y(n);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = u(gen);
+		y[i] = x[(size_t)i*d] - 2.0*x[(size_t)i*d+1]*x[(size_t)i*d+2] + 0.1*u(gen);
+	}
+	Linear_regression l(0.5);
+	Gradient_boosting g(20);
+	Random_forest f(8);
+	l.fit(&x[0],n,d,&y[0]);
+	g.fit(&x[0],n,d,&y[0]);
+	f.fit(&x[0],n,d,&y[0]);
+	vector<double> rl(n), rg(n), rf(n);
+	l.predict(&x[0],n,d,&rl[0]);
+	g.predict(&x[0],n,d,&rg[0]);
+	f.predict(&x[0],n,d,&rf[0]);
+
+	// slot 4 is left empty
+	manager_type mt;
+	mt.add_model(l,g,f);
+	CHECK(mt.num_models() == 3 && !mt.has_model(4));
+
+	// every model writes the predictions it makes alone, and an empty slot writes nothing
+	vector<double> y1(n), y2(n), y3(n), y4(n,-7.0);
+	mt.predict(&x[0],n,d,&y1[0],&y2[0],&y3[0],&y4[0]);
+	CHECK(y1 == rl && y2 == rg && y3 == rf);
+	for (unsigned i = 0; i < n; ++i)
+		CHECK(y4[i] == -7.0);
+
+	// a null buffer skips its model; any subset of rows gives the same values
+	vector<double> only2(n,-7.0);
+	y1.assign(n,-7.0);
+	mt.predict(&x[0],n,d,0,&only2[0]);
+	CHECK(only2 == rg);
+	unsigned lo = 300, m = 517;
+	mt.predict(&x[(size_t)lo*d],m,d,&y1[0],0,&y3[0]);
+	for (unsigned i = 0; i < m; ++i)
+		CHECK(y1[i] == rl[lo+i] && y3[i] == rf[lo+i]);
+	CHECK(y1[m] == -7.0);
+
+	vector<double> one(n);
+	mt.predict_model(2,&x[0],n,d,&one[0]);
+	CHECK(one == rg);
+	mt.predict(&x[0],0,d,&y1[0]);
+	CHECK(y1[0] == rl[lo]);
+
+	cout << "test_predict ok" << endl;
+	return 0;
+}
@@ -0,0 +1,137 @@
+/** @file test_quantize.cpp
+ * @brief Checks the int8 kernels against integer loops and the int8 models against their double forms
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Quantize.hpp"
+#include "Manager.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 4000, d = 12 };
+
+int main(){
+	mt19937 gen(47);
+	uniform_real_distribution<double> u(-1.0,1.0);
+
+	// kernels against plain integer arithmetic, extremes included
+	for (size_t m = 0; m < 70; ++m){
+		vector<int8_t> a(m+1), b(m+1), wt(m*7+1);
+		int32_t ref = 0;
+		for (size_t i = 0; i < m; ++i){
+			a[i] = (int8_t) (i%5 == 0 ? 127 : (int) (gen()%255) - 127);
+			b[i] = (int8_t) (i%5 == 0 ? -127 : (int) (gen()%255) - 127);
+			ref += (int32_t) a[i]*b[i];
+		}
+		CHECK(dot_product_i8(&a[0],&b[0],m) == ref);
+		for (size_t k = 0; k < wt.size(); ++k)
+			wt[k] = (int8_t) (k%3 == 0 ? -127 : (int) (gen()%255) - 127);
+		vector<int32_t> acc(8,-1);
+		gemv_i8_t(&wt[0],&a[0],&acc[0],7,m);
+		for (size_t h = 0; h < 7; ++h){
+			int32_t s = 0;
+			for (size_t j = 0; j < m; ++j)
+				s += (int32_t) wt[j*7+h]*a[j];
+			CHECK(acc[h] == s);
+		}
+		CHECK(acc[7] == -1);
+	}
+	vector<double> v(1000), inv(1000);
+	vector<int8_t> q(1000), q2(1000);
+	for (size_t i = 0; i < v.size(); ++i){
+		v[i] = 300.0*u(gen);
+		inv[i] = 0.5 + (i%3);
+	}
+	quantize_i8(&v[0],0.7,&q[0],v.size());
+	quantize_i8(&v[0],&inv[0],&q2[0],v.size());
+	for (size_t i = 0; i < v.size(); ++i){
+		double t = v[i]*0.7, t2 = v[i]*inv[i];
+		CHECK(q[i] >= -127 && q[i] <= 127 && q2[i] >= -127 && q2[i] <= 127);
+		CHECK(fabs(t) >= 127.0 ? q[i] == (t > 0 ? 127 : -127) : fabs(q[i]-t) <= 0.5 + 1e-9);
+		CHECK(fabs(t2) >= 127.0 ? q2[i] == (t2 > 0 ? 127 : -127) : fabs(q2[i]-t2) <= 0.5 + 1e-9);
+	}
+
+	// features of very different ranges, one of them always zero
+	vector<double> x((size_t)n*d), y(n);
+	for (unsigned i = 0; i < n; ++i){
+		double* r = &x[(size_t)i*d];
+		for (unsigned j = 0; j < d; ++j)
+			r[j] = j == 5 ? 0.0 : pow(10.0,(double) (j%4))*u(gen);
+		y[i] = 3.0 + r[0] - 0.02*r[3] + 0.5*r[6] + fabs(r[1]) + 0.1*u(gen);
+	}
+
+	// the linear model stays within the rounding bound of every calibration row: half a
+	// step of each input and of each folded weight, summed over the features
+	Linear_regression lin;
+	lin.fit(&x[0],n,d,&y[0]);
+	Quantized_linear ql;
+	ql.build(lin,&x[0],n,d);
+	CHECK(ql.dims() == d && ql.bytes() < (d+1)*sizeof(double) + d*sizeof(double) + 3*sizeof(double));
+	vector<double> w = lin.get_params(), s(d,0.0), folded(d);
+	double r = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < d; ++j)
+			s[j] = max(s[j],fabs(x[(size_t)i*d+j]));
+	for (unsigned j = 0; j < d; ++j){
+		s[j] = s[j] > 0.0 ? s[j]/127.0 : 1.0;
+		folded[j] = w[j]*s[j];
+		r = max(r,fabs(folded[j])/127.0);
+	}
+	vector<double> yd(n), yq(n);
+	lin.predict(&x[0],n,d,&yd[0]);
+	ql.predict(&x[0],n,d,&yq[0]);
+	double rel = 0.0;
+	for (unsigned i = 0; i < n; ++i){
+		double bound = 0.0;
+		for (unsigned j = 0; j < d; ++j)
+			bound += 0.5*r*(fabs(x[(size_t)i*d+j])/s[j] + 0.5) + 0.5*fabs(folded[j]);
+		CHECK(fabs(yq[i]-yd[i]) <= bound + 1e-9);
+		rel += fabs(yq[i]-yd[i])/(1.0 + fabs(yd[i]))/n;
+	}
+	CHECK(rel < 0.03);
+
+	// the network tracks its double form closely on average
+	Mlp_regression mlp(32,30);
+	mlp.fit(&x[0],n,d,&y[0]);
+	Quantized_mlp qm;
+	qm.build(mlp,&x[0],n,d);
+	mlp.predict(&x[0],n,d,&yd[0]);
+	qm.predict(&x[0],n,d,&yq[0]);
+	double mean = 0.0, var = 0.0, err = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+		mean += yd[i]/n;
+	for (unsigned i = 0; i < n; ++i){
+		var += (yd[i]-mean)*(yd[i]-mean)/n;
+		err += (yq[i]-yd[i])*(yq[i]-yd[i])/n;
+	}
+	CHECK(err < 0.005*var);
+
+	// Quantizable switches between the two forms and drops the int8 copy on a refit
+	typedef Quantizable<Linear_regression> q_linear;
+	Manager<q_linear> mt;
+	q_linear m;
+	m.fit(&x[0],n,d,&y[0]);
+	m.quantize(&x[0],n,d);
+	CHECK(m.quantized());
+	mt.add_model(m);
+	vector<double> ym(n);
+	mt.predict_model(1,&x[0],n,d,&ym[0]);
+	ql.predict(&x[0],n,d,&yq[0]);
+	CHECK(ym == yq);
+	CHECK(fabs(m.score(&x[0],n,d,&y[0]) - l2_loss(&y[0],&yq[0],n)) <= 1e-9*l2_loss(&y[0],&yq[0],n));
+	m.dequantize();
+	m.predict(&x[0],n,d,&ym[0]);
+	lin.predict(&x[0],n,d,&yd[0]);
+	CHECK(!m.quantized() && ym == yd);
+	m.quantize(&x[0],n,d);
+	m.fit(&x[0],n,d,&y[0]);
+	CHECK(!m.quantized());
+
+	cout << "test_quantize ok" << endl;
+	return 0;
+}
@@ -0,0 +1,122 @@
+/** @file test_regression.cpp
+ * @brief Checks Linear_regression fits against known solutions and a naive ridge solve
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "test_util.hpp"
+#include "Regression.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+/** The d ridge weights followed by the intercept, by Gaussian elimination on the centered normal equations */
+vector<double> ridge_reference(const vector<double>& x, unsigned n, unsigned d, const vector<double>& y, double lambda){
+	vector<double> mean(d+1,0.0);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			mean[j] += x[(size_t)i*d+j]/n;
+		mean[d] += y[i]/n;
+	}
+	// augmented d x (d+1) system
+	vector<double> a((size_t)d*(d+1),0.0);
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < d; ++j){
+			double xj = x[(size_t)i*d+j]-mean[j];
+			for (unsigned k = 0; k < d; ++k)
+				a[(size_t)j*(d+1)+k] += xj*(x[(size_t)i*d+k]-mean[k]);
+			a[(size_t)j*(d+1)+d] += xj*(y[i]-mean[d]);
+		}
+	for (unsigned j = 0; j < d; ++j)
+		a[(size_t)j*(d+1)+j] += lambda;
+	for (unsigned c = 0; c < d; ++c){
+		unsigned p = c;
+		for (unsigned r = c+1; r < d; ++r)
+			if (fabs(a[(size_t)r*(d+1)+c]) > fabs(a[(size_t)p*(d+1)+c]))
+				p = r;
+		for (unsigned k = 0; k <= d; ++k)
+			swap(a[(size_t)c*(d+1)+k],a[(size_t)p*(d+1)+k]);
+		for (unsigned r = 0; r < d; ++r){
+			if (r == c)
+				continue;
+			double f = a[(size_t)r*(d+1)+c]/a[(size_t)c*(d+1)+c];
+			for (unsigned k = c; k <= d; ++k)
+				a[(size_t)r*(d+1)+k] -= f*a[(size_t)c*(d+1)+k];
+		}
+	}
+	vector<double> w(d+1);
+	w[d] = mean[d];
+	for (unsigned j = 0; j < d; ++j){
+		w[j] = a[(size_t)j*(d+1)+d]/a[(size_t)j*(d+1)+j];
+		w[d] -= w[j]*mean[j];
+	}
+	return w;
+}
+
+/** True if the parameters of @a m are within @a tol of @a ref */
+bool near(const Linear_regression& m, const vector<double>& ref, double tol){
+	vector<double> w = m.get_params();
+	if (!m.fitted() || w.size() != ref.size())
+		return false;
+	for (size_t j = 0; j < w.size(); ++j)
+		if (!(fabs(w[j]-ref[j]) <= tol*(1.0 + fabs(ref[j]))))
+			return false;
+	return true;
+}
+
+/** Fits dense and sparse copies of random data with and without threads and compares them to the reference */
+bool matches_reference(unsigned n, unsigned d, double lambda, double tol, unsigned seed){
+	mt19937 gen(seed);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)n*d), y(n);
+	for (size_t k = 0; k < x.size(); ++k)
+		x[k] = gen()%3 == 0 ? 0.0 : 2.0 + u(gen);
+	for (unsigned i = 0; i < n; ++i)
+		y[i] = 1.0 + x[(size_t)i*d] - 3.0*x[(size_t)i*d+d-1] + 0.1*u(gen);
+	vector<double> ref = ridge_reference(x,n,d,y,lambda);
+	Csr_matrix s(&x[0],n,d);
+	unsigned threads[2] = {1,4};
+	for (unsigned t = 0; t < 2; ++t){
+		Linear_regression dense(lambda,threads[t]), sparse(lambda,threads[t]);
+		dense.fit(&x[0],n,d,&y[0]);
+		sparse.fit(s,&y[0]);
+		if (!near(dense,ref,tol) || !near(sparse,ref,tol))
+			return false;
+	}
+	return true;
+}
+
+int main(){
+	// a NaN or infinity in the data leaves the model unfitted instead of retrying forever
+	vector<double> x(8*2), y(8);
+	for (unsigned i = 0; i < 8; ++i){
+		x[2*i] = i;
+		x[2*i+1] = i*i;
+		y[i] = 1.0 + i;
+	}
+	Linear_regression lr;
+	lr.fit(&x[0],8,2,&y[0]);
+	CHECK(lr.fitted());
+	x[5] = NAN;
+	lr.fit(&x[0],8,2,&y[0]);
+	CHECK(!lr.fitted());
+	x[5] = 25.0;
+	y[3] = INFINITY;
+	lr.fit(&x[0],8,2,&y[0]);
+	CHECK(!lr.fitted());
+	y[3] = 4.0;
+	lr.fit(&x[0],8,2,&y[0]);
+	CHECK(lr.fitted());
+
+	// Cholesky (at least as many rows as features) and conjugate gradient (more features
+	// than rows), dense and sparse, agree with the naive solve
+	CHECK(matches_reference(300,8,0.0,1e-9,1));
+	CHECK(matches_reference(300,8,2.0,1e-9,2));
+	CHECK(matches_reference(40,60,1.0,1e-6,3));
+	CHECK(matches_reference(100,150,0.1,1e-6,4));
+
+	cout << "test_regression ok" << endl;
+	return 0;
+}
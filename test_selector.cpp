@@ -0,0 +1,134 @@
+/** @file test_selector.cpp
+ * @brief Checks Selector::race() and profile() against a full pass over the test set, and the latency-aware choices
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Selector.hpp"
+#include "Regression.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+typedef Selector<Linear_regression,vector<double>,vector<double>,Qerror_loss> selector_type;
+typedef selector_type::ManagerType manager_type;
+
+enum { d = 3, n = 20000 };
+
+/** Mean q-error of @a m over the @a n rows of @a x */
+double full_qerror(const Linear_regression& m, const vector<double>& x, const vector<double>& y){
+	vector<double> y_hat(n);
+	m.predict(&x[0],n,d,&y_hat[0]);
+	double s = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+		s += qerror(y[i],y_hat[i]);
+	return s/n;
+}
+
+/** A profile entry with the given risk and latencies */
+selector_type::model_profile entry(unsigned id, double risk, double mean_ns, double p99_ns){
+	selector_type::model_profile p;
+	p.id_ = id;
+	p.risk_ = risk;
+	p.mean_ns_ = mean_ns;
+	p.p99_ns_ = p99_ns;
+	return p;
+}
+
+int main(){
+	// positive "cardinalities" linear in the features, with noise
+	mt19937 gen(17);
+	uniform_real_distribution<double> u(0.0,1.0);
+	vector<double> x((size_t)n*d), y(n), y_bad(n);
+	for (unsigned i = 0; i < n; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = 100.0*u(gen);
+		y[i] = 50.0 + 20.0*x[(size_t)i*d] + 5.0*x[(size_t)i*d+2] + 50.0*u(gen);
+		y_bad[i] = 50.0 + 20.0*x[(size_t)i*d+1] + 50.0*u(gen);
+	}
+	Linear_regression good, bad;
+	good.fit(&x[0],n,d,&y[0]);
+	bad.fit(&x[0],n,d,&y_bad[0]);
+	double good_q = full_qerror(good,x,y), bad_q = full_qerror(bad,x,y);
+	CHECK(good_q < bad_q);
+
+	// the race keeps the model that is better over the whole set, dropping the other
+	// after a few batches; either slot order gives the same answer
+	selector_type sel;
+	for (unsigned order = 0; order < 2; ++order){
+		manager_type mt;
+		if (order == 0)
+			mt.add_model(good,bad);
+		else
+			mt.add_model(bad,good);
+		selector_type::race_options opt(50.0);
+		selector_type::Model winner = sel.race(mt,&x[0],&y[0],n,d,opt);
+		CHECK(winner == (order == 0 ? 1u : 2u));
+		CHECK(sel.race_evaluations() < n/2);
+		CHECK(fabs(mt.model_risk(winner) - good_q) < 0.1*good_q);
+
+		opt.bernstein_ = false;
+		CHECK(sel.race(mt,&x[0],&y[0],n,d,opt) == winner);
+		CHECK(sel.race_evaluations() < 2*n);
+	}
+
+	// two copies of one model are never told apart: both see every point, and the
+	// clipped count is the number of q-errors above the range
+	manager_type same;
+	same.add_model(good,good);
+	vector<double> y_hat(n);
+	good.predict(&x[0],n,d,&y_hat[0]);
+	unsigned above = 0;
+	for (unsigned i = 0; i < n; ++i)
+		above += qerror(y[i],y_hat[i]) > 1.2;
+	CHECK(above > 0 && above < n);
+	selector_type::race_options tight(1.2);
+	tight.batch_size_ = 1000;
+	CHECK(sel.race(same,&x[0],&y[0],n,d,tight) != 0);
+	CHECK(sel.race_evaluations() == 2*n);
+	CHECK(sel.race_clipped() == 2*above);
+
+	// no fitted model, no winner
+	manager_type none;
+	CHECK(sel.race(none,&x[0],&y[0],n,d,tight) == 0);
+
+	// profile() measures the same risk as a full pass and marks the undominated models
+	manager_type both;
+	both.add_model(good,bad);
+	for (unsigned batch = 1; batch <= 64; batch *= 64){
+		vector<selector_type::model_profile> prof = sel.profile(both,&x[0],&y[0],n,d,batch);
+		CHECK(prof.size() == 2 && prof[0].id_ == 1 && prof[1].id_ == 2);
+		CHECK(fabs(prof[0].risk_ - good_q) <= 1e-9*good_q && fabs(prof[1].risk_ - bad_q) <= 1e-9*bad_q);
+		CHECK(both.model_risk(1) == prof[0].risk_);
+		for (unsigned i = 0; i < 2; ++i){
+			CHECK(prof[i].mean_ns_ > 0.0 && prof[i].p99_ns_ > 0.0);
+			const selector_type::model_profile& o = prof[1-i];
+			bool dominated = o.risk_ <= prof[i].risk_ && o.p99_ns_ <= prof[i].p99_ns_
+				&& (o.risk_ < prof[i].risk_ || o.p99_ns_ < prof[i].p99_ns_);
+			CHECK(prof[i].pareto_ == !dominated);
+		}
+		CHECK(prof[0].pareto_);
+	}
+
+	// choices over a fixed frontier: accurate-but-slow 1, balanced 2, fast 3, dominated 4
+	vector<selector_type::model_profile> prof;
+	prof.push_back(entry(1,1.5,900.0,1000.0));
+	prof.push_back(entry(2,2.0,250.0,300.0));
+	prof.push_back(entry(3,4.0,40.0,50.0));
+	prof.push_back(entry(4,5.0,400.0,500.0));
+	CHECK(sel.best_model_within(prof,1e9) == 1);
+	CHECK(sel.best_model_within(prof,1000.0) == 1);
+	CHECK(sel.best_model_within(prof,999.0) == 2);
+	CHECK(sel.best_model_within(prof,100.0) == 3);
+	CHECK(sel.best_model_within(prof,10.0) == 3);	//nothing fits: the fastest
+	CHECK(sel.best_model_weighted(prof,0.0) == 1);
+	CHECK(sel.best_model_weighted(prof,0.002) == 2);	//1.5+1.8, 2.0+0.5, 4.0+0.08
+	CHECK(sel.best_model_weighted(prof,1.0) == 3);
+	CHECK(sel.best_model_within(vector<selector_type::model_profile>(),1e9) == 0);
+
+	cout << "test_selector ok" << endl;
+	return 0;
+}
@@ -0,0 +1,158 @@
+/** @file test_sgd.cpp
+ * @brief Checks model gradients against finite differences and Online_learner against a direct fit
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "CS207/Util.hpp"
+#include <vector>
+#include <string>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+#include "Sampler.hpp"
+#include "Sgd.hpp"
+#include "Regression.hpp"
+#include "Mlp.hpp"
+#include "test_util.hpp"
+
+typedef vector<double> sample_type;
+
+/** A policy whose samples are only ever added by the test */
+struct fed_policy: pvt<sample_type>{
+	vector<sample_type> s_;
+	vector<sample_type>& samples(){
+		return s_;
+	}
+};
+
+typedef Sampler<fed_policy,sample_type> sampler_type;
+typedef Online_learner<Linear_regression,sampler_type> linear_learner;
+
+/** True if gradient() of @a m matches central differences of its loss at @a n rows */
+template <typename M>
+bool gradient_matches(M& m, const vector<double>& x, unsigned n, unsigned d, const vector<double>& y){
+	vector<double>& w = m.params();
+	vector<double> g(w.size()), scratch(w.size());
+	m.gradient(&x[0],n,d,&y[0],&g[0]);
+	for (size_t k = 0; k < w.size(); ++k){
+		double h = 1e-6, w0 = w[k];
+		w[k] = w0 + h;
+		double up = m.gradient(&x[0],n,d,&y[0],&scratch[0]);
+		w[k] = w0 - h;
+		double down = m.gradient(&x[0],n,d,&y[0],&scratch[0]);
+		w[k] = w0;
+		if (!(fabs((up-down)/(2*h) - g[k]) <= 1e-6*(1.0 + fabs(g[k]))))
+			return false;
+	}
+	return true;
+}
+
+/** Feeds @a rows samples to @a p in chunks, updating @a l after each with a decaying rate */
+void feed(sampler_type::Policy& p, linear_learner& l, const vector<double>& x, const vector<double>& y, unsigned rows, unsigned d){
+	for (unsigned start = 0; start < rows; start += 1000){
+		sampler_type::Samples chunk;
+		for (unsigned i = start; i < start+1000 && i < rows; ++i){
+			sample_type s(x.begin()+(size_t)i*d,x.begin()+(size_t)(i+1)*d);
+			s.push_back(y[i]);
+			chunk.push_back(s);
+		}
+		p.add_samples(chunk);
+		l.update();
+		l.optimizer().rate() *= 0.9;
+	}
+}
+
+/** True if the parameters of @a a and @a b differ by at most @a tol */
+bool close_params(const Linear_regression& a, const Linear_regression& b, double tol){
+	vector<double> wa = a.get_params(), wb = b.get_params();
+	if (wa.size() != wb.size())
+		return false;
+	for (size_t k = 0; k < wa.size(); ++k)
+		if (!(fabs(wa[k]-wb[k]) <= tol))
+			return false;
+	return true;
+}
+
+enum { rows = 60000, d = 4, onehot = 16 };
+
+int main(){
+	mt19937 gen(29);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)rows*d), y(rows);
+	for (unsigned i = 0; i < rows; ++i){
+		for (unsigned j = 0; j < d; ++j)
+			x[(size_t)i*d+j] = u(gen);
+		y[i] = 1.0 + 2.0*x[(size_t)i*d] - x[(size_t)i*d+1] + 0.5*x[(size_t)i*d+3] + 0.05*u(gen);
+	}
+
+	// gradients against finite differences, and the sparse form against the dense one
+	Linear_regression lin;
+	lin.init(d);
+	for (unsigned k = 0; k <= d; ++k)
+		lin.params()[k] = u(gen);
+	CHECK(gradient_matches(lin,x,50,d,y));
+	Mlp_regression mlp(8);
+	mlp.init(d);
+	CHECK(gradient_matches(mlp,x,50,d,y));
+	vector<double> gd(d+1), gs(d+1);
+	double ld = lin.gradient(&x[0],50,d,&y[0],&gd[0]);
+	double ls = lin.gradient(Csr_matrix(&x[0],50,d),&y[0],&gs[0]);
+	CHECK(fabs(ld-ls) <= 1e-12*ld);
+	for (unsigned k = 0; k <= d; ++k)
+		CHECK(fabs(gd[k]-gs[k]) <= 1e-12*(1.0 + fabs(gd[k])));
+
+	// the online learner, fed in chunks, ends near the least squares solution
+	Linear_regression exact;
+	exact.fit(&x[0],rows,d,&y[0]);
+	sampler_type sampler;
+	sampler_type::Policy p = sampler.create_policy(rows);
+	Linear_regression online;
+	linear_learner learner(online,p,Sgd_optimizer(Sgd_optimizer::ADAM,0.05));
+	feed(p,learner,x,y,rows,d);
+	CHECK(learner.consumed() == rows && learner.update() == 0);
+	CHECK(online.dims() == d);
+	CHECK(close_params(online,exact,0.005));
+	CHECK(learner.last_loss() < 0.01);
+
+	// after the policy is cleared the learner starts again at its first sample
+	p.clear();
+	feed(p,learner,x,y,2000,d);
+	CHECK(learner.consumed() == 2000);
+
+	// one-hot features go through the sparse gradient and reach the same solution
+	vector<double> xo((size_t)rows*onehot,0.0), yo(rows);
+	for (unsigned i = 0; i < rows; ++i){
+		unsigned a = gen()%(onehot/2), b = onehot/2 + gen()%(onehot/2);
+		xo[(size_t)i*onehot+a] = 1.0;
+		xo[(size_t)i*onehot+b] = 1.0;
+		yo[i] = 0.5*a - 0.25*b + 0.05*u(gen);
+	}
+	Linear_regression exact_o(1e-6), online_o;
+	exact_o.fit(&xo[0],rows,onehot,&yo[0]);
+	sampler_type::Policy po = sampler.create_policy(rows);
+	linear_learner learner_o(online_o,po,Sgd_optimizer(Sgd_optimizer::ADAM,0.05));
+	feed(po,learner_o,xo,yo,rows,onehot);
+	vector<double> a(rows), b(rows);
+	exact_o.predict(&xo[0],rows,onehot,&a[0]);
+	online_o.predict(&xo[0],rows,onehot,&b[0]);
+	double worst = 0.0;
+	for (unsigned i = 0; i < rows; ++i)
+		worst = max(worst,fabs(a[i]-b[i]));
+	CHECK(worst < 0.01);
+
+	// the network fits a nonlinear target far better than a constant
+	vector<double> yn(rows);
+	double mean = 0.0;
+	for (unsigned i = 0; i < 5000; ++i)
+		mean += (yn[i] = fabs(x[(size_t)i*d]) + x[(size_t)i*d+1]*x[(size_t)i*d+2])/5000;
+	double total = 0.0;
+	for (unsigned i = 0; i < 5000; ++i)
+		total += (yn[i]-mean)*(yn[i]-mean);
+	mlp.fit(&x[0],5000,d,&yn[0]);
+	CHECK(mlp.score(&x[0],5000,d,&yn[0]) < 0.1*total);
+
+	cout << "test_sgd ok" << endl;
+	return 0;
+}
@@ -0,0 +1,141 @@
+/** @file test_sparse.cpp
+ * @brief Checks CSR/CSC storage, conversions and products against the dense matrix, and sparse fits against dense fits
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Sparse.hpp"
+#include "Regression.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 137, d = 53 };
+
+/** True if @a a and @a b agree up to rounding */
+bool close(double a, double b){
+	return fabs(a-b) <= 1e-12*(1.0 + fabs(b));
+}
+
+/** True if every element of @a s equals the dense row-major @a x */
+template <matrix_layout L>
+bool same_elements(const Sparse_matrix<L>& s, const vector<double>& x){
+	if (s.rows() != n || s.cols() != d)
+		return false;
+	size_t nnz = 0;
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < d; ++j){
+			nnz += x[(size_t)i*d+j] != 0.0;
+			if (s(i,j) != x[(size_t)i*d+j])
+				return false;
+		}
+	return s.nnz() == nnz && close(s.density(),(double) nnz/(n*d));
+}
+
+/** True if spmv() and spmv_t() with @a s match dense products with @a x */
+template <matrix_layout L>
+bool same_products(const Sparse_matrix<L>& s, const vector<double>& x, const vector<double>& v, const vector<double>& u){
+	vector<double> y(n,-1.0), out(d,-1.0);
+	spmv(s,&v[0],&y[0]);
+	spmv_t(s,&u[0],&out[0]);
+	for (unsigned i = 0; i < n; ++i){
+		double r = 0.0;
+		for (unsigned j = 0; j < d; ++j)
+			r += x[(size_t)i*d+j]*v[j];
+		if (!close(y[i],r))
+			return false;
+	}
+	for (unsigned j = 0; j < d; ++j){
+		double r = 0.0;
+		for (unsigned i = 0; i < n; ++i)
+			r += x[(size_t)i*d+j]*u[i];
+		if (!close(out[j],r))
+			return false;
+	}
+	return true;
+}
+
+int main(){
+	// about 80% zeros, with some empty rows and one empty column
+	mt19937 gen(61);
+	uniform_real_distribution<double> u(-1.0,1.0);
+	vector<double> x((size_t)n*d,0.0), v(d), w(n);
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < d; ++j)
+			if (i%11 != 3 && j != 7 && gen()%5 == 0)
+				x[(size_t)i*d+j] = u(gen);
+	for (unsigned j = 0; j < d; ++j)
+		v[j] = u(gen);
+	for (unsigned i = 0; i < n; ++i)
+		w[i] = u(gen);
+
+	Csr_matrix csr(&x[0],n,d);
+	Csc_matrix csc(&x[0],n,d);
+	CHECK(same_elements(csr,x) && same_elements(csc,x));
+	CHECK(csr.outer() == n && csr.inner() == d && csc.outer() == d && csc.inner() == n);
+
+	// conversions both ways reproduce the storage exactly
+	CHECK(Csc_matrix(csr) == csc && Csr_matrix(csc) == csr && Csr_matrix(csr) == csr);
+	CHECK(same_products(csr,x,v,w) && same_products(csc,x,v,w));
+
+	// slices: dense copies, dot and axpy
+	vector<double> row(d), acc(d,0.0), col(n);
+	for (unsigned i = 0; i < n; ++i){
+		csr.densify(i,&row[0]);
+		double r = 0.0;
+		for (unsigned j = 0; j < d; ++j){
+			CHECK(row[j] == x[(size_t)i*d+j]);
+			r += x[(size_t)i*d+j]*v[j];
+		}
+		CHECK(close(csr.dot(i,&v[0]),r));
+		csr.axpy(i,2.0,&acc[0]);
+	}
+	for (unsigned j = 0; j < d; ++j){
+		double s = 0.0;
+		for (unsigned i = 0; i < n; ++i)
+			s += 2.0*x[(size_t)i*d+j];
+		CHECK(close(acc[j],s));
+		csc.densify(j,&col[0]);
+		for (unsigned i = 0; i < n; ++i)
+			CHECK(col[i] == x[(size_t)i*d+j]);
+	}
+
+	// push_back() of explicit entries builds the same matrix as push_dense(); clear() keeps the width
+	Csr_matrix built(0,d);
+	vector<unsigned> idx;
+	vector<double> val;
+	for (unsigned i = 0; i < n; ++i){
+		idx.clear();
+		val.clear();
+		for (unsigned j = 0; j < d; ++j)
+			if (x[(size_t)i*d+j] != 0.0){
+				idx.push_back(j);
+				val.push_back(x[(size_t)i*d+j]);
+			}
+		built.push_back(idx.empty() ? 0 : &idx[0],val.empty() ? 0 : &val[0],idx.size());
+	}
+	CHECK(built == csr);
+	CHECK(built.bytes() < x.size()*sizeof(double));
+	built.clear();
+	CHECK(built.rows() == 0 && built.cols() == d && built.nnz() == 0);
+
+	// a model fit on the sparse rows predicts and scores as the one fit on the dense rows
+	vector<double> y(n);
+	for (unsigned i = 0; i < n; ++i)
+		y[i] = 1.0 + csr.dot(i,&v[0]) + 0.01*u(gen);
+	Linear_regression dense(0.1), sparse(0.1);
+	dense.fit(&x[0],n,d,&y[0]);
+	sparse.fit(csr,&y[0]);
+	vector<double> a(n), b(n);
+	dense.predict(&x[0],n,d,&a[0]);
+	sparse.predict(csr,&b[0]);
+	for (unsigned i = 0; i < n; ++i)
+		CHECK(fabs(a[i]-b[i]) <= 1e-9*(1.0 + fabs(a[i])));
+	CHECK(fabs(sparse.score(csr,&y[0]) - dense.score(&x[0],n,d,&y[0])) <= 1e-9*(1.0 + dense.score(&x[0],n,d,&y[0])));
+
+	cout << "test_sparse ok" << endl;
+	return 0;
+}
@@ -0,0 +1,120 @@
+/** @file test_spn.cpp
+ * @brief Checks Sum_product_network range estimates against exact counts over the rows
+ *
+ * Built by 'make check' with the other test programs; exits nonzero on the first failure.
+ */
+
+#include "Spn.hpp"
+#include "Loss.hpp"
+#include "test_util.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum { n = 20000, d = 4, queries = 2000 };
+
+/** Rows with lo[j] <= x[j] <= hi[j] for every column, among the first @a rows */
+double true_count(const vector<double>& x, unsigned rows, const double* lo, const double* hi){
+	double c = 0.0;
+	for (unsigned i = 0; i < rows; ++i){
+		bool in = true;
+		for (unsigned j = 0; j < d && in; ++j)
+			in = lo[j] <= x[(size_t)i*d+j] && x[(size_t)i*d+j] <= hi[j];
+		c += in;
+	}
+	return c;
+}
+
+/** Product of the single-column fractions, the estimate that assumes independence */
+double independent_count(const vector<double>& x, const double* lo, const double* hi){
+	double p = 1.0;
+	for (unsigned j = 0; j < d; ++j){
+		vector<double> l(d,-HUGE_VAL), h(d,HUGE_VAL);
+		l[j] = lo[j];
+		h[j] = hi[j];
+		p *= true_count(x,n,&l[0],&h[0])/n;
+	}
+	return p*n;
+}
+
+/** Median of @a v */
+double median(vector<double> v){
+	nth_element(v.begin(),v.begin()+v.size()/2,v.end());
+	return v[v.size()/2];
+}
+
+int main(){
+	// two correlated discrete columns, a discrete column and a continuous one that depends on it
+	mt19937 gen(53);
+	uniform_real_distribution<double> u(0.0,1.0);
+	vector<double> x((size_t)n*d);
+	for (unsigned i = 0; i < n; ++i){
+		double* r = &x[(size_t)i*d];
+		r[0] = gen()%10;
+		r[1] = r[0] + gen()%3;
+		r[2] = gen()%5;
+		r[3] = 20.0*r[2] + 20.0*u(gen);
+	}
+	Sum_product_network spn;
+	spn.fit(&x[0],n,d);
+	CHECK(spn.dims() == d && spn.rows() == n && spn.num_nodes() > d);
+
+	vector<double> lo(d,-HUGE_VAL), hi(d,HUGE_VAL);
+	CHECK(fabs(spn.probability(&lo[0],&hi[0]) - 1.0) < 1e-12);
+
+	// a range on one discrete column is counted exactly, whatever the structure above its leaves
+	for (unsigned j = 0; j < 3; ++j)
+		for (double a = -1.0; a <= 12.0; a += 1.0)
+			for (double b = a; b <= 12.0; b += 2.5){
+				lo[j] = a;
+				hi[j] = b;
+				CHECK(fabs(spn.cardinality(&lo[0],&hi[0]) - true_count(x,n,&lo[0],&hi[0])) < 1e-6);
+				lo[j] = -HUGE_VAL;
+				hi[j] = HUGE_VAL;
+			}
+
+	// random conjunctions: close to the true count, and far closer than independence
+	// when the correlated columns are both constrained
+	vector<double> q_spn, q_ind;
+	for (unsigned t = 0; t < queries; ++t){
+		for (unsigned j = 0; j < d; ++j){
+			double span = j == 3 ? 100.0 : 12.0;
+			double a = span*u(gen), b = span*u(gen);
+			bool used = j < 2 || gen()%2;
+			lo[j] = used ? min(a,b) : -HUGE_VAL;
+			hi[j] = used ? max(a,b) : HUGE_VAL;
+		}
+		double c = true_count(x,n,&lo[0],&hi[0]);
+		if (c < 100.0)
+			continue;
+		q_spn.push_back(qerror(c,spn.cardinality(&lo[0],&hi[0])));
+		q_ind.push_back(qerror(c,independent_count(x,&lo[0],&hi[0])));
+	}
+	CHECK(q_spn.size() > 200);
+	CHECK(median(q_spn) < 1.1);
+	sort(q_spn.begin(),q_spn.end());
+	CHECK(q_spn[q_spn.size()*95/100] < 1.5 && q_spn.back() < 3.0);
+	CHECK(median(q_spn) < median(q_ind));
+
+	// rows inserted after the fit are counted as if they had been learned from
+	Sum_product_network half;
+	half.fit(&x[0],n/2,d);
+	for (unsigned i = n/2; i < n; ++i)
+		half.insert(&x[(size_t)i*d]);
+	CHECK(half.rows() == n);
+	lo.assign(d,-HUGE_VAL);
+	hi.assign(d,HUGE_VAL);
+	for (unsigned j = 0; j < 3; ++j)
+		for (double a = 0.0; a <= 11.0; a += 1.0){
+			lo[j] = hi[j] = a;
+			CHECK(fabs(half.cardinality(&lo[0],&hi[0]) - true_count(x,n,&lo[0],&hi[0])) < 1e-6);
+			lo[j] = -HUGE_VAL;
+			hi[j] = HUGE_VAL;
+		}
+
+	cout << "test_spn ok" << endl;
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef CS207_TEST_UTIL_HPP
+#define CS207_TEST_UTIL_HPP
+
+/** @file test_util.hpp
+ * @brief Shared pieces of the test programs run by 'make check'
+ */
+
+#include "Join_enumerator.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+using namespace std;
+
+/** Returns 1 from the enclosing function (main) with the failed condition, if @a c is false */
+#define CHECK(c) do{ if (!(c)){ cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #c << endl; return 1; } }while(0)
+
+/** A random connected join graph: a random spanning tree over @a n relations plus
+ * @a extra predicates between random pairs
+ * @param[in] tables	relation i reads table i % @a tables
+ * @param[in] order	relation order[k] becomes node k; empty for the identity
+ *
+ * Every random draw is made per relation, not per node, so the same @a seed gives
+ * the same query under any @a order. Tree predicates keep 1/1 to 1/1000 of the
+ * cross product, extra ones 1/100.
+ */
+inline join_graph random_join_graph(unsigned n, unsigned seed, unsigned extra, unsigned tables = ~0u, const vector<unsigned>& order = vector<unsigned>()){
+	mt19937 gen(seed);
+	vector<unsigned> at(n);
+	for (unsigned i = 0; i < n; ++i)
+		at[order.empty() ? i : order[i]] = i;
+
+	vector<join_relation> rel(n);
+	for (unsigned i = 0; i < n; ++i){
+		rel[i].table_ = i % tables;
+		rel[i].rows_ = 10 + gen()%100000;
+	}
+	join_graph g;
+	for (unsigned k = 0; k < n; ++k)
+		g.add_node(Point(),rel[order.empty() ? k : order[k]]);
+
+	for (unsigned i = 1; i < n; ++i){
+		join_predicate p = {1.0/(1 + gen()%1000)};
+		g.add_edge(g.node(at[gen()%i]),g.node(at[i]),p);
+	}
+	for (unsigned k = 0; k < extra; ++k){
+		unsigned a = gen()%n, b = gen()%n;
+		join_predicate p = {0.01};
+		if (a != b)
+			g.add_edge(g.node(at[a]),g.node(at[b]),p);
+	}
+	return g;
+}
+
+#endif